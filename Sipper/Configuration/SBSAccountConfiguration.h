@@ -21,6 +21,13 @@ typedef NS_ENUM(NSInteger, SBSSecureMediaPolicy) {
     SBSSecureMediaPolicyRequired
 };
 
+typedef NS_ENUM(NSInteger, SBSDtmfMode) {
+    SBSDtmfModeAuto,
+    SBSDtmfModeRfc2833,
+    SBSDtmfModeSipInfo,
+    SBSDtmfModeInBand
+};
+
 @interface SBSAccountConfiguration : NSObject
 
 /**
@@ -97,7 +104,10 @@ typedef NS_ENUM(NSInteger, SBSSecureMediaPolicy) {
 @property(nonatomic) NSUInteger sipRegistrationLifetime;
 
 /**
- *  Sets the duration to wait when registration fails. Set to 0 to disable.
+ *  Sets the longest duration to wait when registration fails. Set to 0 to back off up to 60 seconds.
+ *
+ *  Retries start at the endpoint's registrationRetryBaseDelay and back off up to this value. Failed registrations
+ *  are always retried while registrations are enabled.
  *
  *  Default: 5 minutes
  */
@@ -108,6 +118,50 @@ typedef NS_ENUM(NSInteger, SBSSecureMediaPolicy) {
  */
 @property(nonatomic) BOOL sipPublishEnabled;
 
+/**
+ *  If YES, calls on this account use Trickle ICE (RFC 8838/8840)
+ *
+ *  The INVITE (or answer) is sent with the host candidates that are available right away, instead of waiting for
+ *  STUN and TURN, and the remaining candidates follow in a SIP INFO once they're gathered. Candidates the remote
+ *  trickles are added to the call's ICE checks as they arrive. Trickling only happens with remotes that advertise
+ *  support for it, but the initial offer still carries fewer candidates for the ones that don't.
+ *
+ *  Has no effect unless ICE is enabled.
+ *
+ *  Default: NO
+ */
+@property(nonatomic) BOOL trickleIce;
+
+/**
+ *  How calls on this account send DTMF digits
+ *
+ *  RFC 2833 sends telephone-events in the call's RTP, SIP INFO sends an application/dtmf-relay request for each
+ *  digit, and in-band mixes the tones into the call's audio. Auto sends RFC 2833, and falls back to in-band when the
+ *  remote didn't negotiate telephone-events.
+ *
+ *  Default: auto
+ */
+@property(nonatomic) SBSDtmfMode dtmfMode;
+
+/**
+ *  How long each DTMF digit lasts, in MS
+ *
+ *  RFC 2833 digits last at least PJMEDIA_DTMF_DURATION, which PJSIP fixes when it's built.
+ *
+ *  Default: 200
+ */
+@property(nonatomic) NSUInteger dtmfDuration;
+
+/**
+ *  The silence between DTMF digits, in MS
+ *
+ *  Digits are queued and sent one at a time, so long strings like IVR PINs aren't sent faster than the remote can
+ *  tell them apart.
+ *
+ *  Default: 100
+ */
+@property(nonatomic) NSUInteger dtmfGap;
+
 @end
 
 #endif
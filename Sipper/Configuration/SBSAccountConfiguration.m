@@ -19,6 +19,9 @@
     _secureMediaPolicy = SBSSecureMediaPolicyOptional;
     _sipRegistrationRetryTimeout = 500;
     _sipRegistrationLifetime = 800;
+    _dtmfMode = SBSDtmfModeAuto;
+    _dtmfDuration = 200;
+    _dtmfGap = 100;
   }
 
   return self;
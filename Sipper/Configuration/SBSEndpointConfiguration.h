@@ -14,6 +14,42 @@
 
 typedef void (^LoggingHandler)(SBSLogLevel, NSString *_Nonnull);
 
+/**
+ *  Strategies for moving SIP flows over to a new network after a reachability change
+ */
+typedef NS_ENUM(NSInteger, SBSTransportFailoverMode) {
+  /**
+   *  Shut down all connection-oriented transports, then re-invite calls one by one
+   */
+  SBSTransportFailoverModeBreakBeforeMake,
+  /**
+   *  Open replacement connections first, re-bind registrations and calls to them in a single pass, and
+   *  only release the old connections once audio has been restored (or the grace period expires)
+   */
+  SBSTransportFailoverModeMakeBeforeBreak
+};
+
+typedef NS_ENUM(NSInteger, SBSSrtpSuiteOrder) {
+  /**
+   *  Offer SRTP suites in PJSIP's order, without calibrating them
+   */
+  SBSSrtpSuiteOrderDefault,
+  /**
+   *  Offer suites with 80-bit authentication tags before those with 32-bit tags, and the cheapest suite first
+   *  otherwise
+   */
+  SBSSrtpSuiteOrderBalanced,
+  /**
+   *  Offer suites with 256-bit keys first, then suites with 80-bit authentication tags, and the cheapest suite first
+   *  otherwise
+   */
+  SBSSrtpSuiteOrderStrongest,
+  /**
+   *  Offer the cheapest suite first
+   */
+  SBSSrtpSuiteOrderFastest
+};
+
 @interface SBSEndpointConfiguration : NSObject
 
 /**
@@ -115,8 +151,74 @@ typedef void (^LoggingHandler)(SBSLogLevel, NSString *_Nonnull);
  */
 @property(nonatomic) NSUInteger jbMax;
 
+/**
+ *  Determines if the jitter buffer of each call should be retuned based on observed network conditions
+ *
+ *  When enabled, Sipper periodically samples the jitter buffer of every active call, and adjusts the minimum
+ *  and maximum prefetch to keep the discard rate near jbTargetDiscardRate. The values configured above are
+ *  only used as a starting point, and jbMax remains the hard upper bound.
+ *
+ *  Default value: false
+ */
+@property(nonatomic) BOOL adaptiveJitterBuffer;
+
+/**
+ *  The fraction of audio frames the adaptive jitter buffer is willing to discard, from 0 to 1
+ *
+ *  Lower values trade latency for fewer audio gaps.
+ *
+ *  Default value: 0.01
+ */
+@property(nonatomic) double jbTargetDiscardRate;
+
+/**
+ *  The interval between adaptive jitter buffer adjustments, in seconds
+ *
+ *  Default value: 2.0
+ */
+@property(nonatomic) NSTimeInterval jbAdaptationInterval;
+
+/**
+ *  Determines if the Opus encoder of each call should be retuned from the loss and round-trip time the remote reports
+ *
+ *  When enabled, calls start out with in-band FEC at opusMaxBitrate. Once RTCP reports come in, clean networks get
+ *  opusMinBitrate with DTX and a lower encoder complexity, lossy ones get FEC with a bitrate that rises with the
+ *  loss, and congested ones (loss along with a high round-trip time) get FEC at opusMinBitrate. Calls using other
+ *  codecs are left alone.
+ *
+ *  Default value: false
+ */
+@property(nonatomic) BOOL adaptiveOpus;
+
+/**
+ *  The Opus bitrate on clean or congested networks, in bits per second
+ *
+ *  Default value: 16000
+ */
+@property(nonatomic) NSUInteger opusMinBitrate;
+
+/**
+ *  The Opus bitrate at high loss, where in-band FEC takes a large share of it, in bits per second
+ *
+ *  Default value: 32000
+ */
+@property(nonatomic) NSUInteger opusMaxBitrate;
+
+/**
+ *  The interval between Opus encoder adjustments, in seconds
+ *
+ *  Loss is only known from RTCP receiver reports, so intervals shorter than the RTCP interval (5 seconds by default)
+ *  only add latency to the first adjustment after each report.
+ *
+ *  Default value: 5.0
+ */
+@property(nonatomic) NSTimeInterval opusAdaptationInterval;
+
 /**
  *  An array which will hold all the configured transports.
+ *
+ *  The first transport is created before the endpoint is initialized, and the rest shortly after, on the
+ *  background thread. The first should be the one accounts register over.
  */
 @property(strong, nonatomic, nonnull) NSArray *transportConfigurations;
 
@@ -139,6 +241,235 @@ typedef void (^LoggingHandler)(SBSLogLevel, NSString *_Nonnull);
  */
 @property(nonatomic) BOOL preserveConnectionsForCalls;
 
+/**
+ *  Determines how transports and calls are moved to a new network when the application reports a reachability change
+ *
+ *  Default value: SBSTransportFailoverModeBreakBeforeMake
+ */
+@property(nonatomic) SBSTransportFailoverMode transportFailoverMode;
+
+/**
+ *  How long the previous connections are kept alive during a make-before-break failover, in seconds
+ *
+ *  Old connections are released as soon as every call has restored its audio. This is the upper bound in case
+ *  that never happens (for example, if the remote never answers a re-INVITE).
+ *
+ *  Default value: 10.0
+ */
+@property(nonatomic) NSTimeInterval transportFailoverGracePeriod;
+
+/**
+ *  Determines if TLS sessions should be cached and resumed when reconnecting to the same server
+ *
+ *  When enabled, the session negotiated by each SIP-over-TLS connection is cached, keyed by the server name and
+ *  address, and offered again when a new connection is made to it (for example, after a reachability change or a
+ *  dropped registration). This replaces the full handshake with an abbreviated one when the server supports it.
+ *
+ *  Default value: true
+ */
+@property(nonatomic) BOOL tlsSessionResumption;
+
+/**
+ *  The maximum number of REGISTER requests that may be awaiting a response at once, across all accounts
+ *
+ *  Registrations beyond this limit wait for an earlier one to complete.
+ *
+ *  Default value: 8
+ */
+@property(nonatomic) NSUInteger maxConcurrentRegistrations;
+
+/**
+ *  The shortest delay before retrying a failed or lost registration, in seconds
+ *
+ *  Consecutive retries back off with decorrelated jitter, up to the account's sipRegistrationRetryTimeout.
+ *
+ *  Default value: 2.0
+ */
+@property(nonatomic) NSTimeInterval registrationRetryBaseDelay;
+
+/**
+ *  The maximum random delay added to each account's registration refresh, in seconds
+ *
+ *  Spreads refreshes out so accounts that registered together don't keep refreshing together.
+ *
+ *  Default value: 30.0
+ */
+@property(nonatomic) NSTimeInterval registrationRefreshJitter;
+
+/**
+ *  The DNS servers to resolve SIP targets with, as IP addresses with an optional port (e.g. "8.8.8.8:53")
+ *
+ *  When set, registrars, proxies and call targets are resolved asynchronously (SRV, then A/AAAA) through the
+ *  endpoint's DNS cache, instead of with a blocking getaddrinfo call on the worker thread. At most four are used.
+ *
+ *  Default value: nil
+ */
+@property(nonatomic, strong, nullable) NSArray<NSString *> *nameservers;
+
+/**
+ *  How long before a cached DNS record expires it is refreshed, in seconds
+ *
+ *  Only records that were looked up since they were last resolved are refreshed, so names that aren't in use are
+ *  left to expire.
+ *
+ *  Default value: 10.0
+ */
+@property(nonatomic) NSTimeInterval dnsPrefetchWindow;
+
+/**
+ *  How long after a DNS record expires it may still be used while it's revalidated, in seconds
+ *
+ *  Lookups for a record in this window are answered immediately with the old addresses, and a refresh is started in
+ *  the background. Set to 0 to always wait for a fresh answer.
+ *
+ *  Default value: 60.0
+ */
+@property(nonatomic) NSTimeInterval dnsMaxStaleAge;
+
+/**
+ *  The maximum number of host ICE candidates gathered per address family
+ *
+ *  Every local candidate is paired with every remote candidate, so each extra one adds connectivity checks, SDP size
+ *  and time to media. Addresses are ranked before they're trimmed: the interface of the default route comes first,
+ *  then Wi-Fi/Ethernet, cellular and VPN interfaces, with interfaces that ICE succeeded on before moving up. Each
+ *  interface contributes one address before any contributes a second one.
+ *
+ *  Default value: 2
+ */
+@property(nonatomic) NSUInteger iceHostCandidatesPerFamily;
+
+/**
+ *  The interval between keep-alives on every SIP flow, in seconds
+ *
+ *  When set, the per-connection TCP/TLS keep-alive timers and the per-account UDP keep-alive timers are replaced by a
+ *  single timer that fires on multiples of this interval and refreshes every flow at once. This lets the device wake
+ *  up once per interval instead of once per flow. Set to 0 to keep the individual timers.
+ *
+ *  Every flow is sent a CRLF ping, UDP ones included, rather than a STUN Binding request.
+ *
+ *  Default value: 0
+ */
+@property(nonatomic) NSTimeInterval keepAliveInterval;
+
+/**
+ *  Whether outgoing SIP messages are compacted to fit sipMessageSizeBudget
+ *
+ *  Header names are sent in their compact form, SDP bodies lose formats of codecs that have been disabled,
+ *  rtpmap attributes of static payload types and default a=rtcp attributes, and SRTP only offers the
+ *  AES_CM_128_HMAC_SHA1_80 and AES_CM_128_HMAC_SHA1_32 suites. Messages that are still over budget have redundant
+ *  ICE candidates trimmed, lowest priority first. Messages over the budget are sent over TCP by PJSIP, if it's
+ *  available, and UDP messages over the path MTU are fragmented.
+ *
+ *  Default value: false
+ */
+@property(nonatomic) BOOL sipMessageCompaction;
+
+/**
+ *  The size that compacted SIP messages are trimmed to, in bytes
+ *
+ *  This has no effect unless sipMessageCompaction is set. The default leaves room for IP, UDP and tunnel headers in
+ *  a 1500 byte MTU, and matches the size at which PJSIP switches a request from UDP to TCP.
+ *
+ *  Default value: 1300
+ */
+@property(nonatomic) NSUInteger sipMessageSizeBudget;
+
+/**
+ *  The number of recent SIP messages kept for writeSipCaptureToPath:completion:
+ *
+ *  When set, every message the endpoint sends or receives is copied, unformatted, into a ring that keeps the most
+ *  recent ones. Copying a message takes well under a microsecond and never waits on a lock, so this can stay on in
+ *  production. Each message takes about 4 KB. Set to 0 to disable capture.
+ *
+ *  Default value: 0
+ */
+@property(nonatomic) NSUInteger sipCapturePackets;
+
+/**
+ *  The number of recent call setup spans kept for writeCallTraceForCall:toPath:completion:
+ *
+ *  When set, the endpoint times each step of setting up a call (the hop to the background thread, making the call,
+ *  ICE gathering, the INVITE and its responses, the ACK, media becoming active, NAT64 rewriting and every PJSUA
+ *  callback for it) and keeps the most recent spans. A call takes a few dozen. Set to 0 to disable tracing.
+ *
+ *  Default value: 0
+ */
+@property(nonatomic) NSUInteger callTraceEvents;
+
+/**
+ *  The order SRTP crypto suites are offered in
+ *
+ *  Unless this is SBSSrtpSuiteOrderDefault, the endpoint measures what each suite costs to protect and unprotect a
+ *  20 ms audio packet when it starts, which takes a few milliseconds, and orders offers by that cost within the
+ *  limits of the security policy. Suites that the device accelerates in hardware come out cheaper, so they're
+ *  preferred without having to detect the hardware. The measurements are available from the endpoint's
+ *  srtpSuiteBenchmarks.
+ *
+ *  Default value: SBSSrtpSuiteOrderDefault
+ */
+@property(nonatomic) SBSSrtpSuiteOrder srtpSuiteOrder;
+
+/**
+ *  The path of the file that finished calls are recorded to, whose directory must exist
+ *
+ *  When set, the endpoint appends a record of every call to this file when it ends, with its timestamps, direction,
+ *  final status, codec, transport and a quality summary. Records are available from the endpoint's callRecordStore.
+ *
+ *  Default value: nil
+ */
+@property(nonatomic, strong, nullable) NSString *callRecordPath;
+
+/**
+ *  The number of calls recorded to each call record file before it's rotated
+ *
+ *  Each call takes 256 bytes, and the whole file is mapped into memory.
+ *
+ *  Default value: 4096
+ */
+@property(nonatomic) NSUInteger callRecordCapacity;
+
+/**
+ *  The number of call record files kept, including the one being written to
+ *
+ *  Default value: 4
+ */
+@property(nonatomic) NSUInteger callRecordFiles;
+
+/**
+ *  The number of call events of each kind the endpoint keeps for reuse
+ *
+ *  When set, state change, hold, mute, transaction and received message events are taken back once every listener
+ *  has been invoked with them, and handed out again for the next notification instead of being allocated. Listeners
+ *  must not keep an event, or read it after they return: copy out whatever is needed instead. Set to 0 to allocate
+ *  every event.
+ *
+ *  Default value: 0
+ */
+@property(nonatomic) NSUInteger callEventPoolCapacity;
+
+/**
+ *  The serial queue that call events and account and endpoint delegate calls are delivered on
+ *
+ *  Everything delivered while the endpoint handles one PJSIP callback is enqueued as a single block, in order, so
+ *  call setup doesn't flood the queue with a block per event. Call futures complete on it too, but other completion
+ *  blocks are still invoked on the main queue. Leaving this value as nil delivers on the main queue.
+ *
+ *  Default value: nil
+ */
+@property(strong, nonatomic, nullable) dispatch_queue_t eventQueue;
+
+/**
+ *  Whether redundant state change events are dropped
+ *
+ *  When set, a call's state change, hold state change or mute state change event replaces the one of the same kind
+ *  that's still waiting to be delivered, instead of following it. The call's state is read when the event is
+ *  handled, so listeners see the same state, just once. Endpoint state changes are coalesced the same way, and the
+ *  delegate is told the latest state.
+ *
+ *  Default value: NO
+ */
+@property(nonatomic) BOOL coalesceStateChangeEvents;
+
 /**
  *  The value to place in the SIP User-Agent header field
  *
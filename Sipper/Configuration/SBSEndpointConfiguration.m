@@ -18,6 +18,21 @@ static NSUInteger const EndpointConfigurationLogConsoleLevel = 4;
 static NSString *const EndpointConfigurationLogFileName = nil;
 static NSUInteger const EndpointConfigurationClockRate = PJSUA_DEFAULT_CLOCK_RATE;
 static NSUInteger const EndpointConfigurationSndClockRate = 0;
+static double const EndpointConfigurationJbTargetDiscardRate = 0.01;
+static NSTimeInterval const EndpointConfigurationJbAdaptationInterval = 2.0;
+static NSUInteger const EndpointConfigurationOpusMinBitrate = 16000;
+static NSUInteger const EndpointConfigurationOpusMaxBitrate = 32000;
+static NSTimeInterval const EndpointConfigurationOpusAdaptationInterval = 5.0;
+static NSTimeInterval const EndpointConfigurationTransportFailoverGracePeriod = 10.0;
+static NSUInteger const EndpointConfigurationMaxConcurrentRegistrations = 8;
+static NSTimeInterval const EndpointConfigurationRegistrationRetryBaseDelay = 2.0;
+static NSTimeInterval const EndpointConfigurationRegistrationRefreshJitter = 30.0;
+static NSTimeInterval const EndpointConfigurationDnsPrefetchWindow = 10.0;
+static NSTimeInterval const EndpointConfigurationDnsMaxStaleAge = 60.0;
+static NSUInteger const EndpointConfigurationIceHostCandidatesPerFamily = 2;
+static NSUInteger const EndpointConfigurationSipMessageSizeBudget = PJSIP_UDP_SIZE_THRESHOLD;
+static NSUInteger const EndpointConfigurationCallRecordCapacity = 4096;
+static NSUInteger const EndpointConfigurationCallRecordFiles = 4;
 
 @implementation SBSEndpointConfiguration
 
@@ -32,10 +47,38 @@ static NSUInteger const EndpointConfigurationSndClockRate = 0;
     _logFilename = EndpointConfigurationLogFileName;
     _logFileFlags = PJ_O_APPEND;
     _preserveConnectionsForCalls = true;
+    _transportFailoverMode = SBSTransportFailoverModeBreakBeforeMake;
+    _transportFailoverGracePeriod = EndpointConfigurationTransportFailoverGracePeriod;
+    _tlsSessionResumption = true;
+    _maxConcurrentRegistrations = EndpointConfigurationMaxConcurrentRegistrations;
+    _registrationRetryBaseDelay = EndpointConfigurationRegistrationRetryBaseDelay;
+    _registrationRefreshJitter = EndpointConfigurationRegistrationRefreshJitter;
+    _dnsPrefetchWindow = EndpointConfigurationDnsPrefetchWindow;
+    _dnsMaxStaleAge = EndpointConfigurationDnsMaxStaleAge;
+    _iceHostCandidatesPerFamily = EndpointConfigurationIceHostCandidatesPerFamily;
+    _keepAliveInterval = 0;
+    _sipMessageCompaction = false;
+    _sipMessageSizeBudget = EndpointConfigurationSipMessageSizeBudget;
+    _sipCapturePackets = 0;
+    _callTraceEvents = 0;
+    _srtpSuiteOrder = SBSSrtpSuiteOrderDefault;
+    _callRecordCapacity = EndpointConfigurationCallRecordCapacity;
+    _callRecordFiles = EndpointConfigurationCallRecordFiles;
+    _callEventPoolCapacity = 0;
+    _coalesceStateChangeEvents = NO;
 
     _backgroundThreadPriority = 0.532258;
     _clockRate = EndpointConfigurationClockRate;
     _sndClockRate = EndpointConfigurationSndClockRate;
+
+    _adaptiveJitterBuffer = false;
+    _jbTargetDiscardRate = EndpointConfigurationJbTargetDiscardRate;
+    _jbAdaptationInterval = EndpointConfigurationJbAdaptationInterval;
+
+    _adaptiveOpus = false;
+    _opusMinBitrate = EndpointConfigurationOpusMinBitrate;
+    _opusMaxBitrate = EndpointConfigurationOpusMaxBitrate;
+    _opusAdaptationInterval = EndpointConfigurationOpusAdaptationInterval;
   }
   return self;
 }
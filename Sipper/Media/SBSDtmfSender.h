@@ -0,0 +1,77 @@
+//
+//  SBSDtmfSender.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import <pjsua.h>
+
+#import "SBSAccountConfiguration.h"
+
+/**
+ * Sends a single call's DTMF digits, one at a time
+ *
+ * Digits are queued in the order they're sent, and each is followed by the configured gap before the next one
+ * starts, so a long string isn't sent faster than the remote can tell its digits apart. Each digit goes out over RFC
+ * 2833, SIP INFO, or in-band through a port on the conference bridge, depending on the mode.
+ *
+ * Everything here must be invoked on the endpoint's background thread, whose run loop paces the digits.
+ */
+@interface SBSDtmfSender : NSObject
+
+/**
+ * The call this sender is attached to, or -1 if it is detached
+ */
+@property(nonatomic) pjsua_call_id callId;
+
+/**
+ * How digits are sent
+ */
+@property(nonatomic, readonly) SBSDtmfMode mode;
+
+/**
+ * How long each digit lasts, and the silence after it, in MS
+ */
+@property(nonatomic, readonly) NSUInteger duration;
+@property(nonatomic, readonly) NSUInteger gap;
+
+/**
+ * The number of digits queued that haven't been sent yet
+ */
+@property(nonatomic, readonly) NSUInteger pendingDigits;
+
+/**
+ * Creates a new sender
+ *
+ * @param mode     how digits are sent
+ * @param duration how long each digit lasts, in MS
+ * @param gap      the silence between digits, in MS
+ */
+- (instancetype _Nonnull)initWithMode:(SBSDtmfMode)mode duration:(NSUInteger)duration gap:(NSUInteger)gap;
+
+/**
+ * Whether every character of a string is a DTMF digit
+ */
++ (BOOL)isValidDigits:(NSString *_Nonnull)digits;
+
+/**
+ * Queues digits to be sent after any that are already queued
+ *
+ * @param digits     the digits, which must all be valid
+ * @param progress   invoked with the index of each digit once it and its gap have been sent
+ * @param completion invoked with PJ_SUCCESS once every digit has been sent, or with the status that stopped them
+ */
+- (void)sendDigits:(NSString *_Nonnull)digits
+          progress:(void (^_Nullable)(NSUInteger index))progress
+        completion:(void (^_Nonnull)(pj_status_t status))completion;
+
+/**
+ * Stops sending, fails whatever is still queued with PJ_ECANCELLED, and removes the in-band port from the bridge
+ */
+- (void)stop;
+
+@end
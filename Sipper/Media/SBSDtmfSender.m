@@ -0,0 +1,299 @@
+//
+//  SBSDtmfSender.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSDtmfSender.h"
+
+#import <pjsua-lib/pjsua_internal.h>
+
+#import "pj_dtmf.h"
+
+/**
+ * How long PJSIP plays an RFC 2833 digit, in MS. The duration is in the units of the telephone-event clock, which
+ * is 8kHz.
+ */
+static NSUInteger const DtmfRfc2833Duration = PJMEDIA_DTMF_DURATION / 8;
+
+/**
+ * Digits queued by a single send, and how far through them the sender is
+ */
+@interface SBSDtmfBatch : NSObject
+
+@property(nonatomic, strong) NSString *digits;
+@property(nonatomic) NSUInteger index;
+@property(nonatomic, copy) void (^progress)(NSUInteger);
+@property(nonatomic, copy) void (^completion)(pj_status_t);
+
+@end
+
+@implementation SBSDtmfBatch
+
+@end
+
+@interface SBSDtmfSender ()
+
+@property(nonatomic, strong) NSMutableArray<SBSDtmfBatch *> *batches;
+@property(nonatomic, strong) NSTimer *timer;
+
+@end
+
+@implementation SBSDtmfSender {
+  pj_pool_t *_pool;
+  pjmedia_port *_port;
+  pjsua_conf_port_id _slot;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithMode:(SBSDtmfMode)mode duration:(NSUInteger)duration gap:(NSUInteger)gap {
+  if (self = [super init]) {
+    _callId = -1;
+    _mode = mode;
+    _duration = MAX(duration, 1);
+    _gap = gap;
+    _batches = [[NSMutableArray alloc] init];
+    _slot = PJSUA_INVALID_ID;
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)dealloc {
+  [_timer invalidate];
+  [self removePort];
+}
+
+//------------------------------------------------------------------------------
+
++ (BOOL)isValidDigits:(NSString *)digits {
+  for (NSUInteger i = 0; i < digits.length; i++) {
+    unichar digit = [digits characterAtIndex:i];
+    if (digit > 0x7f || !pj_dtmf_is_digit((char) digit)) {
+      return NO;
+    }
+  }
+
+  return YES;
+}
+
+//------------------------------------------------------------------------------
+
+- (NSUInteger)pendingDigits {
+  NSUInteger pending = 0;
+  for (SBSDtmfBatch *batch in _batches) {
+    pending += batch.digits.length - batch.index;
+  }
+
+  return pending;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)sendDigits:(NSString *)digits progress:(void (^)(NSUInteger))progress completion:(void (^)(pj_status_t))completion {
+  if (digits.length == 0) {
+    completion(PJ_SUCCESS);
+    return;
+  }
+
+  SBSDtmfBatch *batch = [[SBSDtmfBatch alloc] init];
+  batch.digits = digits;
+  batch.progress = progress;
+  batch.completion = completion;
+  [_batches addObject:batch];
+
+  // A digit that's already on its way sends the next one when its gap is over
+  if (_timer == nil) {
+    [self sendNextDigit];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)stop {
+  [_timer invalidate];
+  _timer = nil;
+
+  NSArray<SBSDtmfBatch *> *batches = [_batches copy];
+  [_batches removeAllObjects];
+  for (SBSDtmfBatch *batch in batches) {
+    batch.completion(PJ_ECANCELLED);
+  }
+
+  [self removePort];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)sendNextDigit {
+  while (_batches.count > 0) {
+    SBSDtmfBatch *batch = _batches.firstObject;
+    char digit = (char) [batch.digits characterAtIndex:batch.index];
+
+    NSUInteger duration = _duration;
+    pj_status_t status = _callId < 0 ? PJ_EINVALIDOP : [self sendDigit:digit duration:&duration];
+
+    if (status == PJ_SUCCESS) {
+      _timer = [NSTimer scheduledTimerWithTimeInterval:(duration + _gap) / 1000.0
+                                                target:self
+                                              selector:@selector(digitSent:)
+                                              userInfo:nil
+                                               repeats:NO];
+      return;
+    }
+
+    // The rest of this batch can't be sent either, but the next one might be
+    [_batches removeObjectAtIndex:0];
+    batch.completion(status);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)digitSent:(NSTimer *)timer {
+  _timer = nil;
+
+  SBSDtmfBatch *batch = _batches.firstObject;
+  if (batch == nil) {
+    return;
+  }
+
+  if (batch.progress != nil) {
+    batch.progress(batch.index);
+  }
+
+  if (++batch.index == batch.digits.length) {
+    [_batches removeObjectAtIndex:0];
+    batch.completion(PJ_SUCCESS);
+  }
+
+  [self sendNextDigit];
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)sendDigit:(char)digit duration:(NSUInteger *)duration {
+  switch (_mode) {
+    case SBSDtmfModeRfc2833:
+      return [self sendRfc2833Digit:digit duration:duration];
+
+    case SBSDtmfModeSipInfo:
+      return [self sendInfoDigit:digit];
+
+    case SBSDtmfModeInBand:
+      return [self playDigit:digit];
+
+    case SBSDtmfModeAuto: {
+      pj_status_t status = [self sendRfc2833Digit:digit duration:duration];
+      if (status == PJMEDIA_RTP_EREMNORFC2833) {
+        *duration = _duration;
+        status = [self playDigit:digit];
+      }
+      return status;
+    }
+  }
+
+  return PJ_EINVAL;
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)sendRfc2833Digit:(char)digit duration:(NSUInteger *)duration {
+  *duration = MAX(_duration, DtmfRfc2833Duration);
+
+  pj_str_t digits = pj_str(&digit);
+  digits.slen = 1;
+  return pjsua_call_dial_dtmf(_callId, &digits);
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)sendInfoDigit:(char)digit {
+  char buffer[64];
+  int length = pj_dtmf_relay_print(digit, (unsigned) _duration, buffer, sizeof(buffer));
+  if (length < 0) {
+    return PJ_EINVAL;
+  }
+
+  pjsua_msg_data msg_data;
+  pjsua_msg_data_init(&msg_data);
+  msg_data.content_type = pj_str((char *) PJ_DTMF_RELAY_CONTENT_TYPE "/" PJ_DTMF_RELAY_CONTENT_SUB);
+  msg_data.msg_body = pj_str(buffer);
+  msg_data.msg_body.slen = length;
+
+  pj_str_t method = pj_str((char *) "INFO");
+  return pjsua_call_send_request(_callId, &method, &msg_data);
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)playDigit:(char)digit {
+  pjsua_conf_port_id callSlot = pjsua_call_get_conf_port(_callId);
+  if (callSlot == PJSUA_INVALID_ID) {
+    return PJ_EINVALIDOP;
+  }
+
+  pj_status_t status = [self addPort];
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  // The call's slot changes when its media is renegotiated, and connecting it again is harmless
+  status = pjsua_conf_connect(_slot, callSlot);
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  return pj_dtmf_port_play(_port, digit, (unsigned) _duration);
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)addPort {
+  if (_slot != PJSUA_INVALID_ID) {
+    return PJ_SUCCESS;
+  }
+
+  // The tones are rendered in the bridge's own format, so it doesn't have to resample them
+  pjmedia_port *master = pjmedia_conf_get_master_port(pjsua_var.mconf);
+
+  _pool = pjsua_pool_create("dtmf", 512, 512);
+  pj_status_t status = pj_dtmf_port_create(_pool, PJMEDIA_PIA_SRATE(&master->info), PJMEDIA_PIA_CCNT(&master->info),
+                                           PJMEDIA_PIA_SPF(&master->info), &_port);
+
+  if (status == PJ_SUCCESS) {
+    status = pjsua_conf_add_port(_pool, _port, &_slot);
+  }
+
+  if (status != PJ_SUCCESS) {
+    [self removePort];
+  }
+
+  return status;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)removePort {
+  if (_slot != PJSUA_INVALID_ID) {
+    pjsua_conf_remove_port(_slot);
+    _slot = PJSUA_INVALID_ID;
+  }
+
+  if (_port != NULL) {
+    pjmedia_port_destroy(_port);
+    _port = NULL;
+  }
+
+  if (_pool != NULL) {
+    pj_pool_release(_pool);
+    _pool = NULL;
+  }
+}
+
+@end
@@ -0,0 +1,88 @@
+//
+//  SBSJitterBufferController.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/8/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import <pjsua.h>
+
+/**
+ * Retunes the jitter buffer of a single call's audio stream at runtime
+ *
+ * The controller samples the stream's jitter buffer statistics on a fixed interval, and moves the minimum
+ * prefetch up when the discard rate exceeds the configured target, and back down when the network has
+ * been quiet for a while. The goal is to keep mouth-to-ear latency as low as possible on good networks
+ * (Wi-Fi) without losing audio on bursty ones (LTE).
+ */
+@interface SBSJitterBufferController : NSObject
+
+/**
+ * The call this controller is attached to, or -1 if it is detached
+ */
+@property(nonatomic) pjsua_call_id callId;
+
+/**
+ * The media index of the audio stream being controlled
+ */
+@property(nonatomic) unsigned mediaIndex;
+
+/**
+ * Duration of a single jitter buffer frame, in MS
+ */
+@property(nonatomic) unsigned frameDuration;
+
+/**
+ * Current prefetch values, in frames
+ */
+@property(nonatomic, readonly) unsigned prefetch;
+@property(nonatomic, readonly) unsigned minPrefetch;
+@property(nonatomic, readonly) unsigned maxPrefetch;
+
+/**
+ * The observed discard rate during the last adjustment interval, from 0 to 1
+ */
+@property(nonatomic, readonly) double discardRate;
+
+/**
+ * Creates a new controller
+ *
+ * @param targetDiscardRate the fraction of frames we are willing to discard, for example 0.01
+ * @param frameDuration     the duration of a single frame in the jitter buffer, in MS
+ * @param maxPrefetch       the hard upper bound of the prefetch, in frames
+ */
+- (instancetype _Nonnull)initWithTargetDiscardRate:(double)targetDiscardRate frameDuration:(unsigned)frameDuration maxPrefetch:(unsigned)maxPrefetch;
+
+/**
+ * Starts sampling the stream on the current thread's run loop
+ *
+ * This must be invoked on a thread that is registered with PJSIP, and is expected to be the endpoint's
+ * background thread.
+ *
+ * @param interval the interval between adjustments
+ */
+- (void)startWithInterval:(NSTimeInterval)interval;
+
+/**
+ * Stops sampling the stream
+ *
+ * Must be invoked on the same thread that the controller was started on
+ */
+- (void)stop;
+
+/**
+ * Computes a new set of prefetch values from a jitter buffer sample
+ *
+ * This does not touch the underlying stream, and is exposed separately so the policy can be exercised
+ * without a live call.
+ *
+ * @param state   the current state of the jitter buffer
+ * @param elapsed the time since the previous sample, in seconds
+ * @return YES if the prefetch values changed and should be applied to the stream
+ */
+- (BOOL)adjustForState:(const pjmedia_jb_state *_Nonnull)state elapsed:(NSTimeInterval)elapsed;
+
+@end
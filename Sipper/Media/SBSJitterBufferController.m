@@ -0,0 +1,182 @@
+//
+//  SBSJitterBufferController.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/8/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSJitterBufferController.h"
+
+#import <pjsua-lib/pjsua_internal.h>
+
+/**
+ * Number of consecutive quiet intervals before we attempt to shrink the buffer
+ */
+static unsigned const JitterBufferQuietIntervalsBeforeShrink = 3;
+
+/**
+ * Initial minimum prefetch, in MS, before we've observed anything about the network
+ */
+static unsigned const JitterBufferInitialMinPrefetchMs = 40;
+
+@interface SBSJitterBufferController ()
+
+@property(nonatomic) double targetDiscardRate;
+@property(nonatomic) unsigned hardMaxPrefetch;
+@property(nonatomic, strong) NSTimer *timer;
+@property(nonatomic) NSTimeInterval interval;
+
+@end
+
+@implementation SBSJitterBufferController {
+  unsigned _lastDiscard;
+  unsigned _lastEmpty;
+  unsigned _quietIntervals;
+  BOOL _hasBaseline;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithTargetDiscardRate:(double)targetDiscardRate frameDuration:(unsigned)frameDuration maxPrefetch:(unsigned)maxPrefetch {
+  if (self = [super init]) {
+    _callId = -1;
+    _mediaIndex = 0;
+    _targetDiscardRate = targetDiscardRate;
+    _hardMaxPrefetch = MAX(maxPrefetch, 2);
+    _hasBaseline = NO;
+    _quietIntervals = 0;
+
+    [self setFrameDuration:frameDuration];
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)setFrameDuration:(unsigned)frameDuration {
+  _frameDuration = MAX(frameDuration, 1);
+
+  // Reset the window to a sane starting point for this frame size
+  _minPrefetch = MIN(MAX(JitterBufferInitialMinPrefetchMs / _frameDuration, 1), _hardMaxPrefetch - 1);
+  _maxPrefetch = _hardMaxPrefetch;
+  _prefetch = _minPrefetch;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)startWithInterval:(NSTimeInterval)interval {
+  [self stop];
+
+  _interval = interval;
+  _hasBaseline = NO;
+  _timer = [NSTimer scheduledTimerWithTimeInterval:interval target:self selector:@selector(tick:) userInfo:nil repeats:YES];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)stop {
+  [_timer invalidate];
+  _timer = nil;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)dealloc {
+  [_timer invalidate];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)tick:(NSTimer *)timer {
+  if (_callId < 0) {
+    return;
+  }
+
+  // Sample the current state of the jitter buffer
+  pjsua_stream_stat stat;
+  if (pjsua_call_get_stream_stat(_callId, _mediaIndex, &stat) != PJ_SUCCESS) {
+    return;
+  }
+
+  // Figure out if the sample warrants a change, and bail if it doesn't
+  if (![self adjustForState:&stat.jbuf elapsed:_interval]) {
+    return;
+  }
+
+  // Apply the new values to the running stream. The stream can disappear out from under us during
+  // re-invites, so look it up under the lock every time.
+  PJSUA_LOCK();
+
+  pj_status_t status = PJ_ENOTFOUND;
+  if (_callId < (pjsua_call_id) PJ_ARRAY_SIZE(pjsua_var.calls) && _mediaIndex < pjsua_var.calls[_callId].med_cnt) {
+    pjsua_call_media *media = &pjsua_var.calls[_callId].media[_mediaIndex];
+    if (media->type == PJMEDIA_TYPE_AUDIO && media->strm.a.stream != NULL) {
+      status = pjmedia_stream_jbuf_set_adaptive(media->strm.a.stream, _prefetch, _minPrefetch, _maxPrefetch);
+    }
+  }
+
+  PJSUA_UNLOCK();
+
+  if (status != PJ_SUCCESS) {
+    NSLog(@"Failed to retune jitter buffer for call %d: %d", _callId, status);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)adjustForState:(const pjmedia_jb_state *)state elapsed:(NSTimeInterval)elapsed {
+
+  // The first sample (or a reset stream) only establishes a baseline for the counters
+  if (!_hasBaseline || state->discard < _lastDiscard || state->empty < _lastEmpty) {
+    _lastDiscard = state->discard;
+    _lastEmpty = state->empty;
+    _hasBaseline = YES;
+    return NO;
+  }
+
+  // Both discards (late/overflowing frames) and empty gets (frames that didn't make it in time) are a
+  // direct function of how much we're buffering. Lost packets are not, so they're left out.
+  double expectedFrames = MAX(elapsed * 1000.0 / _frameDuration, 1.0);
+  unsigned lateFrames = (state->discard - _lastDiscard) + (state->empty - _lastEmpty);
+  _lastDiscard = state->discard;
+  _lastEmpty = state->empty;
+  _discardRate = MIN(lateFrames / expectedFrames, 1.0);
+
+  // Estimate how much jitter we're actually seeing, in frames. Bursts are already expressed in frames,
+  // while the delay deviation is in MS.
+  unsigned jitterFrames = (unsigned) ceil(state->avg_burst + 2.0 * state->dev_delay / _frameDuration);
+  unsigned floorPrefetch = MIN(MAX((unsigned) ceil(state->avg_burst), 1), _hardMaxPrefetch - 1);
+
+  // Grow quickly when we're discarding, shrink slowly when the network has been quiet for a while
+  unsigned minPrefetch = _minPrefetch;
+  if (_discardRate > _targetDiscardRate) {
+    minPrefetch += _discardRate > _targetDiscardRate * 4 ? 2 : 1;
+    _quietIntervals = 0;
+  } else if (_discardRate < _targetDiscardRate / 2) {
+    if (++_quietIntervals >= JitterBufferQuietIntervalsBeforeShrink && minPrefetch > floorPrefetch) {
+      minPrefetch--;
+      _quietIntervals = 0;
+    }
+  } else {
+    _quietIntervals = 0;
+  }
+
+  minPrefetch = MIN(MAX(minPrefetch, floorPrefetch), _hardMaxPrefetch - 1);
+
+  // Leave enough headroom above the minimum to absorb the jitter we're currently observing
+  unsigned maxPrefetch = MIN(MAX(minPrefetch + 2 * MAX(jitterFrames, 1), minPrefetch + 1), _hardMaxPrefetch);
+
+  if (minPrefetch == _minPrefetch && maxPrefetch == _maxPrefetch) {
+    return NO;
+  }
+
+  _minPrefetch = minPrefetch;
+  _maxPrefetch = maxPrefetch;
+  _prefetch = minPrefetch;
+
+  return YES;
+}
+
+@end
@@ -0,0 +1,73 @@
+//
+//  SBSMediaTap.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import <pjsua.h>
+
+#import "SBSCall.h"
+
+@class SBSMediaTapStatistics;
+
+/**
+ * Hands a single call's audio to a handler, on a thread of its own
+ *
+ * The tap has a port on the conference bridge for each direction: the uplink one hears the microphone whenever the
+ * call does, and the downlink one hears the call. The bridge's clock thread copies each frame into the port's ring
+ * and moves on, and the tap's thread polls the rings and invokes the handler with the frames in place.
+ *
+ * Attaching must be done on the endpoint's background thread. Stopping can be done on any PJLIB thread, and on the
+ * tap's own.
+ */
+@interface SBSMediaTap : NSObject
+
+/**
+ * Number of frames each direction's ring holds
+ */
+@property(nonatomic, readonly) NSUInteger capacity;
+
+/**
+ * The call slot the tap is listening to, or PJSUA_INVALID_ID if it isn't attached yet
+ */
+@property(nonatomic, readonly) pjsua_conf_port_id callSlot;
+
+/**
+ * Creates a new tap, which isn't on the bridge until it's attached
+ *
+ * @param handler  invoked with each frame on the tap's thread
+ * @param capacity the number of frames each ring holds, which is rounded up to a power of two
+ */
+- (instancetype _Nonnull)initWithHandler:(SBSMediaTapHandler _Nonnull)handler capacity:(NSUInteger)capacity;
+
+/**
+ * Adds the tap's ports to the bridge if they aren't there yet, and connects them to a call's slot and the microphone
+ *
+ * This is safe to do again whenever the call's media or mute state changes. The tap's thread is started the first
+ * time it succeeds.
+ *
+ * @param slot  the call's conference slot
+ * @param muted whether the call is muted, in which case the uplink is silence
+ * @return the PJSIP status of adding or connecting the ports
+ */
+- (pj_status_t)attachToSlot:(pjsua_conf_port_id)slot muted:(BOOL)muted;
+
+/**
+ * Takes the tap's ports off the bridge, and tells the tap's thread to hand the frames that were still in the rings to
+ * the handler, then free them
+ *
+ * This doesn't wait for the tap's thread, so a slow handler doesn't hold up the caller, and the handler may stop its
+ * own tap. The statistics stay as they were when the tap stopped. A stopped tap can't be attached again.
+ */
+- (void)stop;
+
+/**
+ * A snapshot of the tap's counters
+ */
+- (SBSMediaTapStatistics *_Nonnull)statistics;
+
+@end
@@ -0,0 +1,262 @@
+//
+//  SBSMediaTap.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSMediaTap.h"
+
+#import <pjsua-lib/pjsua_internal.h>
+
+#import "SBSMediaTapStatistics.h"
+#import "pj_media_tap.h"
+
+@interface SBSMediaTap ()
+
+@property(atomic) BOOL stopping;
+
+@end
+
+@implementation SBSMediaTap {
+  SBSMediaTapHandler _handler;
+  pj_pool_t *_pool;
+  pj_media_tap *_tap;
+  pjsua_conf_port_id _slots[PJ_MEDIA_TAP_DIR_COUNT];
+  NSUInteger _sampleRate;
+  NSUInteger _channelCount;
+  useconds_t _pollInterval;
+  NSThread *_thread;
+  pj_thread_desc _threadDesc;
+  NSLock *_statisticsLock;
+  SBSMediaTapStatistics *_finalStatistics;
+  BOOL _stopped;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithHandler:(SBSMediaTapHandler)handler capacity:(NSUInteger)capacity {
+  if (self = [super init]) {
+    _handler = [handler copy];
+    _capacity = 1;
+    while (_capacity < capacity) {
+      _capacity <<= 1;
+    }
+    _callSlot = PJSUA_INVALID_ID;
+    _slots[PJ_MEDIA_TAP_UPLINK] = PJSUA_INVALID_ID;
+    _slots[PJ_MEDIA_TAP_DOWNLINK] = PJSUA_INVALID_ID;
+    _statisticsLock = [[NSLock alloc] init];
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)attachToSlot:(pjsua_conf_port_id)slot muted:(BOOL)muted {
+  @synchronized(self) {
+    if (_stopped) {
+      return PJ_EINVALIDOP;
+    }
+
+    pj_status_t status = [self addPorts];
+    if (status != PJ_SUCCESS) {
+      return status;
+    }
+
+    // A renegotiated call has a new slot, and the old one usually went with the old stream
+    if (_callSlot != slot && _callSlot != PJSUA_INVALID_ID) {
+      pjsua_conf_disconnect(_callSlot, _slots[PJ_MEDIA_TAP_DOWNLINK]);
+    }
+    _callSlot = slot;
+
+    status = pjsua_conf_connect(slot, _slots[PJ_MEDIA_TAP_DOWNLINK]);
+    if (status != PJ_SUCCESS) {
+      return status;
+    }
+
+    // The uplink hears what the call does, so it goes quiet while the call is muted
+    if (!muted) {
+      status = pjsua_conf_connect(0, _slots[PJ_MEDIA_TAP_UPLINK]);
+    } else {
+      pjsua_conf_disconnect(0, _slots[PJ_MEDIA_TAP_UPLINK]);
+    }
+
+    if (status == PJ_SUCCESS && _thread == nil) {
+      _thread = [[NSThread alloc] initWithTarget:self selector:@selector(consume) object:nil];
+      _thread.name = @"sipper.media-tap";
+      [_thread start];
+    }
+
+    return status;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)stop {
+  @synchronized(self) {
+    if (_stopped) {
+      return;
+    }
+    _stopped = YES;
+
+    // Once the ports are off the bridge nothing is produced, and the counters are final
+    [self removePorts];
+    SBSMediaTapStatistics *statistics = [self statistics];
+
+    [_statisticsLock lock];
+    _finalStatistics = statistics;
+    [_statisticsLock unlock];
+
+    // The pool only holds what the bridge allocated for the ports, and the rings aren't in it
+    if (_pool != NULL) {
+      pj_pool_release(_pool);
+      _pool = NULL;
+    }
+
+    // The tap's thread hands over what's left in the rings and frees them on its own time. Waiting for it here would
+    // hold up the caller for as long as the handler takes, or forever if the handler is the one stopping the tap.
+    if (_thread != nil) {
+      _thread = nil;
+      self.stopping = YES;
+    } else if (_tap != NULL) {
+      [self destroyTap];
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSMediaTapStatistics *)statistics {
+  pj_media_tap_stat uplink, downlink;
+  pj_bzero(&uplink, sizeof(uplink));
+  pj_bzero(&downlink, sizeof(downlink));
+
+  [_statisticsLock lock];
+  if (_finalStatistics != nil) {
+    [_statisticsLock unlock];
+    return _finalStatistics;
+  }
+  if (_tap != NULL) {
+    pj_media_tap_get_stat(_tap, PJ_MEDIA_TAP_UPLINK, &uplink);
+    pj_media_tap_get_stat(_tap, PJ_MEDIA_TAP_DOWNLINK, &downlink);
+  }
+  [_statisticsLock unlock];
+
+  return [[SBSMediaTapStatistics alloc] initWithCapacity:_capacity
+                                            uplinkFrames:uplink.frames
+                                          downlinkFrames:downlink.frames
+                                         uplinkOverflows:uplink.overflows
+                                       downlinkOverflows:downlink.overflows
+                                                maxDepth:MAX(uplink.max_depth, downlink.max_depth)];
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)addPorts {
+  if (_tap != NULL) {
+    return PJ_SUCCESS;
+  }
+
+  // The ports take frames in the bridge's own format, so it doesn't have to resample them
+  pjmedia_port *master = pjmedia_conf_get_master_port(pjsua_var.mconf);
+  unsigned clockRate = PJMEDIA_PIA_SRATE(&master->info);
+  unsigned channelCount = PJMEDIA_PIA_CCNT(&master->info);
+  unsigned samplesPerFrame = PJMEDIA_PIA_SPF(&master->info);
+
+  pj_media_tap *tap;
+  pj_status_t status = pj_media_tap_create(clockRate, channelCount, samplesPerFrame, (unsigned) _capacity, &tap);
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  _pool = pjsua_pool_create("tap", 512, 512);
+  for (int dir = 0; dir < PJ_MEDIA_TAP_DIR_COUNT && status == PJ_SUCCESS; dir++) {
+    status = pjsua_conf_add_port(_pool, pj_media_tap_get_port(tap, (pj_media_tap_dir) dir), &_slots[dir]);
+  }
+
+  if (status != PJ_SUCCESS) {
+    [self removePorts];
+    pj_pool_release(_pool);
+    _pool = NULL;
+    pj_media_tap_destroy(tap);
+    return status;
+  }
+
+  // The rings are polled at twice the bridge's frame rate, which keeps them close to empty
+  _sampleRate = clockRate;
+  _channelCount = channelCount;
+  _pollInterval = (useconds_t) ((pj_uint64_t) samplesPerFrame * 1000000 / channelCount / clockRate / 2);
+
+  [_statisticsLock lock];
+  _tap = tap;
+  [_statisticsLock unlock];
+
+  return PJ_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)removePorts {
+  for (int dir = 0; dir < PJ_MEDIA_TAP_DIR_COUNT; dir++) {
+    if (_slots[dir] != PJSUA_INVALID_ID) {
+      pjsua_conf_remove_port(_slots[dir]);
+      _slots[dir] = PJSUA_INVALID_ID;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)destroyTap {
+  pj_media_tap *tap = _tap;
+
+  [_statisticsLock lock];
+  _tap = NULL;
+  [_statisticsLock unlock];
+
+  pj_media_tap_destroy(tap);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)consume {
+  // The handler may stop the tap from here, which takes the ports off the bridge
+  pj_thread_t *thread;
+  pj_thread_register("media-tap", _threadDesc, &thread);
+
+  while (!self.stopping) {
+    if (![self drain]) {
+      usleep(_pollInterval);
+    }
+  }
+
+  // The bridge is done with the rings by now, so whatever is left in them is the last of the call
+  [self drain];
+  [self destroyTap];
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)drain {
+  BOOL drained = NO;
+
+  @autoreleasepool {
+    for (int dir = 0; dir < PJ_MEDIA_TAP_DIR_COUNT; dir++) {
+      SBSMediaTapDirection direction = dir == PJ_MEDIA_TAP_UPLINK ? SBSMediaTapDirectionUplink : SBSMediaTapDirectionDownlink;
+
+      pj_media_tap_frame frame;
+      while (pj_media_tap_peek(_tap, (pj_media_tap_dir) dir, &frame)) {
+        _handler(direction, frame.samples, frame.sample_count, _channelCount, _sampleRate, frame.silent, frame.seq);
+        pj_media_tap_release(_tap, (pj_media_tap_dir) dir);
+        drained = YES;
+      }
+    }
+  }
+
+  return drained;
+}
+
+@end
@@ -0,0 +1,85 @@
+//
+//  SBSMediaTransportPool.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/17/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import <pjsua.h>
+
+/**
+ * Keeps ICE media transports with their candidates already gathered, ready to be handed to the next call
+ *
+ * Normally PJSUA creates the ICE transport for a call inside pjsua_call_make_call() (or when an INVITE arrives),
+ * and the INVITE can't be sent or answered until every host, STUN and TURN candidate has been gathered. The pool
+ * does that work ahead of time, using the same settings PJSUA would use for the account, so a call that finds a
+ * ready transport in the pool skips the gathering phase entirely.
+ *
+ * Transports are created with the settings of one account. Filling and draining the pool must happen on the
+ * endpoint's background thread, while transports may be taken from any thread PJSUA creates call media on.
+ */
+@interface SBSMediaTransportPool : NSObject
+
+/**
+ * The account whose media settings transports are created with
+ */
+@property(nonatomic, readonly) pjsua_acc_id accountId;
+
+/**
+ * The number of transports the pool tries to keep ready. Zero disables the pool.
+ */
+@property(nonatomic) NSUInteger capacity;
+
+/**
+ * The number of transports that have finished gathering and are waiting for a call
+ */
+@property(nonatomic, readonly) NSUInteger readyCount;
+
+/**
+ * The number of calls that were given a transport from the pool, and that had to gather their own
+ */
+@property(nonatomic, readonly) NSUInteger hits;
+@property(nonatomic, readonly) NSUInteger misses;
+
+/**
+ * Creates a new, empty pool
+ *
+ * @param accountId the account whose media settings transports are created with
+ */
+- (instancetype _Nonnull)initWithAccountId:(pjsua_acc_id)accountId;
+
+/**
+ * Starts gathering new transports until the pool is back at capacity, and closes any that went bad
+ */
+- (void)fill;
+
+/**
+ * Closes every transport in the pool, for example because the candidates belong to a network we're no longer on
+ */
+- (void)drain;
+
+/**
+ * Hands a ready transport over to a call's media
+ *
+ * Ownership of the transport passes to PJSUA, which closes it when the call ends.
+ *
+ * @param callMedia the call media that will use the transport
+ * @return a transport, or NULL if none have finished gathering
+ */
+- (pjmedia_transport *_Nullable)takeTransportForCallMedia:(void *_Nonnull)callMedia;
+
+/**
+ * Creates a transport for a call's media right away, without waiting for gathering to complete
+ *
+ * This is for Trickle ICE, where the call's offer or answer goes out with the candidates that are ready, and the
+ * call is told when the rest have been gathered. Ownership of the transport passes to PJSUA.
+ *
+ * @param callMedia the call media that will use the transport
+ * @return a transport, or NULL if ICE isn't enabled for the account or the transport couldn't be created
+ */
+- (pjmedia_transport *_Nullable)createTransportForCallMedia:(void *_Nonnull)callMedia;
+
+@end
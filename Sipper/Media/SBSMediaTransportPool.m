@@ -0,0 +1,383 @@
+//
+//  SBSMediaTransportPool.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/17/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSMediaTransportPool.h"
+
+#import <pjsua-lib/pjsua_internal.h>
+
+#import "SBSCall+Internal.h"
+
+static void onIceComplete(pjmedia_transport *transport, pj_ice_strans_op op, pj_status_t status);
+
+/**
+ * Every transport that currently belongs to a pool. This set also serves as the lock for all pool state.
+ */
+static NSMutableSet<NSValue *> *PooledTransports;
+
+/**
+ * Every pool that's alive. ICE callbacks for transports whose user data is one of these are routed to that pool,
+ * while callbacks for everything else come from transports that were handed to a call, whose user data is the call
+ * media. A transport created for a trickle call belongs to the call before it has finished gathering.
+ */
+static NSMutableSet<NSValue *> *LivePools;
+
+@interface SBSMediaTransportPool ()
+
+@property(nonatomic, strong) NSMutableArray<NSValue *> *gathering;
+@property(nonatomic, strong) NSMutableArray<NSValue *> *ready;
+@property(nonatomic, strong) NSMutableArray<NSValue *> *failed;
+
+@end
+
+@implementation SBSMediaTransportPool {
+  NSUInteger _created;
+}
+
+//------------------------------------------------------------------------------
+
++ (void)initialize {
+  if (self == [SBSMediaTransportPool class]) {
+    PooledTransports = [[NSMutableSet alloc] init];
+    LivePools = [[NSMutableSet alloc] init];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithAccountId:(pjsua_acc_id)accountId {
+  if (self = [super init]) {
+    _accountId = accountId;
+    _gathering = [[NSMutableArray alloc] init];
+    _ready = [[NSMutableArray alloc] init];
+    _failed = [[NSMutableArray alloc] init];
+
+    @synchronized (PooledTransports) {
+      [LivePools addObject:[NSValue valueWithPointer:(__bridge void *) self]];
+    }
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)dealloc {
+  @synchronized (PooledTransports) {
+    [LivePools removeObject:[NSValue valueWithPointer:(__bridge void *) self]];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (NSUInteger)readyCount {
+  @synchronized (PooledTransports) {
+    return _ready.count;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)fill {
+  NSArray<NSValue *> *failed;
+  NSUInteger missing;
+
+  @synchronized (PooledTransports) {
+    failed = [_failed copy];
+    [_failed removeAllObjects];
+
+    // Calls on an account without ICE get plain UDP transports, which are cheap enough to create on demand
+    NSUInteger pooled = _gathering.count + _ready.count;
+    missing = [self iceEnabled] && _capacity > pooled ? _capacity - pooled : 0;
+  }
+
+  for (NSValue *wrapper in failed) {
+    pjmedia_transport_close((pjmedia_transport *) wrapper.pointerValue);
+  }
+
+  for (NSUInteger i = 0; i < missing; i++) {
+    pj_status_t status = [self createTransport];
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to create media transport for pool: %d", status);
+      break;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)drain {
+  NSMutableArray<NSValue *> *transports = [[NSMutableArray alloc] init];
+
+  @synchronized (PooledTransports) {
+    [transports addObjectsFromArray:_gathering];
+    [transports addObjectsFromArray:_ready];
+    [transports addObjectsFromArray:_failed];
+
+    for (NSValue *wrapper in transports) {
+      [PooledTransports removeObject:wrapper];
+    }
+
+    [_gathering removeAllObjects];
+    [_ready removeAllObjects];
+    [_failed removeAllObjects];
+  }
+
+  for (NSValue *wrapper in transports) {
+    pjmedia_transport_close((pjmedia_transport *) wrapper.pointerValue);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (pjmedia_transport *)takeTransportForCallMedia:(void *)callMedia {
+  @synchronized (PooledTransports) {
+    NSValue *wrapper = _ready.firstObject;
+    if (wrapper == nil) {
+      _misses++;
+      return NULL;
+    }
+
+    [_ready removeObjectAtIndex:0];
+    [PooledTransports removeObject:wrapper];
+    _hits++;
+
+    // From here on, ICE callbacks for this transport are about the call
+    pjmedia_transport *transport = (pjmedia_transport *) wrapper.pointerValue;
+    transport->user_data = callMedia;
+
+    return transport;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (pjmedia_transport *)createTransportForCallMedia:(void *)callMedia {
+  if (![self iceEnabled]) {
+    return NULL;
+  }
+
+  // The call owns the transport from the start, so the pool never sees its gathering complete
+  pjmedia_transport *transport;
+  pj_status_t status = [self createTransportWithUserData:callMedia transport:&transport];
+  if (status != PJ_SUCCESS) {
+    NSLog(@"Failed to create media transport for call: %d", status);
+    return NULL;
+  }
+
+  return transport;
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)iceEnabled {
+  return pjsua_var.media_cfg.enable_ice && pjsua_var.acc[_accountId].cfg.ice_cfg.enable_ice;
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)createTransport {
+  pjmedia_transport *transport;
+  pj_status_t status = [self createTransportWithUserData:(__bridge void *) self transport:&transport];
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  NSValue *wrapper = [NSValue valueWithPointer:transport];
+  @synchronized (PooledTransports) {
+    [PooledTransports addObject:wrapper];
+    if (![_ready containsObject:wrapper] && ![_failed containsObject:wrapper]) {
+      [_gathering addObject:wrapper];
+    }
+  }
+
+  return PJ_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)createTransportWithUserData:(void *)userData transport:(pjmedia_transport **)transport {
+  pjsua_acc_config *accountConfig = &pjsua_var.acc[_accountId].cfg;
+  pjsua_transport_config *transportConfig = &accountConfig->rtp_cfg;
+
+  // This mirrors the configuration PJSUA builds for a call's ICE transport, so a pooled transport is
+  // indistinguishable from one the call would have created
+  pj_ice_strans_cfg config;
+  pj_ice_strans_cfg_default(&config);
+  config.af = accountConfig->ipv6_media_use != PJSUA_IPV6_DISABLED ? pj_AF_INET6() : pj_AF_INET();
+  pj_stun_config_init(&config.stun_cfg,
+                      &pjsua_var.cp.factory,
+                      0,
+                      pjsip_endpt_get_ioqueue(pjsua_var.endpt),
+                      pjsip_endpt_get_timer_heap(pjsua_var.endpt));
+  config.resolver = pjsua_var.resolver;
+  config.opt = accountConfig->ice_cfg.ice_opt;
+
+  // Only use the STUN server if PJSUA has finished resolving it, rather than blocking on it here
+  char stunAddress[PJ_INET6_ADDRSTRLEN];
+  if (pjsua_var.stun_status == PJ_SUCCESS && pj_sockaddr_has_addr(&pjsua_var.stun_srv)) {
+    pj_sockaddr_print(&pjsua_var.stun_srv, stunAddress, sizeof(stunAddress), 0);
+    config.stun.server = pj_str(stunAddress);
+    config.stun.port = pj_sockaddr_get_port(&pjsua_var.stun_srv);
+  }
+
+  if (accountConfig->ice_cfg.ice_max_host_cands >= 0) {
+    config.stun.max_host_cands = accountConfig->ice_cfg.ice_max_host_cands;
+  }
+
+  pj_sockaddr_init(config.af, &config.stun.cfg.bound_addr, &transportConfig->bound_addr, (pj_uint16_t) transportConfig->port);
+  config.stun.cfg.port_range = (pj_uint16_t) transportConfig->port_range;
+  if (transportConfig->port != 0 && config.stun.cfg.port_range == 0) {
+    config.stun.cfg.port_range = (pj_uint16_t) (pjsua_var.ua_cfg.max_calls * 10);
+  }
+
+  config.stun.cfg.qos_type = transportConfig->qos_type;
+  pj_memcpy(&config.stun.cfg.qos_params, &transportConfig->qos_params, sizeof(transportConfig->qos_params));
+
+  if (accountConfig->turn_cfg.enable_turn) {
+    config.turn.server = accountConfig->turn_cfg.turn_server;
+    config.turn.conn_type = accountConfig->turn_cfg.turn_conn_type;
+    pj_memcpy(&config.turn.auth_cred, &accountConfig->turn_cfg.turn_auth_cred, sizeof(config.turn.auth_cred));
+  }
+
+  unsigned componentCount = 1;
+  if (PJMEDIA_ADVERTISE_RTCP && !accountConfig->ice_cfg.ice_no_rtcp) {
+    componentCount++;
+  }
+
+  pjmedia_ice_cb callbacks;
+  pj_bzero(&callbacks, sizeof(callbacks));
+  callbacks.on_ice_complete = &onIceComplete;
+
+  char name[32];
+  pj_ansi_snprintf(name, sizeof(name), "icepool%02lu", (unsigned long) (_created++ % 100));
+
+  // Gathering may complete before this returns, in which case the callback has already been invoked
+  return pjmedia_ice_create3(pjsua_var.med_endpt, name, componentCount, &config, &callbacks, 0, userData, transport);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)transport:(pjmedia_transport *)transport didCompleteOperation:(pj_ice_strans_op)op status:(pj_status_t)status {
+  NSValue *wrapper = [NSValue valueWithPointer:transport];
+
+  @synchronized (PooledTransports) {
+    [_gathering removeObject:wrapper];
+
+    // A transport whose STUN keep-alive failed no longer has a usable server reflexive candidate. It can't be
+    // closed from inside its own callback, so it's left for the next fill.
+    if (status == PJ_SUCCESS && op == PJ_ICE_STRANS_OP_INIT) {
+      [_ready addObject:wrapper];
+    } else if (status != PJ_SUCCESS) {
+      [_ready removeObject:wrapper];
+      [_failed addObject:wrapper];
+    }
+  }
+}
+
+@end
+
+//------------------------------------------------------------------------------
+
+static void onCallIceComplete(pjsua_call_media *callMedia, pjmedia_transport *transport, pj_ice_strans_op op, pj_status_t status) {
+  BOOL notifyMediaState = NO;
+  BOOL notifyTransportState = NO;
+  pjsua_med_tp_state_info info;
+  pjsua_call_id callId;
+
+  // PJSUA only installs its on_ice_complete on the transports it creates itself, so this is a port of it for the
+  // ones it acquired from us, with the application callbacks invoked once the lock has been released
+  PJSUA_LOCK();
+
+  pjsua_call *call = callMedia->call;
+  callId = call->index;
+
+  switch (op) {
+    case PJ_ICE_STRANS_OP_INIT:
+      // Resumes media initialization if it was waiting for gathering to complete
+      callMedia->tp_ready = status;
+      if (callMedia->med_create_cb) {
+        (*callMedia->med_create_cb)(callMedia, status, call->secure_level, NULL);
+      }
+      break;
+
+    case PJ_ICE_STRANS_OP_NEGOTIATION:
+      if (status == PJ_SUCCESS) {
+        pjmedia_transport_info transportInfo;
+        pjmedia_transport_info_init(&transportInfo);
+        pjmedia_transport_get_info(callMedia->tp, &transportInfo);
+        pj_sockaddr_cp(&callMedia->rtp_addr, &transportInfo.sock_info.rtp_addr_name);
+      } else {
+        callMedia->state = PJSUA_CALL_MEDIA_ERROR;
+        callMedia->dir = PJMEDIA_DIR_NONE;
+        notifyMediaState = YES;
+      }
+
+      // Checks whether the default address changed
+      call->reinv_ice_tried = PJ_FALSE;
+      pjsua_call_schedule_reinvite_check(call, 0);
+      break;
+
+    case PJ_ICE_STRANS_OP_KEEP_ALIVE:
+    case PJ_ICE_STRANS_OP_ADDR_CHANGE:
+      if (!call->hanging_up) {
+        pj_bzero(&info, sizeof(info));
+        info.med_idx = callMedia->idx;
+        info.state = callMedia->tp_st;
+        info.status = status;
+        info.ext_info = &op;
+        notifyTransportState = YES;
+      }
+      break;
+  }
+
+  PJSUA_UNLOCK();
+
+  if (status != PJ_SUCCESS) {
+    PJ_PERROR(3, ("SBSMediaTransportPool", status, "ICE operation %d failed for call %d", op, callId));
+  }
+
+  if (notifyMediaState && pjsua_var.ua_cfg.cb.on_call_media_state) {
+    (*pjsua_var.ua_cfg.cb.on_call_media_state)(callId);
+  }
+
+  if (notifyTransportState && pjsua_var.ua_cfg.cb.on_call_media_transport_state) {
+    (*pjsua_var.ua_cfg.cb.on_call_media_transport_state)(callId, &info);
+  }
+
+  if (op == PJ_ICE_STRANS_OP_KEEP_ALIVE && pjsua_var.ua_cfg.cb.on_ice_transport_error) {
+    (*pjsua_var.ua_cfg.cb.on_ice_transport_error)(callId, op, status, NULL);
+  }
+
+  // A trickle call's transport finishes gathering after the call has started, whether or not that succeeded
+  if (op == PJ_ICE_STRANS_OP_INIT) {
+    void *data = pjsua_call_get_user_data(callId);
+    if (data != NULL) {
+      [(__bridge SBSCall *) data handleLocalCandidatesGathered];
+    }
+  }
+}
+
+static void onIceComplete(pjmedia_transport *transport, pj_ice_strans_op op, pj_status_t status) {
+  @autoreleasepool {
+    SBSMediaTransportPool *pool = nil;
+
+    // Gathering may complete before the pool has had a chance to register the transport, so the user data is
+    // what tells pooled transports apart
+    @synchronized (PooledTransports) {
+      if ([LivePools containsObject:[NSValue valueWithPointer:transport->user_data]]) {
+        pool = (__bridge SBSMediaTransportPool *) transport->user_data;
+      }
+    }
+
+    if (pool != nil) {
+      [pool transport:transport didCompleteOperation:op status:status];
+    } else if (transport->user_data != NULL) {
+      onCallIceComplete((pjsua_call_media *) transport->user_data, transport, op, status);
+    }
+  }
+}
@@ -0,0 +1,92 @@
+//
+//  SBSOpusController.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import <pjsua.h>
+
+/**
+ * Retunes the Opus encoder of a single call's audio stream from the loss and round-trip time the remote reports
+ *
+ * The controller samples the stream's RTCP statistics on a fixed interval. On a clean network it sends at the
+ * minimum bitrate with a lower encoder complexity and DTX, to save bandwidth and CPU. When the remote reports loss,
+ * it turns on in-band FEC, tells the encoder how much loss to expect, and raises the bitrate in proportion so the
+ * redundant data doesn't come out of the primary encoding. When loss comes with a high round-trip time, the loss is
+ * most likely congestion, so the bitrate drops back to the minimum while FEC stays on.
+ */
+@interface SBSOpusController : NSObject
+
+/**
+ * The call this controller is attached to, or -1 if it is detached
+ */
+@property(nonatomic) pjsua_call_id callId;
+
+/**
+ * The media index of the audio stream being controlled
+ */
+@property(nonatomic) unsigned mediaIndex;
+
+/**
+ * Current encoder settings
+ */
+@property(nonatomic, readonly) unsigned bitrate;
+@property(nonatomic, readonly) unsigned complexity;
+@property(nonatomic, readonly) unsigned packetLoss;
+@property(nonatomic, readonly) BOOL fec;
+@property(nonatomic, readonly) BOOL dtx;
+
+/**
+ * The smoothed fraction of packets the remote reported as lost, from 0 to 1
+ */
+@property(nonatomic, readonly) double lossRate;
+
+/**
+ * The last round-trip time measured from RTCP, in MS
+ */
+@property(nonatomic, readonly) unsigned roundTripTime;
+
+/**
+ * Creates a new controller
+ *
+ * The controller starts out as if the network were lossy, with FEC on at the maximum bitrate, until the first
+ * RTCP report says otherwise.
+ *
+ * @param minBitrate the bitrate used on clean or congested networks, in bits per second
+ * @param maxBitrate the bitrate used at high loss, in bits per second
+ */
+- (instancetype _Nonnull)initWithMinBitrate:(unsigned)minBitrate maxBitrate:(unsigned)maxBitrate;
+
+/**
+ * Starts sampling the stream on the current thread's run loop
+ *
+ * This must be invoked on a thread that is registered with PJSIP, and is expected to be the endpoint's
+ * background thread.
+ *
+ * @param interval the interval between adjustments
+ */
+- (void)startWithInterval:(NSTimeInterval)interval;
+
+/**
+ * Stops sampling the stream
+ *
+ * Must be invoked on the same thread that the controller was started on
+ */
+- (void)stop;
+
+/**
+ * Computes new encoder settings from an RTCP sample
+ *
+ * This does not touch the underlying stream, and is exposed separately so the policy can be exercised
+ * without a live call.
+ *
+ * @param stat the current RTCP statistics of the stream
+ * @return YES if the encoder settings changed and should be applied to the stream
+ */
+- (BOOL)adjustForStatistics:(const pjmedia_rtcp_stat *_Nonnull)stat;
+
+@end
@@ -0,0 +1,231 @@
+//
+//  SBSOpusController.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSOpusController.h"
+
+#import <pjmedia-codec/opus.h>
+#import <pjsua-lib/pjsua_internal.h>
+
+/**
+ * Loss at which in-band FEC is turned on, from 0 to 1
+ */
+static double const OpusFecLossThreshold = 0.01;
+
+/**
+ * Loss at which the bitrate reaches its maximum, from 0 to 1
+ */
+static double const OpusFullRedundancyLoss = 0.1;
+
+/**
+ * Loss and round-trip time, in MS, past which loss is treated as congestion
+ */
+static double const OpusCongestionLoss = 0.05;
+static unsigned const OpusCongestionRoundTripTime = 400;
+
+/**
+ * Weight of the previous loss estimate when loss is falling. Rising loss is taken as is.
+ */
+static double const OpusLossDecay = 0.7;
+
+/**
+ * The most loss the encoder is told to expect, in percent. Past this, more redundancy costs more than it recovers.
+ */
+static unsigned const OpusMaxPacketLoss = 25;
+
+/**
+ * Encoder complexity on clean and lossy networks. Below 5 quality drops noticeably at voice bitrates, while the
+ * top of the range mostly pays off when FEC is sharing the bits.
+ */
+static unsigned const OpusCleanComplexity = 5;
+static unsigned const OpusLossyComplexity = 9;
+
+/**
+ * Smallest bitrate change worth retuning the encoder for, in bits per second
+ */
+static unsigned const OpusBitrateStep = 2000;
+
+@interface SBSOpusController ()
+
+@property(nonatomic) unsigned minBitrate;
+@property(nonatomic) unsigned maxBitrate;
+@property(nonatomic, strong) NSTimer *timer;
+
+@end
+
+@implementation SBSOpusController {
+  unsigned _lastPackets;
+  unsigned _lastLoss;
+  unsigned _lastUpdate;
+  BOOL _hasBaseline;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithMinBitrate:(unsigned)minBitrate maxBitrate:(unsigned)maxBitrate {
+  if (self = [super init]) {
+    _callId = -1;
+    _mediaIndex = 0;
+    _minBitrate = minBitrate;
+    _maxBitrate = MAX(maxBitrate, minBitrate);
+    _hasBaseline = NO;
+
+    // Nothing is known about the network yet, so protect the start of the call
+    _bitrate = _maxBitrate;
+    _complexity = OpusLossyComplexity;
+    _packetLoss = (unsigned) (OpusFullRedundancyLoss * 100);
+    _fec = YES;
+    _dtx = NO;
+    _lossRate = OpusFullRedundancyLoss;
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)startWithInterval:(NSTimeInterval)interval {
+  [self stop];
+
+  _hasBaseline = NO;
+  _timer = [NSTimer scheduledTimerWithTimeInterval:interval target:self selector:@selector(tick:) userInfo:nil repeats:YES];
+
+  // Bring the encoder in line with the controller, which may not match what the stream was opened with
+  [self apply];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)stop {
+  [_timer invalidate];
+  _timer = nil;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)dealloc {
+  [_timer invalidate];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)tick:(NSTimer *)timer {
+  if (_callId < 0) {
+    return;
+  }
+
+  pjsua_stream_stat stat;
+  if (pjsua_call_get_stream_stat(_callId, _mediaIndex, &stat) != PJ_SUCCESS) {
+    return;
+  }
+
+  if (![self adjustForStatistics:&stat.rtcp]) {
+    return;
+  }
+
+  [self apply];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)apply {
+  if (_callId < 0) {
+    return;
+  }
+
+  pjmedia_codec_opus_config config;
+  pjmedia_codec_opus_get_config(&config);
+  config.bit_rate = _bitrate;
+  config.complexity = _complexity;
+  config.packet_loss = _packetLoss;
+  config.cbr = PJ_FALSE;
+
+  // The stream can disappear out from under us during re-invites, so look it up under the lock every time
+  PJSUA_LOCK();
+
+  pj_status_t status = PJ_ENOTFOUND;
+  if (_callId < (pjsua_call_id) PJ_ARRAY_SIZE(pjsua_var.calls) && _mediaIndex < pjsua_var.calls[_callId].med_cnt) {
+    pjsua_call_media *media = &pjsua_var.calls[_callId].media[_mediaIndex];
+    if (media->type == PJMEDIA_TYPE_AUDIO && media->strm.a.stream != NULL) {
+      pjmedia_codec *codec = pjmedia_stream_get_codec(media->strm.a.stream);
+
+      // Another codec may have been negotiated, in which case there's nothing to do
+      status = pjmedia_codec_opus_is_instance(codec) ? pjmedia_codec_opus_modify(codec, &config, _fec, _dtx) : PJ_SUCCESS;
+    }
+  }
+
+  PJSUA_UNLOCK();
+
+  if (status != PJ_SUCCESS) {
+    NSLog(@"Failed to retune Opus encoder for call %d: %d", _callId, status);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)adjustForStatistics:(const pjmedia_rtcp_stat *)stat {
+
+  // The first sample (or a reset stream) only establishes a baseline for the counters
+  if (!_hasBaseline || stat->tx.pkt < _lastPackets || stat->tx.loss < _lastLoss) {
+    _lastPackets = stat->tx.pkt;
+    _lastLoss = stat->tx.loss;
+    _lastUpdate = stat->tx.update_cnt;
+    _hasBaseline = YES;
+    return NO;
+  }
+
+  // Loss is only known from receiver reports, so wait for a new one. Nothing sent (hold, or DTX through a long
+  // silence) says nothing about the network either.
+  unsigned packets = stat->tx.pkt - _lastPackets;
+  if (stat->tx.update_cnt == _lastUpdate || packets == 0) {
+    return NO;
+  }
+
+  unsigned lost = stat->tx.loss - _lastLoss;
+  _lastPackets = stat->tx.pkt;
+  _lastLoss = stat->tx.loss;
+  _lastUpdate = stat->tx.update_cnt;
+
+  double sample = MIN((double) lost / (packets + lost), 1.0);
+  _lossRate = sample > _lossRate ? sample : OpusLossDecay * _lossRate + (1.0 - OpusLossDecay) * sample;
+  _roundTripTime = stat->rtt.last / 1000;
+
+  BOOL lossy = _lossRate >= OpusFecLossThreshold;
+  BOOL congested = _lossRate >= OpusCongestionLoss && _roundTripTime >= OpusCongestionRoundTripTime;
+
+  unsigned bitrate = _minBitrate;
+  if (lossy && !congested) {
+    double redundancy = MIN(_lossRate / OpusFullRedundancyLoss, 1.0);
+    bitrate = _minBitrate + (unsigned) ((_maxBitrate - _minBitrate) * redundancy);
+  }
+
+  // Small bitrate changes aren't worth retuning for, but the bounds always are
+  if (bitrate != _minBitrate && bitrate != _maxBitrate && (unsigned) abs((int) bitrate - (int) _bitrate) < OpusBitrateStep) {
+    bitrate = _bitrate;
+  }
+
+  unsigned packetLoss = lossy ? MIN((unsigned) ceil(_lossRate * 100), OpusMaxPacketLoss) : 0;
+  unsigned complexity = lossy ? OpusLossyComplexity : OpusCleanComplexity;
+
+  // DTX stretches the gap a lost packet leaves behind, so it's only used when packets aren't being lost
+  BOOL fec = lossy;
+  BOOL dtx = !lossy;
+
+  if (bitrate == _bitrate && packetLoss == _packetLoss && complexity == _complexity && fec == _fec && dtx == _dtx) {
+    return NO;
+  }
+
+  _bitrate = bitrate;
+  _packetLoss = packetLoss;
+  _complexity = complexity;
+  _fec = fec;
+  _dtx = dtx;
+
+  return YES;
+}
+
+@end
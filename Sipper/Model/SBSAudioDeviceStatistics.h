@@ -0,0 +1,52 @@
+//
+//  SBSAudioDeviceStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of how the sound device's sample rate has been switched, and what converting its audio costs
+ */
+@interface SBSAudioDeviceStatistics : NSObject
+
+/**
+ * The sample rate the sound device runs at, or is opened at next
+ */
+@property(nonatomic, readonly) NSUInteger sampleRate;
+
+/**
+ * Number of times the sample rate was switched
+ */
+@property(nonatomic, readonly) NSUInteger switches;
+
+/**
+ * Silence between the last frame at the old sample rate and the first at the new one, for the last switch and the
+ * longest, in seconds
+ */
+@property(nonatomic, readonly) NSTimeInterval lastGap;
+@property(nonatomic, readonly) NSTimeInterval maxGap;
+
+/**
+ * Number of frames passed between the sound device and the conference bridge, in either direction
+ */
+@property(nonatomic, readonly) uint64_t frames;
+
+/**
+ * Time spent converting a frame between the device's sample rate and the bridge's, on average and at most, in seconds
+ */
+@property(nonatomic, readonly) NSTimeInterval averageFrameCost;
+@property(nonatomic, readonly) NSTimeInterval maxFrameCost;
+
+- (instancetype _Nonnull)initWithSampleRate:(NSUInteger)sampleRate
+                                   switches:(NSUInteger)switches
+                                    lastGap:(NSTimeInterval)lastGap
+                                     maxGap:(NSTimeInterval)maxGap
+                                     frames:(uint64_t)frames
+                                  frameCost:(NSTimeInterval)frameCost
+                               maxFrameCost:(NSTimeInterval)maxFrameCost;
+
+@end
@@ -0,0 +1,39 @@
+//
+//  SBSAudioDeviceStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSAudioDeviceStatistics.h"
+
+@implementation SBSAudioDeviceStatistics {
+  NSTimeInterval _frameCost;
+}
+
+- (instancetype)initWithSampleRate:(NSUInteger)sampleRate
+                          switches:(NSUInteger)switches
+                           lastGap:(NSTimeInterval)lastGap
+                            maxGap:(NSTimeInterval)maxGap
+                            frames:(uint64_t)frames
+                         frameCost:(NSTimeInterval)frameCost
+                      maxFrameCost:(NSTimeInterval)maxFrameCost {
+  if (self = [super init]) {
+    _sampleRate = sampleRate;
+    _switches = switches;
+    _lastGap = lastGap;
+    _maxGap = maxGap;
+    _frames = frames;
+    _frameCost = frameCost;
+    _maxFrameCost = maxFrameCost;
+  }
+
+  return self;
+}
+
+- (NSTimeInterval)averageFrameCost {
+  return _frames > 0 ? _frameCost / _frames : 0;
+}
+
+@end
@@ -0,0 +1,95 @@
+//
+//  SBSCallRecord.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SBSCall.h"
+
+/**
+ * The details of a single finished call, as kept by the endpoint's call record store
+ */
+@interface SBSCallRecord : NSObject
+
+/**
+ * Position of the record in the store, increasing by one with every call recorded
+ *
+ * This is 0 for records that haven't been written to a store yet.
+ */
+@property(nonatomic, readonly) uint64_t sequence;
+
+/**
+ * The UUID of the call
+ */
+@property(strong, nonatomic, nonnull, readonly) NSUUID *uuid;
+
+/**
+ * The direction of the call
+ */
+@property(nonatomic, readonly) SBSCallDirection direction;
+
+/**
+ * The remote party, as dialed for outbound calls or as sent in the From header for inbound calls
+ */
+@property(strong, nonatomic, nonnull, readonly) NSString *remote;
+
+/**
+ * When the call started, became active and completed
+ */
+@property(strong, nonatomic, nullable, readonly) NSDate *startedAt;
+@property(strong, nonatomic, nullable, readonly) NSDate *activeAt;
+@property(strong, nonatomic, nullable, readonly) NSDate *completedAt;
+
+/**
+ * How long the call was active for, in seconds, which is 0 for calls that never connected
+ */
+@property(nonatomic, readonly) NSTimeInterval duration;
+
+/**
+ * The last SIP status code of the call, or 0 if the call failed before any was received
+ */
+@property(nonatomic, readonly) NSInteger statusCode;
+
+/**
+ * The SIP transport the call was signaled over, like UDP or TLS, or nil if unknown
+ */
+@property(strong, nonatomic, nullable, readonly) NSString *transport;
+
+/**
+ * The audio codec that was last in use, like opus/48000, or nil if the call never had audio
+ */
+@property(strong, nonatomic, nullable, readonly) NSString *codec;
+
+/**
+ * Fraction of packets lost on the way to us, and on the way to the remote as it reported, from 0 to 1
+ */
+@property(nonatomic, readonly) float lossRate;
+@property(nonatomic, readonly) float remoteLossRate;
+
+/**
+ * Average jitter of received audio and average round-trip time, in seconds
+ */
+@property(nonatomic, readonly) NSTimeInterval jitter;
+@property(nonatomic, readonly) NSTimeInterval roundTripTime;
+
+- (instancetype _Nonnull)initWithSequence:(uint64_t)sequence
+                                     uuid:(NSUUID *_Nonnull)uuid
+                                direction:(SBSCallDirection)direction
+                                   remote:(NSString *_Nonnull)remote
+                                startedAt:(NSDate *_Nullable)startedAt
+                                 activeAt:(NSDate *_Nullable)activeAt
+                              completedAt:(NSDate *_Nullable)completedAt
+                                 duration:(NSTimeInterval)duration
+                               statusCode:(NSInteger)statusCode
+                                transport:(NSString *_Nullable)transport
+                                    codec:(NSString *_Nullable)codec
+                                 lossRate:(float)lossRate
+                           remoteLossRate:(float)remoteLossRate
+                                   jitter:(NSTimeInterval)jitter
+                            roundTripTime:(NSTimeInterval)roundTripTime;
+
+@end
@@ -0,0 +1,49 @@
+//
+//  SBSCallRecord.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSCallRecord.h"
+
+@implementation SBSCallRecord
+
+- (instancetype)initWithSequence:(uint64_t)sequence
+                            uuid:(NSUUID *)uuid
+                       direction:(SBSCallDirection)direction
+                          remote:(NSString *)remote
+                       startedAt:(NSDate *)startedAt
+                        activeAt:(NSDate *)activeAt
+                     completedAt:(NSDate *)completedAt
+                        duration:(NSTimeInterval)duration
+                      statusCode:(NSInteger)statusCode
+                       transport:(NSString *)transport
+                           codec:(NSString *)codec
+                        lossRate:(float)lossRate
+                  remoteLossRate:(float)remoteLossRate
+                          jitter:(NSTimeInterval)jitter
+                   roundTripTime:(NSTimeInterval)roundTripTime {
+  if (self = [super init]) {
+    _sequence = sequence;
+    _uuid = uuid;
+    _direction = direction;
+    _remote = remote;
+    _startedAt = startedAt;
+    _activeAt = activeAt;
+    _completedAt = completedAt;
+    _duration = duration;
+    _statusCode = statusCode;
+    _transport = transport;
+    _codec = codec;
+    _lossRate = lossRate;
+    _remoteLossRate = remoteLossRate;
+    _jitter = jitter;
+    _roundTripTime = roundTripTime;
+  }
+
+  return self;
+}
+
+@end
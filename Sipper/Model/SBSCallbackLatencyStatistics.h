@@ -0,0 +1,68 @@
+//
+//  SBSCallbackLatencyStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * How long one PJSUA callback has taken to run, since the endpoint was started or the times were reset
+ *
+ * Callbacks run on PJSIP's threads with its locks held, so time spent in them holds up retransmissions and media.
+ * Percentiles are accurate to within about 3%.
+ */
+@interface SBSCallbackLatencyStatistics : NSObject
+
+/**
+ * Name of the PJSUA callback, like on_call_state
+ */
+@property(nonatomic, readonly, nonnull) NSString *callback;
+
+/**
+ * Number of times the callback ran
+ */
+@property(nonatomic, readonly) NSUInteger count;
+
+/**
+ * Average time spent in the callback, in nanoseconds
+ */
+@property(nonatomic, readonly) NSUInteger meanTime;
+
+/**
+ * Longest time spent in the callback, in nanoseconds
+ */
+@property(nonatomic, readonly) NSUInteger maxTime;
+
+/**
+ * Median time spent in the callback, in nanoseconds
+ */
+@property(nonatomic, readonly) NSUInteger p50Time;
+
+/**
+ * 90th percentile time spent in the callback, in nanoseconds
+ */
+@property(nonatomic, readonly) NSUInteger p90Time;
+
+/**
+ * 99th percentile time spent in the callback, in nanoseconds
+ */
+@property(nonatomic, readonly) NSUInteger p99Time;
+
+/**
+ * 99.9th percentile time spent in the callback, in nanoseconds
+ */
+@property(nonatomic, readonly) NSUInteger p999Time;
+
+- (instancetype _Nonnull)initWithCallback:(NSString *_Nonnull)callback
+                                    count:(NSUInteger)count
+                                 meanTime:(NSUInteger)meanTime
+                                  maxTime:(NSUInteger)maxTime
+                                  p50Time:(NSUInteger)p50Time
+                                  p90Time:(NSUInteger)p90Time
+                                  p99Time:(NSUInteger)p99Time
+                                 p999Time:(NSUInteger)p999Time;
+
+@end
@@ -0,0 +1,35 @@
+//
+//  SBSCallbackLatencyStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSCallbackLatencyStatistics.h"
+
+@implementation SBSCallbackLatencyStatistics
+
+- (instancetype)initWithCallback:(NSString *)callback
+                           count:(NSUInteger)count
+                        meanTime:(NSUInteger)meanTime
+                         maxTime:(NSUInteger)maxTime
+                         p50Time:(NSUInteger)p50Time
+                         p90Time:(NSUInteger)p90Time
+                         p99Time:(NSUInteger)p99Time
+                        p999Time:(NSUInteger)p999Time {
+  if (self = [super init]) {
+    _callback = callback;
+    _count = count;
+    _meanTime = meanTime;
+    _maxTime = maxTime;
+    _p50Time = p50Time;
+    _p90Time = p90Time;
+    _p99Time = p99Time;
+    _p999Time = p999Time;
+  }
+
+  return self;
+}
+
+@end
@@ -0,0 +1,43 @@
+//
+//  SBSCallbackReplayStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * How fast a recording of PJSUA callbacks was replayed through the calls and the endpoint
+ *
+ * A recording is replayed at full speed, on the endpoint's thread, and replaying the same recording does the same
+ * work each time, so these can be compared from one build to the next.
+ */
+@interface SBSCallbackReplayStatistics : NSObject
+
+/**
+ * Number of callbacks replayed
+ */
+@property(nonatomic, readonly) NSUInteger events;
+
+/**
+ * Number of calls the callbacks were for
+ */
+@property(nonatomic, readonly) NSUInteger calls;
+
+/**
+ * Time spent replaying, in seconds
+ */
+@property(nonatomic, readonly) NSTimeInterval duration;
+
+/**
+ * Callbacks replayed each second
+ */
+@property(nonatomic, readonly) double eventsPerSecond;
+
+- (instancetype _Nonnull)initWithEvents:(NSUInteger)events
+                                  calls:(NSUInteger)calls
+                               duration:(NSTimeInterval)duration;
+
+@end
@@ -0,0 +1,29 @@
+//
+//  SBSCallbackReplayStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSCallbackReplayStatistics.h"
+
+@implementation SBSCallbackReplayStatistics
+
+- (instancetype)initWithEvents:(NSUInteger)events
+                         calls:(NSUInteger)calls
+                      duration:(NSTimeInterval)duration {
+  if (self = [super init]) {
+    _events = events;
+    _calls = calls;
+    _duration = duration;
+  }
+
+  return self;
+}
+
+- (double)eventsPerSecond {
+  return _duration > 0 ? _events / _duration : 0;
+}
+
+@end
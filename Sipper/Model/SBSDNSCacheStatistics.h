@@ -0,0 +1,53 @@
+//
+//  SBSDNSCacheStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/16/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of the endpoint's DNS cache counters since the endpoint was started
+ */
+@interface SBSDNSCacheStatistics : NSObject
+
+/**
+ * Number of lookups answered from a record that had not expired
+ */
+@property(nonatomic, readonly) NSUInteger hits;
+
+/**
+ * Number of lookups answered from an expired record while it was being revalidated
+ */
+@property(nonatomic, readonly) NSUInteger staleHits;
+
+/**
+ * Number of lookups that had to wait for the network
+ */
+@property(nonatomic, readonly) NSUInteger misses;
+
+/**
+ * Number of records refreshed before they expired
+ */
+@property(nonatomic, readonly) NSUInteger prefetches;
+
+/**
+ * Number of queries sent to the nameservers
+ */
+@property(nonatomic, readonly) NSUInteger queries;
+
+/**
+ * Number of resolutions that failed
+ */
+@property(nonatomic, readonly) NSUInteger failures;
+
+- (instancetype _Nonnull)initWithHits:(NSUInteger)hits
+                            staleHits:(NSUInteger)staleHits
+                               misses:(NSUInteger)misses
+                           prefetches:(NSUInteger)prefetches
+                              queries:(NSUInteger)queries
+                             failures:(NSUInteger)failures;
+
+@end
@@ -0,0 +1,31 @@
+//
+//  SBSDNSCacheStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/16/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSDNSCacheStatistics.h"
+
+@implementation SBSDNSCacheStatistics
+
+- (instancetype)initWithHits:(NSUInteger)hits
+                   staleHits:(NSUInteger)staleHits
+                      misses:(NSUInteger)misses
+                  prefetches:(NSUInteger)prefetches
+                     queries:(NSUInteger)queries
+                    failures:(NSUInteger)failures {
+  if (self = [super init]) {
+    _hits = hits;
+    _staleHits = staleHits;
+    _misses = misses;
+    _prefetches = prefetches;
+    _queries = queries;
+    _failures = failures;
+  }
+
+  return self;
+}
+
+@end
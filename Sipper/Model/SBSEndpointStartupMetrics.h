@@ -0,0 +1,94 @@
+//
+//  SBSEndpointStartupMetrics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * How long each phase of the endpoint's startup took, in seconds
+ *
+ * Startup is split in two. The critical path is what initializeEndpointWithConfiguration:error: waits for before it
+ * returns: the SIP core, the first transport and the background thread. Everything else is deferred to the background
+ * thread, and finishes shortly after.
+ */
+@interface SBSEndpointStartupMetrics : NSObject
+
+/**
+ * Creating PJSUA
+ */
+@property(nonatomic, readonly) NSTimeInterval createTime;
+
+/**
+ * Initializing PJSUA and its media subsystem, the DNS cache and ICE candidate ranking
+ */
+@property(nonatomic, readonly) NSTimeInterval initializeTime;
+
+/**
+ * Creating the first configured transport
+ */
+@property(nonatomic, readonly) NSTimeInterval transportTime;
+
+/**
+ * Starting PJSUA
+ */
+@property(nonatomic, readonly) NSTimeInterval startTime;
+
+/**
+ * Starting and registering the background thread and the services that run on it, and opening the call record store
+ */
+@property(nonatomic, readonly) NSTimeInterval threadTime;
+
+/**
+ * The whole critical path, until the endpoint was ready to use
+ */
+@property(nonatomic, readonly) NSTimeInterval readyTime;
+
+/**
+ * Creating the rest of the configured transports
+ */
+@property(nonatomic, readonly) NSTimeInterval extraTransportTime;
+
+/**
+ * Registering the NAT64, compaction and capture modules, and measuring SRTP crypto suites
+ */
+@property(nonatomic, readonly) NSTimeInterval moduleTime;
+
+/**
+ * Applying the codec policy, like the starting Opus parameters
+ */
+@property(nonatomic, readonly) NSTimeInterval codecTime;
+
+/**
+ * Creating the ringback tone generator and adding it to the conference bridge
+ */
+@property(nonatomic, readonly) NSTimeInterval ringbackTime;
+
+/**
+ * From the start of initialization until the deferred work was done, including time spent waiting for the background
+ * thread. This is 0 until the deferred work is done.
+ */
+@property(nonatomic, readonly) NSTimeInterval completeTime;
+
+/**
+ * Whether the deferred work is done
+ */
+@property(nonatomic, readonly) BOOL complete;
+
+- (instancetype _Nonnull)initWithCreateTime:(NSTimeInterval)createTime
+                             initializeTime:(NSTimeInterval)initializeTime
+                              transportTime:(NSTimeInterval)transportTime
+                                  startTime:(NSTimeInterval)startTime
+                                 threadTime:(NSTimeInterval)threadTime
+                                  readyTime:(NSTimeInterval)readyTime
+                         extraTransportTime:(NSTimeInterval)extraTransportTime
+                                 moduleTime:(NSTimeInterval)moduleTime
+                                  codecTime:(NSTimeInterval)codecTime
+                               ringbackTime:(NSTimeInterval)ringbackTime
+                               completeTime:(NSTimeInterval)completeTime
+                                   complete:(BOOL)complete;
+
+@end
@@ -0,0 +1,43 @@
+//
+//  SBSEndpointStartupMetrics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSEndpointStartupMetrics.h"
+
+@implementation SBSEndpointStartupMetrics
+
+- (instancetype)initWithCreateTime:(NSTimeInterval)createTime
+                    initializeTime:(NSTimeInterval)initializeTime
+                     transportTime:(NSTimeInterval)transportTime
+                         startTime:(NSTimeInterval)startTime
+                        threadTime:(NSTimeInterval)threadTime
+                         readyTime:(NSTimeInterval)readyTime
+                extraTransportTime:(NSTimeInterval)extraTransportTime
+                        moduleTime:(NSTimeInterval)moduleTime
+                         codecTime:(NSTimeInterval)codecTime
+                      ringbackTime:(NSTimeInterval)ringbackTime
+                      completeTime:(NSTimeInterval)completeTime
+                          complete:(BOOL)complete {
+  if (self = [super init]) {
+    _createTime = createTime;
+    _initializeTime = initializeTime;
+    _transportTime = transportTime;
+    _startTime = startTime;
+    _threadTime = threadTime;
+    _readyTime = readyTime;
+    _extraTransportTime = extraTransportTime;
+    _moduleTime = moduleTime;
+    _codecTime = codecTime;
+    _ringbackTime = ringbackTime;
+    _completeTime = completeTime;
+    _complete = complete;
+  }
+
+  return self;
+}
+
+@end
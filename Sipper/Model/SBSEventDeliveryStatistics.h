@@ -0,0 +1,51 @@
+//
+//  SBSEventDeliveryStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of the endpoint's event delivery counters since the endpoint was started
+ */
+@interface SBSEventDeliveryStatistics : NSObject
+
+/**
+ * Number of events and delegate calls that were delivered
+ */
+@property(nonatomic, readonly) NSUInteger events;
+
+/**
+ * Number of state change events dropped because a later one for the same call was delivered in the same batch
+ */
+@property(nonatomic, readonly) NSUInteger coalesced;
+
+/**
+ * Number of blocks enqueued on the event queue, each delivering one batch
+ */
+@property(nonatomic, readonly) NSUInteger blocks;
+
+/**
+ * Number of calls made or received
+ */
+@property(nonatomic, readonly) NSUInteger calls;
+
+/**
+ * Average number of blocks enqueued for each call
+ */
+@property(nonatomic, readonly) double blocksPerCall;
+
+/**
+ * Average number of events delivered by each block
+ */
+@property(nonatomic, readonly) double eventsPerBlock;
+
+- (instancetype _Nonnull)initWithEvents:(NSUInteger)events
+                              coalesced:(NSUInteger)coalesced
+                                 blocks:(NSUInteger)blocks
+                                  calls:(NSUInteger)calls;
+
+@end
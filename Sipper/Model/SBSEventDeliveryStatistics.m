@@ -0,0 +1,35 @@
+//
+//  SBSEventDeliveryStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSEventDeliveryStatistics.h"
+
+@implementation SBSEventDeliveryStatistics
+
+- (instancetype)initWithEvents:(NSUInteger)events
+                     coalesced:(NSUInteger)coalesced
+                        blocks:(NSUInteger)blocks
+                         calls:(NSUInteger)calls {
+  if (self = [super init]) {
+    _events = events;
+    _coalesced = coalesced;
+    _blocks = blocks;
+    _calls = calls;
+  }
+
+  return self;
+}
+
+- (double)blocksPerCall {
+  return _calls > 0 ? (double) _blocks / _calls : 0;
+}
+
+- (double)eventsPerBlock {
+  return _blocks > 0 ? (double) _events / _blocks : 0;
+}
+
+@end
@@ -0,0 +1,47 @@
+//
+//  SBSICECandidateStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/18/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of the endpoint's ICE candidate counters since the endpoint was started
+ */
+@interface SBSICECandidateStatistics : NSObject
+
+/**
+ * Number of times host addresses were ranked, once per address family of every ICE transport
+ */
+@property(nonatomic, readonly) NSUInteger rankings;
+
+/**
+ * Number of local addresses found while gathering
+ */
+@property(nonatomic, readonly) NSUInteger addresses;
+
+/**
+ * Number of addresses that became host candidates
+ */
+@property(nonatomic, readonly) NSUInteger candidates;
+
+/**
+ * Number of synthesized NAT64 candidates left out of an SDP because they were redundant or unroutable
+ */
+@property(nonatomic, readonly) NSUInteger suppressed;
+
+/**
+ * Number of completed ICE sessions that were credited to the interface they used
+ */
+@property(nonatomic, readonly) NSUInteger successes;
+
+- (instancetype _Nonnull)initWithRankings:(NSUInteger)rankings
+                                addresses:(NSUInteger)addresses
+                               candidates:(NSUInteger)candidates
+                               suppressed:(NSUInteger)suppressed
+                                successes:(NSUInteger)successes;
+
+@end
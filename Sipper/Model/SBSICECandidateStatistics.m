@@ -0,0 +1,29 @@
+//
+//  SBSICECandidateStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/18/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSICECandidateStatistics.h"
+
+@implementation SBSICECandidateStatistics
+
+- (instancetype)initWithRankings:(NSUInteger)rankings
+                       addresses:(NSUInteger)addresses
+                      candidates:(NSUInteger)candidates
+                      suppressed:(NSUInteger)suppressed
+                       successes:(NSUInteger)successes {
+  if (self = [super init]) {
+    _rankings = rankings;
+    _addresses = addresses;
+    _candidates = candidates;
+    _suppressed = suppressed;
+    _successes = successes;
+  }
+
+  return self;
+}
+
+@end
@@ -0,0 +1,47 @@
+//
+//  SBSKeepAliveStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/15/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of the endpoint's shared keep-alive timer
+ */
+@interface SBSKeepAliveStatistics : NSObject
+
+/**
+ * Number of times the keep-alive timer woke up
+ */
+@property(nonatomic, readonly) NSUInteger wakeups;
+
+/**
+ * Number of keep-alive packets sent, across all flows
+ */
+@property(nonatomic, readonly) NSUInteger keepAlivesSent;
+
+/**
+ * Number of keep-alive packets that could not be sent
+ */
+@property(nonatomic, readonly) NSUInteger sendFailures;
+
+/**
+ * Number of flows that were kept alive on the most recent tick
+ */
+@property(nonatomic, readonly) NSUInteger flows;
+
+/**
+ * Total CPU time spent sending keep-alives, in seconds
+ */
+@property(nonatomic, readonly) NSTimeInterval cpuTime;
+
+- (instancetype _Nonnull)initWithWakeups:(NSUInteger)wakeups
+                          keepAlivesSent:(NSUInteger)keepAlivesSent
+                            sendFailures:(NSUInteger)sendFailures
+                                   flows:(NSUInteger)flows
+                                 cpuTime:(NSTimeInterval)cpuTime;
+
+@end
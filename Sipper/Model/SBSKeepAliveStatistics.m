@@ -0,0 +1,29 @@
+//
+//  SBSKeepAliveStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/15/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSKeepAliveStatistics.h"
+
+@implementation SBSKeepAliveStatistics
+
+- (instancetype)initWithWakeups:(NSUInteger)wakeups
+                 keepAlivesSent:(NSUInteger)keepAlivesSent
+                   sendFailures:(NSUInteger)sendFailures
+                          flows:(NSUInteger)flows
+                        cpuTime:(NSTimeInterval)cpuTime {
+  if (self = [super init]) {
+    _wakeups = wakeups;
+    _keepAlivesSent = keepAlivesSent;
+    _sendFailures = sendFailures;
+    _flows = flows;
+    _cpuTime = cpuTime;
+  }
+
+  return self;
+}
+
+@end
@@ -0,0 +1,50 @@
+//
+//  SBSMediaTapStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of how a call's media tap has kept up with its audio
+ */
+@interface SBSMediaTapStatistics : NSObject
+
+/**
+ * Number of frames each ring holds
+ */
+@property(nonatomic, readonly) NSUInteger capacity;
+
+/**
+ * Number of frames put in the uplink and downlink rings
+ */
+@property(nonatomic, readonly) uint64_t uplinkFrames;
+@property(nonatomic, readonly) uint64_t downlinkFrames;
+
+/**
+ * Number of uplink and downlink frames dropped because the handler fell behind and the ring was full
+ */
+@property(nonatomic, readonly) uint64_t uplinkOverflows;
+@property(nonatomic, readonly) uint64_t downlinkOverflows;
+
+/**
+ * The most frames that have waited in either ring
+ */
+@property(nonatomic, readonly) NSUInteger maxDepth;
+
+/**
+ * Fraction of the frames the bridge offered, in both directions, that were dropped
+ */
+@property(nonatomic, readonly) double overflowRatio;
+
+- (instancetype _Nonnull)initWithCapacity:(NSUInteger)capacity
+                             uplinkFrames:(uint64_t)uplinkFrames
+                           downlinkFrames:(uint64_t)downlinkFrames
+                          uplinkOverflows:(uint64_t)uplinkOverflows
+                        downlinkOverflows:(uint64_t)downlinkOverflows
+                                 maxDepth:(NSUInteger)maxDepth;
+
+@end
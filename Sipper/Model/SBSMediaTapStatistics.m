@@ -0,0 +1,37 @@
+//
+//  SBSMediaTapStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSMediaTapStatistics.h"
+
+@implementation SBSMediaTapStatistics
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+                    uplinkFrames:(uint64_t)uplinkFrames
+                  downlinkFrames:(uint64_t)downlinkFrames
+                 uplinkOverflows:(uint64_t)uplinkOverflows
+               downlinkOverflows:(uint64_t)downlinkOverflows
+                        maxDepth:(NSUInteger)maxDepth {
+  if (self = [super init]) {
+    _capacity = capacity;
+    _uplinkFrames = uplinkFrames;
+    _downlinkFrames = downlinkFrames;
+    _uplinkOverflows = uplinkOverflows;
+    _downlinkOverflows = downlinkOverflows;
+    _maxDepth = maxDepth;
+  }
+
+  return self;
+}
+
+- (double)overflowRatio {
+  uint64_t overflows = _uplinkOverflows + _downlinkOverflows;
+  uint64_t offered = _uplinkFrames + _downlinkFrames + overflows;
+  return offered > 0 ? (double) overflows / offered : 0;
+}
+
+@end
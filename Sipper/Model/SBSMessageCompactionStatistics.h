@@ -0,0 +1,65 @@
+//
+//  SBSMessageCompactionStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of the endpoint's SIP message compaction counters since the endpoint was started
+ */
+@interface SBSMessageCompactionStatistics : NSObject
+
+/**
+ * Number of outgoing messages with an SDP body that were compacted
+ */
+@property(nonatomic, readonly) NSUInteger messages;
+
+/**
+ * Number of messages that were over the size budget, and had candidates trimmed
+ */
+@property(nonatomic, readonly) NSUInteger trimmed;
+
+/**
+ * Number of messages that were still over the size budget once nothing else could be trimmed
+ */
+@property(nonatomic, readonly) NSUInteger overBudget;
+
+/**
+ * Number of formats removed because their codec had been disabled
+ */
+@property(nonatomic, readonly) NSUInteger formats;
+
+/**
+ * Number of redundant rtpmap and a=rtcp attributes removed
+ */
+@property(nonatomic, readonly) NSUInteger attributes;
+
+/**
+ * Number of ICE candidates trimmed to fit the size budget
+ */
+@property(nonatomic, readonly) NSUInteger candidates;
+
+/**
+ * Number of bytes removed from SDP bodies
+ */
+@property(nonatomic, readonly) NSUInteger bytesSaved;
+
+/**
+ * Size of the largest message sent, in bytes
+ */
+@property(nonatomic, readonly) NSUInteger largest;
+
+- (instancetype _Nonnull)initWithMessages:(NSUInteger)messages
+                                  trimmed:(NSUInteger)trimmed
+                               overBudget:(NSUInteger)overBudget
+                                  formats:(NSUInteger)formats
+                               attributes:(NSUInteger)attributes
+                               candidates:(NSUInteger)candidates
+                               bytesSaved:(NSUInteger)bytesSaved
+                                  largest:(NSUInteger)largest;
+
+@end
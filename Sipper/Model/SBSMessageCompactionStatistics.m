@@ -0,0 +1,35 @@
+//
+//  SBSMessageCompactionStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSMessageCompactionStatistics.h"
+
+@implementation SBSMessageCompactionStatistics
+
+- (instancetype)initWithMessages:(NSUInteger)messages
+                         trimmed:(NSUInteger)trimmed
+                      overBudget:(NSUInteger)overBudget
+                         formats:(NSUInteger)formats
+                      attributes:(NSUInteger)attributes
+                      candidates:(NSUInteger)candidates
+                      bytesSaved:(NSUInteger)bytesSaved
+                         largest:(NSUInteger)largest {
+  if (self = [super init]) {
+    _messages = messages;
+    _trimmed = trimmed;
+    _overBudget = overBudget;
+    _formats = formats;
+    _attributes = attributes;
+    _candidates = candidates;
+    _bytesSaved = bytesSaved;
+    _largest = largest;
+  }
+
+  return self;
+}
+
+@end
@@ -0,0 +1,59 @@
+//
+//  SBSRegistrationMetrics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/12/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of the endpoint's registration scheduler
+ */
+@interface SBSRegistrationMetrics : NSObject
+
+/**
+ * Number of REGISTER requests that have been sent by the scheduler
+ */
+@property(nonatomic, readonly) NSUInteger registrationsSent;
+
+/**
+ * Number of retries that were scheduled after a failed or lost registration
+ */
+@property(nonatomic, readonly) NSUInteger retriesScheduled;
+
+/**
+ * Number of registrations that became due while the in-flight limit was reached, and had to wait
+ */
+@property(nonatomic, readonly) NSUInteger registrationsDeferred;
+
+/**
+ * Number of registrations that never reported a result, and were assumed lost
+ */
+@property(nonatomic, readonly) NSUInteger registrationsTimedOut;
+
+/**
+ * Number of REGISTER requests currently awaiting a response
+ */
+@property(nonatomic, readonly) NSUInteger inFlight;
+
+/**
+ * The highest number of REGISTER requests that were ever in flight at once
+ */
+@property(nonatomic, readonly) NSUInteger peakInFlight;
+
+/**
+ * Number of registrations waiting to be sent
+ */
+@property(nonatomic, readonly) NSUInteger pending;
+
+- (instancetype _Nonnull)initWithRegistrationsSent:(NSUInteger)registrationsSent
+                                  retriesScheduled:(NSUInteger)retriesScheduled
+                             registrationsDeferred:(NSUInteger)registrationsDeferred
+                             registrationsTimedOut:(NSUInteger)registrationsTimedOut
+                                          inFlight:(NSUInteger)inFlight
+                                      peakInFlight:(NSUInteger)peakInFlight
+                                           pending:(NSUInteger)pending;
+
+@end
@@ -0,0 +1,33 @@
+//
+//  SBSRegistrationMetrics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/12/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSRegistrationMetrics.h"
+
+@implementation SBSRegistrationMetrics
+
+- (instancetype)initWithRegistrationsSent:(NSUInteger)registrationsSent
+                         retriesScheduled:(NSUInteger)retriesScheduled
+                    registrationsDeferred:(NSUInteger)registrationsDeferred
+                    registrationsTimedOut:(NSUInteger)registrationsTimedOut
+                                 inFlight:(NSUInteger)inFlight
+                             peakInFlight:(NSUInteger)peakInFlight
+                                  pending:(NSUInteger)pending {
+  if (self = [super init]) {
+    _registrationsSent = registrationsSent;
+    _retriesScheduled = retriesScheduled;
+    _registrationsDeferred = registrationsDeferred;
+    _registrationsTimedOut = registrationsTimedOut;
+    _inFlight = inFlight;
+    _peakInFlight = peakInFlight;
+    _pending = pending;
+  }
+
+  return self;
+}
+
+@end
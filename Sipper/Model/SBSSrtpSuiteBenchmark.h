@@ -0,0 +1,47 @@
+//
+//  SBSSrtpSuiteBenchmark.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * What one SRTP crypto suite measured as costing when the endpoint started
+ */
+@interface SBSSrtpSuiteBenchmark : NSObject
+
+/**
+ * Name of the suite, as it appears in a=crypto attributes
+ */
+@property(nonatomic, readonly, nonnull) NSString *suite;
+
+/**
+ * Length of the master key, in bits
+ */
+@property(nonatomic, readonly) NSUInteger keyLength;
+
+/**
+ * Length of the RTP authentication tag, in bits
+ */
+@property(nonatomic, readonly) NSUInteger tagLength;
+
+/**
+ * Average time to protect a 20 ms audio packet, in nanoseconds
+ */
+@property(nonatomic, readonly) NSUInteger protectTime;
+
+/**
+ * Average time to unprotect a 20 ms audio packet, in nanoseconds
+ */
+@property(nonatomic, readonly) NSUInteger unprotectTime;
+
+- (instancetype _Nonnull)initWithSuite:(NSString *_Nonnull)suite
+                             keyLength:(NSUInteger)keyLength
+                             tagLength:(NSUInteger)tagLength
+                           protectTime:(NSUInteger)protectTime
+                         unprotectTime:(NSUInteger)unprotectTime;
+
+@end
@@ -0,0 +1,29 @@
+//
+//  SBSSrtpSuiteBenchmark.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSSrtpSuiteBenchmark.h"
+
+@implementation SBSSrtpSuiteBenchmark
+
+- (instancetype)initWithSuite:(NSString *)suite
+                    keyLength:(NSUInteger)keyLength
+                    tagLength:(NSUInteger)tagLength
+                  protectTime:(NSUInteger)protectTime
+                unprotectTime:(NSUInteger)unprotectTime {
+  if (self = [super init]) {
+    _suite = suite;
+    _keyLength = keyLength;
+    _tagLength = tagLength;
+    _protectTime = protectTime;
+    _unprotectTime = unprotectTime;
+  }
+
+  return self;
+}
+
+@end
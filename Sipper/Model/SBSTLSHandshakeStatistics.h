@@ -0,0 +1,35 @@
+//
+//  SBSTLSHandshakeStatistics.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/11/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A snapshot of the TLS handshakes performed by SIP-over-TLS transports since the endpoint was started
+ */
+@interface SBSTLSHandshakeStatistics : NSObject
+
+/**
+ * Number of handshakes that negotiated a brand new session
+ */
+@property(nonatomic, readonly) NSUInteger fullHandshakes;
+
+/**
+ * Number of handshakes that resumed a cached session
+ */
+@property(nonatomic, readonly) NSUInteger resumedHandshakes;
+
+/**
+ * Number of sessions currently held in the session cache
+ */
+@property(nonatomic, readonly) NSUInteger cachedSessions;
+
+- (instancetype _Nonnull)initWithFullHandshakes:(NSUInteger)fullHandshakes
+                              resumedHandshakes:(NSUInteger)resumedHandshakes
+                                 cachedSessions:(NSUInteger)cachedSessions;
+
+@end
@@ -0,0 +1,25 @@
+//
+//  SBSTLSHandshakeStatistics.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/11/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSTLSHandshakeStatistics.h"
+
+@implementation SBSTLSHandshakeStatistics
+
+- (instancetype)initWithFullHandshakes:(NSUInteger)fullHandshakes
+                     resumedHandshakes:(NSUInteger)resumedHandshakes
+                        cachedSessions:(NSUInteger)cachedSessions {
+  if (self = [super init]) {
+    _fullHandshakes = fullHandshakes;
+    _resumedHandshakes = resumedHandshakes;
+    _cachedSessions = cachedSessions;
+  }
+
+  return self;
+}
+
+@end
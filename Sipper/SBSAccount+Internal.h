@@ -13,7 +13,9 @@
 #import <pjsua.h>
 
 @class SBSAccountConfiguration;
+@class SBSCall;
 @class SBSEndpoint;
+@class SBSMediaTransportPool;
 
 @interface SBSAccount ()
 
@@ -22,6 +24,21 @@
  */
 @property(nonatomic) pjsua_acc_id accountId;
 
+/**
+ * Pre-gathered media transports for the account's next calls
+ */
+@property(nonatomic, strong, readonly, nonnull) SBSMediaTransportPool *mediaTransportPool;
+
+/**
+ * Sends a REGISTER for the account right away
+ *
+ * This is invoked by the endpoint's registration scheduler on the background thread. Everything else should go
+ * through the scheduler rather than calling this directly.
+ *
+ * @return NO if the request could not be sent
+ */
+- (BOOL)sendRegistration;
+
 /**
  * Invoked once we've started a registration attempt with PJSUA
  *
@@ -58,6 +75,38 @@
  */
 - (void)handleTransportStateChange:(pjsip_transport *_Nonnull)transport state:(pjsip_transport_state)state info:(const pjsip_transport_state_info *_Nonnull)info;
 
+/**
+ * Replaces the account's warm media transports with ones gathered on the current network
+ */
+- (void)refreshMediaTransports;
+
+/**
+ * Hands one of the account's warm media transports to a call, and starts gathering its replacement
+ *
+ * This is invoked by PJSUA, with its lock held, right before it would create the call's media transport. When the
+ * account trickles ICE candidates and no warm transport is ready, a new one is returned before it has finished
+ * gathering.
+ *
+ * @param callMedia the pjsua_call_media that will use the transport
+ * @return a transport, or NULL if PJSUA should create one
+ */
+- (pjmedia_transport *_Nullable)acquireMediaTransportForCallMedia:(void *_Nonnull)callMedia;
+
+/**
+ * Closes the account's warm media transports. This must be invoked on the endpoint's background thread.
+ */
+- (void)drainMediaTransports;
+
+/**
+ * Moves the account's registration and calls over to new transports after a reachability change
+ *
+ * This must be invoked on the endpoint's background thread. The registration is refreshed and every call is
+ * re-invited in the same pass, without waiting on any responses, so that all flows are re-established in parallel.
+ *
+ * @return the calls that were successfully re-invited
+ */
+- (NSArray<SBSCall *> *_Nonnull)handleTransportFailover;
+
 /**
  * Attempts to create a new account and returns the account instance
  *
@@ -200,6 +200,25 @@ typedef NS_ENUM(NSInteger, SBSAccountError) {
  */
 - (void)handleReachabilityChange;
 
+/**
+ * Prepares media transports for upcoming calls on this account
+ *
+ * Gathering ICE candidates (host addresses, STUN and TURN) normally happens after a call is placed or received, and
+ * holds up the INVITE or the answer until it's done. Warming gathers them ahead of time, for example when the dialer
+ * is opened, and the next calls on this account use the prepared transports right away. Used transports are
+ * replaced, and all of them are gathered again when reachability changes, until the pool is cooled down.
+ *
+ * Warm transports keep their STUN bindings alive, so only keep them around while a call is likely.
+ *
+ * @param count the number of transports to keep ready, usually 1
+ */
+- (void)warmMediaTransports:(NSUInteger)count;
+
+/**
+ * Closes all prepared media transports. Calls will gather their own candidates again.
+ */
+- (void)coolMediaTransports;
+
 /**
  * Creates a new call to the requested target destination
  *
@@ -14,7 +14,12 @@
 #import "SBSAccountConfiguration.h"
 #import "SBSCall+Internal.h"
 #import "SBSEndpoint.h"
+#import "SBSEndpoint+Internal.h"
 #import "SBSEndpointConfiguration.h"
+#import "SBSEventDelivery.h"
+#import "SBSKeepAliveService.h"
+#import "SBSMediaTransportPool.h"
+#import "SBSRegistrationScheduler.h"
 #import "SBSSipURI.h"
 
 static NSString *const AccountErrorDomain = @"sipper.account.error";
@@ -40,6 +45,7 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
     _configuration = configuration;
     _registrationState = SBSAccountRegistrationStateDisabled;
     _registrationsEnabled = false;
+    _mediaTransportPool = [[SBSMediaTransportPool alloc] initWithAccountId:accountId];
     
     [self prepare];
   }
@@ -66,6 +72,22 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
     return;
   }
   
+  _registrationsEnabled = true;
+  
+  // Hand the registration to the endpoint's scheduler, which limits how many are in flight at once
+  NSNumber *accountId = @(_accountId);
+  [self.endpoint performAsync:^{
+    [self.endpoint.registrationScheduler scheduleRegistration:accountId after:0 jitter:0];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)sendRegistration {
+  if (!_registrationsEnabled) {
+    return YES;
+  }
+  
   pj_status_t status = pjsua_acc_set_registration(_accountId, PJ_TRUE);
   if (status != PJ_SUCCESS) {
     NSError *error = [NSError ErrorWithUnderlying:nil
@@ -74,12 +96,16 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
                                       errorDomain:AccountErrorDomain
                                         errorCode:SBSAccountErrorCannotRegister];
     
-    if ([self.delegate respondsToSelector:@selector(account:registrationDidFailWithError:)]) {
-      [self.delegate account:self registrationDidFailWithError:error];
-    }
+    [self.endpoint.eventDelivery deliver:^{
+      if ([self.delegate respondsToSelector:@selector(account:registrationDidFailWithError:)]) {
+        [self.delegate account:self registrationDidFailWithError:error];
+      }
+    }];
+    
+    return NO;
   }
   
-  _registrationsEnabled = true;
+  return YES;
 }
 
 //------------------------------------------------------------------------------
@@ -89,6 +115,13 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
     return;
   }
   
+  // Make sure nothing that's still scheduled re-registers us
+  NSNumber *accountId = @(_accountId);
+  [self.endpoint performAsync:^{
+    [self.endpoint.registrationScheduler cancelRegistration:accountId];
+    [self.endpoint.keepAliveService removeDatagramFlowForKey:accountId];
+  }];
+  
   pj_status_t status = pjsua_acc_set_registration(_accountId, PJ_FALSE);
   if (status != PJ_SUCCESS) {
     NSError *error = [NSError ErrorWithUnderlying:nil
@@ -150,6 +183,102 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
 
 //------------------------------------------------------------------------------
 
+- (void)warmMediaTransports:(NSUInteger)count {
+  [self.endpoint performAsync:^{
+    _mediaTransportPool.capacity = count;
+    [_mediaTransportPool fill];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)coolMediaTransports {
+  [self.endpoint performAsync:^{
+    _mediaTransportPool.capacity = 0;
+    [_mediaTransportPool drain];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)refreshMediaTransports {
+  [self.endpoint performAsync:^{
+    if (_mediaTransportPool.capacity == 0) {
+      return;
+    }
+    
+    // Host and server reflexive candidates from the old network are useless now
+    [_mediaTransportPool drain];
+    [_mediaTransportPool fill];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (pjmedia_transport *)acquireMediaTransportForCallMedia:(void *)callMedia {
+  pjmedia_transport *transport = NULL;
+  
+  if (_mediaTransportPool.capacity > 0) {
+    transport = [_mediaTransportPool takeTransportForCallMedia:callMedia];
+    
+    // Gathering takes a while, so the replacement is started outside of PJSUA's lock
+    [self.endpoint performAsync:^{
+      [_mediaTransportPool fill];
+    }];
+  }
+  
+  // With trickle, the call goes ahead with whatever candidates are ready instead of waiting for the rest
+  if (transport == NULL && _configuration.trickleIce) {
+    transport = [_mediaTransportPool createTransportForCallMedia:callMedia];
+  }
+  
+  return transport;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)drainMediaTransports {
+  [_mediaTransportPool drain];
+}
+
+//------------------------------------------------------------------------------
+
+- (NSArray<SBSCall *> *)handleTransportFailover {
+  
+  // Refresh the registration so the registrar learns about the new flow
+  if (_registrationsEnabled) {
+    pj_status_t status = pjsua_acc_set_registration(_accountId, PJ_TRUE);
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to refresh registration during transport failover: %d", status);
+    }
+  }
+  
+  NSArray<SBSCall *> *calls;
+  @synchronized (_calls) {
+    calls = [_calls allObjects];
+  }
+  
+  // Re-invite every active call right away. There's no need to wait for the registration (or for each other),
+  // since the re-INVITEs are in-dialog and will be queued on the new connection while it's being set up.
+  NSMutableArray<SBSCall *> *reinvited = [[NSMutableArray alloc] init];
+  for (SBSCall *call in calls) {
+    if (call.state != SBSCallStateActive) {
+      continue;
+    }
+    
+    pj_status_t status = [call reinviteWithFlags:PJSUA_CALL_REINIT_MEDIA | PJSUA_CALL_UPDATE_CONTACT];
+    if (status == PJ_SUCCESS) {
+      [reinvited addObject:call];
+    } else {
+      NSLog(@"Failed to re-invite call %d during transport failover: %d", call.callId, status);
+    }
+  }
+  
+  return [reinvited copy];
+}
+
+//------------------------------------------------------------------------------
+
 - (SBSCall *)callWithDestination:(NSString *)destination headers:(NSDictionary<NSString *, NSString *> *_Nullable)headers {
   return [self callWithDestination:destination headers:headers start:YES];
 }
@@ -176,11 +305,11 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
   }
   
   // Schedule a delegate call to inform of the new call
-  dispatch_async(dispatch_get_main_queue(), ^{
+  [self.endpoint.eventDelivery deliver:^{
     if ([self.delegate respondsToSelector:@selector(account:didMakeOutgoingCall:)]) {
       [self.delegate account:self didMakeOutgoingCall:call];
     }
-  });
+  }];
   
   // Return the newly created call so the UI can update immediately
   return call;
@@ -205,6 +334,15 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
 - (void)handleRegistrationStarted:(pjsua_reg_info *)info {
   pjsip_regc_info regc_info;
   pjsip_regc_get_info(info->regc, &regc_info);
+  
+  // PJSUA refreshes registrations on its own timer, so tell the scheduler about them. Those it sent are already
+  // in flight.
+  if (info->renew) {
+    NSNumber *accountId = @(_accountId);
+    [self.endpoint performAsync:^{
+      [self.endpoint.registrationScheduler startRegistration:accountId];
+    }];
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -224,11 +362,11 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
                                       errorDomain:AccountErrorDomain
                                         errorCode:SBSAccountErrorCannotRegister];
     
-    dispatch_async(dispatch_get_main_queue(), ^{
+    [self.endpoint.eventDelivery deliver:^{
       if ([self.delegate respondsToSelector:@selector(account:registrationDidFailWithError:)]) {
         [self.delegate account:self registrationDidFailWithError:error];
       }
-    });
+    }];
     
     // Here, we're still pending on registration
   } else if (PJSIP_IS_STATUS_IN_CLASS(registration_status, 100) || PJSIP_IS_STATUS_IN_CLASS(registration_status, 300)) {
@@ -247,22 +385,53 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
     _registrationState = SBSAccountRegistrationStateInactive;
   }
   
-  // Now, if we're inactive but registrations are enabled, re-registration
-  if (_registrationState == SBSAccountRegistrationStateInactive && _registrationsEnabled) {
-    NSLog(@"Received inactive registration state while registrations enabled, re-sending registration");
-    pj_status_t status = pjsua_acc_set_registration(_accountId, PJ_TRUE);
-    if (status != PJ_SUCCESS) {
-      NSError *error = [NSError ErrorWithUnderlying:nil
-                            localizedDescriptionKey:NSLocalizedString(@"Could not register account", nil)
-                        localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
-                                        errorDomain:AccountErrorDomain
-                                          errorCode:SBSAccountErrorCannotRegister];
+  // Let the scheduler know this registration is done, so it can free up the slot and back off if it failed.
+  // Rather than re-registering immediately (which turns a registrar blip into a storm when there are many
+  // accounts), losing the registration or failing to register schedules a jittered retry.
+  BOOL finished = params->status != PJ_SUCCESS || registration_status >= 200;
+  BOOL failed = params->status != PJ_SUCCESS || registration_status >= 300;
+  BOOL lost = _registrationState == SBSAccountRegistrationStateInactive;
+  BOOL success = finished && !failed && !lost;
+  NSTimeInterval maxDelay = _configuration.sipRegistrationRetryTimeout;
+  
+  if (finished) {
+    NSNumber *accountId = @(_accountId);
+    [self.endpoint performAsync:^{
+      SBSRegistrationScheduler *scheduler = self.endpoint.registrationScheduler;
+      [scheduler completeRegistration:accountId success:success];
+      
+      if (!_registrationsEnabled || success) {
+        return;
+      }
       
-      dispatch_async(dispatch_get_main_queue(), ^{
-        if ([self.delegate respondsToSelector:@selector(account:registrationDidFailWithError:)]) {
-          [self.delegate account:self registrationDidFailWithError:error];
-        }
-      });
+      if (lost) {
+        NSLog(@"Received inactive registration state while registrations enabled, scheduling registration");
+      }
+      
+      // Without a configured limit, the scheduler backs off to its default one
+      [scheduler scheduleRetry:accountId maxDelay:maxDelay];
+    }];
+  }
+  
+  // Keep the UDP flow to the registrar open from the shared keep-alive timer, sending to wherever the response
+  // came from just like PJSUA's own keep-alive would
+  pjsip_rx_data *rdata = params->rdata;
+  if (success && rdata != NULL && self.endpoint.configuration.keepAliveInterval > 0) {
+    pjsip_transport *transport = rdata->tp_info.transport;
+    unsigned flag = pjsip_transport_get_flag_from_type((pjsip_transport_type_e) transport->key.type);
+    
+    if (flag & PJSIP_TRANSPORT_DATAGRAM) {
+      NSNumber *accountId = @(_accountId);
+      pj_sockaddr destination = rdata->pkt_info.src_addr;
+      int length = rdata->pkt_info.src_addr_len;
+      
+      // The rdata is gone by the time the block runs, so hold on to the transport until it does
+      pjsip_transport_add_ref(transport);
+      [self.endpoint performAsync:^{
+        pj_sockaddr address = destination;
+        [self.endpoint.keepAliveService addDatagramFlow:transport destination:&address length:length forKey:accountId];
+        pjsip_transport_dec_ref(transport);
+      }];
     }
   }
   
@@ -270,11 +439,11 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
   if (_registrationState != previousState) {
     
     // Fire the delegate handler
-    dispatch_async(dispatch_get_main_queue(), ^{
+    [self.endpoint.eventDelivery deliver:^{
       if ([self.delegate respondsToSelector:@selector(account:registrationDidChangeState:withStatusCode:)]) {
         [self.delegate account:self registrationDidChangeState:_registrationState withStatusCode:registration_status];
       }
-    });
+    }];
   }
 }
 
@@ -289,13 +458,13 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
   }
   
   // Invoke the delegate - ringtone may change after this so we call ring isndoe the delegate handler
-  dispatch_async(dispatch_get_main_queue(), ^{
+  [self.endpoint.eventDelivery deliver:^{
     if ([self.delegate respondsToSelector:@selector(account:didReceiveIncomingCall:)]) {
       [self.delegate account:self didReceiveIncomingCall:call];
     }
     
     [call ring];
-  });
+  }];
 }
 
 //------------------------------------------------------------------------------
@@ -353,8 +522,18 @@ static NSString *const AccountErrorDomain = @"sipper.account.error";
   config->register_on_acc_add = false;
   config->publish_enabled = configuration.sipPublishEnabled ? PJ_TRUE : PJ_FALSE;
   config->reg_timeout = (int) configuration.sipRegistrationLifetime;
-  config->reg_retry_interval = (int) configuration.sipRegistrationRetryTimeout;
+  config->reg_retry_interval = 0;
+  
+  // Retries are handled by the endpoint's registration scheduler, and refreshes are jittered so that accounts
+  // which registered together drift apart
+  unsigned refresh_jitter = (unsigned) MIN(endpoint.configuration.registrationRefreshJitter, configuration.sipRegistrationLifetime / 2);
+  config->reg_delay_before_refresh = PJSIP_REGISTER_CLIENT_DELAY_BEFORE_REFRESH + (refresh_jitter > 0 ? arc4random_uniform(refresh_jitter) : 0);
   config->use_rfc5626 = true;
+  
+  // The endpoint's shared keep-alive timer takes care of the UDP flow when it's enabled
+  if (endpoint.configuration.keepAliveInterval > 0) {
+    config->ka_interval = 0;
+  }
   config->use_srtp = [self convertSrtpPolicy:configuration.secureMediaPolicy];
   config->ipv6_media_use = PJSUA_IPV6_ENABLED;
   config->media_stun_use = PJSUA_STUN_USE_DEFAULT;
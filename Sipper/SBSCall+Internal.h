@@ -13,6 +13,20 @@
 
 #import <pjsua.h>
 
+#import "pj_call_trace.h"
+
+/**
+ * The call control actions, which the endpoint can perform on many calls at once
+ */
+typedef NS_ENUM(NSInteger, SBSCallControl) {
+  SBSCallControlAnswer,
+  SBSCallControlHangup,
+  SBSCallControlHold,
+  SBSCallControlUnhold,
+  SBSCallControlReinvite,
+  SBSCallControlRefer
+};
+
 @interface SBSCall ()
 
 /**
@@ -20,6 +34,11 @@
  */
 @property(nonatomic) pjsua_call_id callId;
 
+/**
+ * The trace the call's setup is recorded in, or 0 if the endpoint isn't tracing calls
+ */
+@property(nonatomic, readonly) pj_call_trace_id traceId;
+
 /**
  * Creates a new instance of a call wrapper from the incoming PJSIP call
  *
@@ -49,6 +68,32 @@
  */
 - (void)ring;
 
+/**
+ * Sends a re-INVITE for the call with a single audio stream
+ *
+ * Unlike reinviteWithCallback:, this runs synchronously and must be invoked on the endpoint's background thread.
+ *
+ * @param flags the pjsua_call_flag values to send the re-INVITE with
+ * @return the PJSIP status of the request
+ */
+- (pj_status_t)reinviteWithFlags:(unsigned)flags;
+
+/**
+ * Attaches the call to a PJSIP call, and reconciles its state with it
+ *
+ * @param callId the PJSIP call
+ */
+- (void)attachCall:(pjsua_call_id)callId;
+
+/**
+ * Ends the call, whatever state it's in, and detaches it from its PJSIP call
+ *
+ * The call is recorded if the endpoint keeps call records, and the end event is fired with the error.
+ *
+ * @param error the reason the call ended, or nil if it ended normally
+ */
+- (void)endCallWithError:(NSError *_Nullable)error;
+
 /**
  * Invoked when the call state changes
  *
@@ -66,6 +111,14 @@
  */
 - (void)handleCallMediaStateChange;
 
+/**
+ * Invoked when the call's ICE transport has finished gathering candidates after the call started
+ *
+ * Only calls that trickle ICE candidates get this. The candidates that weren't in the call's offer or answer are
+ * sent to the remote once it's known to support trickling, and the dialog allows it.
+ */
+- (void)handleLocalCandidatesGathered;
+
 /**
  * Invoked when a call's transaction state changes
  *
@@ -86,6 +139,48 @@
  */
 - (void)handleTransportStateChange:(pjsip_transport *_Nonnull)transport state:(pjsip_transport_state)state info:(const pjsip_transport_state_info *_Nonnull)info;
 
+/**
+ * Performs a call control action right away
+ *
+ * This must be called on the endpoint's background thread.
+ *
+ * @param control  the action to perform
+ * @param code     the status code to answer or hang up with
+ * @param argument the destination to refer the call to
+ * @return the reason the action couldn't be performed, or nil if it was
+ */
+- (NSError *_Nullable)performControl:(SBSCallControl)control status:(SBSStatusCode)code argument:(NSString *_Nullable)argument;
+
+@end
+
+@interface SBSCallEvent ()
+
+/**
+ * Creates a new event for a call
+ */
++ (SBSCallEvent *_Nonnull)eventWithName:(NSString *_Nonnull)name call:(SBSCall *_Nonnull)call;
+
+/**
+ * Points a pooled event at the call it's dispatched for next, or at no call while it waits to be reused
+ */
+- (void)reuseWithCall:(SBSCall *_Nullable)call;
+
+@end
+
+@interface SBSCallReceivedMessageEvent ()
+
++ (SBSCallReceivedMessageEvent *_Nonnull)eventWithName:(NSString *_Nonnull)name call:(SBSCall *_Nonnull)call message:(SBSSipMessage *_Nonnull)message;
+
+- (void)reuseWithCall:(SBSCall *_Nullable)call message:(SBSSipMessage *_Nullable)message;
+
+@end
+
+@interface SBSCallTransactionStateChangeEvent ()
+
++ (SBSCallTransactionStateChangeEvent *_Nonnull)eventWithName:(NSString *_Nonnull)name call:(SBSCall *_Nonnull)call method:(NSString *_Nonnull)method state:(SBSCallTransactionState)state error:(NSError *_Nullable)error;
+
+- (void)reuseWithCall:(SBSCall *_Nullable)call method:(NSString *_Nullable)method state:(SBSCallTransactionState)state error:(NSError *_Nullable)error;
+
 @end
 
 #endif
@@ -10,9 +10,11 @@
 
 @class SBSAccount;
 @class SBSCall;
+@class SBSCallFuture;
 @class SBSEndpoint;
 @class SBSEventBinding;
 @class SBSMediaDescription;
+@class SBSMediaTapStatistics;
 @class SBSNameAddressPair;
 @class SBSRingtone;
 @class SBSSipMessage;
@@ -135,6 +137,20 @@ typedef NS_ENUM(NSInteger, SBSCallDirection) {
   SBSCallDirectionInbound
 };
 
+/**
+ *  The sides of a call's audio that a media tap sees
+ */
+typedef NS_ENUM(NSInteger, SBSMediaTapDirection) {
+  /**
+   *  Audio sent to the remote, from the microphone
+   */
+  SBSMediaTapDirectionUplink,
+  /**
+   *  Audio received from the remote
+   */
+  SBSMediaTapDirectionDownlink
+};
+
 /**
  *  Possible errors the call can return.
  */
@@ -174,7 +190,11 @@ typedef NS_ENUM(NSInteger, SBSCallError) {
   /**
    *  Unable to send a re-invite for the call
    */
-  SBSCallErrorCannotReinvite
+  SBSCallErrorCannotReinvite,
+  /**
+   *  Unable to start tapping the call's media
+   */
+  SBSCallErrorCannotTapMedia
 };
 
 #pragma mark - Events
@@ -250,6 +270,28 @@ typedef void (^SBSCallEventListener)(SBSCallEvent * _Nonnull);
 
 typedef void (^SBSActionCallbackBlock)(BOOL successful, NSError * _Nullable);
 
+/**
+ * Receives a frame of a call's audio from its media tap
+ *
+ * The samples are 16 bit, at the conference bridge's sample rate and interleaved at its channel count, and point into
+ * the tap's ring. They're only valid until the handler returns, so anything that outlives it has to copy them.
+ *
+ * @param direction    which side of the call the frame is from
+ * @param samples      the frame's samples
+ * @param sampleCount  the number of samples, of all channels
+ * @param channelCount the number of channels the samples are interleaved across
+ * @param sampleRate   the bridge's sample rate
+ * @param silent       whether the bridge had no audio for that side, in which case the samples are silence
+ * @param sequence     the frame's number on its side, which skips any frames that were dropped
+ */
+typedef void (^SBSMediaTapHandler)(SBSMediaTapDirection direction,
+                                   const int16_t *_Nonnull samples,
+                                   NSUInteger sampleCount,
+                                   NSUInteger channelCount,
+                                   NSUInteger sampleRate,
+                                   BOOL silent,
+                                   uint64_t sequence);
+
 #pragma mark - Call
 
 @interface SBSCall : NSObject
@@ -276,6 +318,8 @@ typedef void (^SBSActionCallbackBlock)(BOOL successful, NSError * _Nullable);
 
 /**
  * Controls if media for the current call should be muted or not
+ *
+ * The change is made on the endpoint's thread, and a mute state change event is dispatched once it has been.
  */
 @property (nonatomic) BOOL muted;
 
@@ -334,6 +378,13 @@ typedef void (^SBSActionCallbackBlock)(BOOL successful, NSError * _Nullable);
  */
 @property(strong, nonatomic, nullable, readonly) NSDate *completedAt;
 
+/**
+ * Counters for the call's media tap, or for the last one once it has stopped
+ *
+ * This is nil if the call's media was never tapped. Each access returns a new snapshot.
+ */
+@property(strong, nonatomic, nullable, readonly) SBSMediaTapStatistics *mediaTapStatistics;
+
 /**
  * Returns the value for a specific header on the call
  *
@@ -458,7 +509,7 @@ typedef void (^SBSActionCallbackBlock)(BOOL successful, NSError * _Nullable);
  * Sends the requested digits as DTMF tones
  *
  * Callers can pass any number of digits as a string to this method. Each digit will be sent individually
- * to the remote.
+ * to the remote, paced by the account's dtmfDuration and dtmfGap, after any digits that are still being sent.
  *
  * @param digits the digits to send to the remote
  * @param callback a callback that will be invoked when the DTMF is sent
@@ -473,6 +524,114 @@ typedef void (^SBSActionCallbackBlock)(BOOL successful, NSError * _Nullable);
  */
 - (void)referTo:(NSString *_Nullable)destination completion:(SBSActionCallbackBlock _Nullable)callback;
 
+#pragma mark - Futures
+
+/**
+ * Answers the call with a 200 OK status code
+ *
+ * @return a future that completes when the answer is sent
+ */
+- (SBSCallFuture *_Nonnull)answer;
+
+/**
+ * Answers the call with the requested status code
+ *
+ * @param code the status code to answer the call with
+ * @return a future that completes when the answer is sent
+ */
+- (SBSCallFuture *_Nonnull)answerWithStatus:(SBSStatusCode)code;
+
+/**
+ * Hangs up this call with a 603 Decline status code
+ *
+ * @return a future that completes when the call is hung up
+ */
+- (SBSCallFuture *_Nonnull)hangup;
+
+/**
+ * Hangs up this call with the requested status code
+ *
+ * @param code the status code to respond with
+ * @return a future that completes when the call is hung up
+ */
+- (SBSCallFuture *_Nonnull)hangupWithStatus:(SBSStatusCode)code;
+
+/**
+ * Places the call on hold
+ *
+ * @return a future that completes when the hold is sent
+ */
+- (SBSCallFuture *_Nonnull)hold;
+
+/**
+ * Unholds the call if it's currently on hold
+ *
+ * @return a future that completes when the call is reinvited
+ */
+- (SBSCallFuture *_Nonnull)unhold;
+
+/**
+ * Sends a re-invite to the active call
+ *
+ * @return a future that completes when the call is reinvited
+ */
+- (SBSCallFuture *_Nonnull)reinvite;
+
+/**
+ * Sends the requested digits as DTMF tones
+ *
+ * @param digits the digits to send to the remote
+ * @return a future that completes when the DTMF is sent
+ */
+- (SBSCallFuture *_Nonnull)sendDigits:(NSString *_Nullable)digits;
+
+/**
+ * Sends the requested digits as DTMF tones, reporting each digit as it's sent
+ *
+ * The digits are sent the way the account's dtmfMode says. Any character that isn't 0-9, *, #, or A-D fails the
+ * future without sending anything.
+ *
+ * @param digits   the digits to send to the remote
+ * @param progress invoked on the main queue with the index of each digit, once it and the gap after it have been sent
+ * @return a future that completes when the last digit is sent
+ */
+- (SBSCallFuture *_Nonnull)sendDigits:(NSString *_Nullable)digits progress:(void (^_Nullable)(NSUInteger index))progress;
+
+/**
+ * Sends a SIP REFER message to direct the call to the given destination
+ *
+ * @param destination the new destination to send the call to
+ * @return a future that completes when the REFER is sent
+ */
+- (SBSCallFuture *_Nonnull)referTo:(NSString *_Nullable)destination;
+
+/**
+ * Starts handing the call's audio, both what's sent and what's received, to a handler as it passes through the
+ * conference bridge
+ *
+ * Each frame is copied once into a ring for its direction, on the bridge's clock thread, and the handler is invoked
+ * with it in place on a thread of the tap's own. The bridge never waits for the handler: while a ring is full, the
+ * frames that don't fit are dropped and counted in mediaTapStatistics. A handler that can't keep up with real time
+ * should hand its frames off rather than do its work inline, and must never wait on the endpoint's thread.
+ *
+ * The tap follows the call's audio through re-INVITEs and holds, and stops when the call ends. Starting a tap
+ * replaces any the call already has.
+ *
+ * @param handler invoked with each frame, in order on each side
+ * @return a future that completes once the tap is on the bridge
+ */
+- (SBSCallFuture *_Nonnull)startMediaTapWithHandler:(SBSMediaTapHandler _Nonnull)handler;
+
+/**
+ * Stops the call's media tap, if it has one
+ *
+ * Frames that were already in its rings are still handed to the handler, on the tap's thread, and may be after the
+ * future completes. The handler may stop the tap itself.
+ *
+ * @return a future that completes once the tap is off the bridge
+ */
+- (SBSCallFuture *_Nonnull)stopMediaTap;
+
 /**
  * Adds a new target/action pair to the listeners for this call
  *
@@ -0,0 +1,1821 @@
+//
+// Created by Colin Morelli on 9/18/16.
+// Copyright (c) 2016 Sipper. All rights reserved.
+//
+
+#import "SBSCall+Internal.h"
+
+#import <pjsua.h>
+#include <pjsua-lib/pjsua_internal.h>
+
+#import "NSString+PJString.h"
+#import "NSError+SipperError.h"
+
+#import "SBSAccount.h"
+#import "SBSAccount+Internal.h"
+#import "SBSAccountConfiguration.h"
+#import "SBSBlockEventListener+Internal.h"
+#import "SBSCallEventPool.h"
+#import "SBSCallFuture+Internal.h"
+#import "SBSCallRecord.h"
+#import "SBSCallRecordStore.h"
+#import "SBSDtmfSender.h"
+#import "SBSEndpointConfiguration.h"
+#import "SBSEndpoint.h"
+#import "SBSEndpoint+Internal.h"
+#import "SBSEventDelivery.h"
+#import "SBSJitterBufferController.h"
+#import "SBSOpusController.h"
+#import "SBSMediaDescription.h"
+#import "SBSMediaTap.h"
+#import "SBSNameAddressPair.h"
+#import "SBSRingtonePlayer.h"
+#import "SBSSipRequestMessage.h"
+#import "SBSSipResponseMessage.h"
+#import "SBSSipUtilities+Internal.h"
+#import "SBSTargetActionEventListener+Internal.h"
+
+#import "call_state_machine.hpp"
+#import "pj_call_trace.h"
+#import "pj_cb_latency.h"
+#import "pj_cb_record.h"
+#import "pj_ice_trickle.h"
+
+static NSString *const CallErrorDomain = @"sipper.error.call";
+
+/**
+ * Frames each of a media tap's rings holds, which is a little over a second of 20ms frames
+ */
+static NSUInteger const MediaTapCapacity = 64;
+
+#pragma mark - Forward Declarations
+
+static sipper::call_input convertState(pjsip_inv_state);
+static SBSMediaState convertMediaState(pjsua_call_media_status);
+static SBSMediaType convertMediaType(pjmedia_type);
+static SBSMediaDirection convertMediaDirection(pjmedia_dir);
+static SBSCallTransactionState convertTransactionState(pjsip_tsx_state_e);
+static BOOL supportsTrickleIce(pjsip_msg *);
+
+// The state machine's states are read back as the public ones
+static_assert((int) sipper::call_state::active == SBSCallStateActive, "call states are in the same order");
+static_assert((int) sipper::hold_state::remote == SBSHoldStateRemote, "hold states are in the same order");
+
+#pragma mark - Events
+
+NSString *const SBSCallEventStateChange = @"call.state.changed";
+NSString *const SBSCallEventHoldStateChange = @"call.hold_state.changed";
+NSString *const SBSCallEventReceivedMessage = @"call.message.received";
+NSString *const SBSCallEventMuteStateChange = @"call.mute_state.changed";
+NSString *const SBSCallEventTransactionStateChange = @"call.transaction.state.changed";
+NSString *const SBSCallEventEnd = @"call.ended";
+
+@implementation SBSCallEvent
+
+- (instancetype)initWithEventName:(NSString *)name call:(SBSCall *)call {
+  if (self = [super initWithName:name]) {
+    _call = call;
+  }
+  
+  
+  return self;
+}
+
++ (SBSCallEvent *)eventWithName:(NSString *)name call:(SBSCall *)call {
+  return [[SBSCallEvent alloc] initWithEventName:name call:call];
+}
+
+- (void)reuseWithCall:(SBSCall *)call {
+  _call = call;
+}
+
+@end
+
+@implementation SBSCallReceivedMessageEvent
+
+- (instancetype)initWithEventName:(NSString *)name call:(SBSCall *)call message:(SBSSipMessage *)message {
+  if (self = [super initWithEventName:name call:call]) {
+    _message = message;
+  }
+  
+  return self;
+}
+
++ (SBSCallReceivedMessageEvent *)eventWithName:(NSString *)name call:(SBSCall *)call message:(SBSSipMessage *)message {
+  return [[SBSCallReceivedMessageEvent alloc] initWithEventName:name call:call message:message];
+}
+
+- (void)reuseWithCall:(SBSCall *)call message:(SBSSipMessage *)message {
+  [self reuseWithCall:call];
+  _message = message;
+}
+
+@end
+
+@implementation SBSCallMediaUpdatedEvent
+
+- (instancetype)initWithEventName:(NSString *)name call:(SBSCall *)call media:(NSArray<SBSMediaDescription *> *)media {
+  if (self = [super initWithEventName:name call:call]) {
+    _media = media;
+  }
+  
+  return self;
+}
+
++ (SBSCallMediaUpdatedEvent *)eventWithName:(NSString *)name call:(SBSCall *)call media:(NSArray<SBSMediaDescription *> *)media {
+  return [[SBSCallMediaUpdatedEvent alloc] initWithEventName:name call:call media:media];
+}
+
+@end
+
+@implementation SBSCallTransactionStateChangeEvent
+
+- (instancetype)initWithEventName:(NSString *)name call:(SBSCall *)call method:(NSString *)method state:(SBSCallTransactionState)state error:(NSError *)error {
+  if (self = [super initWithEventName:name call:call]) {
+    _method = method;
+    _state = state;
+    _error = error;
+  }
+  
+  return self;
+}
+
++ (SBSCallTransactionStateChangeEvent *)eventWithName:(NSString *)name call:(SBSCall *)call method:(NSString *)method state:(SBSCallTransactionState)state error:(NSError *)error {
+  return [[SBSCallTransactionStateChangeEvent alloc] initWithEventName:name call:call method:method state:state error:error];
+}
+
+- (void)reuseWithCall:(SBSCall *)call method:(NSString *)method state:(SBSCallTransactionState)state error:(NSError *)error {
+  [self reuseWithCall:call];
+  _method = method;
+  _state = state;
+  _error = error;
+}
+
+@end
+
+@implementation SBSCallEndedEvent
+
+- (instancetype)initWithEventName:(NSString *)name call:(SBSCall *)call error:(NSError *)error {
+  if (self = [super initWithEventName:name call:call]) {
+    _error = error;
+  }
+  
+  return self;
+}
+
++ (SBSCallEndedEvent *)eventWithName:(NSString *)name call:(SBSCall *)call error:(NSError *)error {
+  return [[SBSCallEndedEvent alloc] initWithEventName:name call:call error:error];
+}
+
+@end
+
+#pragma mark - Call
+
+@interface SBSCall ()
+
+@property (nonatomic, nullable) pjsip_transport *transport;
+@property (nonatomic, nonnull, strong) SBSEventDispatcher *dispatcher;
+@property (nonatomic, nullable, strong) SBSRingtonePlayer *player;
+@property (nonatomic, nullable, strong) NSError *error;
+@property (nonatomic, nonnull, strong) NSMutableDictionary<NSString *, NSString *> *allHeaders;
+@property (nonatomic, nonnull, strong) NSDictionary<NSString *, NSString *> *initialHeaders;
+@property (nonatomic, nullable, strong) SBSJitterBufferController *jitterBufferController;
+@property (nonatomic, nullable, strong) SBSOpusController *opusController;
+@property (nonatomic, nullable, strong) SBSDtmfSender *dtmfSender;
+@property (atomic, nullable, strong) SBSMediaTap *mediaTap;
+@property (nonatomic) BOOL ended;
+@property (nonatomic) BOOL remoteTrickleIce;
+@property (nonatomic) BOOL trickledCandidates;
+@property (nonatomic, nonnull, strong) NSMutableArray<NSString *> *remoteCandidateFragments;
+@property (nonatomic) NSInteger lastStatusCode;
+@property (nonatomic, nullable, strong) NSString *remoteInfo;
+@property (nonatomic, nullable, strong) NSString *codecName;
+@property (nonatomic) pj_call_trace_id traceId;
+@property (nonatomic) pj_uint64_t traceStartedAt;
+@property (nonatomic) pj_uint64_t traceMadeAt;
+@property (nonatomic) BOOL tracedMediaActive;
+
+@end
+
+@implementation SBSCall {
+  sipper::call_state_machine<> _machine;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initOutgoingWithEndpoint:(SBSEndpoint *)endpoint
+                                 account:(SBSAccount *)account
+                             destination:(NSString *)destination
+                                 headers:(NSDictionary<NSString *, NSString *> *)headers {
+  if (self = [super init]) {
+    _callId = -1;
+    _uuid = [NSUUID UUID];
+    _endpoint = endpoint;
+    _account = account;
+    _destination = destination;
+    _direction = SBSCallDirectionOutbound;
+    _initialHeaders = headers;
+    _allHeaders = [[NSMutableDictionary alloc] init];
+    _dispatcher = [[SBSEventDispatcher alloc] init];
+    _ended = NO;
+    _remoteCandidateFragments = [[NSMutableArray alloc] init];
+    [endpoint.eventDelivery countCall];
+    
+    [headers enumerateKeysAndObjectsUsingBlock:^(NSString * _Nonnull key, NSString * _Nonnull obj, BOOL * _Nonnull stop) {
+      [_allHeaders setObject:obj forKey:[key lowercaseString]];
+    }];
+  }
+  
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initIncomingWithEndpoint:(SBSEndpoint *)endpoint
+                                 account:(SBSAccount *)account
+                                  remote:(SBSNameAddressPair *)remote
+                                  callId:(pjsua_call_id)callId {
+  if (self = [super init]) {
+    _callId = -1;
+    _uuid = [NSUUID UUID];
+    _endpoint = endpoint;
+    _account = account;
+    _remote = remote;
+    _direction = SBSCallDirectionInbound;
+    _initialHeaders = nil;
+    _allHeaders = [[NSMutableDictionary alloc] init];
+    _dispatcher = [[SBSEventDispatcher alloc] init];
+    _ended = NO;
+    _remoteCandidateFragments = [[NSMutableArray alloc] init];
+    [endpoint.eventDelivery countCall];
+    
+    [self attachCall:callId];
+  }
+  
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)dealloc {
+  
+  // Clear out the reference to ourselves
+  if (_callId >= 0) {
+    
+    // Check if we were de-alloced before the call ended, in which case let's hang up
+    if (_machine.state() != sipper::call_state::disconnected) {
+      pjsua_call_hangup(_callId, PJSIP_SC_DECLINE, NULL, NULL);
+    }
+    
+    // Make sure we don't store invalid references in PJSIP
+    void *user_data = pjsua_call_get_user_data(_callId);
+    if (user_data == (__bridge void *) self) {
+      pjsua_call_set_user_data(_callId, NULL);
+    }
+  }
+  
+  // Release our hold on the transport that this call is using
+  if (_transport) {
+    pjsip_transport_dec_ref(_transport);
+    _transport = NULL;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (NSDictionary<NSString *, NSString *> *)headers {
+  return [_allHeaders copy];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallState)state {
+  return (SBSCallState) _machine.state();
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSHoldState)holdState {
+  return (SBSHoldState) _machine.hold();
+}
+
+//------------------------------------------------------------------------------
+
+- (NSString *)valueForHeader:(NSString *)header {
+  return [_allHeaders valueForKey:[header lowercaseString]];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)ring {
+  if (self.ringtone == nil) {
+    return;
+  }
+  
+  // Start playing the ringtone - note that we don't worry about audio categories here. That is
+  // managed by the endpoint, to ensure we don't clobber audio sessions that would be required by
+  // other active calls.
+  self.player = [[SBSRingtonePlayer alloc] initWithRingtone:self.ringtone];
+  [self.player play];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)connectWithCompletion:(void (^)(BOOL, NSError *_Nullable))callback {
+  [self connectWithHeaders:nil completion:callback];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)connectWithHeaders:(NSDictionary<NSString *,NSString *> *)headers completion:(SBSActionCallbackBlock)callback {
+  if (callback == nil) {
+    callback = ^(BOOL success, NSError *error) {
+    };
+  }
+  
+  // Setup is traced from here, so the wait for the background thread is part of it
+  _traceId = pj_call_trace_create();
+  _traceStartedAt = pj_cb_latency_now();
+  
+  [self.endpoint performAsync:^{
+    pj_call_trace_span(_traceId, "performAsync", _traceStartedAt, pj_cb_latency_now());
+    
+    pjsua_call_setting setting;
+    pjsua_call_setting_default(&setting);
+    
+    // Create a temporary pool to allocate default headers from
+    pj_caching_pool cp;
+    pj_caching_pool_init(&cp, &pj_pool_factory_default_policy, 0);
+    pj_pool_t *pool = pj_pool_create(&cp.factory, "header", 1000, 1000, NULL);
+    
+    // Append any required default headers
+    pjsua_msg_data msg_data;
+    pjsua_msg_data_init(&msg_data);
+    
+    // Append any default headers
+    if (_initialHeaders != nil) {
+      [_initialHeaders enumerateKeysAndObjectsUsingBlock:^(NSString *_Nonnull key, NSString *_Nonnull obj, BOOL *_Nonnull stop) {
+        pj_str_t name = key.pjString;
+        pj_str_t value = obj.pjString;
+        pj_list_push_back((pjsip_hdr *) &msg_data.hdr_list, pjsip_generic_string_hdr_create(pool, &name, &value));
+      }];
+    }
+    
+    // Append any call-specific headers
+    if (headers != nil) {
+      [headers enumerateKeysAndObjectsUsingBlock:^(NSString *_Nonnull key, NSString *_Nonnull obj, BOOL *_Nonnull stop) {
+        pj_str_t name = key.pjString;
+        pj_str_t value = obj.pjString;
+        pj_list_push_back((pjsip_hdr *) &msg_data.hdr_list, pjsip_generic_string_hdr_create(pool, &name, &value));
+      }];
+    }
+    
+    // Let the remote know it can expect, and send, more candidates over INFO
+    [self appendTrickleHeadersToMessageData:&msg_data pool:pool];
+    
+    // Create the call now
+    pjsua_call_id id;
+    pj_str_t dst = _destination.pjString;
+    
+    // What's sent while the call is made belongs to it, though its Call-ID isn't known until this returns
+    _traceMadeAt = pj_cb_latency_now();
+    pj_call_trace_set_current(_traceId);
+    pj_status_t status = pjsua_call_make_call(_account.accountId, &dst, &setting, NULL, &msg_data, &id);
+    pj_call_trace_set_current(0);
+    pj_call_trace_span(_traceId, "pjsua_call_make_call", _traceMadeAt, pj_cb_latency_now());
+    
+    // Discard the pool to cleanup
+    pj_pool_release(pool);
+    
+    // If we couldn't setup the call, fail it now
+    if (status != PJ_SUCCESS) {
+      NSError *error = [NSError ErrorWithUnderlying:nil
+                            localizedDescriptionKey:NSLocalizedString(@"Could not create outbound call", nil)
+                        localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
+                                        errorDomain:CallErrorDomain
+                                          errorCode:SBSCallErrorInvalidOperation];
+      
+      [self endCallWithError:error];
+    } else {
+      [self attachCall:id];
+    }
+  }];
+  
+  _startedAt = [[NSDate alloc] init];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)answerWithCompletion:(void (^)(BOOL, NSError *))callback {
+  [self answerWithStatus:SBSStatusCodeOk completion:callback];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)answerWithStatus:(SBSStatusCode)code completion:(void (^ _Nullable)(BOOL, NSError *))callback {
+  SBSCallFuture *future = [self answerWithStatus:code];
+  if (callback != nil) {
+    [future onComplete:callback];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)hangupWithCompletion:(void (^)(BOOL, NSError *_Nullable))callback {
+  [self hangupWithStatus:SBSStatusCodeDecline completion:callback];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)hangupWithStatus:(SBSStatusCode)code completion:(void (^)(BOOL, NSError *_Nullable))callback {
+  SBSCallFuture *future = [self hangupWithStatus:code];
+  if (callback != nil) {
+    [future onComplete:callback];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)holdWithCallback:(void (^)(BOOL, NSError *_Nullable))callback {
+  SBSCallFuture *future = [self hold];
+  if (callback != nil) {
+    [future onComplete:callback];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)unholdWithCallback:(void (^)(BOOL, NSError *_Nullable))callback {
+  SBSCallFuture *future = [self unhold];
+  if (callback != nil) {
+    [future onComplete:callback];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)reinviteWithCallback:(void (^)(BOOL, NSError *_Nullable))callback {
+  SBSCallFuture *future = [self reinvite];
+  if (callback != nil) {
+    [future onComplete:callback];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)answer {
+  return [self answerWithStatus:SBSStatusCodeOk];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)answerWithStatus:(SBSStatusCode)code {
+  return [self performControlAsync:SBSCallControlAnswer status:code argument:nil];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)hangup {
+  return [self hangupWithStatus:SBSStatusCodeDecline];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)hangupWithStatus:(SBSStatusCode)code {
+  return [self performControlAsync:SBSCallControlHangup status:code argument:nil];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)hold {
+  return [self performControlAsync:SBSCallControlHold status:SBSStatusCodeOk argument:nil];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)unhold {
+  return [self performControlAsync:SBSCallControlUnhold status:SBSStatusCodeOk argument:nil];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)reinvite {
+  return [self performControlAsync:SBSCallControlReinvite status:SBSStatusCodeOk argument:nil];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)sendDigits:(NSString *)digits {
+  return [self sendDigits:digits progress:nil];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)sendDigits:(NSString *)digits progress:(void (^)(NSUInteger))progress {
+  SBSCallFuture *future = [[SBSCallFuture alloc] initWithQueue:self.endpoint.eventDelivery.targetQueue];
+  NSString *sending = digits ?: @"";
+  
+  [self.endpoint performAsync:^{
+    if (_callId < 0) {
+      [future resolveWithError:[self callNotReadyError]];
+      return;
+    }
+    
+    if (![SBSDtmfSender isValidDigits:sending]) {
+      [future resolveWithError:[self sendDigitsErrorWithStatus:PJ_EINVAL]];
+      return;
+    }
+    
+    // Digits are paced by the call's sender, which queues them behind any that are still being sent
+    if (_dtmfSender == nil) {
+      SBSAccountConfiguration *configuration = _account.configuration;
+      _dtmfSender = [[SBSDtmfSender alloc] initWithMode:configuration.dtmfMode
+                                               duration:configuration.dtmfDuration
+                                                    gap:configuration.dtmfGap];
+    }
+    _dtmfSender.callId = _callId;
+    
+    void (^digitSent)(NSUInteger) = nil;
+    if (progress != nil) {
+      digitSent = ^(NSUInteger index) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          progress(index);
+        });
+      };
+    }
+    
+    [_dtmfSender sendDigits:sending progress:digitSent completion:^(pj_status_t status) {
+      [future resolveWithError:status == PJ_SUCCESS ? nil : [self sendDigitsErrorWithStatus:status]];
+    }];
+  }];
+  
+  return future;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)referTo:(NSString *)destination {
+  return [self performControlAsync:SBSCallControlRefer status:SBSStatusCodeOk argument:destination];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)startMediaTapWithHandler:(SBSMediaTapHandler)handler {
+  SBSCallFuture *future = [[SBSCallFuture alloc] initWithQueue:self.endpoint.eventDelivery.targetQueue];
+  
+  [self.endpoint performAsync:^{
+    if (_callId < 0 || _ended) {
+      [future resolveWithError:[self callNotReadyError]];
+      return;
+    }
+    
+    // A call only has the one tap
+    SBSMediaTap *tap = [[SBSMediaTap alloc] initWithHandler:handler capacity:MediaTapCapacity];
+    [self.mediaTap stop];
+    self.mediaTap = tap;
+    
+    // A call without audio yet gets its tap attached along with the audio
+    pjsua_call_info info;
+    pj_status_t status = pjsua_call_get_info(_callId, &info);
+    for (unsigned i = 0; i < info.media_cnt && status == PJ_SUCCESS; i++) {
+      pjsua_call_media_info media = info.media[i];
+      if (media.type == PJMEDIA_TYPE_AUDIO && media.status == PJSUA_CALL_MEDIA_ACTIVE && media.stream.aud.conf_slot != PJSUA_INVALID_ID) {
+        status = [tap attachToSlot:media.stream.aud.conf_slot muted:_machine.muted()];
+        break;
+      }
+    }
+    
+    if (status != PJ_SUCCESS) {
+      [tap stop];
+      self.mediaTap = nil;
+      [future resolveWithError:[self mediaTapErrorWithStatus:status]];
+      return;
+    }
+    
+    [future resolveWithError:nil];
+  }];
+  
+  return future;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)stopMediaTap {
+  SBSCallFuture *future = [[SBSCallFuture alloc] initWithQueue:self.endpoint.eventDelivery.targetQueue];
+  
+  [self.endpoint performAsync:^{
+    [self.mediaTap stop];
+    [future resolveWithError:nil];
+  }];
+  
+  return future;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSMediaTapStatistics *)mediaTapStatistics {
+  return [self.mediaTap statistics];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)performControlAsync:(SBSCallControl)control status:(SBSStatusCode)code argument:(NSString *)argument {
+  SBSCallFuture *future = [[SBSCallFuture alloc] initWithQueue:self.endpoint.eventDelivery.targetQueue];
+  
+  // Perform the action in the appropriate thread, and complete the future on the event queue
+  [self.endpoint performAsync:^{
+    [future resolveWithError:[self performControl:control status:code argument:argument]];
+  }];
+  
+  return future;
+}
+
+//------------------------------------------------------------------------------
+
+- (NSError *)performControl:(SBSCallControl)control status:(SBSStatusCode)code argument:(NSString *)argument {
+  if (_callId < 0) {
+    return [self callNotReadyError];
+  }
+  
+  pj_status_t status;
+  NSString *description;
+  SBSCallError errorCode;
+  
+  switch (control) {
+    case SBSCallControlAnswer: {
+      description = NSLocalizedString(@"Could not answer the call", nil);
+      errorCode = SBSCallErrorCannotAnswer;
+      
+      // Stop the ringtone if it's currently playing and we have a response code
+      // that justifies stopping it
+      if (code != SBSStatusCodeProgress && code != SBSStatusCodeRinging) {
+        [self applyInput:sipper::call_input::answer];
+      }
+      
+      // Only a trickle call has headers of its own to add to the answer
+      pjsua_msg_data msg_data;
+      pjsua_msg_data_init(&msg_data);
+      
+      pj_pool_t *pool = pjsua_pool_create("answer", 512, 512);
+      [self appendTrickleHeadersToMessageData:&msg_data pool:pool];
+      
+      status = pjsua_call_answer(_callId, (pjsip_status_code) code, NULL, &msg_data);
+      pj_pool_release(pool);
+      break;
+    }
+      
+    case SBSCallControlHangup: {
+      description = NSLocalizedString(@"Could not hangup the call", nil);
+      errorCode = SBSCallErrorCannotHangup;
+      
+      // Mark the call as ending, which stops the ringtone. At this point, no further status change events will be sent
+      [self applyInput:sipper::call_input::hangup];
+      
+      // Attempt to actually hang up the call
+      status = pjsua_call_hangup(_callId, (pjsip_status_code) code, NULL, NULL);
+      break;
+    }
+      
+    case SBSCallControlHold: {
+      description = NSLocalizedString(@"Could not hold the call", nil);
+      errorCode = SBSCallErrorCannotHold;
+      
+      // See if we can even hold anything
+      pjsua_call_info info;
+      pjsua_call_get_info(_callId, &info);
+      
+      if (info.media_cnt == 0) {
+        return nil;
+      }
+      
+      status = pjsua_call_set_hold2(_callId, 0, NULL);
+      break;
+    }
+      
+    case SBSCallControlUnhold: {
+      description = NSLocalizedString(@"Could not unhold the call", nil);
+      errorCode = SBSCallErrorCannotUnhold;
+      status = [self reinviteWithFlags:PJSUA_CALL_UNHOLD];
+      break;
+    }
+      
+    case SBSCallControlReinvite: {
+      description = NSLocalizedString(@"Could not reinvite the call", nil);
+      errorCode = SBSCallErrorCannotUnhold;
+      
+      // Send a re-invite and start a new media channel
+      status = [self reinviteWithFlags:PJSUA_CALL_REINIT_MEDIA];
+      break;
+    }
+      
+    case SBSCallControlRefer: {
+      description = NSLocalizedString(@"Could not transfer call", nil);
+      errorCode = SBSCallErrorCannotUnhold;
+      
+      NSString *destination = argument;
+      if ([SBSSipURI sipUriWithString:destination] == nil) {
+        destination = [NSString stringWithFormat:@"sip:%@@%@", destination, self.account.configuration.sipDomain];
+      }
+      
+      pj_str_t destination_string = destination.pjString;
+      status = pjsua_call_xfer(_callId, &destination_string, NULL);
+      break;
+    }
+  }
+  
+  if (status == PJ_SUCCESS) {
+    return nil;
+  }
+  
+  // Made it here, we got a non-successful response code
+  return [NSError ErrorWithUnderlying:nil
+              localizedDescriptionKey:description
+          localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
+                          errorDomain:CallErrorDomain
+                            errorCode:errorCode];
+}
+
+//------------------------------------------------------------------------------
+
+- (NSError *)sendDigitsErrorWithStatus:(pj_status_t)status {
+  return [NSError ErrorWithUnderlying:nil
+              localizedDescriptionKey:NSLocalizedString(@"Could not send DTMF for the call", nil)
+          localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
+                          errorDomain:CallErrorDomain
+                            errorCode:SBSCallErrorCannotSendDTMF];
+}
+
+//------------------------------------------------------------------------------
+
+- (NSError *)mediaTapErrorWithStatus:(pj_status_t)status {
+  return [NSError ErrorWithUnderlying:nil
+              localizedDescriptionKey:NSLocalizedString(@"Could not tap the call's media", nil)
+          localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
+                          errorDomain:CallErrorDomain
+                            errorCode:SBSCallErrorCannotTapMedia];
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)reinviteWithFlags:(unsigned)flags {
+  if (_callId < 0) {
+    return PJ_EINVALIDOP;
+  }
+  
+  pjsua_call_setting setting;
+  pjsua_call_setting_default(&setting);
+  
+  setting.aud_cnt = 1;
+  setting.flag = flags;
+  return pjsua_call_reinvite2(_callId, &setting, NULL);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)appendTrickleHeadersToMessageData:(pjsua_msg_data *)msgData pool:(pj_pool_t *)pool {
+  if (!_account.configuration.trickleIce) {
+    return;
+  }
+  
+  pj_str_t supported = pj_str((char *) "Supported");
+  pj_str_t recvInfo = pj_str((char *) "Recv-Info");
+  pj_str_t package = pj_str((char *) PJ_ICE_TRICKLE_PACKAGE);
+  pj_list_push_back((pjsip_hdr *) &msgData->hdr_list, pjsip_generic_string_hdr_create(pool, &supported, &package));
+  pj_list_push_back((pjsip_hdr *) &msgData->hdr_list, pjsip_generic_string_hdr_create(pool, &recvInfo, &package));
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_ice_strans *)iceTransport {
+  if (_callId < 0) {
+    return NULL;
+  }
+  
+  // Once SRTP is set up, the ICE transport is the one it wraps
+  pjsua_call *call = &pjsua_var.calls[_callId];
+  for (unsigned i = 0; i < call->med_cnt; i++) {
+    pjsua_call_media *media = &call->media[i];
+    pjmedia_transport *transport = media->tp_orig ? media->tp_orig : media->tp;
+    if (media->type == PJMEDIA_TYPE_AUDIO && transport != NULL && transport->type == PJMEDIA_TRANSPORT_TYPE_ICE) {
+      return pjmedia_ice_get_strans(transport);
+    }
+  }
+  
+  return NULL;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)trickleCandidatesIfReady {
+  [self.endpoint performAsync:^{
+    if (!_account.configuration.trickleIce || !_remoteTrickleIce || _trickledCandidates || _callId < 0) {
+      return;
+    }
+    
+    // INFO can only be sent within a dialog, which needs at least a provisional response with a tag
+    pjsua_call_info info;
+    if (pjsua_call_get_info(_callId, &info) != PJ_SUCCESS || info.state < PJSIP_INV_STATE_EARLY || info.state == PJSIP_INV_STATE_DISCONNECTED) {
+      return;
+    }
+    
+    char buffer[PJSIP_MAX_PKT_LEN / 2];
+    int length = -1;
+    
+    PJSUA_LOCK();
+    
+    // Everything is sent at once, when the last candidate has been gathered
+    pj_ice_strans *ice = [self iceTransport];
+    if (ice != NULL && !pj_ice_strans_has_pending_cand(ice)) {
+      pj_ice_sess_cand candidates[PJ_ICE_ST_MAX_CAND * PJ_ICE_MAX_COMP];
+      unsigned count = 0;
+      
+      for (unsigned component = 1; component <= pj_ice_strans_get_running_comp_cnt(ice); component++) {
+        unsigned componentCount = PJ_ICE_ST_MAX_CAND;
+        if (pj_ice_strans_enum_cands(ice, component, &componentCount, &candidates[count]) == PJ_SUCCESS) {
+          count += componentCount;
+        }
+      }
+      
+      pj_str_t ufrag, pwd;
+      pj_ice_strans_get_ufrag_pwd(ice, &ufrag, &pwd, NULL, NULL);
+      length = pj_ice_trickle_print_sdpfrag(&ufrag, &pwd, candidates, count, PJ_TRUE, buffer, sizeof(buffer));
+    }
+    
+    PJSUA_UNLOCK();
+    
+    if (length < 0) {
+      return;
+    }
+    
+    pjsua_msg_data msg_data;
+    pjsua_msg_data_init(&msg_data);
+    msg_data.content_type = pj_str((char *) PJ_ICE_TRICKLE_CONTENT_TYPE "/" PJ_ICE_TRICKLE_CONTENT_SUB);
+    msg_data.msg_body = pj_str(buffer);
+    msg_data.msg_body.slen = length;
+    
+    pj_pool_t *pool = pjsua_pool_create("trickle", 512, 512);
+    pj_str_t infoPackage = pj_str((char *) "Info-Package");
+    pj_str_t package = pj_str((char *) PJ_ICE_TRICKLE_PACKAGE);
+    pj_list_push_back((pjsip_hdr *) &msg_data.hdr_list, pjsip_generic_string_hdr_create(pool, &infoPackage, &package));
+    
+    pj_str_t method = pj_str((char *) "INFO");
+    pj_status_t status = pjsua_call_send_request(_callId, &method, &msg_data);
+    pj_pool_release(pool);
+    
+    if (status == PJ_SUCCESS) {
+      _trickledCandidates = YES;
+    } else {
+      NSLog(@"Failed to send trickled ICE candidates: %d", status);
+    }
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)addRemoteCandidates {
+  @synchronized (_remoteCandidateFragments) {
+    if (_remoteCandidateFragments.count == 0 || _callId < 0) {
+      return;
+    }
+    
+    PJSUA_LOCK();
+    
+    // Candidates can only be paired once the remote's offer or answer has started negotiation
+    pj_ice_strans *ice = [self iceTransport];
+    if (ice == NULL || pj_ice_strans_get_state(ice) < PJ_ICE_STRANS_STATE_NEGO) {
+      PJSUA_UNLOCK();
+      return;
+    }
+    
+    pj_str_t remoteUfrag;
+    pj_ice_strans_get_ufrag_pwd(ice, NULL, NULL, &remoteUfrag, NULL);
+    
+    pj_pool_t *pool = pjsua_pool_create("trickle", 512, 512);
+    for (NSString *fragment in _remoteCandidateFragments) {
+      pj_str_t body = fragment.pjString;
+      pj_str_t ufrag;
+      pj_ice_sess_cand candidates[PJ_ICE_MAX_CAND];
+      unsigned count = PJ_ARRAY_SIZE(candidates);
+      pj_bool_t end;
+      
+      // Fragments for an earlier ICE generation are of no use anymore
+      if (pj_ice_trickle_parse_sdpfrag(pool, &body, &ufrag, candidates, &count, &end) != PJ_SUCCESS ||
+          (ufrag.slen > 0 && pj_strcmp(&ufrag, &remoteUfrag) != 0)) {
+        continue;
+      }
+      
+      for (unsigned i = 0; i < count; i++) {
+        pj_ice_strans_add_remote_cand(ice, &candidates[i]);
+      }
+    }
+    
+    pj_pool_release(pool);
+    PJSUA_UNLOCK();
+    
+    [_remoteCandidateFragments removeAllObjects];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)handleTrickleInfo:(pjsip_rx_data *)request transaction:(pjsip_transaction *)transaction {
+  pjsip_msg_body *body = request->msg_info.msg->body;
+  if (body == NULL ||
+      pj_stricmp2(&body->content_type.type, PJ_ICE_TRICKLE_CONTENT_TYPE) != 0 ||
+      pj_stricmp2(&body->content_type.subtype, PJ_ICE_TRICKLE_CONTENT_SUB) != 0) {
+    return;
+  }
+  
+  // PJSUA leaves INFO it doesn't know about for the application to answer
+  if (transaction->state < PJSIP_TSX_STATE_COMPLETED) {
+    pjsip_tx_data *response;
+    if (pjsip_endpt_create_response(pjsua_get_pjsip_endpt(), request, PJSIP_SC_OK, NULL, &response) == PJ_SUCCESS) {
+      pjsip_tsx_send_msg(transaction, response);
+    }
+  }
+  
+  NSString *fragment = [[NSString alloc] initWithBytes:body->data length:body->len encoding:NSUTF8StringEncoding];
+  if (fragment == nil) {
+    return;
+  }
+  
+  // Buffered until the remote's offer or answer has been processed, if it hasn't been yet
+  @synchronized (_remoteCandidateFragments) {
+    [_remoteCandidateFragments addObject:fragment];
+  }
+  
+  [self addRemoteCandidates];
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)shutdownTransports {
+  if (_transport != NULL) {
+    return pjsip_transport_shutdown((pjsip_transport *) _transport) != 0;
+  }
+  
+  return YES;
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)muted {
+  return _machine.muted();
+}
+
+//------------------------------------------------------------------------------
+
+- (void)setMuted:(BOOL)muted {
+  [self.endpoint performAsync:^{
+    sipper::call_transition transition = _machine.apply(muted ? sipper::call_input::mute : sipper::call_input::unmute);
+    if (!transition.has(sipper::call_action::mute_changed)) {
+      return;
+    }
+    
+    [self updateMuteState];
+    
+    [self dispatchEvent:[self eventWithName:SBSCallEventMuteStateChange]];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)sendDigits:(NSString *)digits completion:(void (^ _Nullable)(BOOL, NSError *_Nullable))callback {
+  SBSCallFuture *future = [self sendDigits:digits];
+  if (callback != nil) {
+    [future onComplete:callback];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)referTo:(NSString *)destination completion:(void (^)(BOOL, NSError *_Nullable))callback {
+  SBSCallFuture *future = [self referTo:destination];
+  if (callback != nil) {
+    [future onComplete:callback];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSEventBinding *)addListenerForEvent:(NSString *)event target:(id)target action:(SEL)selector {
+  return [self.dispatcher addEventListener:[SBSTargetActionEventListener listenerWithTarget:target action:selector] forEvent:event];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSEventBinding *)addListenerForEvent:(NSString *)event block:(SBSCallEventListener)block {
+  void (^ castBlock)(SBSEvent *) = (void (^)(SBSEvent *)) block;
+  return [self.dispatcher addEventListener:[SBSBlockEventListener listenerWithBlock:castBlock] forEvent:event];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)removeBinding:(SBSEventBinding *)binding {
+  [self.dispatcher removeBinding:binding];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)dispatchEvent:(SBSCallEvent *)event {
+  SBSCallEventPool *pool = _endpoint.callEventPool;
+  dispatch_block_t block = ^{
+    [self.dispatcher dispatchEvent:event];
+    
+    // Every listener has returned, so the event can be handed out again
+    [pool recycleEvent:event];
+  };
+  
+  // Events without a payload only say that the call's state changed, which a later one for the same state says too
+  if ([event isMemberOfClass:[SBSCallEvent class]]) {
+    [_endpoint.eventDelivery deliverStateChange:block owner:self name:event.name];
+  } else {
+    [_endpoint.eventDelivery deliver:block];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallEvent *)eventWithName:(NSString *)name {
+  SBSCallEventPool *pool = _endpoint.callEventPool;
+  if (pool != nil) {
+    return [pool eventWithName:name call:self];
+  }
+  
+  return [SBSCallEvent eventWithName:name call:self];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallReceivedMessageEvent *)receivedMessageEventWithMessage:(SBSSipMessage *)message {
+  SBSCallEventPool *pool = _endpoint.callEventPool;
+  if (pool != nil) {
+    return [pool receivedMessageEventWithCall:self message:message];
+  }
+  
+  return [SBSCallReceivedMessageEvent eventWithName:SBSCallEventReceivedMessage call:self message:message];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)update {
+  [self updateCallState];
+  [self updateMediaState];
+}
+
+//------------------------------------------------------------------------------
+
+- (sipper::call_transition)applyInput:(sipper::call_input)input {
+  sipper::call_transition transition = _machine.apply(input);
+  
+  // If the call is not ringing anymore, stop the ringtone player
+  if (transition.has(sipper::call_action::stop_ringtone)) {
+    [self.player stop];
+  }
+  
+  // If we have any status, the call has started
+  if (transition.has(sipper::call_action::started) && _startedAt == nil) {
+    _startedAt = [[NSDate alloc] init];
+  }
+  
+  // The first time we're in an active state, update the call's timestamp. The dialog is confirmed by the ACK, which
+  // the caller has just sent, or the callee received.
+  if (transition.has(sipper::call_action::activated)) {
+    _activeAt = [[NSDate alloc] init];
+    pj_call_trace_instant(_traceId, _direction == SBSCallDirectionOutbound ? "tx ACK" : "rx ACK", pj_cb_latency_now());
+  }
+  
+  // And invoke the delegate method back on the main thread
+  if (transition.has(sipper::call_action::state_changed)) {
+    [self dispatchEvent:[self eventWithName:SBSCallEventStateChange]];
+  }
+  
+  return transition;
+}
+//------------------------------------------------------------------------------
+
+- (void)updateCallState {
+  
+  // If we don't have a valid call ID, then we're just in the setup state
+  if (_callId < 0) {
+    return;
+  }
+  
+  // Anything past here means we have a call ID
+  pjsua_call_info info;
+  pj_status_t status = pj_cb_record_get_call_info(_callId, &info);
+  
+  // Getting call info *will* fail when the call has been disconnected, so catch that
+  // and update as appropriate.
+  sipper::call_input input;
+  if (status == PJSIP_ESESSIONTERMINATED) {
+    input = sipper::call_input::sip_disconnected;
+  } else if (status == PJ_SUCCESS) {
+    input = convertState(info.state);
+    
+    // Kept for the call record, since the info can't be read back once the session has terminated
+    _lastStatusCode = info.last_status;
+    _remoteInfo = [NSString stringWithPJString:info.remote_info];
+  } else {
+    return;
+  }
+  
+  sipper::call_transition transition = [self applyInput:input];
+  
+  // If we are now disconnected, release any transports we may have and end the call
+  if (transition.has(sipper::call_action::ended)) {
+    [self endCallWithError:nil];
+    
+    if (_transport) {
+      pjsip_transport_dec_ref(_transport);
+      _transport = NULL;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)updateMediaState {
+  
+  // If we don't have a valid call ID, then we're just in the setup state
+  if (_callId < 0) {
+    return;
+  }
+  
+  // Anything past here means we have a valid state
+  pjsua_call_info info;
+  pj_cb_record_get_call_info(_callId, &info);
+  
+  // Determine the hold state for the call
+  sipper::call_input holdInput = sipper::call_input::hold_none;
+  NSMutableArray<SBSMediaDescription *> *descriptions = [[NSMutableArray alloc] init];
+  
+  // Calculate the aggregate media state
+  for (int i = 0; i < info.media_cnt; i++) {
+    pjsua_call_media_info media_info = info.media[i];
+    SBSMediaState state = convertMediaState(media_info.status);
+    SBSMediaDirection direction = convertMediaDirection(media_info.dir);
+    SBSMediaType type = convertMediaType(media_info.type);
+    
+    // Append this media entry to our media descriptions array
+    [descriptions addObject:[[SBSMediaDescription alloc] initWithMediaType:type direction:direction state:state]];
+    
+    if (holdInput == sipper::call_input::hold_none) {
+      if (state == SBSMediaStateLocalHold) {
+        holdInput = sipper::call_input::hold_local;
+      } else if (state == SBSMediaStateRemoteHold) {
+        holdInput = sipper::call_input::hold_remote;
+      }
+    }
+  }
+  
+  // Updated media state for the call
+  _media = [descriptions copy];
+  
+  // Determine if the hold state changed
+  BOOL holdStateChanged = _machine.apply(holdInput).has(sipper::call_action::hold_changed);
+  
+  // Remember which codec the audio ended up with, for the call record. A replayed call has no streams to ask.
+  pj_str_t replayCodec;
+  if (pj_cb_record_get_replay_codec(_callId, &replayCodec)) {
+    _codecName = [NSString stringWithPJString:replayCodec];
+  } else {
+    for (unsigned i = 0; i < info.media_cnt; i++) {
+      pjmedia_stream_info stream_info;
+      if (info.media[i].type == PJMEDIA_TYPE_AUDIO && info.media[i].status == PJSUA_CALL_MEDIA_ACTIVE &&
+          pjsua_call_get_stream_info(_callId, i, &stream_info) == PJ_SUCCESS) {
+        _codecName = [NSString stringWithFormat:@"%@/%u", [NSString stringWithPJString:stream_info.fmt.encoding_name], stream_info.fmt.clock_rate];
+        break;
+      }
+    }
+  }
+  
+  // Make sure the jitter buffer is being tuned for whichever audio stream is now active
+  [self updateJitterBufferController:info];
+  
+  // And that the encoder follows the loss the remote reports on it
+  [self updateOpusController:info];
+  
+  // Let the endpoint know we have audio again, in case it's waiting on us to finish a failover
+  for (unsigned i = 0; i < info.media_cnt; i++) {
+    if (info.media[i].type == PJMEDIA_TYPE_AUDIO && info.media[i].status == PJSUA_CALL_MEDIA_ACTIVE) {
+      [_endpoint handleCallAudioRestored:self];
+      
+      // Which is where setup ends
+      if (!_tracedMediaActive) {
+        _tracedMediaActive = YES;
+        pj_uint64_t now = pj_cb_latency_now();
+        pj_call_trace_instant(_traceId, "media active", now);
+        pj_call_trace_span(_traceId, "call setup", _traceStartedAt, now);
+      }
+      break;
+    }
+  }
+  
+  // Reconcile the appropriate mute state. This only connects conference ports, which setMuted: does from this thread
+  // too, so there's no need to hop to the main queue for it.
+  [self updateMuteState:info];
+  
+  // Fire the hold state delegate handler if the hold state changed
+  if (holdStateChanged) {
+    [self dispatchEvent:[self eventWithName:SBSCallEventHoldStateChange]];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)updateJitterBufferController:(pjsua_call_info)info {
+  SBSEndpointConfiguration *configuration = _endpoint.configuration;
+  if (!configuration.adaptiveJitterBuffer) {
+    return;
+  }
+  
+  // Find the active audio stream, if there is one
+  int mediaIndex = -1;
+  for (unsigned i = 0; i < info.media_cnt; i++) {
+    if (info.media[i].type == PJMEDIA_TYPE_AUDIO && info.media[i].status == PJSUA_CALL_MEDIA_ACTIVE) {
+      mediaIndex = (int) i;
+      break;
+    }
+  }
+  
+  // Without an active stream there's nothing to tune, so stop any existing controller
+  if (mediaIndex < 0) {
+    [self stopJitterBufferController];
+    return;
+  }
+  
+  // The frame duration can change across re-invites (i.e. if the codec changes), so always re-read it
+  pjmedia_stream_info stream_info;
+  if (pjsua_call_get_stream_info(_callId, mediaIndex, &stream_info) != PJ_SUCCESS) {
+    return;
+  }
+  
+  unsigned frameDuration = stream_info.param ? stream_info.param->info.frm_ptime : 20;
+  if (frameDuration == 0) {
+    frameDuration = 20;
+  }
+  
+  // Respect the configured maximum if there is one, otherwise fall back to what the stream was created with
+  unsigned maxPrefetch;
+  if ((int) configuration.jbMax > 0) {
+    maxPrefetch = (unsigned) configuration.jbMax / frameDuration;
+  } else {
+    pjsua_stream_stat stat;
+    if (pjsua_call_get_stream_stat(_callId, mediaIndex, &stat) != PJ_SUCCESS) {
+      return;
+    }
+    maxPrefetch = stat.jbuf.max_count * 4 / 5;
+  }
+  
+  pjsua_call_id callId = _callId;
+  
+  // The controller is only ever touched from the background thread, since its timer lives there
+  [_endpoint performAsync:^{
+    if (self.ended) {
+      return;
+    }
+    
+    SBSJitterBufferController *controller = self.jitterBufferController;
+    if (controller == nil) {
+      controller = [[SBSJitterBufferController alloc] initWithTargetDiscardRate:configuration.jbTargetDiscardRate
+                                                                  frameDuration:frameDuration
+                                                                    maxPrefetch:maxPrefetch];
+      self.jitterBufferController = controller;
+    } else if (controller.mediaIndex == (unsigned) mediaIndex && controller.frameDuration == frameDuration) {
+      return;
+    } else {
+      controller.frameDuration = frameDuration;
+    }
+    
+    controller.callId = callId;
+    controller.mediaIndex = (unsigned) mediaIndex;
+    [controller startWithInterval:configuration.jbAdaptationInterval];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)stopJitterBufferController {
+  if (!_endpoint.configuration.adaptiveJitterBuffer) {
+    return;
+  }
+  
+  [_endpoint performAsync:^{
+    [self.jitterBufferController stop];
+    self.jitterBufferController = nil;
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)updateOpusController:(pjsua_call_info)info {
+  SBSEndpointConfiguration *configuration = _endpoint.configuration;
+  if (!configuration.adaptiveOpus) {
+    return;
+  }
+  
+  // Find the active audio stream, if there is one
+  int mediaIndex = -1;
+  for (unsigned i = 0; i < info.media_cnt; i++) {
+    if (info.media[i].type == PJMEDIA_TYPE_AUDIO && info.media[i].status == PJSUA_CALL_MEDIA_ACTIVE) {
+      mediaIndex = (int) i;
+      break;
+    }
+  }
+  
+  // Only Opus has an encoder worth retuning
+  pjmedia_stream_info stream_info;
+  if (mediaIndex < 0 || pjsua_call_get_stream_info(_callId, mediaIndex, &stream_info) != PJ_SUCCESS ||
+      pj_stricmp2(&stream_info.fmt.encoding_name, "opus") != 0) {
+    [self stopOpusController];
+    return;
+  }
+  
+  pjsua_call_id callId = _callId;
+  
+  // The controller is only ever touched from the background thread, since its timer lives there
+  [_endpoint performAsync:^{
+    if (self.ended) {
+      return;
+    }
+    
+    SBSOpusController *controller = self.opusController;
+    if (controller == nil) {
+      controller = [[SBSOpusController alloc] initWithMinBitrate:(unsigned) configuration.opusMinBitrate
+                                                      maxBitrate:(unsigned) configuration.opusMaxBitrate];
+      self.opusController = controller;
+    } else if (controller.mediaIndex == (unsigned) mediaIndex) {
+      return;
+    }
+    
+    controller.callId = callId;
+    controller.mediaIndex = (unsigned) mediaIndex;
+    [controller startWithInterval:configuration.opusAdaptationInterval];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)stopOpusController {
+  if (!_endpoint.configuration.adaptiveOpus) {
+    return;
+  }
+  
+  [_endpoint performAsync:^{
+    [self.opusController stop];
+    self.opusController = nil;
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)stopDtmfSender {
+  [_endpoint performAsync:^{
+    [self.dtmfSender stop];
+    self.dtmfSender = nil;
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)updateMuteState {
+  if (_callId < 0) {
+    return;
+  }
+  
+  // Otherwise grab call info and reconcile
+  pjsua_call_info info;
+  pj_status_t status = pjsua_call_get_info(_callId, &info);
+  if (status != PJ_SUCCESS) {
+    return;
+  }
+  
+  // Reconcile the appropriate audio states
+  [self updateMuteState:info];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)updateMuteState:(pjsua_call_info)info {
+  for (unsigned i = 0; i < info.media_cnt; i++) {
+    pjsua_call_media_info media = info.media[i];
+    
+    // If we have an active audio stream, connect the audio channels. Replayed audio has no port to connect.
+    if (media.type == PJMEDIA_TYPE_AUDIO && media.status == PJSUA_CALL_MEDIA_ACTIVE && media.stream.aud.conf_slot != PJSUA_INVALID_ID) {
+      pjsua_conf_connect(media.stream.aud.conf_slot, 0);
+      
+      // Only connect the microphone to the output if we're not muted. When we're muted, we
+      // connect the bridge to the null port. This ensures we continue to send 0 RTP data, as
+      // opposed to not sending any RTP data at all which would cause the call to drop for
+      // many providers
+      if (!_machine.muted()) {
+        pjsua_conf_connect(0, media.stream.aud.conf_slot);
+      } else {
+        pjsua_conf_disconnect(0, media.stream.aud.conf_slot);
+      }
+      
+      // The tap follows the call's slot, and hears the microphone only when the call does
+      [self.mediaTap attachToSlot:media.stream.aud.conf_slot muted:_machine.muted()];
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)attachCall:(pjsua_call_id)callId {
+  _callId = callId;
+  
+  // Attach ourselves as the call's user data
+  pjsua_call_set_user_data(callId, (__bridge void *) self);
+  
+  // Incoming calls are traced from when they arrive
+  if (_traceId == 0) {
+    _traceId = pj_call_trace_create();
+    _traceStartedAt = pj_cb_latency_now();
+    _traceMadeAt = _traceStartedAt;
+  }
+  
+  // Callbacks and messages find the trace by the call
+  pjsua_call_info info;
+  if (_traceId != 0 && pj_cb_record_get_call_info(callId, &info) == PJ_SUCCESS) {
+    pj_call_trace_bind(_traceId, callId, &info.call_id);
+  }
+  
+  // Reconcile this object's state with the SIP call
+  [self update];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)endCallWithError:(NSError *)error {
+  BOOL ended = _ended;
+  _ended = YES;
+  [self stopJitterBufferController];
+  [self stopOpusController];
+  [self stopDtmfSender];
+  
+  // Stopping the tap hands its handler whatever is left of the call's audio, before the end event goes out
+  [self.mediaTap stop];
+  
+  if (_completedAt == nil) {
+    _completedAt = [[NSDate alloc] init];
+  }
+  
+  // Record the call once, while its streams can still be read
+  if (!ended) {
+    [_endpoint.callRecordStore appendRecord:[self callRecord]];
+    
+    // The call's index is about to be reused
+    if (_callId >= 0) {
+      pj_call_trace_unbind(_callId);
+    }
+  }
+  
+  SBSCallEndedEvent *event = [SBSCallEndedEvent eventWithName:SBSCallEventEnd call:self error:error];
+  
+  // Move the call to its disconnected state, if it isn't there yet
+  [self applyInput:sipper::call_input::end];
+  
+  // Now fire the call end event
+  [self dispatchEvent:event];
+  
+  // Clean up the associated user data for this call ID in PJSIP. Not doing this
+  // can leave dangling pointers associated with the call.
+  if (_callId >= 0) {
+    pjsua_call_set_user_data(_callId, NULL);
+    _callId = -1;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallRecord *)callRecord {
+  float lossRate = 0, remoteLossRate = 0;
+  NSTimeInterval jitter = 0, roundTripTime = 0;
+  
+  // Quality comes from whichever audio stream is still around, which is none if the call never had media
+  pjsua_call_info info;
+  if (_callId >= 0 && pj_cb_record_get_call_info(_callId, &info) == PJ_SUCCESS) {
+    for (unsigned i = 0; i < info.media_cnt; i++) {
+      pjsua_stream_stat stat;
+      if (info.media[i].type != PJMEDIA_TYPE_AUDIO || pjsua_call_get_stream_stat(_callId, i, &stat) != PJ_SUCCESS) {
+        continue;
+      }
+      
+      unsigned received = stat.rtcp.rx.pkt + stat.rtcp.rx.loss;
+      unsigned sent = stat.rtcp.tx.pkt + stat.rtcp.tx.loss;
+      lossRate = received > 0 ? (float) stat.rtcp.rx.loss / received : 0;
+      remoteLossRate = sent > 0 ? (float) stat.rtcp.tx.loss / sent : 0;
+      jitter = stat.rtcp.rx.jitter.mean / 1e6;
+      roundTripTime = stat.rtcp.rtt.mean / 1e6;
+      break;
+    }
+  }
+  
+  NSString *remote = _direction == SBSCallDirectionOutbound ? _destination : _remoteInfo;
+  NSString *transport = _transport != NULL ? [NSString stringWithUTF8String:pjsip_transport_get_type_name(_transport->key.type)] : nil;
+  NSTimeInterval duration = _activeAt != nil ? [_completedAt timeIntervalSinceDate:_activeAt] : 0;
+  
+  return [[SBSCallRecord alloc] initWithSequence:0
+                                            uuid:_uuid
+                                       direction:_direction
+                                          remote:remote ?: @""
+                                       startedAt:_startedAt
+                                        activeAt:_activeAt
+                                     completedAt:_completedAt
+                                        duration:duration
+                                      statusCode:_lastStatusCode
+                                       transport:transport
+                                           codec:_codecName
+                                        lossRate:lossRate
+                                  remoteLossRate:remoteLossRate
+                                          jitter:jitter
+                                   roundTripTime:roundTripTime];
+}
+
+//------------------------------------------------------------------------------
+
+- (NSError *)callNotReadyError {
+  return [NSError ErrorWithUnderlying:nil
+              localizedDescriptionKey:NSLocalizedString(@"Call is not setup, cannot perform action", nil)
+          localizedFailureReasonError:NSLocalizedString(@"The requested action can only be performed when the call has left the setup state", nil)
+                          errorDomain:CallErrorDomain
+                            errorCode:SBSCallErrorCallNotReady];
+}
+
+//------------------------------------------------------------------------------
+// Event Listeners
+//------------------------------------------------------------------------------
+
+- (void)handleCallStateChange {
+  [self updateCallState];
+  [self trickleCandidatesIfReady];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)handleCallMediaStateChange {
+  [self updateMediaState];
+  [self addRemoteCandidates];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)handleLocalCandidatesGathered {
+  pj_call_trace_span(_traceId, "ICE gathering", _traceMadeAt, pj_cb_latency_now());
+  [self trickleCandidatesIfReady];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)handleTransactionStateChange:(pjsip_transaction *)transaction event:(pjsip_event *)event {
+  [self traceTransaction:transaction event:event];
+  
+  // See if we should grab a handle to this transport
+  if (_account.endpoint.configuration.preserveConnectionsForCalls) {
+    if (transaction->transport != _transport) {
+      if (_transport) {
+        pjsip_transport_dec_ref(_transport);
+      }
+      
+      if (transaction->transport) {
+        pjsip_transport_add_ref(transaction->transport);
+      }
+      
+      _transport = transaction->transport;
+    }
+  }
+  
+  // Create the event for the transaction state change
+  SBSCallTransactionState state = convertTransactionState(transaction->state);
+  NSString *method = [SBSSipUtilities nameOfMethod:&transaction->method];
+  NSError *error = nil;
+  
+  // Check and see if we had a transport error, and drop the call if so
+  if (transaction->transport_err != PJ_SUCCESS) {
+    error = [NSError ErrorWithUnderlying:nil
+                  localizedDescriptionKey:NSLocalizedString(@"Transport failure during SIP message", nil)
+              localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), transaction->transport_err]
+                              errorDomain:CallErrorDomain
+                                errorCode:SBSCallErrorTransportFailure];
+  }
+  
+  // Dispatch an event for the messag echange
+  SBSCallEventPool *pool = _endpoint.callEventPool;
+  if (pool != nil) {
+    [self dispatchEvent:[pool transactionEventWithCall:self method:method state:state error:error]];
+  } else {
+    [self dispatchEvent:[SBSCallTransactionStateChangeEvent eventWithName:SBSCallEventTransactionStateChange call:self method:method state:state error:error]];
+  }
+  
+  // If this is a response message from the remote, parse the response
+  if (event->type == PJSIP_EVENT_TSX_STATE && event->body.tsx_state.type == PJSIP_EVENT_RX_MSG) {
+    pjsip_rx_data *response = event->body.tsx_state.src.rdata;
+    
+    // Parse all of the headers out of the response message
+    NSDictionary *headers = [SBSSipUtilities headersFromMessage:response->msg_info.msg];
+    [_allHeaders addEntriesFromDictionary:headers];
+    
+    // Candidates are only trickled to a remote that supports it, which may only become known from its answer
+    if (!_remoteTrickleIce && supportsTrickleIce(response->msg_info.msg)) {
+      _remoteTrickleIce = YES;
+      [self trickleCandidatesIfReady];
+    }
+    
+    if (transaction->role == PJSIP_ROLE_UAS && pj_stricmp2(&transaction->method.name, "INFO") == 0) {
+      [self handleTrickleInfo:response transaction:transaction];
+    }
+    
+    // Check for response message types
+    if (response->msg_info.msg->type == PJSIP_REQUEST_MSG) {
+      int status_code = response->msg_info.msg->line.status.code;
+      pj_str_t reason = response->msg_info.msg->line.status.reason;
+      pj_str_t call_id = response->msg_info.cid->id;
+      SBSSipResponseMessage *message = [[SBSSipResponseMessage alloc] initWithStatusCode:status_code
+                                                                            statusReason:[NSString stringWithPJString:reason]
+                                                                                  callId:[NSString stringWithPJString:call_id]
+                                                                                 headers:headers];
+      
+      // Invoke the delegate method that we received a new response
+      _lastMessage = message;
+      [self dispatchEvent:[self receivedMessageEventWithMessage:message]];
+    } else {
+      pj_str_t call_id = response->msg_info.cid->id;
+      SBSSipRequestMessage *message = [[SBSSipRequestMessage alloc] initWithMethod:[SBSSipUtilities nameOfMethod:&response->msg_info.msg->line.req.method]
+                                                                            callId:[NSString stringWithPJString:call_id]
+                                                                           headers:headers];
+      
+      // Invoke the delegate method that we received a new response
+      _lastMessage = message;
+      [self dispatchEvent:[self receivedMessageEventWithMessage:message]];
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)traceTransaction:(pjsip_transaction *)transaction event:(pjsip_event *)event {
+  if (_traceId == 0 || event->type != PJSIP_EVENT_TSX_STATE) {
+    return;
+  }
+  
+  // Retransmissions don't change the transaction's state, so each message is traced once
+  pjsip_msg *msg = NULL;
+  const char *direction = NULL;
+  if (event->body.tsx_state.type == PJSIP_EVENT_TX_MSG && event->body.tsx_state.src.tdata != NULL) {
+    msg = event->body.tsx_state.src.tdata->msg;
+    direction = "tx";
+  } else if (event->body.tsx_state.type == PJSIP_EVENT_RX_MSG && event->body.tsx_state.src.rdata != NULL) {
+    msg = event->body.tsx_state.src.rdata->msg_info.msg;
+    direction = "rx";
+  }
+  
+  if (msg == NULL) {
+    return;
+  }
+  
+  char name[PJ_CALL_TRACE_NAME_LEN];
+  if (msg->type == PJSIP_REQUEST_MSG) {
+    pj_ansi_snprintf(name, sizeof(name), "%s %.*s", direction, (int) msg->line.req.method.name.slen, msg->line.req.method.name.ptr);
+  } else {
+    pj_ansi_snprintf(name, sizeof(name), "%s %d %.*s", direction, msg->line.status.code, (int) transaction->method.name.slen, transaction->method.name.ptr);
+  }
+  
+  pj_call_trace_instant(_traceId, name, pj_cb_latency_now());
+}
+
+//------------------------------------------------------------------------------
+
+- (void)handleTransportStateChange:(pjsip_transport *)transport state:(pjsip_transport_state)state info:(const pjsip_transport_state_info *)info {
+  // Because calls may hold onto their transport, we could run into issues where we want to explicitly shut down
+  // a transport but the call is still holding onto it so it never gets destroyed. So, in this case, we listen to
+  // shutdown attempts for the transport and release it, since shutdown will only be called if the user really wants
+  // us to release this.
+  if (state == PJSIP_TP_STATE_DESTROY || state == PJSIP_TP_STATE_SHUTDOWN) {
+    if (_transport == transport) {
+      pjsip_transport_dec_ref(_transport);
+      _transport = NULL;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
++ (instancetype)outgoingCallWithAccount:(SBSAccount *)account destination:(NSString *)destination headers:(NSDictionary<NSString *,NSString *> *)headers {
+  return [[SBSCall alloc] initOutgoingWithEndpoint:account.endpoint account:account destination:destination headers:headers];
+}
+
+//------------------------------------------------------------------------------
+
++ (instancetype)incomingCallWithAccount:(SBSAccount *)account callId:(pjsua_call_id)callId data:(pjsip_rx_data *)data {
+  SBSCall *call = [[SBSCall alloc] initIncomingWithEndpoint:account.endpoint account:account remote:nil callId:callId];
+  call.remoteTrickleIce = supportsTrickleIce(data->msg_info.msg);
+  return call;
+}
+
+@end
+
+#pragma mark - Static Methods
+
+static sipper::call_input convertState(pjsip_inv_state state) {
+  switch (state) {
+    case PJSIP_INV_STATE_NULL:
+      return sipper::call_input::sip_null;
+    case PJSIP_INV_STATE_EARLY:
+      return sipper::call_input::sip_early;
+    case PJSIP_INV_STATE_CALLING:
+      return sipper::call_input::sip_calling;
+    case PJSIP_INV_STATE_INCOMING:
+      return sipper::call_input::sip_incoming;
+    case PJSIP_INV_STATE_CONFIRMED:
+      return sipper::call_input::sip_confirmed;
+    case PJSIP_INV_STATE_CONNECTING:
+      return sipper::call_input::sip_connecting;
+    case PJSIP_INV_STATE_DISCONNECTED:
+      return sipper::call_input::sip_disconnected;
+  }
+};
+
+static SBSMediaState convertMediaState(pjsua_call_media_status state) {
+  switch (state) {
+    case PJSUA_CALL_MEDIA_NONE:
+      return SBSMediaStateNone;
+    case PJSUA_CALL_MEDIA_ACTIVE:
+      return SBSMediaStateActive;
+    case PJSUA_CALL_MEDIA_LOCAL_HOLD:
+      return SBSMediaStateLocalHold;
+    case PJSUA_CALL_MEDIA_REMOTE_HOLD:
+      return SBSMediaStateRemoteHold;
+    case PJSUA_CALL_MEDIA_ERROR:
+      return SBSMediaStateError;
+  }
+}
+
+static SBSMediaType convertMediaType(pjmedia_type type) {
+  switch (type) {
+    case PJMEDIA_TYPE_NONE:
+      return SBSMediaTypeNone;
+    case PJMEDIA_TYPE_AUDIO:
+      return SBSMediaTypeAudio;
+    case PJMEDIA_TYPE_VIDEO:
+      return SBSMediaTypeVideo;
+    case PJMEDIA_TYPE_APPLICATION:
+      return SBSMediaTypeApplication;
+    case PJMEDIA_TYPE_UNKNOWN:
+      return SBSMediaTypeUnknown;
+  }
+}
+
+static SBSMediaDirection convertMediaDirection(pjmedia_dir direction) {
+  switch (direction) {
+    case PJMEDIA_DIR_NONE:
+      return SBSMediaDirectionNone;
+    case PJMEDIA_DIR_ENCODING:
+      return SBSMediaDirectionOutbound;
+    case PJMEDIA_DIR_DECODING:
+      return SBSMediaDirectionInbound;
+    case PJMEDIA_DIR_ENCODING_DECODING:
+      return SBSMediaDirectionBidirectional;
+  }
+}
+
+static SBSCallTransactionState convertTransactionState(pjsip_tsx_state_e state) {
+  switch (state) {
+    case PJSIP_TSX_STATE_PROCEEDING:
+      return SBSCallTransactionStateProceeding;
+    case PJSIP_TSX_STATE_DESTROYED:
+      return SBSCallTransactionStateDestroyed;
+    case PJSIP_TSX_STATE_CONFIRMED:
+      return SBSCallTransactionStateConfirmed;
+    case PJSIP_TSX_STATE_COMPLETED:
+      return SBSCallTransactionStateCompleted;
+    case PJSIP_TSX_STATE_CALLING:
+      return SBSCallTransactionStateCalling;
+    case PJSIP_TSX_STATE_TRYING:
+      return SBSCallTransactionStateTrying;
+    case PJSIP_TSX_STATE_NULL:
+      return SBSCallTransactionStatePending;
+    case PJSIP_TSX_STATE_TERMINATED:
+      return SBSCallTransactionStateTerminated;
+    default:
+      return SBSCallTransactionStatePending;
+  }
+}
+
+static BOOL supportsTrickleIce(pjsip_msg *msg) {
+  pj_str_t package = pj_str((char *) PJ_ICE_TRICKLE_PACKAGE);
+  
+  pjsip_supported_hdr *supported = (pjsip_supported_hdr *) pjsip_msg_find_hdr(msg, PJSIP_H_SUPPORTED, NULL);
+  while (supported != NULL) {
+    for (unsigned i = 0; i < supported->count; i++) {
+      if (pj_stricmp(&supported->values[i], &package) == 0) {
+        return YES;
+      }
+    }
+    
+    supported = (pjsip_supported_hdr *) pjsip_msg_find_hdr(msg, PJSIP_H_SUPPORTED, supported->next);
+  }
+  
+  return NO;
+}
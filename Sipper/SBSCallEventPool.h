@@ -0,0 +1,74 @@
+//
+//  SBSCallEventPool.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SBSCall.h"
+
+/**
+ * Keeps call events that have been dispatched, so the next notification of the same kind reuses one instead of
+ * allocating it
+ *
+ * Plain events are kept by name, along with transaction state change and received message events. Other events carry
+ * state that listeners are likely to hold on to (media descriptions, the error that ended the call), and are always
+ * allocated. A recycled event has its call and payload cleared, so the pool doesn't keep calls alive.
+ *
+ * The pool may be used from any thread.
+ */
+@interface SBSCallEventPool : NSObject
+
+/**
+ * Number of events of each kind that are kept for reuse
+ */
+@property(nonatomic, readonly) NSUInteger capacity;
+
+/**
+ * Number of events the pool had to allocate
+ */
+@property(nonatomic, readonly) NSUInteger created;
+
+/**
+ * Number of events the pool handed out again
+ */
+@property(nonatomic, readonly) NSUInteger reused;
+
+/**
+ * Creates a pool
+ *
+ * @param capacity the number of events of each kind to keep
+ */
+- (instancetype _Nonnull)initWithCapacity:(NSUInteger)capacity;
+
+/**
+ * Returns an event with no payload for a call
+ */
+- (SBSCallEvent *_Nonnull)eventWithName:(NSString *_Nonnull)name call:(SBSCall *_Nonnull)call;
+
+/**
+ * Returns a transaction state change event for a call
+ */
+- (SBSCallTransactionStateChangeEvent *_Nonnull)transactionEventWithCall:(SBSCall *_Nonnull)call
+                                                                  method:(NSString *_Nonnull)method
+                                                                   state:(SBSCallTransactionState)state
+                                                                   error:(NSError *_Nullable)error;
+
+/**
+ * Returns a received message event for a call
+ */
+- (SBSCallReceivedMessageEvent *_Nonnull)receivedMessageEventWithCall:(SBSCall *_Nonnull)call
+                                                              message:(SBSSipMessage *_Nonnull)message;
+
+/**
+ * Takes back an event once every listener has been invoked with it. Events the pool doesn't keep, and events beyond
+ * its capacity, are ignored.
+ *
+ * @param event the event that was dispatched
+ */
+- (void)recycleEvent:(SBSCallEvent *_Nonnull)event;
+
+@end
@@ -0,0 +1,148 @@
+//
+//  SBSCallEventPool.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSCallEventPool.h"
+
+#import "SBSCall+Internal.h"
+
+@implementation SBSCallEventPool {
+  NSMutableDictionary<NSString *, NSMutableArray<SBSCallEvent *> *> *_events;
+  NSMutableArray<SBSCallTransactionStateChangeEvent *> *_transactionEvents;
+  NSMutableArray<SBSCallReceivedMessageEvent *> *_messageEvents;
+  NSUInteger _created;
+  NSUInteger _reused;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+  if (self = [super init]) {
+    _capacity = capacity;
+    _events = [[NSMutableDictionary alloc] init];
+    _transactionEvents = [[NSMutableArray alloc] initWithCapacity:capacity];
+    _messageEvents = [[NSMutableArray alloc] initWithCapacity:capacity];
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (NSUInteger)created {
+  @synchronized(self) {
+    return _created;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (NSUInteger)reused {
+  @synchronized(self) {
+    return _reused;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallEvent *)eventWithName:(NSString *)name call:(SBSCall *)call {
+  SBSCallEvent *event;
+  @synchronized(self) {
+    event = [self takeFrom:_events[name]];
+  }
+
+  if (event == nil) {
+    return [SBSCallEvent eventWithName:name call:call];
+  }
+
+  [event reuseWithCall:call];
+  return event;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallTransactionStateChangeEvent *)transactionEventWithCall:(SBSCall *)call
+                                                          method:(NSString *)method
+                                                           state:(SBSCallTransactionState)state
+                                                           error:(NSError *)error {
+  SBSCallTransactionStateChangeEvent *event;
+  @synchronized(self) {
+    event = (SBSCallTransactionStateChangeEvent *) [self takeFrom:_transactionEvents];
+  }
+
+  if (event == nil) {
+    return [SBSCallTransactionStateChangeEvent eventWithName:SBSCallEventTransactionStateChange call:call method:method state:state error:error];
+  }
+
+  [event reuseWithCall:call method:method state:state error:error];
+  return event;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallReceivedMessageEvent *)receivedMessageEventWithCall:(SBSCall *)call message:(SBSSipMessage *)message {
+  SBSCallReceivedMessageEvent *event;
+  @synchronized(self) {
+    event = (SBSCallReceivedMessageEvent *) [self takeFrom:_messageEvents];
+  }
+
+  if (event == nil) {
+    return [SBSCallReceivedMessageEvent eventWithName:SBSCallEventReceivedMessage call:call message:message];
+  }
+
+  [event reuseWithCall:call message:message];
+  return event;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)recycleEvent:(SBSCallEvent *)event {
+  NSMutableArray *unused;
+
+  // Subclasses are matched exactly, so an event with a payload the pool doesn't know about is never kept
+  if ([event isMemberOfClass:[SBSCallTransactionStateChangeEvent class]]) {
+    [(SBSCallTransactionStateChangeEvent *) event reuseWithCall:nil method:nil state:SBSCallTransactionStatePending error:nil];
+    unused = _transactionEvents;
+  } else if ([event isMemberOfClass:[SBSCallReceivedMessageEvent class]]) {
+    [(SBSCallReceivedMessageEvent *) event reuseWithCall:nil message:nil];
+    unused = _messageEvents;
+  } else if ([event isMemberOfClass:[SBSCallEvent class]]) {
+    [event reuseWithCall:nil];
+  } else {
+    return;
+  }
+
+  @synchronized(self) {
+    if (unused == nil) {
+      unused = _events[event.name];
+      if (unused == nil) {
+        unused = [[NSMutableArray alloc] initWithCapacity:_capacity];
+        _events[event.name] = unused;
+      }
+    }
+
+    if (unused.count < _capacity) {
+      [unused addObject:event];
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallEvent *)takeFrom:(NSMutableArray<SBSCallEvent *> *)unused {
+  SBSCallEvent *event = unused.lastObject;
+  if (event == nil) {
+    _created++;
+    return nil;
+  }
+
+  [unused removeLastObject];
+  _reused++;
+  return event;
+}
+
+@end
@@ -0,0 +1,34 @@
+//
+//  SBSCallFuture+Internal.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef SBSCallFuture_Internal_h
+#define SBSCallFuture_Internal_h
+
+#import "SBSCallFuture.h"
+
+@interface SBSCallFuture ()
+
+/**
+ * Creates a future whose blocks are invoked on the given queue
+ *
+ * @param queue the queue to invoke blocks on, which must be serial
+ */
+- (instancetype _Nonnull)initWithQueue:(dispatch_queue_t _Nonnull)queue;
+
+/**
+ * Completes the future, and invokes its blocks on its queue
+ *
+ * This may be called from any thread, and only the first call has any effect.
+ *
+ * @param error the reason the action failed, or nil if it succeeded
+ */
+- (void)resolveWithError:(NSError *_Nullable)error;
+
+@end
+
+#endif /* SBSCallFuture_Internal_h */
@@ -0,0 +1,69 @@
+//
+//  SBSCallFuture.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * The eventual result of a call control action, such as holding or hanging up a call
+ *
+ * A future completes once, when the action has been sent (or couldn't be). Like the completion blocks of the call's
+ * other methods, that *does not* mean the remote has accepted it: observe the call's events for that. Blocks added to
+ * a future are invoked on the endpoint's event queue (the main queue, unless one was configured), including blocks
+ * added after it completed.
+ *
+ * Futures compose, so a sequence of actions can be described up front:
+ *
+ *   [[[call hold] then:^SBSCallFuture *{
+ *     return [other answer];
+ *   }] onComplete:^(BOOL successful, NSError *error) {
+ *     ...
+ *   }];
+ */
+@interface SBSCallFuture : NSObject
+
+/**
+ * Whether the action has completed, successfully or not
+ */
+@property(nonatomic, readonly) BOOL completed;
+
+/**
+ * Whether the action completed successfully
+ */
+@property(nonatomic, readonly) BOOL successful;
+
+/**
+ * The reason the action failed, or nil if it hasn't
+ */
+@property(strong, nonatomic, readonly, nullable) NSError *error;
+
+/**
+ * Adds a block to invoke on the future's queue once the action completes
+ *
+ * @param block the block to invoke
+ * @return this future, so more blocks can be added
+ */
+- (SBSCallFuture *_Nonnull)onComplete:(void (^_Nonnull)(BOOL successful, NSError *_Nullable error))block;
+
+/**
+ * Starts another action once this one completes successfully
+ *
+ * @param next block returning the future of the next action, which isn't invoked if this action fails
+ * @return a future on the same queue that completes with the next action, or with this action if it failed
+ */
+- (SBSCallFuture *_Nonnull)then:(SBSCallFuture *_Nonnull (^_Nonnull)(void))next;
+
+/**
+ * Combines the futures of several actions
+ *
+ * @param futures the futures to wait for
+ * @return a future on the first one's queue that completes once all of them have, and fails with the error of the
+ *         first one that failed
+ */
++ (SBSCallFuture *_Nonnull)all:(NSArray<SBSCallFuture *> *_Nonnull)futures;
+
+@end
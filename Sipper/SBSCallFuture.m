@@ -0,0 +1,149 @@
+//
+//  SBSCallFuture.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSCallFuture+Internal.h"
+
+typedef void (^SBSCallFutureBlock)(BOOL, NSError *_Nullable);
+
+@implementation SBSCallFuture {
+  NSMutableArray<SBSCallFutureBlock> *_blocks;
+  dispatch_queue_t _queue;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)init {
+  return [self initWithQueue:dispatch_get_main_queue()];
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue {
+  if (self = [super init]) {
+    _blocks = [[NSMutableArray alloc] init];
+    _queue = queue;
+  }
+  
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)onComplete:(SBSCallFutureBlock)block {
+  @synchronized(self) {
+    if (!_completed) {
+      [_blocks addObject:[block copy]];
+      return self;
+    }
+  }
+  
+  // Already complete, so the block is only waiting on the queue
+  BOOL successful = _successful;
+  NSError *error = _error;
+  [self invoke:^{
+    block(successful, error);
+  }];
+  
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)then:(SBSCallFuture *(^)(void))next {
+  SBSCallFuture *result = [[SBSCallFuture alloc] initWithQueue:_queue];
+  
+  [self onComplete:^(BOOL successful, NSError *error) {
+    if (!successful) {
+      [result resolveWithError:error];
+      return;
+    }
+    
+    [next() onComplete:^(BOOL nextSuccessful, NSError *nextError) {
+      [result resolveWithError:nextError];
+    }];
+  }];
+  
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
++ (SBSCallFuture *)all:(NSArray<SBSCallFuture *> *)futures {
+  SBSCallFuture *result = futures.count > 0 ? [[SBSCallFuture alloc] initWithQueue:futures.firstObject->_queue]
+                                            : [[SBSCallFuture alloc] init];
+  if (futures.count == 0) {
+    [result resolveWithError:nil];
+    return result;
+  }
+  
+  // Futures of different endpoints complete on different queues, so these are guarded by the result
+  __block NSUInteger remaining = futures.count;
+  __block NSError *firstError = nil;
+  
+  for (SBSCallFuture *future in futures) {
+    [future onComplete:^(BOOL successful, NSError *error) {
+      BOOL done;
+      NSError *resultError;
+      @synchronized(result) {
+        if (!successful && firstError == nil) {
+          firstError = error;
+        }
+        
+        done = --remaining == 0;
+        resultError = firstError;
+      }
+      
+      if (done) {
+        [result resolveWithError:resultError];
+      }
+    }];
+  }
+  
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)resolveWithError:(NSError *)error {
+  NSArray<SBSCallFutureBlock> *blocks;
+  
+  @synchronized(self) {
+    if (_completed) {
+      return;
+    }
+    
+    _completed = YES;
+    _successful = error == nil;
+    _error = error;
+    blocks = _blocks;
+    _blocks = nil;
+  }
+  
+  if (blocks.count == 0) {
+    return;
+  }
+  
+  // Every block goes in a single hop to the queue
+  [self invoke:^{
+    for (SBSCallFutureBlock block in blocks) {
+      block(error == nil, error);
+    }
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)invoke:(dispatch_block_t)block {
+  if (_queue == dispatch_get_main_queue() && [NSThread isMainThread]) {
+    block();
+  } else {
+    dispatch_async(_queue, block);
+  }
+}
+
+@end
@@ -0,0 +1,86 @@
+//
+//  SBSCallRecordStore.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class SBSCallRecord;
+
+/**
+ * Keeps a record of every finished call in a memory-mapped, append-only file
+ *
+ * Records have a fixed layout, so appending one is a copy into the mapped file followed by a commit counter update,
+ * and the operating system writes the pages back in its own time. Appends run on the store's own queue, and never
+ * wait on the disk. A record is only counted once its commit is visible, and carries a checksum, so a crash in the
+ * middle of an append (or a power loss that persisted some pages and not others) loses at most the record being
+ * written: whatever was committed before it is recovered when the store is next opened.
+ *
+ * When the file is full it's rotated: the current file becomes path.1, path.1 becomes path.2, and so on, and the
+ * oldest one is deleted once there are more than the configured number of files.
+ */
+@interface SBSCallRecordStore : NSObject
+
+/**
+ * Path of the current file. Rotated files have a numbered suffix.
+ */
+@property(strong, nonatomic, nonnull, readonly) NSString *path;
+
+/**
+ * Number of records in each file
+ */
+@property(nonatomic, readonly) NSUInteger capacity;
+
+/**
+ * Number of files kept, including the current one
+ */
+@property(nonatomic, readonly) NSUInteger files;
+
+/**
+ * Opens the store, recovering the committed records of an existing file
+ *
+ * An existing file with a different capacity is rotated out, and stays readable.
+ *
+ * @param path     the path of the current file, whose directory must exist
+ * @param capacity the number of records in each file
+ * @param files    the number of files to keep, including the current one
+ * @param error    the reason the file couldn't be opened
+ * @return the store, or nil if the file couldn't be opened
+ */
+- (instancetype _Nullable)initWithPath:(NSString *_Nonnull)path
+                              capacity:(NSUInteger)capacity
+                                 files:(NSUInteger)files
+                                 error:(NSError *_Nullable *_Nullable)error;
+
+/**
+ * Appends a record on the store's queue, and returns without waiting for it
+ *
+ * The record's sequence is ignored, and assigned by the store.
+ *
+ * @param record the record to append
+ */
+- (void)appendRecord:(SBSCallRecord *_Nonnull)record;
+
+/**
+ * Waits for every pending append, then for the current file to be written to disk
+ */
+- (void)synchronize;
+
+/**
+ * Enumerates every committed record, oldest first, including those in rotated files
+ *
+ * Appends made before this is called are included. The block runs on the store's queue, so it must not append.
+ *
+ * @param block invoked with each record, and may set stop to YES to end the enumeration
+ */
+- (void)enumerateRecordsUsingBlock:(void (^_Nonnull)(SBSCallRecord *_Nonnull record, BOOL *_Nonnull stop))block;
+
+/**
+ * Waits for pending appends and closes the file. Later appends are dropped.
+ */
+- (void)close;
+
+@end
@@ -0,0 +1,446 @@
+//
+//  SBSCallRecordStore.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSCallRecordStore.h"
+
+#import "SBSCallRecord.h"
+
+#import <fcntl.h>
+#import <stdatomic.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <unistd.h>
+
+static uint32_t const CallRecordFileMagic = 0x43534253;   // "SBSC"
+static uint32_t const CallRecordMagic = 0x52534253;       // "SBSR"
+static uint16_t const CallRecordVersion = 1;
+
+/**
+ * The first 64 bytes of every file. Records follow it.
+ */
+typedef struct call_record_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t capacity;
+  uint32_t reserved;
+  uint64_t first_sequence;
+  _Atomic uint64_t committed;        // written last, once the record it counts is complete
+  uint8_t padding[32];
+} call_record_header;
+
+/**
+ * A single record. Strings are UTF-8, truncated on a character boundary, and NUL-padded.
+ */
+typedef struct call_record_entry {
+  uint32_t magic;
+  uint32_t checksum;                 // FNV-1a of everything after this field
+  uint64_t sequence;
+  uint8_t uuid[16];
+  double started_at;                 // seconds since 1970, or 0 if unset
+  double active_at;
+  double completed_at;
+  int32_t status_code;
+  uint32_t duration_ms;
+  uint8_t direction;
+  uint8_t reserved[3];
+  float loss_rate;
+  float remote_loss_rate;
+  uint32_t jitter_us;
+  uint32_t rtt_us;
+  char transport[8];
+  char codec[32];
+  char remote[128];
+} call_record_entry;
+
+_Static_assert(sizeof(call_record_header) == 64, "call record header must stay 64 bytes");
+_Static_assert(sizeof(call_record_entry) == 256, "call records must stay 256 bytes");
+
+@implementation SBSCallRecordStore {
+  dispatch_queue_t _queue;
+  int _fd;
+  void *_map;
+  size_t _mapLength;
+  call_record_header *_header;
+  call_record_entry *_entries;
+  uint64_t _count;
+  uint64_t _nextSequence;
+}
+
+//------------------------------------------------------------------------------
+
+static uint32_t checksumEntry(const call_record_entry *entry) {
+  const uint8_t *bytes = (const uint8_t *) &entry->sequence;
+  size_t length = sizeof(*entry) - offsetof(call_record_entry, sequence);
+
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+static void copyString(char *destination, size_t size, NSString *string) {
+  memset(destination, 0, size);
+
+  const char *utf8 = string.UTF8String;
+  if (utf8 == NULL) {
+    return;
+  }
+
+  // Don't leave half a character at the end
+  size_t length = strlen(utf8);
+  if (length >= size) {
+    length = size - 1;
+    while (length > 0 && ((unsigned char) utf8[length] & 0xC0) == 0x80) {
+      length--;
+    }
+  }
+
+  memcpy(destination, utf8, length);
+}
+
+static NSString *readString(const char *source, size_t size) {
+  size_t length = strnlen(source, size);
+  return length > 0 ? [[NSString alloc] initWithBytes:source length:length encoding:NSUTF8StringEncoding] : nil;
+}
+
+static double timestamp(NSDate *date) {
+  return date != nil ? date.timeIntervalSince1970 : 0;
+}
+
+static NSDate *dateFromTimestamp(double timestamp) {
+  return timestamp > 0 ? [NSDate dateWithTimeIntervalSince1970:timestamp] : nil;
+}
+
+static BOOL isValidHeader(const call_record_header *header, size_t length) {
+  return length >= sizeof(*header) && header->magic == CallRecordFileMagic && header->version == CallRecordVersion &&
+         header->record_size == sizeof(call_record_entry) &&
+         length >= sizeof(*header) + (size_t) header->capacity * sizeof(call_record_entry);
+}
+
+/**
+ * Counts the records that were committed and are intact. A record whose pages didn't all make it to disk fails its
+ * checksum, and ends the file there.
+ */
+static uint64_t recoverCount(const call_record_header *header) {
+  const call_record_entry *entries = (const call_record_entry *) (header + 1);
+  uint64_t committed = MIN(atomic_load_explicit(&header->committed, memory_order_acquire), header->capacity);
+
+  for (uint64_t i = 0; i < committed; i++) {
+    if (entries[i].magic != CallRecordMagic || entries[i].sequence != header->first_sequence + i ||
+        entries[i].checksum != checksumEntry(&entries[i])) {
+      return i;
+    }
+  }
+
+  return committed;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithPath:(NSString *)path capacity:(NSUInteger)capacity files:(NSUInteger)files error:(NSError *__autoreleasing *)error {
+  if (self = [super init]) {
+    _path = [path copy];
+    _capacity = MAX(capacity, 1);
+    _files = MAX(files, 1);
+    _fd = -1;
+    _queue = dispatch_queue_create("sipper.call-records", DISPATCH_QUEUE_SERIAL);
+    _nextSequence = 1;
+
+    if (![self openCurrentFileWithError:error]) {
+      return nil;
+    }
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)dealloc {
+  [self unmapCurrentFile];
+}
+
+//------------------------------------------------------------------------------
+
+- (NSString *)pathForFile:(NSUInteger)index {
+  return index == 0 ? _path : [_path stringByAppendingFormat:@".%lu", (unsigned long) index];
+}
+
+//------------------------------------------------------------------------------
+
+- (uint64_t)sequenceAfterFile:(NSString *)path {
+  __block uint64_t sequence = 1;
+  [self readFile:path block:^(const call_record_header *header, uint64_t count) {
+    sequence = header->first_sequence + count;
+  }];
+
+  return sequence;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)readFile:(NSString *)path block:(void (^)(const call_record_header *header, uint64_t count))block {
+  int fd = open(path.fileSystemRepresentation, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(call_record_header)) {
+    close(fd);
+    return;
+  }
+
+  void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return;
+  }
+
+  const call_record_header *header = map;
+  if (isValidHeader(header, (size_t) st.st_size)) {
+    block(header, recoverCount(header));
+  }
+
+  munmap(map, (size_t) st.st_size);
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)openCurrentFileWithError:(NSError *__autoreleasing *)error {
+  const char *path = _path.fileSystemRepresentation;
+  size_t length = sizeof(call_record_header) + _capacity * sizeof(call_record_entry);
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return [self failWithErrno:errno error:error];
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int code = errno;
+    close(fd);
+    return [self failWithErrno:code error:error];
+  }
+
+  // A file from another version, or with another capacity, is kept as history and replaced
+  BOOL existing = st.st_size > 0;
+  if (existing) {
+    call_record_header header;
+    BOOL compatible = pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                      isValidHeader(&header, (size_t) st.st_size) && header.capacity == _capacity;
+
+    if (!compatible) {
+      close(fd);
+      return [self rotateFilesWithError:error] && [self openCurrentFileWithError:error];
+    }
+  } else if (ftruncate(fd, (off_t) length) != 0) {
+    int code = errno;
+    close(fd);
+    return [self failWithErrno:code error:error];
+  }
+
+  void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    int code = errno;
+    close(fd);
+    return [self failWithErrno:code error:error];
+  }
+
+  _fd = fd;
+  _map = map;
+  _mapLength = length;
+  _header = map;
+  _entries = (call_record_entry *) (_header + 1);
+
+  if (existing) {
+    _count = recoverCount(_header);
+    _nextSequence = _header->first_sequence + _count;
+    atomic_store_explicit(&_header->committed, _count, memory_order_release);
+  } else {
+
+    // Carry on from wherever the last rotated file left off, which may have been written by an earlier run
+    _nextSequence = MAX(_nextSequence, [self sequenceAfterFile:[self pathForFile:1]]);
+
+    _header->magic = CallRecordFileMagic;
+    _header->version = CallRecordVersion;
+    _header->record_size = sizeof(call_record_entry);
+    _header->capacity = (uint32_t) _capacity;
+    _header->first_sequence = _nextSequence;
+    atomic_store_explicit(&_header->committed, 0, memory_order_release);
+    _count = 0;
+    msync(_map, sizeof(call_record_header), MS_ASYNC);
+  }
+
+  return YES;
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)failWithErrno:(int)code error:(NSError *__autoreleasing *)error {
+  if (error != NULL) {
+    *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:@{NSFilePathErrorKey: _path}];
+  }
+
+  return NO;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)unmapCurrentFile {
+  if (_map != NULL) {
+    munmap(_map, _mapLength);
+    _map = NULL;
+    _header = NULL;
+    _entries = NULL;
+  }
+
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)rotateFilesWithError:(NSError *__autoreleasing *)error {
+  [self unmapCurrentFile];
+
+  // Older files are allowed to be missing, but the current one has to move out of the way
+  for (NSUInteger i = _files - 1; i > 1; i--) {
+    rename([self pathForFile:i - 1].fileSystemRepresentation, [self pathForFile:i].fileSystemRepresentation);
+  }
+
+  int result = _files > 1 ? rename(_path.fileSystemRepresentation, [self pathForFile:1].fileSystemRepresentation)
+                          : unlink(_path.fileSystemRepresentation);
+  return result == 0 || [self failWithErrno:errno error:error];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)appendRecord:(SBSCallRecord *)record {
+  dispatch_async(_queue, ^{
+    if (_map == NULL) {
+      return;
+    }
+
+    if (_count == _capacity) {
+      NSError *error;
+      if (![self rotateFilesWithError:&error] || ![self openCurrentFileWithError:&error]) {
+        NSLog(@"Dropping call records, could not rotate %@: %@", _path, error);
+        return;
+      }
+    }
+
+    call_record_entry *entry = &_entries[_count];
+    memset(entry, 0, sizeof(*entry));
+
+    entry->sequence = _nextSequence;
+    [record.uuid getUUIDBytes:entry->uuid];
+    entry->started_at = timestamp(record.startedAt);
+    entry->active_at = timestamp(record.activeAt);
+    entry->completed_at = timestamp(record.completedAt);
+    entry->status_code = (int32_t) record.statusCode;
+    entry->duration_ms = (uint32_t) MAX(record.duration * 1000.0, 0);
+    entry->direction = (uint8_t) record.direction;
+    entry->loss_rate = record.lossRate;
+    entry->remote_loss_rate = record.remoteLossRate;
+    entry->jitter_us = (uint32_t) MAX(record.jitter * 1e6, 0);
+    entry->rtt_us = (uint32_t) MAX(record.roundTripTime * 1e6, 0);
+    copyString(entry->transport, sizeof(entry->transport), record.transport);
+    copyString(entry->codec, sizeof(entry->codec), record.codec);
+    copyString(entry->remote, sizeof(entry->remote), record.remote);
+    entry->checksum = checksumEntry(entry);
+    entry->magic = CallRecordMagic;
+
+    // The commit is what makes the record count, so it has to land after everything it points to
+    atomic_store_explicit(&_header->committed, _count + 1, memory_order_release);
+    _count++;
+    _nextSequence++;
+
+    // Ask for the dirty pages to be written back, without waiting for them
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) entry & ~((uintptr_t) page - 1);
+    msync((void *) start, (uintptr_t) (entry + 1) - start, MS_ASYNC);
+    msync(_map, sizeof(call_record_header), MS_ASYNC);
+  });
+}
+
+//------------------------------------------------------------------------------
+
+- (void)synchronize {
+  dispatch_sync(_queue, ^{
+    if (_map != NULL) {
+      msync(_map, _mapLength, MS_SYNC);
+    }
+  });
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallRecord *)recordFromEntry:(const call_record_entry *)entry {
+  NSUUID *uuid = [[NSUUID alloc] initWithUUIDBytes:entry->uuid];
+
+  return [[SBSCallRecord alloc] initWithSequence:entry->sequence
+                                            uuid:uuid
+                                       direction:(SBSCallDirection) entry->direction
+                                          remote:readString(entry->remote, sizeof(entry->remote)) ?: @""
+                                       startedAt:dateFromTimestamp(entry->started_at)
+                                        activeAt:dateFromTimestamp(entry->active_at)
+                                     completedAt:dateFromTimestamp(entry->completed_at)
+                                        duration:entry->duration_ms / 1000.0
+                                      statusCode:entry->status_code
+                                       transport:readString(entry->transport, sizeof(entry->transport))
+                                           codec:readString(entry->codec, sizeof(entry->codec))
+                                        lossRate:entry->loss_rate
+                                  remoteLossRate:entry->remote_loss_rate
+                                          jitter:entry->jitter_us / 1e6
+                                   roundTripTime:entry->rtt_us / 1e6];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)enumerateRecordsUsingBlock:(void (^)(SBSCallRecord *, BOOL *))block {
+  dispatch_sync(_queue, ^{
+    __block BOOL stop = NO;
+
+    for (NSUInteger i = _files - 1; i > 0 && !stop; i--) {
+      [self readFile:[self pathForFile:i] block:^(const call_record_header *header, uint64_t count) {
+        const call_record_entry *entries = (const call_record_entry *) (header + 1);
+        for (uint64_t j = 0; j < count && !stop; j++) {
+          @autoreleasepool {
+            block([self recordFromEntry:&entries[j]], &stop);
+          }
+        }
+      }];
+    }
+
+    for (uint64_t j = 0; _map != NULL && j < _count && !stop; j++) {
+      @autoreleasepool {
+        block([self recordFromEntry:&_entries[j]], &stop);
+      }
+    }
+  });
+}
+
+//------------------------------------------------------------------------------
+
+- (void)close {
+  dispatch_sync(_queue, ^{
+    if (_map != NULL) {
+      msync(_map, _mapLength, MS_SYNC);
+    }
+
+    [self unmapCurrentFile];
+  });
+}
+
+@end
@@ -0,0 +1,57 @@
+//
+//  SBSEndpoint+Internal.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/10/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef SBSEndpoint_Internal_h
+#define SBSEndpoint_Internal_h
+
+#import "SBSEndpoint.h"
+
+@class SBSCallEventPool;
+@class SBSEventDelivery;
+@class SBSKeepAliveService;
+@class SBSRegistrationScheduler;
+
+@interface SBSEndpoint ()
+
+/**
+ * Scheduler that all accounts route their REGISTER requests through
+ *
+ * The scheduler must only be used from the endpoint's background thread
+ */
+@property(strong, nonatomic, readonly, nullable) SBSRegistrationScheduler *registrationScheduler;
+
+/**
+ * Shared keep-alive timer, or nil if each flow keeps itself alive
+ *
+ * The service must only be used from the endpoint's background thread
+ */
+@property(strong, nonatomic, readonly, nullable) SBSKeepAliveService *keepAliveService;
+
+/**
+ * Pool that calls take their events from, or nil if every event is allocated
+ */
+@property(strong, nonatomic, readonly, nullable) SBSCallEventPool *callEventPool;
+
+/**
+ * Delivery that calls and accounts send their events and delegate calls through, batched by PJSUA callback
+ */
+@property(strong, nonatomic, readonly, nonnull) SBSEventDelivery *eventDelivery;
+
+/**
+ * Invoked by a call whenever one of its audio streams becomes active
+ *
+ * If a make-before-break failover is in progress, this marks the call as restored. Once every call that was
+ * re-invited has restored audio, the previous connections are released and the failover duration is recorded.
+ *
+ * @param call the call whose audio is active
+ */
+- (void)handleCallAudioRestored:(SBSCall *_Nonnull)call;
+
+@end
+
+#endif /* SBSEndpoint_Internal_h */
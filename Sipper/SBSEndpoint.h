@@ -13,12 +13,26 @@
 
 @class SBSAccount;
 @class SBSAccountConfiguration;
+@class SBSAudioDeviceStatistics;
 @class SBSAudioManager;
 @class SBSCall;
+@class SBSCallFuture;
+@class SBSCallRecordStore;
+@class SBSCallbackLatencyStatistics;
+@class SBSCallbackReplayStatistics;
 @class SBSCodecDescriptor;
+@class SBSDNSCacheStatistics;
 @class SBSEndpoint;
 @class SBSEndpointConfiguration;
+@class SBSEndpointStartupMetrics;
+@class SBSEventDeliveryStatistics;
+@class SBSICECandidateStatistics;
+@class SBSKeepAliveStatistics;
+@class SBSMessageCompactionStatistics;
+@class SBSRegistrationMetrics;
 @class SBSRingbackDescription;
+@class SBSSrtpSuiteBenchmark;
+@class SBSTLSHandshakeStatistics;
 
 /**
  *  Possible errors the Endpoint can return.
@@ -47,7 +61,26 @@ typedef NS_ENUM(NSInteger, SBSEndpointError) {
   /**
    *  Unable to cleanly destroy the endpoint on shutdown.
    */
-  SBSEndpointErrorCannotDestroy
+  SBSEndpointErrorCannotDestroy,
+  /**
+   *  Unable to write the SIP capture.
+   */
+  SBSEndpointErrorCannotWriteCapture,
+  
+  /**
+   *  Unable to write the call trace.
+   */
+  SBSEndpointErrorCannotWriteTrace,
+  
+  /**
+   *  Unable to record the PJSUA callbacks.
+   */
+  SBSEndpointErrorCannotRecordCallbacks,
+  
+  /**
+   *  Unable to replay a recording of PJSUA callbacks.
+   */
+  SBSEndpointErrorCannotReplayCallbacks
 };
 
 /**
@@ -124,6 +157,102 @@ typedef NS_ENUM(NSInteger, SBSEndpointState) {
  */
 @property(nonatomic, readonly) BOOL audioEnabled;
 
+/**
+ * Time from the most recent make-before-break transport failover until every call restored its audio, in seconds
+ *
+ * This is 0 until a failover has completed, and is never updated in SBSTransportFailoverModeBreakBeforeMake
+ */
+@property(nonatomic, readonly) NSTimeInterval lastFailoverDuration;
+
+/**
+ * Counters for the TLS handshakes performed by SIP-over-TLS transports
+ *
+ * Each access returns a new snapshot of the counters
+ */
+@property(nonatomic, readonly, nonnull) SBSTLSHandshakeStatistics *tlsHandshakeStatistics;
+
+/**
+ * Counters for the registration scheduler shared by all accounts
+ *
+ * Each access returns a new snapshot of the counters
+ */
+@property(nonatomic, readonly, nullable) SBSRegistrationMetrics *registrationMetrics;
+
+/**
+ * Counters for the DNS cache shared by SIP and NAT64 address lookups
+ *
+ * Each access returns a new snapshot of the counters
+ */
+@property(nonatomic, readonly, nonnull) SBSDNSCacheStatistics *dnsCacheStatistics;
+
+/**
+ * Counters for host ICE candidate ranking and NAT64 candidate suppression
+ *
+ * Each access returns a new snapshot of the counters
+ */
+@property(nonatomic, readonly, nonnull) SBSICECandidateStatistics *iceCandidateStatistics;
+
+/**
+ * Counters for the shared keep-alive timer
+ *
+ * This is nil unless the endpoint was configured with a keepAliveInterval. Each access returns a new snapshot.
+ */
+@property(nonatomic, readonly, nullable) SBSKeepAliveStatistics *keepAliveStatistics;
+
+/**
+ * Counters for SIP message compaction
+ *
+ * The counters are all zero unless the endpoint was configured with sipMessageCompaction. Each access returns a new
+ * snapshot.
+ */
+@property(nonatomic, readonly, nonnull) SBSMessageCompactionStatistics *messageCompactionStatistics;
+
+/**
+ * What each SRTP crypto suite cost when the endpoint started, in the order the suites are offered
+ *
+ * This is empty unless the endpoint was configured with an srtpSuiteOrder other than SBSSrtpSuiteOrderDefault.
+ */
+@property(nonatomic, readonly, nonnull) NSArray<SBSSrtpSuiteBenchmark *> *srtpSuiteBenchmarks;
+
+/**
+ * The record of every call that has ended, oldest first
+ *
+ * This is nil unless the endpoint was configured with a callRecordPath.
+ */
+@property(nonatomic, readonly, nullable) SBSCallRecordStore *callRecordStore;
+
+/**
+ * How long each phase of the last startup took
+ *
+ * This is nil until the endpoint has been initialized. Work that isn't needed to register or place a call finishes on
+ * the background thread after initialization returns, and the metrics say whether it's done. Each access returns a new
+ * snapshot.
+ */
+@property(nonatomic, readonly, nullable) SBSEndpointStartupMetrics *startupMetrics;
+
+/**
+ * How long each PJSUA callback has taken to run, one entry per callback
+ *
+ * Times are always recorded, and kept across restarts of the endpoint until they're reset. Each access returns a new
+ * snapshot.
+ */
+@property(nonatomic, readonly, nonnull) NSArray<SBSCallbackLatencyStatistics *> *callbackLatencyStatistics;
+
+/**
+ * Counters for the delivery of events and delegate calls to the event queue, including the blocks enqueued per call
+ *
+ * Each access returns a new snapshot of the counters since the endpoint was last initialized.
+ */
+@property(nonatomic, readonly, nonnull) SBSEventDeliveryStatistics *eventDeliveryStatistics;
+
+/**
+ * The sound device's sample rate, how often it has been switched and how long each switch left the audio silent, and
+ * what converting its frames to and from the conference bridge costs
+ *
+ * Each access returns a new snapshot of the counters since the endpoint was last initialized.
+ */
+@property(nonatomic, readonly, nonnull) SBSAudioDeviceStatistics *audioDeviceStatistics;
+
 /**
  * Initializes the SIP endpoint
  *
@@ -148,6 +277,11 @@ typedef NS_ENUM(NSInteger, SBSEndpointState) {
  */
 - (BOOL)destroyEndpointWithError:(NSError *_Nullable *_Nullable)error;
 
+/**
+ * Forgets the times recorded for every PJSUA callback
+ */
+- (void)resetCallbackLatencyStatistics;
+
 /**
  * Attempts to create and register an account with the endpoint
  *
@@ -204,9 +338,14 @@ typedef NS_ENUM(NSInteger, SBSEndpointState) {
 /**
  * Updates the endpoint's hardware audio sampling rate
  *
- * This method can be safely invoked at runtime, during an active call. It executes a multi-step process, where it will first
- * shut down the sound device, then update the media sample rate, and then attempt to re-open the sound device before connecting
- * it back into the conference bridge.
+ * This method can be safely invoked at runtime, during an active call. The sound device is attached to the conference bridge
+ * through an adapter that has resamplers ready for 8, 16, 32, 44.1 and 48kHz, so a switch only restarts the device's audio
+ * stream at the new rate: the bridge, and every call connected to it, are left alone. Nothing happens if the rate is the one
+ * the device already runs at, and a rate the adapter doesn't support runs the device at the bridge's rate instead.
+ *
+ * The endpoint opens the sound device itself rather than through PJSUA, so PJSUA's sound device functions don't reach
+ * it. In particular, echo cancellation is set up from the media configuration whenever the device opens, and a later
+ * pjsua_set_ec only takes effect the next time it does.
  *
  * @param sampleRate the new sample rate to open the audio device with
  */
@@ -218,6 +357,8 @@ typedef NS_ENUM(NSInteger, SBSEndpointState) {
  * The responsibility of this method is to recreate any transports that are necessary after the local IP address changes due
  * to a reachability event. It should make a best effort to restore any active calls that might be lost due to the IP change.
  * Primarily, this consists of simply sending a re-invite with the updated IP address.
+ *
+ * How the old transports are torn down depends on the transportFailoverMode of the endpoint configuration.
  */
 - (void)handleReachabilityChange;
 
@@ -237,6 +378,93 @@ typedef NS_ENUM(NSInteger, SBSEndpointState) {
  */
 - (void)enableAudio;
 
+/**
+ * Places every call on hold, for example when a cellular call arrives
+ *
+ * All calls are acted on in a single pass on the endpoint's background thread, instead of one round trip per call,
+ * and their events are delivered as one batch. Calls that have been hung up are skipped. A call that can't be held
+ * doesn't stop the rest from being held.
+ *
+ * @return a future that completes once every call has been acted on, and fails with the first error
+ */
+- (SBSCallFuture *_Nonnull)holdAll;
+
+/**
+ * Hangs up every call with a 603 Decline status code, in a single pass like holdAll
+ *
+ * @return a future that completes once every call has been acted on, and fails with the first error
+ */
+- (SBSCallFuture *_Nonnull)hangupAll;
+
+/**
+ * Sends a re-invite to every call, in a single pass like holdAll
+ *
+ * @return a future that completes once every call has been acted on, and fails with the first error
+ */
+- (SBSCallFuture *_Nonnull)reinviteAll;
+
+/**
+ * Writes the SIP messages captured so far to a pcapng file
+ *
+ * The file holds the most recent sipCapturePackets messages, oldest first, each with the IP and UDP or TCP header it
+ * would have had on the wire, so it can be opened in Wireshark. Messages sent over TLS appear decrypted, as TCP.
+ * Capture carries on while the file is written.
+ *
+ * @param path     the file to write, which is replaced if it exists
+ * @param callback invoked on the main thread with the number of messages written, or an error if the endpoint
+ *                 isn't capturing or the file couldn't be written
+ */
+- (void)writeSipCaptureToPath:(NSString *_Nonnull)path completion:(void (^_Nullable)(NSUInteger, NSError *_Nullable))callback;
+
+/**
+ * Writes the call setup spans traced so far to a Chrome trace JSON file
+ *
+ * The file holds the most recent callTraceEvents spans, oldest first, with timestamps from a monotonic clock. It
+ * opens in chrome://tracing or Perfetto as a timeline with a track for each call, named after its Call-ID.
+ *
+ * @param call     the call to write the spans of, or nil for every call
+ * @param path     the file to write, which is replaced if it exists
+ * @param callback invoked on the main thread with the number of spans written, or an error if the endpoint isn't
+ *                 tracing or the file couldn't be written
+ */
+- (void)writeCallTraceForCall:(SBSCall *_Nullable)call toPath:(NSString *_Nonnull)path completion:(void (^_Nullable)(NSUInteger, NSError *_Nullable))callback;
+
+/**
+ * Starts recording the call callbacks PJSUA makes to a file, which can be replayed later
+ *
+ * Each callback is recorded with the call info it reads and any message it received, in a compact binary form that's
+ * buffered in memory, so recording can be left on while calls are made.
+ *
+ * @param path  the file to write, which is replaced if it exists
+ * @param error the reason recording couldn't start, which includes it having started already
+ * @return if recording started
+ */
+- (BOOL)startRecordingCallbacksToPath:(NSString *_Nonnull)path error:(NSError *_Nullable *_Nullable)error;
+
+/**
+ * Stops recording callbacks, and writes out whatever is buffered
+ *
+ * @return the number of callbacks recorded, or 0 if they weren't being recorded or the file couldn't be written
+ */
+- (NSUInteger)stopRecordingCallbacks;
+
+/**
+ * Replays a recording of callbacks through the calls and the endpoint, as fast as they'll go
+ *
+ * Calls are created and run through their states as they were when recorded, and the endpoint reconciles its state
+ * after each callback, without any SIP messages or media. Incoming calls are received on the given account, and
+ * outgoing calls are made from it. This is for measuring the call and endpoint logic in isolation, so it refuses to
+ * run while the endpoint has calls of its own, or is recording, and calls that are made or come in while it runs
+ * wait for it to finish.
+ *
+ * @param path     the recording
+ * @param account  the account calls are replayed on
+ * @param callback invoked on the main thread with how fast the recording was replayed, or an error if it couldn't be
+ */
+- (void)replayCallbacksFromPath:(NSString *_Nonnull)path
+                        account:(SBSAccount *_Nonnull)account
+                     completion:(void (^_Nullable)(SBSCallbackReplayStatistics *_Nullable, NSError *_Nullable))callback;
+
 /**
  * Returns the static shared endpoint
  *
@@ -6,7 +6,7 @@
 //  Copyright © 2016 Sipper. All rights reserved.
 //
 
-#import "SBSEndpoint.h"
+#import "SBSEndpoint+Internal.h"
 
 #if TARGET_OS_IPHONE
 #endif
@@ -15,17 +15,82 @@
 #import "NSError+SipperError.h"
 
 #import "SBSAccount+Internal.h"
+#import "SBSAccountConfiguration.h"
+#import "SBSAudioDeviceStatistics.h"
 #import "SBSCall+Internal.h"
+#import "SBSCallFuture+Internal.h"
+#import "SBSCallEventPool.h"
+#import "SBSCallRecordStore.h"
+#import "SBSCallbackLatencyStatistics.h"
+#import "SBSCallbackReplayStatistics.h"
 #import "SBSCodecDescriptor.h"
+#import "SBSDNSCacheStatistics.h"
 #import "SBSEndpointConfiguration.h"
+#import "SBSEndpointStartupMetrics.h"
+#import "SBSEventDelivery.h"
+#import "SBSICECandidateStatistics.h"
+#import "SBSKeepAliveService.h"
+#import "SBSMessageCompactionStatistics.h"
 #import "SBSTransportConfiguration.h"
+#import "SBSRegistrationMetrics.h"
+#import "SBSRegistrationScheduler.h"
 #import "SBSRingbackDescription.h"
+#import "SBSSrtpSuiteBenchmark.h"
+#import "SBSTLSHandshakeStatistics.h"
+#import "pj_call_trace.h"
+#import "pj_cb_latency.h"
+#import "pj_cb_record.h"
+#import "pj_dns_cache.h"
+#import "pj_ice_host_rank.h"
 #import "pj_nat64.h"
+#import "pj_rate_port.h"
+#import "pj_sip_capture.h"
+#import "pj_sip_compact.h"
+#import "pj_srtp_bench.h"
 #import <pjsua.h>
+#import <pjmedia-codec/opus.h>
 #import <pjsua-lib/pjsua_internal.h>
 
 static NSString *const EndpointErrorDomain = @"sipper.endpoint.error";
 
+/**
+ * Granularity of the registration scheduler, in seconds
+ */
+static NSTimeInterval const EndpointRegistrationSchedulerResolution = 0.1;
+
+/**
+ * Packets each SRTP suite is measured with when the endpoint starts, ten seconds of 20 ms audio
+ */
+static unsigned const EndpointSrtpCalibrationPackets = 500;
+
+/**
+ * How long each phase of startup took, in seconds
+ */
+typedef struct EndpointStartupTimes {
+  NSTimeInterval create;
+  NSTimeInterval initialize;
+  NSTimeInterval transport;
+  NSTimeInterval start;
+  NSTimeInterval thread;
+  NSTimeInterval ready;
+  NSTimeInterval extraTransports;
+  NSTimeInterval modules;
+  NSTimeInterval codecs;
+  NSTimeInterval ringback;
+  NSTimeInterval complete;
+  BOOL finished;
+} EndpointStartupTimes;
+
+/**
+ * Size of the pool a replayed callback's message is parsed into, which is reused from one callback to the next
+ */
+static pj_size_t const EndpointReplayPoolSize = 4 * PJSIP_MAX_PKT_LEN;
+
+/**
+ * Name the endpoint's state changes are coalesced under
+ */
+static NSString *const EndpointStateChange = @"endpointStateChange";
+
 #pragma mark - Forward Declarations
 
 static void onLogMessage(int, const char *, int);
@@ -38,6 +103,29 @@ static void onCallTsxState(pjsua_call_id callId, pjsip_transaction *tsx, pjsip_e
 static void onTransportState(pjsip_transport *transport, pjsip_transport_state state, const pjsip_transport_state_info *info);
 static void onSdpCreated(pjsua_call_id callId, pjmedia_sdp_session *sdp, pj_pool_t *pool, const pjmedia_sdp_session *remote);
 static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx, pjmedia_srtp_setting *srtp_opt);
+static pjmedia_transport *onAcquireMediaTransport(pjsua_call_id callId, unsigned mediaIndex, pjmedia_type type);
+static pj_status_t onEndpointUnload(void);
+
+/**
+ * Ahead of every other module, so PJSIP unloads it last as PJSUA destroys the endpoint. By then PJSUA is done
+ * unregistering accounts and ending calls, which still go through the C modules, but hasn't yet released the pool
+ * factory the modules allocate from.
+ */
+static pjsip_module endpointModule = {
+  NULL, NULL,                     /* prev, next.      */
+  { "mod-sipper", 10 },           /* Name.            */
+  -1,                             /* Id               */
+  -3,                             /* Priority         */
+  NULL,                           /* load()           */
+  NULL,                           /* start()          */
+  NULL,                           /* stop()           */
+  &onEndpointUnload,              /* unload()         */
+  NULL,                           /* on_rx_request()  */
+  NULL,                           /* on_rx_response() */
+  NULL,                           /* on_tx_request.   */
+  NULL,                           /* on_tx_response() */
+  NULL,                           /* on_tsx_state()   */
+};
 
 #pragma mark - Endpoint
 
@@ -46,6 +134,15 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
   pj_thread_t *pjBackgroundThread;
   pjmedia_port *pjRingbackPort;
   pjsua_conf_port_id pjRingbackConfPort;
+  pj_pool_t *pjRatePool;
+  pjmedia_port *pjRatePort;
+  pj_pool_t *pjSoundPool;
+  pjmedia_snd_port *pjSoundPort;
+  EndpointStartupTimes _startupTimes;
+  NSUInteger _generation;
+  BOOL _replacedKeepAliveIntervals;
+  long _tcpKeepAliveInterval;
+  long _tlsKeepAliveInterval;
 }
 
 @property(strong, nonatomic) NSArray *activeTransports;
@@ -54,6 +151,18 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
 @property(strong, nonatomic) NSMutableDictionary *accountsMap;
 @property(strong, nonatomic) NSSet<NSNumber *> *ringingCalls;
 @property(nonatomic) BOOL playingRingback;
+@property(nonatomic) BOOL soundDeviceNeeded;
+@property(strong, nonatomic) NSArray<NSValue *> *failoverTransports;
+@property(strong, nonatomic) NSHashTable<SBSCall *> *failoverCalls;
+@property(strong, nonatomic) NSDate *failoverStartedAt;
+@property(strong, nonatomic) NSTimer *failoverTimer;
+@property(nonatomic, readwrite) NSTimeInterval lastFailoverDuration;
+@property(strong, nonatomic, readwrite) SBSRegistrationScheduler *registrationScheduler;
+@property(strong, nonatomic) NSTimer *registrationTimer;
+@property(strong, nonatomic, readwrite) SBSKeepAliveService *keepAliveService;
+@property(strong, nonatomic, readwrite) SBSCallEventPool *callEventPool;
+@property(strong, nonatomic, readwrite) SBSEventDelivery *eventDelivery;
+@property(strong, nonatomic, readwrite) SBSCallRecordStore *callRecordStore;
 
 @end
 
@@ -70,6 +179,8 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
     _activeTransports = [NSArray array];
     _state = SBSEndpointStateIdle;
     _ringbackDescription = [SBSRingbackDescription usRingback];
+    pjRingbackConfPort = PJSUA_INVALID_ID;
+    _eventDelivery = [[SBSEventDelivery alloc] initWithTargetQueue:dispatch_get_main_queue() coalesceStateChanges:NO];
   }
   
   return self;
@@ -79,6 +190,20 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
 
 - (BOOL)initializeEndpointWithConfiguration:(SBSEndpointConfiguration *)configuration error:(NSError *__autoreleasing *)error {
   __block pj_status_t status;
+  NSTimeInterval began = [NSProcessInfo processInfo].systemUptime;
+  __block NSTimeInterval mark = began;
+  NSTimeInterval (^lap)(void) = ^NSTimeInterval {
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    NSTimeInterval elapsed = now - mark;
+    mark = now;
+    return elapsed;
+  };
+  
+  NSUInteger generation;
+  @synchronized(self) {
+    _startupTimes = (EndpointStartupTimes) {0};
+    generation = _generation;
+  }
   
   // Create a new instance of PJSUA. The default instance will be thread-confined to the thread it was created on. However,
   // background queues can be used if they're registered with the endpoint.
@@ -93,6 +218,10 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
     return NO;
   }
   
+  @synchronized(self) {
+    _startupTimes.create = lap();
+  }
+  
   // Convert all of the provided configuration into the appropriate structs
   pjsua_logging_config logging_config;
   pjsua_media_config media_config;
@@ -113,14 +242,92 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
     return NO;
   }
   
-  // Now, we need to iterate through each of the requested transports and configure them here
-  for (SBSTransportConfiguration *transportConfiguration in configuration.transportConfigurations) {
-    pjsua_transport_config transport_config;
-    pjsip_transport_type_e transport_type = [self convertTransportType:transportConfiguration.transportType];
-    [self convertTransportConfiguration:transportConfiguration config:&transport_config];
+  // The C modules set up from here on are shut down when this is unloaded
+  status = pjsip_endpt_register_module(pjsua_get_pjsip_endpt(), &endpointModule);
+  if (status != PJ_SUCCESS) {
+    [self destroyEndpointWithError:nil];
+    *error = [NSError ErrorWithUnderlying:nil
+                  localizedDescriptionKey:NSLocalizedString(@"Could not initialize endpoint", nil)
+              localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP error %d: %@", nil), status, fromPjError(status)]
+                              errorDomain:EndpointErrorDomain
+                                errorCode:SBSEndpointErrorCannotInitialize];
+    return NO;
+  }
+  
+  // Resume TLS sessions across reconnects. This must be set before any TLS transport is created.
+  pj_ssl_sock_session_cache_enable(configuration.tlsSessionResumption ? PJ_TRUE : PJ_FALSE);
+  
+  // Put the DNS cache in front of everything the endpoint resolves. Without nameservers there's no asynchronous
+  // resolver, and PJSIP keeps using getaddrinfo for SIP targets, but NAT64 lookups are still cached.
+  pjsip_endpoint *endpoint = pjsua_get_pjsip_endpt();
+  pj_dns_resolver *resolver = pjsip_endpt_get_resolver(endpoint);
+  status = pj_dns_cache_init(&pjsua_var.cp.factory,
+                             resolver,
+                             pjsip_endpt_get_timer_heap(endpoint),
+                             (unsigned) configuration.dnsPrefetchWindow,
+                             (unsigned) configuration.dnsMaxStaleAge);
+  if (status == PJ_SUCCESS && resolver != NULL) {
+    status = pj_dns_cache_enable_sip_resolver(endpoint);
+  }
+  
+  if (status != PJ_SUCCESS) {
+    [self destroyEndpointWithError:nil];
+    *error = [NSError ErrorWithUnderlying:nil
+                  localizedDescriptionKey:NSLocalizedString(@"Could not create the DNS cache", nil)
+              localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP error %d: %@", nil), status, fromPjError(status)]
+                              errorDomain:EndpointErrorDomain
+                                errorCode:SBSEndpointErrorCannotInitialize];
+    return NO;
+  }
+  
+  // Tracing is on before anything can place a call
+  if (configuration.callTraceEvents > 0) {
+    status = pj_call_trace_init(&pjsua_var.cp.factory, (unsigned) configuration.callTraceEvents);
+    if (status != PJ_SUCCESS) {
+      [self destroyEndpointWithError:nil];
+      *error = [NSError ErrorWithUnderlying:nil
+                    localizedDescriptionKey:NSLocalizedString(@"Could not enable call tracing", nil)
+                localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP error %d: %@", nil), status, fromPjError(status)]
+                                errorDomain:EndpointErrorDomain
+                                  errorCode:SBSEndpointErrorCannotInitialize];
+      return NO;
+    }
+  }
+  
+  // Rank host addresses before ICE transports turn them into candidates, so the ones we keep are the likely winners
+  status = pj_ice_host_rank_init(&pjsua_var.cp.factory);
+  if (status != PJ_SUCCESS) {
+    [self destroyEndpointWithError:nil];
+    *error = [NSError ErrorWithUnderlying:nil
+                  localizedDescriptionKey:NSLocalizedString(@"Could not initialize ICE candidate ranking", nil)
+              localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP error %d: %@", nil), status, fromPjError(status)]
+                              errorDomain:EndpointErrorDomain
+                                errorCode:SBSEndpointErrorCannotInitialize];
+    return NO;
+  }
+  
+  // With a shared keep-alive timer, turn off the one PJSIP runs for each connection. This must also be set before
+  // any connection is created. The setting is process-wide, so it's put back when the endpoint is destroyed.
+  if (configuration.keepAliveInterval > 0) {
+    if (!_replacedKeepAliveIntervals) {
+      _replacedKeepAliveIntervals = YES;
+      _tcpKeepAliveInterval = pjsip_cfg()->tcp.keep_alive_interval;
+      _tlsKeepAliveInterval = pjsip_cfg()->tls.keep_alive_interval;
+    }
     
-    pjsua_transport_id transport_id;
-    status = pjsua_transport_create(transport_type, &transport_config, &transport_id);
+    pjsip_cfg()->tcp.keep_alive_interval = 0;
+    pjsip_cfg()->tls.keep_alive_interval = 0;
+  }
+  
+  @synchronized(self) {
+    _startupTimes.initialize = lap();
+  }
+  
+  // Only the first transport is on the critical path, since it's all an account needs to register. The rest are
+  // created with the deferred work.
+  SBSTransportConfiguration *firstTransport = configuration.transportConfigurations.firstObject;
+  if (firstTransport != nil) {
+    status = [self createTransportWithConfiguration:firstTransport];
     if (status != PJ_SUCCESS) {
       [self destroyEndpointWithError:nil];
       *error = [NSError ErrorWithUnderlying:nil
@@ -132,6 +339,10 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
     }
   }
   
+  @synchronized(self) {
+    _startupTimes.transport = lap();
+  }
+  
   // And, finally, we can start the endpoint - this enables PJSUA to be used
   status = pjsua_start();
   if (status != PJ_SUCCESS) {
@@ -144,12 +355,18 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
     return NO;
   }
   
+  @synchronized(self) {
+    _startupTimes.start = lap();
+  }
+  
   // Assign a thread priority. Answering/hanging up/calling is done on this background thread, so you probably
   // want a high thread priority to ensure the user isn't waiting on these actions to happen.
   _backgroundThread.threadPriority = configuration.backgroundThreadPriority;
   
-  // Start the background thread
-  [_backgroundThread start];
+  // Start the background thread, which keeps running when the endpoint is destroyed, so it's only started once
+  if (!_backgroundThread.executing) {
+    [_backgroundThread start];
+  }
   
   // Perform a block to register the background thread
   [self performSelector:@selector(performAsyncWithBlock:) onThread:_backgroundThread withObject:^{
@@ -167,259 +384,1257 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
     return NO;
   }
   
-  // Enable NAT64 rewrite
-  status = pj_nat64_enable_rewrite_module();
-  pj_nat64_set_options(NAT64_REWRITE_INCOMING_SDP);
-  if (status != PJ_SUCCESS) {
-    [self destroyEndpointWithError:nil];
-    *error = [NSError ErrorWithUnderlying:nil
-                  localizedDescriptionKey:NSLocalizedString(@"Could not enable the NAT64 rewriting module", nil)
-              localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
-                              errorDomain:EndpointErrorDomain
-                                errorCode:SBSEndpointErrorCannotRegisterThread];
-    return NO;
+  // Open the call record store, picking up after whatever the last run committed. This is done before any
+  // deferred work is queued, so a failure here has nothing running on the background thread to tear down.
+  if (configuration.callRecordPath != nil) {
+    NSError *storeError;
+    _callRecordStore = [[SBSCallRecordStore alloc] initWithPath:configuration.callRecordPath
+                                                       capacity:configuration.callRecordCapacity
+                                                          files:configuration.callRecordFiles
+                                                          error:&storeError];
+    if (_callRecordStore == nil) {
+      [self destroyEndpointWithError:nil];
+      *error = [NSError ErrorWithUnderlying:storeError
+                    localizedDescriptionKey:NSLocalizedString(@"Could not open the call record store", nil)
+                localizedFailureReasonError:storeError.localizedDescription
+                                errorDomain:EndpointErrorDomain
+                                  errorCode:SBSEndpointErrorCannotInitialize];
+      return NO;
+    }
+  }
+  
+  // Whatever the previous delivery still holds is already on its way to the previous queue
+  _eventDelivery = [[SBSEventDelivery alloc] initWithTargetQueue:configuration.eventQueue ?: dispatch_get_main_queue()
+                                            coalesceStateChanges:configuration.coalesceStateChangeEvents];
+  
+  if (configuration.callEventPoolCapacity > 0) {
+    _callEventPool = [[SBSCallEventPool alloc] initWithCapacity:configuration.callEventPoolCapacity];
+  }
+  
+  // Everything that isn't needed to register or place a call is finished on the background thread. It's queued ahead
+  // of everything else there, so registrations (and anything the application queues) run after it.
+  [self performAsync:^{
+    
+    // The endpoint may have been destroyed on this thread before it got here
+    @synchronized(self) {
+      if (_generation != generation) {
+        return;
+      }
+    }
+    
+    [self performDeferredStartup:configuration mediaConfig:media_config began:began];
+  }];
+  
+  // Start the registration scheduler, which is driven from the background thread
+  _registrationScheduler = [[SBSRegistrationScheduler alloc] initWithMaxInFlight:configuration.maxConcurrentRegistrations
+                                                                       resolution:EndpointRegistrationSchedulerResolution
+                                                                   retryBaseDelay:configuration.registrationRetryBaseDelay
+                                                                              now:[NSProcessInfo processInfo].systemUptime
+                                                                           sender:^BOOL(NSNumber *accountId) {
+    SBSAccount *account = (__bridge SBSAccount *) pjsua_acc_get_user_data(accountId.intValue);
+    return account != nil && [account sendRegistration];
+  }];
+  
+  [self performAsync:^{
+    _registrationTimer = [NSTimer scheduledTimerWithTimeInterval:EndpointRegistrationSchedulerResolution
+                                                          target:self
+                                                        selector:@selector(registrationTimerFired:)
+                                                        userInfo:nil
+                                                         repeats:YES];
+  }];
+  
+  // Start the shared keep-alive timer, which also runs on the background thread
+  if (configuration.keepAliveInterval > 0) {
+    _keepAliveService = [[SBSKeepAliveService alloc] initWithInterval:configuration.keepAliveInterval];
+    _keepAliveService.streamTransports = ^NSArray<NSValue *> *{
+      return [[SBSEndpoint sharedEndpoint] referenceActiveTransports];
+    };
+    
+    [self performAsync:^{
+      [_keepAliveService start];
+    }];
   }
   
   // Disable sound device by default
   pjsua_set_no_snd_dev();
   
-  // Create a tone generator to use for ringback
+  @synchronized(self) {
+    _startupTimes.thread = lap();
+    _startupTimes.ready = mark - began;
+  }
+  
+  // Update the configuration that is in use
+  _configuration = configuration;
+  
+  // We're successful if we didn't set an error pointer
+  return YES;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)performDeferredStartup:(SBSEndpointConfiguration *)configuration mediaConfig:(pjsua_media_config)media_config began:(NSTimeInterval)began {
+  EndpointStartupTimes times = {0};
+  NSTimeInterval mark = [NSProcessInfo processInfo].systemUptime;
+  NSTimeInterval now;
+  pj_status_t status;
+  
+  // The endpoint is already usable, so nothing that fails from here on fails the endpoint. It's left without the
+  // feature that failed.
+  NSArray<SBSTransportConfiguration *> *transportConfigurations = configuration.transportConfigurations;
+  for (NSUInteger i = 1; i < transportConfigurations.count; i++) {
+    status = [self createTransportWithConfiguration:transportConfigurations[i]];
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to create transport %lu: %@", (unsigned long) i, fromPjError(status));
+    }
+  }
+  
+  now = [NSProcessInfo processInfo].systemUptime;
+  times.extraTransports = now - mark;
+  mark = now;
+  
+  // NAT64 rewriting only applies to messages that arrive over IPv6, so it's not needed without an IPv6 transport
+  if ([self hasIPv6TransportConfiguration:configuration]) {
+    status = pj_nat64_enable_rewrite_module();
+    pj_nat64_set_options(NAT64_REWRITE_INCOMING_SDP);
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to enable the NAT64 rewriting module: %@", fromPjError(status));
+    }
+  }
+  
+  // Compaction has to see messages after the NAT64 module has added its candidates to them
+  if (configuration.sipMessageCompaction) {
+    status = pj_sip_compact_init(&pjsua_var.cp.factory, pjsua_get_pjsip_endpt(), (unsigned) configuration.sipMessageSizeBudget);
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to enable SIP message compaction: %@", fromPjError(status));
+    }
+  }
+  
+  // Capture sees messages before any other module on the way in, and after all of them on the way out
+  if (configuration.sipCapturePackets > 0) {
+    status = pj_sip_capture_init(pjsua_get_pjsip_endpt(), (unsigned) configuration.sipCapturePackets);
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to enable SIP capture: %@", fromPjError(status));
+    }
+  }
+  
+  // PJSUA initialized libsrtp along with its media subsystem, so suites can be measured now. Calls set up before this
+  // is done offer suites in the default order.
+  if (configuration.srtpSuiteOrder != SBSSrtpSuiteOrderDefault) {
+    status = pj_srtp_bench_calibrate(&pjsua_var.cp.factory, [self convertSrtpSuiteOrder:configuration.srtpSuiteOrder], EndpointSrtpCalibrationPackets);
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to calibrate SRTP crypto suites: %@", fromPjError(status));
+    }
+  }
+  
+  now = [NSProcessInfo processInfo].systemUptime;
+  times.modules = now - mark;
+  mark = now;
+  
+  // Calls using Opus start out protected, until their controller has heard how the network is doing
+  if (configuration.adaptiveOpus) {
+    [self configureAdaptiveOpus:configuration];
+  }
+  
+  now = [NSProcessInfo processInfo].systemUptime;
+  times.codecs = now - mark;
+  mark = now;
+  
+  // Create a tone generator to use for ringback. The pool is shared with calls being set up on other threads.
   pj_str_t ringback = pj_str("ringback");
   int samples_per_frame = media_config.audio_frame_ptime *
                           media_config.clock_rate *
                           media_config.channel_count / 1000;
   
+  pjmedia_port *port = NULL;
+  PJSUA_LOCK();
   status = pjmedia_tonegen_create2(pjsua_var.pool, &ringback,
                           media_config.snd_clock_rate,
                           media_config.channel_count,
                           samples_per_frame,
                           16,
                           PJMEDIA_TONEGEN_LOOP,
-                          &pjRingbackPort);
-  if (status != PJ_SUCCESS) {
-    [self destroyEndpointWithError:nil];
-    *error = [NSError ErrorWithUnderlying:nil
-                  localizedDescriptionKey:NSLocalizedString(@"Could not create the tone generator", nil)
-              localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
-                              errorDomain:EndpointErrorDomain
-                                errorCode:SBSEndpointErrorCannotRegisterThread];
-    return NO;
-  }
+                          &port);
+  PJSUA_UNLOCK();
   
   // Register tone generator with the conference bridge
-  status = pjsua_conf_add_port(pjsua_var.pool, pjRingbackPort, &pjRingbackConfPort);
-  if (status != PJ_SUCCESS) {
-    [self destroyEndpointWithError:nil];
-    *error = [NSError ErrorWithUnderlying:nil
-                  localizedDescriptionKey:NSLocalizedString(@"Could not register the tone generator with the conference bridge", nil)
-              localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
-                              errorDomain:EndpointErrorDomain
-                                errorCode:SBSEndpointErrorCannotRegisterThread];
-    return NO;
+  pjsua_conf_port_id conf_port = PJSUA_INVALID_ID;
+  if (status == PJ_SUCCESS) {
+    status = pjsua_conf_add_port(pjsua_var.pool, port, &conf_port);
   }
   
-  // Update the configuration that is in use
-  _configuration = configuration;
+  if (status == PJ_SUCCESS) {
+    pjRingbackPort = port;
+    pjRingbackConfPort = conf_port;
+  } else {
+    NSLog(@"Failed to create the ringback tone generator, calls will not play ringback: %@", fromPjError(status));
+  }
   
-  // We're successful if we didn't set an error pointer
-  return YES;
+  now = [NSProcessInfo processInfo].systemUptime;
+  times.ringback = now - mark;
+  
+  @synchronized(self) {
+    _startupTimes.extraTransports = times.extraTransports;
+    _startupTimes.modules = times.modules;
+    _startupTimes.codecs = times.codecs;
+    _startupTimes.ringback = times.ringback;
+    _startupTimes.complete = now - began;
+    _startupTimes.finished = YES;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)createTransportWithConfiguration:(SBSTransportConfiguration *)transportConfiguration {
+  pjsua_transport_config transport_config;
+  pjsip_transport_type_e transport_type = [self convertTransportType:transportConfiguration.transportType];
+  [self convertTransportConfiguration:transportConfiguration config:&transport_config];
+  
+  pjsua_transport_id transport_id;
+  return pjsua_transport_create(transport_type, &transport_config, &transport_id);
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)hasIPv6TransportConfiguration:(SBSEndpointConfiguration *)configuration {
+  for (SBSTransportConfiguration *transportConfiguration in configuration.transportConfigurations) {
+    pjsip_transport_type_e transport_type = [self convertTransportType:transportConfiguration.transportType];
+    if ((transport_type & PJSIP_TRANSPORT_IPV6) == PJSIP_TRANSPORT_IPV6) {
+      return YES;
+    }
+  }
+  
+  return NO;
 }
 
 //------------------------------------------------------------------------------
 
 - (BOOL)destroyEndpointWithError:(NSError *__autoreleasing *)error {
+  @synchronized(self) {
+    _generation++;
+  }
+  
+  if (pj_cb_record_enabled()) {
+    pj_cb_record_stop(NULL);
+  }
+  
+  // Everything scheduled on the background thread's run loop has to stop before PJSUA goes away
+  [self performSync:^{
+    
+    // The pools are confined to the background thread, like the transports they hold
+    for (SBSAccount *account in self.accounts) {
+      [account drainMediaTransports];
+    }
+    
+    // Registrations the scheduler still has queued are dropped along with the accounts. The timer also retains us.
+    [_registrationTimer invalidate];
+    _registrationTimer = nil;
+    
+    // A failover that's still in its grace period holds references to the old flows and their replacements
+    [self completeFailover:NO];
+    
+    // The service holds references to the datagram transports it sends on, which have to be released while the
+    // transports still exist
+    [_keepAliveService stop];
+    _keepAliveService = nil;
+    
+    // The sound device and its adapter are the endpoint's, not PJSUA's, and their pools come from PJSUA
+    [self closeSoundDevice];
+    if (pjRatePort != NULL) {
+      pjmedia_port_destroy(pjRatePort);
+      pjRatePort = NULL;
+      pj_pool_release(pjRatePool);
+      pjRatePool = NULL;
+    }
+  }];
+  
+  // The C modules are shut down partway through, once nothing is left that needs them (see endpointModule)
   pjsua_destroy();
   
+  // Calls ended by the shutdown have been recorded by now
+  [_callRecordStore close];
+  _callRecordStore = nil;
+  _callEventPool = nil;
+  
+  // The ringback port went with the pool it was allocated from
+  pjRingbackPort = NULL;
+  pjRingbackConfPort = PJSUA_INVALID_ID;
+  
+  // The connections that had their own keep-alive timers turned off are gone
+  if (_replacedKeepAliveIntervals) {
+    pjsip_cfg()->tcp.keep_alive_interval = _tcpKeepAliveInterval;
+    pjsip_cfg()->tls.keep_alive_interval = _tlsKeepAliveInterval;
+    _replacedKeepAliveIntervals = NO;
+  }
+  
+  @synchronized(self) {
+    _startupTimes = (EndpointStartupTimes) {0};
+  }
+  
   return YES;
 }
 
 //------------------------------------------------------------------------------
 
+- (void)configureAdaptiveOpus:(SBSEndpointConfiguration *)configuration {
+  pjmedia_codec_mgr *codec_mgr = pjmedia_endpt_get_codec_mgr(pjsua_get_pjmedia_endpt());
+  pj_str_t codec_id = pj_str("opus");
+  const pjmedia_codec_info *codec_info[1];
+  unsigned count = PJ_ARRAY_SIZE(codec_info);
+  
+  // Opus is optional in PJSIP builds, and there's nothing to configure without it
+  if (pjmedia_codec_mgr_find_codecs_by_id(codec_mgr, &codec_id, &count, codec_info, NULL) != PJ_SUCCESS || count == 0) {
+    NSLog(@"Opus is not available, calls will not use adaptive Opus");
+    return;
+  }
+  
+  pjmedia_codec_opus_config config;
+  pjmedia_codec_param param;
+  pjmedia_codec_opus_get_config(&config);
+  pj_status_t status = pjmedia_codec_mgr_get_default_param(codec_mgr, codec_info[0], &param);
+  
+  // The same settings the controller starts with, which also advertise useinbandfec=1 so the remote protects
+  // what it sends us too
+  config.bit_rate = (unsigned) configuration.opusMaxBitrate;
+  config.packet_loss = 10;
+  param.setting.plc = 1;
+  param.setting.vad = 0;
+  
+  if (status == PJ_SUCCESS) {
+    status = pjmedia_codec_opus_set_default_param(&config, &param);
+  }
+  
+  if (status != PJ_SUCCESS) {
+    NSLog(@"Failed to set default Opus parameters: %d", status);
+  }
+}
+
+//------------------------------------------------------------------------------
+
 - (BOOL)codecDescriptor:(SBSCodecDescriptor *)descriptor matchesIdentifier:(NSString *)identifier {
   NSArray<NSString *> *parts = [identifier componentsSeparatedByString:@"/"];
   NSString *encodingName = parts[0];
   NSUInteger samplingRate = [parts[1] integerValue];
   NSUInteger numberOfChannels = [parts[2] integerValue];
   
-  return [encodingName isEqualToString:descriptor.encoding]
-  && (descriptor.samplingRate == 0 || descriptor.samplingRate == samplingRate)
-  && (descriptor.numberOfChannels == 0 || descriptor.numberOfChannels == numberOfChannels);
+  return [encodingName isEqualToString:descriptor.encoding]
+  && (descriptor.samplingRate == 0 || descriptor.samplingRate == samplingRate)
+  && (descriptor.numberOfChannels == 0 || descriptor.numberOfChannels == numberOfChannels);
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSAccount *)createAccountWithConfiguration:(SBSAccountConfiguration *)configuration error:(NSError *__autoreleasing *)error {
+  SBSAccount *account = [SBSAccount accountWithConfiguration:configuration endpoint:self error:error];
+  
+  // Stop here if we didn't get an account
+  if (account == nil) {
+    return nil;
+  }
+  
+  // Successful creation, register the account with sipper
+  return self.accountsMap[account.uuid] = account;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)removeAccount:(NSUUID *)id {
+  SBSAccount *account = self.accountsMap[id];
+  
+  [account stopRegistration];
+  [self.accountsMap removeObjectForKey:id];
+  
+  [self performAsync:^{
+    [account drainMediaTransports];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)updatePreferredCodecs:(NSArray<SBSCodecDescriptor *> *)descriptors completion:(void (^)(BOOL, NSError *_Nullable))callback {
+  [self performAsync:^{
+    NSError *error;
+    pj_status_t status;
+    
+    const unsigned codec_info_size = 64;
+    unsigned codec_count = codec_info_size;
+    pjsua_codec_info codec_info[codec_info_size];
+    
+    status = pjsua_enum_codecs(codec_info, &codec_count);
+    if (status != PJ_SUCCESS) {
+      error = [NSError ErrorWithUnderlying:nil
+                   localizedDescriptionKey:NSLocalizedString(@"Could not register thread", nil)
+               localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
+                               errorDomain:EndpointErrorDomain
+                                 errorCode:SBSEndpointErrorCannotRegisterThread];
+      callback(NO, error);
+      return;
+    }
+    
+    // Push all codecs into a codec list
+    NSMutableSet<NSString *> *unmatchedCodecs = [[NSMutableSet alloc] init];
+    NSUInteger attachedCodecs = 0;
+    for (NSUInteger i = 0; i < codec_count; i++) {
+      [unmatchedCodecs addObject:[NSString stringWithPJString:codec_info[i].codec_id]];
+    }
+    
+    // Now, iterate over our preferred codecs map and find matches
+    for (SBSCodecDescriptor *descriptor in descriptors) {
+      
+      // Find any matching codecs in the result
+      for (NSUInteger i = 0; i < codec_count; i++) {
+        NSString *codecIdentifier = [NSString stringWithPJString:codec_info[i].codec_id];
+        
+        // Stop here if this codec doesn't match
+        if (![self codecDescriptor:descriptor matchesIdentifier:codecIdentifier]) {
+          continue;
+        }
+        
+        // This codec had a match, we can pull it out of the unmatched list
+        [unmatchedCodecs removeObject:codecIdentifier];
+        
+        // And, assign this codec's priority from the number of codecs we've already assigned
+        pj_uint8_t priority = PJMEDIA_CODEC_PRIO_HIGHEST - attachedCodecs++;
+        NSLog(@"Codec %@ matches codec descriptor %@, assigning priority %d", codecIdentifier, descriptor, priority);
+        status = pjsua_codec_set_priority(&codec_info[i].codec_id, priority);
+        
+        if (status != PJ_SUCCESS) {
+          error = [NSError ErrorWithUnderlying:nil
+                       localizedDescriptionKey:NSLocalizedString(@"Could not register thread", nil)
+                   localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
+                                   errorDomain:EndpointErrorDomain
+                                     errorCode:SBSEndpointErrorCannotRegisterThread];
+          callback(NO, error);
+          return;
+        }
+      }
+      
+    }
+    
+    // Disable any remaining unmatched codecs
+    for (NSString *codecIdentifier in unmatchedCodecs) {
+      NSLog(@"Codec %@ not found in priority list, disabling", codecIdentifier);
+      
+      pj_str_t codec_identifier = codecIdentifier.pjString;
+      status = pjsua_codec_set_priority(&codec_identifier, 0);
+      if (status != PJ_SUCCESS) {
+        error = [NSError ErrorWithUnderlying:nil
+                     localizedDescriptionKey:NSLocalizedString(@"Could not register thread", nil)
+                 localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
+                                 errorDomain:EndpointErrorDomain
+                                   errorCode:SBSEndpointErrorCannotRegisterThread];
+        callback(NO, error);
+        return;
+      }
+    }
+    
+    callback(YES, nil);
+    return;
+  }];
+ }
+
+//------------------------------------------------------------------------------
+
+- (void)writeSipCaptureToPath:(NSString *)path completion:(void (^)(NSUInteger, NSError *_Nullable))callback {
+  [self performAsync:^{
+    unsigned count = 0;
+    pj_status_t status = pj_sip_capture_write(path.fileSystemRepresentation, &count);
+
+    NSError *error;
+    if (status != PJ_SUCCESS) {
+      NSString *description = status == PJ_EINVALIDOP ? NSLocalizedString(@"SIP capture is not enabled", nil)
+                                                      : NSLocalizedString(@"Could not write the SIP capture", nil);
+      error = [NSError ErrorWithUnderlying:nil
+                   localizedDescriptionKey:description
+               localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP error %d: %@", nil), status, fromPjError(status)]
+                               errorDomain:EndpointErrorDomain
+                                 errorCode:SBSEndpointErrorCannotWriteCapture];
+    }
+
+    if (callback != nil) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        callback(count, error);
+      });
+    }
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)writeCallTraceForCall:(SBSCall *)call toPath:(NSString *)path completion:(void (^)(NSUInteger, NSError *_Nullable))callback {
+  [self performAsync:^{
+    unsigned count = 0;
+    pj_status_t status = pj_call_trace_write(path.fileSystemRepresentation, call != nil ? call.traceId : 0, &count);
+    
+    NSError *error;
+    if (status != PJ_SUCCESS) {
+      NSString *description = status == PJ_EINVALIDOP ? NSLocalizedString(@"Call tracing is not enabled", nil)
+                                                      : NSLocalizedString(@"Could not write the call trace", nil);
+      error = [NSError ErrorWithUnderlying:nil
+                   localizedDescriptionKey:description
+               localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP error %d: %@", nil), status, fromPjError(status)]
+                               errorDomain:EndpointErrorDomain
+                                 errorCode:SBSEndpointErrorCannotWriteTrace];
+    }
+    
+    if (callback != nil) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        callback(count, error);
+      });
+    }
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)startRecordingCallbacksToPath:(NSString *)path error:(NSError *__autoreleasing *)error {
+  pj_status_t status = pj_cb_record_start(&pjsua_var.cp.factory, path.fileSystemRepresentation);
+  if (status != PJ_SUCCESS) {
+    if (error != NULL) {
+      NSString *description = status == PJ_EINVALIDOP ? NSLocalizedString(@"Callbacks are already being recorded", nil)
+                                                      : NSLocalizedString(@"Could not record callbacks", nil);
+      *error = [NSError ErrorWithUnderlying:nil
+                    localizedDescriptionKey:description
+                localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP error %d: %@", nil), status, fromPjError(status)]
+                                errorDomain:EndpointErrorDomain
+                                  errorCode:SBSEndpointErrorCannotRecordCallbacks];
+    }
+    return NO;
+  }
+  
+  return YES;
+}
+
+//------------------------------------------------------------------------------
+
+- (NSUInteger)stopRecordingCallbacks {
+  unsigned count = 0;
+  pj_cb_record_stop(&count);
+  return count;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)replayCallbacksFromPath:(NSString *)path account:(SBSAccount *)account completion:(void (^)(SBSCallbackReplayStatistics *_Nullable, NSError *_Nullable))callback {
+  [self performAsync:^{
+    SBSCallbackReplayStatistics *statistics;
+    pj_status_t status;
+    
+    // Replayed calls take the indexes they were recorded with, which the endpoint's own calls could be using. PJSUA
+    // only hands out call indexes under its lock, so holding it for the whole replay also keeps a call that comes in
+    // or is made meanwhile from taking one of them. It waits until the replay is done.
+    PJSUA_LOCK();
+    if (pj_cb_record_enabled() || pjsua_call_get_count() > 0) {
+      status = PJ_EINVALIDOP;
+    } else {
+      pj_pool_t *pool = pjsua_pool_create("replay", EndpointReplayPoolSize, EndpointReplayPoolSize);
+      pj_cb_record_reader *reader;
+      
+      status = pj_cb_record_open(pool, path.fileSystemRepresentation, &reader);
+      if (status == PJ_SUCCESS) {
+        status = [self replayRecording:reader account:account statistics:&statistics];
+        pj_cb_record_close(reader);
+      }
+      
+      pj_pool_release(pool);
+    }
+    PJSUA_UNLOCK();
+    
+    NSError *error;
+    if (status != PJ_SUCCESS) {
+      NSString *description = status == PJ_EINVALIDOP ? NSLocalizedString(@"Callbacks can't be replayed while there are calls, or while recording", nil)
+                                                      : NSLocalizedString(@"Could not replay the recording", nil);
+      error = [NSError ErrorWithUnderlying:nil
+                   localizedDescriptionKey:description
+               localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP error %d: %@", nil), status, fromPjError(status)]
+                               errorDomain:EndpointErrorDomain
+                                 errorCode:SBSEndpointErrorCannotReplayCallbacks];
+      statistics = nil;
+    }
+    
+    if (callback != nil) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        callback(statistics, error);
+      });
+    }
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)replayRecording:(pj_cb_record_reader *)reader account:(SBSAccount *)account statistics:(SBSCallbackReplayStatistics **)statistics {
+  pj_pool_t *pool = pjsua_pool_create("replaymsg", EndpointReplayPoolSize, EndpointReplayPoolSize);
+  NSMutableSet<SBSCall *> *calls = [[NSMutableSet alloc] init];
+  NSUInteger events = 0;
+  pj_cb_record_event event;
+  pj_status_t status;
+  
+  // Calls read their info from the recording from here on
+  pj_cb_record_set_replay(reader);
+  
+  pj_uint64_t began = pj_cb_latency_now();
+  
+  while ((status = pj_cb_record_read(reader, &event)) == PJ_SUCCESS) {
+    @autoreleasepool {
+      if ([self replayCallback:&event account:account pool:pool]) {
+        events++;
+        
+        // Held for the rest of the replay, like the application would hold them
+        void *data = pjsua_call_get_user_data(event.call_id);
+        if (data != NULL) {
+          [calls addObject:(__bridge SBSCall *) data];
+        }
+      }
+    }
+    
+    pj_pool_reset(pool);
+  }
+  
+  // Calls the recording stopped in the middle of are ended, so nothing is left attached to the PJSUA calls
+  for (SBSCall *call in calls) {
+    if (call.callId >= 0) {
+      [call endCallWithError:nil];
+    }
+  }
+  [self reconcileState];
+  
+  pj_uint64_t ended = pj_cb_latency_now();
+  
+  pj_cb_record_set_replay(NULL);
+  pj_pool_release(pool);
+  
+  if (status != PJ_EEOF) {
+    return status;
+  }
+  
+  *statistics = [[SBSCallbackReplayStatistics alloc] initWithEvents:events
+                                                              calls:calls.count
+                                                           duration:(ended - began) / 1e9];
+  return PJ_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)replayCallback:(const pj_cb_record_event *)event account:(SBSAccount *)account pool:(pj_pool_t *)pool {
+  pjsua_call_id callId = event->call_id;
+  if (callId < 0 || callId >= (pjsua_call_id) pjsua_call_get_max_count()) {
+    return NO;
+  }
+  
+  // The parser wants a terminated copy of the message it can write to
+  pjsip_rx_data rdata;
+  pj_bzero(&rdata, sizeof(rdata));
+  if (event->message.slen > 0) {
+    char *buffer = (char *) pj_pool_alloc(pool, event->message.slen + 1);
+    pj_memcpy(buffer, event->message.ptr, event->message.slen);
+    buffer[event->message.slen] = '\0';
+    
+    rdata.msg_info.msg_buf = buffer;
+    rdata.msg_info.len = (int) event->message.slen;
+    rdata.msg_info.msg = pjsip_parse_msg(pool, buffer, event->message.slen, NULL);
+    if (rdata.msg_info.msg != NULL) {
+      rdata.msg_info.cid = (pjsip_cid_hdr *) pjsip_msg_find_hdr(rdata.msg_info.msg, PJSIP_H_CALL_ID, NULL);
+    }
+  }
+  
+  switch (event->type) {
+    case PJ_CB_RECORD_INCOMING_CALL: {
+      if (rdata.msg_info.msg == NULL) {
+        return NO;
+      }
+      
+      onIncomingCall(account.accountId, callId, &rdata);
+      return YES;
+    }
+      
+    case PJ_CB_RECORD_CALL_STATE: {
+      
+      // Outgoing calls are in the calling state when they're first seen, and are made from the account
+      if (event->state == PJSIP_INV_STATE_CALLING && pjsua_call_get_user_data(callId) == NULL) {
+        SBSCall *call = [account callWithDestination:[NSString stringWithPJString:event->remote_info] headers:nil start:NO];
+        [call attachCall:callId];
+      }
+      
+      pjsip_event pjEvent;
+      pj_bzero(&pjEvent, sizeof(pjEvent));
+      pjEvent.type = PJSIP_EVENT_UNKNOWN;
+      onCallState(callId, &pjEvent);
+      return YES;
+    }
+      
+    case PJ_CB_RECORD_CALL_MEDIA_STATE: {
+      onCallMediaState(callId);
+      return YES;
+    }
+      
+    case PJ_CB_RECORD_CALL_TSX_STATE: {
+      pjsip_transaction *tsx = PJ_POOL_ZALLOC_T(pool, pjsip_transaction);
+      tsx->role = event->role;
+      tsx->state = event->tsx_state;
+      tsx->transport_err = event->transport_err;
+      pjsip_method_init_np(&tsx->method, (pj_str_t *) &event->method);
+      
+      // Nothing can be sent on a replayed transaction, so requests are replayed as already answered
+      if (tsx->role == PJSIP_ROLE_UAS && tsx->state < PJSIP_TSX_STATE_COMPLETED) {
+        tsx->state = PJSIP_TSX_STATE_COMPLETED;
+      }
+      
+      pjsip_event pjEvent;
+      pj_bzero(&pjEvent, sizeof(pjEvent));
+      pjEvent.type = PJSIP_EVENT_TSX_STATE;
+      pjEvent.body.tsx_state.tsx = tsx;
+      pjEvent.body.tsx_state.type = event->event_type;
+      
+      if (event->event_type == PJSIP_EVENT_RX_MSG) {
+        if (rdata.msg_info.msg == NULL) {
+          return NO;
+        }
+        pjEvent.body.tsx_state.src.rdata = &rdata;
+      }
+      
+      onCallTsxState(callId, tsx, &pjEvent);
+      return YES;
+    }
+  }
+  
+  return NO;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSAccount *)findAccount:(NSUUID *)id {
+  return self.accountsMap[id];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)handleReachabilityChange {
+  
+  // Cached addresses (especially ones synthesized for NAT64) may not be valid on the new network
+  pj_dns_cache_clear();
+  
+  // The same goes for the candidates of any warm media transports, whichever failover mode we're in
+  for (SBSAccount *account in self.accounts) {
+    [account refreshMediaTransports];
+  }
+  
+  // In make-before-break mode, keep the old flows around until their replacements are carrying the calls
+  if (_configuration.transportFailoverMode == SBSTransportFailoverModeMakeBeforeBreak) {
+    [self performAsync:^{
+      [self failoverTransports];
+    }];
+    return;
+  }
+  
+  // Destroy all existing transports - they're most likely not safe at this point
+  for (NSValue *wrapper in _activeTransports) {
+    pj_status_t status = pjsip_transport_shutdown((pjsip_transport *) wrapper.pointerValue);
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to close active transport: %d", status);
+    }
+  }
+  
+  // Now, handle reachability on all accounts, which should fan out to perform a
+  // re-invite on all calls
+  for (SBSAccount *account in self.accounts) {
+    [account handleReachabilityChange];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (NSArray<NSValue *> *)referenceActiveTransports {
+  
+  // Transports are only unlisted from their own state callbacks, which PJSIP invokes before it frees them and which
+  // hold the lock of the list they're replacing. A transport that's still listed once we hold the current list's
+  // lock can't be freed before it has our reference.
+  while (YES) {
+    NSArray<NSValue *> *transports = self.activeTransports;
+    @synchronized (transports) {
+      if (transports != self.activeTransports) {
+        continue;
+      }
+      
+      for (NSValue *wrapper in transports) {
+        pjsip_transport_add_ref((pjsip_transport *) wrapper.pointerValue);
+      }
+      
+      return transports;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)failoverTransports {
+  
+  // Drop anything left over from a previous failover that never completed
+  [self completeFailover:NO];
+  
+  NSMutableArray<NSValue *> *retained = [[NSMutableArray alloc] init];
+  for (NSValue *wrapper in self.activeTransports) {
+    pjsip_transport *transport = (pjsip_transport *) wrapper.pointerValue;
+    
+    // Calls release their own references as soon as the transport is shut down, so hold one here to keep the
+    // old flow alive until the calls have moved over
+    pjsip_transport_add_ref(transport);
+    [retained addObject:wrapper];
+    
+    // Shutting down only unlists the transport from the manager, which forces new requests onto a new connection
+    pj_status_t status = pjsip_transport_shutdown(transport);
+    if (status != PJ_SUCCESS) {
+      NSLog(@"Failed to shut down active transport: %d", status);
+    }
+    
+    // Start connecting the replacement right away so it's (hopefully) up by the time the re-INVITEs go out. TLS
+    // is left to the first request, since it needs the request's destination name to verify the server.
+    unsigned flag = pjsip_transport_get_flag_from_type((pjsip_transport_type_e) transport->key.type);
+    if (!(flag & PJSIP_TRANSPORT_SECURE)) {
+      pjsip_transport *replacement = NULL;
+      status = pjsip_endpt_acquire_transport(pjsua_get_pjsip_endpt(), (pjsip_transport_type_e) transport->key.type,
+                                             &transport->key.rem_addr, transport->addr_len, NULL, &replacement);
+      
+      // Acquiring returns a referenced transport, which we hold alongside the old ones so it isn't idled out
+      if (status == PJ_SUCCESS) {
+        [retained addObject:[NSValue valueWithPointer:replacement]];
+      } else {
+        NSLog(@"Failed to open replacement transport: %d", status);
+      }
+    }
+  }
+  
+  _failoverTransports = [retained copy];
+  _failoverStartedAt = [[NSDate alloc] init];
+  _failoverCalls = [NSHashTable weakObjectsHashTable];
+  
+  // Re-bind every account and call in this single pass, rather than queueing them one after another
+  for (SBSAccount *account in self.accounts) {
+    for (SBSCall *call in [account handleTransportFailover]) {
+      [_failoverCalls addObject:call];
+    }
+  }
+  
+  // Nothing to wait for if there were no calls to move
+  if (_failoverCalls.allObjects.count == 0) {
+    [self completeFailover:NO];
+    return;
+  }
+  
+  _failoverTimer = [NSTimer scheduledTimerWithTimeInterval:_configuration.transportFailoverGracePeriod
+                                                    target:self
+                                                  selector:@selector(failoverGracePeriodExpired:)
+                                                  userInfo:nil
+                                                   repeats:NO];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)failoverGracePeriodExpired:(NSTimer *)timer {
+  NSLog(@"Transport failover grace period expired with %lu call(s) still pending", (unsigned long) _failoverCalls.allObjects.count);
+  [self completeFailover:NO];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)completeFailover:(BOOL)restored {
+  [_failoverTimer invalidate];
+  _failoverTimer = nil;
+  
+  if (restored && _failoverStartedAt != nil) {
+    _lastFailoverDuration = -[_failoverStartedAt timeIntervalSinceNow];
+    NSLog(@"Transport failover restored audio in %.0fms", _lastFailoverDuration * 1000);
+  }
+  
+  // Let go of the old flows (and the replacements, which are now referenced by whoever is using them)
+  for (NSValue *wrapper in _failoverTransports) {
+    pjsip_transport_dec_ref((pjsip_transport *) wrapper.pointerValue);
+  }
+  
+  _failoverTransports = nil;
+  _failoverCalls = nil;
+  _failoverStartedAt = nil;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)handleCallAudioRestored:(SBSCall *)call {
+  if (_configuration.transportFailoverMode != SBSTransportFailoverModeMakeBeforeBreak) {
+    return;
+  }
+  
+  [self performAsync:^{
+    if (![_failoverCalls containsObject:call]) {
+      return;
+    }
+    
+    [_failoverCalls removeObject:call];
+    if (_failoverCalls.allObjects.count == 0) {
+      [self completeFailover:YES];
+    }
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSTLSHandshakeStatistics *)tlsHandshakeStatistics {
+  pj_ssl_sock_session_stat stat;
+  pj_ssl_sock_session_cache_get_stat(&stat);
+  
+  return [[SBSTLSHandshakeStatistics alloc] initWithFullHandshakes:stat.full
+                                                 resumedHandshakes:stat.resumed
+                                                    cachedSessions:stat.cached];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)registrationTimerFired:(NSTimer *)timer {
+  [_registrationScheduler advanceToTime:[NSProcessInfo processInfo].systemUptime];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSEndpointStartupMetrics *)startupMetrics {
+  @synchronized(self) {
+    if (_startupTimes.ready == 0) {
+      return nil;
+    }
+    
+    return [[SBSEndpointStartupMetrics alloc] initWithCreateTime:_startupTimes.create
+                                                  initializeTime:_startupTimes.initialize
+                                                   transportTime:_startupTimes.transport
+                                                       startTime:_startupTimes.start
+                                                      threadTime:_startupTimes.thread
+                                                       readyTime:_startupTimes.ready
+                                              extraTransportTime:_startupTimes.extraTransports
+                                                      moduleTime:_startupTimes.modules
+                                                       codecTime:_startupTimes.codecs
+                                                    ringbackTime:_startupTimes.ringback
+                                                    completeTime:_startupTimes.complete
+                                                        complete:_startupTimes.finished];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSRegistrationMetrics *)registrationMetrics {
+  if (_registrationScheduler == nil) {
+    return nil;
+  }
+  
+  // The scheduler is confined to the background thread, so hop over there to take the snapshot
+  __block SBSRegistrationMetrics *metrics;
+  [self performSync:^{
+    metrics = _registrationScheduler.metrics;
+  }];
+  
+  return metrics;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSDNSCacheStatistics *)dnsCacheStatistics {
+  pj_dns_cache_stat stat;
+  pj_dns_cache_get_stat(&stat);
+  
+  return [[SBSDNSCacheStatistics alloc] initWithHits:stat.hits
+                                           staleHits:stat.stale_hits
+                                              misses:stat.misses
+                                          prefetches:stat.prefetches
+                                             queries:stat.queries
+                                            failures:stat.failures];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSICECandidateStatistics *)iceCandidateStatistics {
+  pj_ice_host_rank_stat stat;
+  pj_ice_host_rank_get_stat(&stat);
+  
+  return [[SBSICECandidateStatistics alloc] initWithRankings:stat.rankings
+                                                   addresses:stat.addresses
+                                                  candidates:stat.candidates
+                                                  suppressed:stat.suppressed
+                                                   successes:stat.successes];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSKeepAliveStatistics *)keepAliveStatistics {
+  if (_keepAliveService == nil) {
+    return nil;
+  }
+  
+  // The service is confined to the background thread, so hop over there to take the snapshot
+  __block SBSKeepAliveStatistics *statistics;
+  [self performSync:^{
+    statistics = _keepAliveService.statistics;
+  }];
+  
+  return statistics;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSEventDeliveryStatistics *)eventDeliveryStatistics {
+  return _eventDelivery.statistics;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSAudioDeviceStatistics *)audioDeviceStatistics {
+  __block pj_rate_port_stat stat;
+  pj_bzero(&stat, sizeof(stat));
+  
+  // The adapter is created and destroyed on the background thread, so take the snapshot there
+  [self performSync:^{
+    if (pjRatePort != NULL) {
+      pj_rate_port_get_stat(pjRatePort, &stat);
+    }
+  }];
+  
+  return [[SBSAudioDeviceStatistics alloc] initWithSampleRate:[self soundDeviceClockRate]
+                                                     switches:stat.switches
+                                                      lastGap:stat.last_gap_nsec / 1e9
+                                                       maxGap:stat.max_gap_nsec / 1e9
+                                                       frames:stat.frames
+                                                    frameCost:stat.frame_nsec / 1e9
+                                                 maxFrameCost:stat.max_frame_nsec / 1e9];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSMessageCompactionStatistics *)messageCompactionStatistics {
+  pj_sip_compact_stat stat;
+  pj_sip_compact_get_stat(&stat);
+  
+  return [[SBSMessageCompactionStatistics alloc] initWithMessages:stat.messages
+                                                          trimmed:stat.trimmed
+                                                       overBudget:stat.over_budget
+                                                          formats:stat.formats
+                                                       attributes:stat.attributes
+                                                       candidates:stat.candidates
+                                                       bytesSaved:stat.bytes_saved
+                                                          largest:stat.largest];
 }
 
 //------------------------------------------------------------------------------
 
-- (SBSAccount *)createAccountWithConfiguration:(SBSAccountConfiguration *)configuration error:(NSError *__autoreleasing *)error {
-  SBSAccount *account = [SBSAccount accountWithConfiguration:configuration endpoint:self error:error];
+- (NSArray<SBSSrtpSuiteBenchmark *> *)srtpSuiteBenchmarks {
+  pj_srtp_bench_result results[PJ_SRTP_BENCH_MAX_SUITES];
+  unsigned count = PJ_ARRAY_SIZE(results);
+  pj_srtp_bench_get_results(results, &count);
   
-  // Stop here if we didn't get an account
-  if (account == nil) {
-    return nil;
+  NSMutableArray<SBSSrtpSuiteBenchmark *> *benchmarks = [[NSMutableArray alloc] initWithCapacity:count];
+  for (unsigned i = 0; i < count; i++) {
+    [benchmarks addObject:[[SBSSrtpSuiteBenchmark alloc] initWithSuite:[NSString stringWithUTF8String:results[i].name]
+                                                             keyLength:results[i].key_bits
+                                                             tagLength:results[i].tag_bits
+                                                           protectTime:results[i].protect_nsec
+                                                         unprotectTime:results[i].unprotect_nsec]];
   }
   
-  // Successful creation, register the account with sipper
-  return self.accountsMap[account.uuid] = account;
+  return benchmarks;
 }
 
 //------------------------------------------------------------------------------
 
-- (void)removeAccount:(NSUUID *)id {
-  SBSAccount *account = self.accountsMap[id];
+- (NSArray<SBSCallbackLatencyStatistics *> *)callbackLatencyStatistics {
+  NSMutableArray<SBSCallbackLatencyStatistics *> *statistics = [[NSMutableArray alloc] initWithCapacity:PJ_CB_LATENCY_COUNT];
+  for (unsigned i = 0; i < PJ_CB_LATENCY_COUNT; i++) {
+    pj_cb_latency_stat stat;
+    pj_cb_latency_get_stat((pj_cb_latency_id) i, &stat);
+    [statistics addObject:[[SBSCallbackLatencyStatistics alloc] initWithCallback:[NSString stringWithUTF8String:stat.name]
+                                                                           count:(NSUInteger) stat.count
+                                                                        meanTime:(NSUInteger) stat.mean_nsec
+                                                                         maxTime:(NSUInteger) stat.max_nsec
+                                                                         p50Time:(NSUInteger) stat.p50_nsec
+                                                                         p90Time:(NSUInteger) stat.p90_nsec
+                                                                         p99Time:(NSUInteger) stat.p99_nsec
+                                                                        p999Time:(NSUInteger) stat.p999_nsec]];
+  }
   
-  [account stopRegistration];
-  [self.accountsMap removeObjectForKey:id];
+  return statistics;
 }
 
 //------------------------------------------------------------------------------
 
-- (void)updatePreferredCodecs:(NSArray<SBSCodecDescriptor *> *)descriptors completion:(void (^)(BOOL, NSError *_Nullable))callback {
+- (void)resetCallbackLatencyStatistics {
+  pj_cb_latency_reset();
+}
+
+//------------------------------------------------------------------------------
+
+- (void)updateDeviceSampleRate:(NSUInteger)rate {
   [self performAsync:^{
-    NSError *error;
-    pj_status_t status;
-    
-    const unsigned codec_info_size = 64;
-    unsigned codec_count = codec_info_size;
-    pjsua_codec_info codec_info[codec_info_size];
     
-    status = pjsua_enum_codecs(codec_info, &codec_count);
-    if (status != PJ_SUCCESS) {
-      error = [NSError ErrorWithUnderlying:nil
-                   localizedDescriptionKey:NSLocalizedString(@"Could not register thread", nil)
-               localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
-                               errorDomain:EndpointErrorDomain
-                                 errorCode:SBSEndpointErrorCannotRegisterThread];
-      callback(NO, error);
+    // Route changes often keep the rate the device already runs at, in which case there's nothing to do
+    if (rate == [self soundDeviceClockRate]) {
       return;
     }
     
-    // Push all codecs into a codec list
-    NSMutableSet<NSString *> *unmatchedCodecs = [[NSMutableSet alloc] init];
-    NSUInteger attachedCodecs = 0;
-    for (NSUInteger i = 0; i < codec_count; i++) {
-      [unmatchedCodecs addObject:[NSString stringWithPJString:codec_info[i].codec_id]];
-    }
-    
-    // Now, iterate over our preferred codecs map and find matches
-    for (SBSCodecDescriptor *descriptor in descriptors) {
-      
-      // Find any matching codecs in the result
-      for (NSUInteger i = 0; i < codec_count; i++) {
-        NSString *codecIdentifier = [NSString stringWithPJString:codec_info[i].codec_id];
-        
-        // Stop here if this codec doesn't match
-        if (![self codecDescriptor:descriptor matchesIdentifier:codecIdentifier]) {
-          continue;
-        }
-        
-        // This codec had a match, we can pull it out of the unmatched list
-        [unmatchedCodecs removeObject:codecIdentifier];
-        
-        // And, assign this codec's priority from the number of codecs we've already assigned
-        pj_uint8_t priority = PJMEDIA_CODEC_PRIO_HIGHEST - attachedCodecs++;
-        NSLog(@"Codec %@ matches codec descriptor %@, assigning priority %d", codecIdentifier, descriptor, priority);
-        status = pjsua_codec_set_priority(&codec_info[i].codec_id, priority);
-        
-        if (status != PJ_SUCCESS) {
-          error = [NSError ErrorWithUnderlying:nil
-                       localizedDescriptionKey:NSLocalizedString(@"Could not register thread", nil)
-                   localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
-                                   errorDomain:EndpointErrorDomain
-                                     errorCode:SBSEndpointErrorCannotRegisterThread];
-          callback(NO, error);
-          return;
-        }
-      }
-      
-    }
+    pjsua_var.media_cfg.snd_clock_rate = (unsigned int) rate;
     
-    // Disable any remaining unmatched codecs
-    for (NSString *codecIdentifier in unmatchedCodecs) {
-      NSLog(@"Codec %@ not found in priority list, disabling", codecIdentifier);
-      
-      pj_str_t codec_identifier = codecIdentifier.pjString;
-      status = pjsua_codec_set_priority(&codec_identifier, 0);
-      if (status != PJ_SUCCESS) {
-        error = [NSError ErrorWithUnderlying:nil
-                     localizedDescriptionKey:NSLocalizedString(@"Could not register thread", nil)
-                 localizedFailureReasonError:[NSString stringWithFormat:NSLocalizedString(@"PJSIP status code: %d", nil), status]
-                                 errorDomain:EndpointErrorDomain
-                                   errorCode:SBSEndpointErrorCannotRegisterThread];
-        callback(NO, error);
-        return;
-      }
+    // Only the device's stream restarts. The bridge and the adapter's resamplers stay as they are, and a device that
+    // isn't open picks up the new rate when it's opened next.
+    if (pjSoundPort != NULL) {
+      [self closeSoundDevice];
+      [self openSoundDevice];
     }
-    
-    callback(YES, nil);
-    return;
   }];
- }
+}
 
 //------------------------------------------------------------------------------
 
-- (SBSAccount *)findAccount:(NSUUID *)id {
-  return self.accountsMap[id];
+- (void)disableAudio {
+  [self performAsync:^{
+    _audioEnabled = NO;
+    [self reconcileSoundDevice];
+  }];
 }
 
 //------------------------------------------------------------------------------
 
-- (void)handleReachabilityChange {
+- (void)enableAudio {
+  [self performAsync:^{
+    _audioEnabled = YES;
+    [self reconcileSoundDevice];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (unsigned)soundDeviceClockRate {
+  return pjsua_var.media_cfg.snd_clock_rate != 0 ? pjsua_var.media_cfg.snd_clock_rate : pjsua_var.media_cfg.clock_rate;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)reconcileSoundDevice {
   
-  // Destroy all existing transports - they're most likely not safe at this point
-  for (NSValue *wrapper in _activeTransports) {
-    pj_status_t status = pjsip_transport_shutdown((pjsip_transport *) wrapper.pointerValue);
+  // Like PJSUA would, the device is only open while some call is using it, so it's released between calls
+  if (_audioEnabled && _soundDeviceNeeded) {
+    [self openSoundDevice];
+  } else {
+    [self closeSoundDevice];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)openSoundDevice {
+  if (pjSoundPort != NULL) {
+    return;
+  }
+  
+  pj_status_t status = PJ_SUCCESS;
+  unsigned rate = [self soundDeviceClockRate];
+  
+  // The adapter is made once, with everything it needs to switch rates, and outlives the device streams it's given
+  if (pjRatePort == NULL) {
+    pjmedia_port *master = pjsua_set_no_snd_dev();
+    unsigned quality = pjsua_var.media_cfg.quality;
+    
+    pjRatePool = pjsua_pool_create("rate", 4096, 4096);
+    status = pj_rate_port_create(pjRatePool, master, PJMEDIA_PIA_SRATE(&master->info), quality >= 4, quality >= 10, &pjRatePort);
     if (status != PJ_SUCCESS) {
-      NSLog(@"Failed to close active transport: %d", status);
+      pj_pool_release(pjRatePool);
+      pjRatePool = NULL;
+      pjRatePort = NULL;
+      NSLog(@"Failed to create the sound device adapter, audio is disabled: %@", fromPjError(status));
+      return;
     }
   }
   
-  // Now, handle reachability on all accounts, which should fan out to perform a
-  // re-invite on all calls
-  for (SBSAccount *account in self.accounts) {
-    [account handleReachabilityChange];
+  if (pj_rate_port_set_clock_rate(pjRatePort, rate) != PJ_SUCCESS) {
+    NSLog(@"Sound device sample rate %u isn't supported, using %u", rate, pjsua_var.media_cfg.clock_rate);
+    rate = pjsua_var.media_cfg.clock_rate;
+    pj_rate_port_set_clock_rate(pjRatePort, rate);
+  }
+  
+  pjSoundPool = pjsua_pool_create("snd", 4096, 4096);
+  status = pjmedia_snd_port_create(pjSoundPool, PJMEDIA_AUD_DEFAULT_CAPTURE_DEV, PJMEDIA_AUD_DEFAULT_PLAYBACK_DEV, rate,
+                                   PJMEDIA_PIA_CCNT(&pjRatePort->info), PJMEDIA_PIA_SPF(&pjRatePort->info), 16, 0,
+                                   &pjSoundPort);
+  
+  // PJSUA doesn't know about this port, so pjsua_set_ec only updates the settings it's opened with next time
+  if (status == PJ_SUCCESS && pjsua_var.media_cfg.ec_tail_len > 0) {
+    pjmedia_snd_port_set_ec(pjSoundPort, pjSoundPool, pjsua_var.media_cfg.ec_tail_len, pjsua_var.media_cfg.ec_options);
+  }
+  
+  if (status == PJ_SUCCESS) {
+    status = pjmedia_snd_port_connect(pjSoundPort, pjRatePort);
+  }
+  
+  if (status != PJ_SUCCESS) {
+    NSLog(@"Failed to open the sound device at %u Hz: %@", rate, fromPjError(status));
+    [self closeSoundDevice];
   }
 }
 
 //------------------------------------------------------------------------------
 
-- (void)updateDeviceSampleRate:(NSUInteger)rate {
-  [self performAsync:^{
-    pjsua_check_snd_dev_idle();
-    
-    // If audo is on, temporarily disable it
-    if (_audioEnabled) {
-      pjsua_set_no_snd_dev();
-    }
-    
-    // Sound device is disabled, update the preferred hardware sample rate
-    pjsua_var.media_cfg.snd_clock_rate = (unsigned int) rate;
-    
-    // Before we go re-enable audio, let's see if we actually need to do this
-    if (_audioEnabled && pjsua_var.call_cnt > 0) {
-      pjsua_set_snd_dev(PJMEDIA_AUD_DEFAULT_CAPTURE_DEV, PJMEDIA_AUD_DEFAULT_PLAYBACK_DEV);
-    } else {
-      PJSUA_LOCK();
-      pjsua_var.cap_dev = PJMEDIA_AUD_DEFAULT_CAPTURE_DEV;
-      pjsua_var.play_dev = PJMEDIA_AUD_DEFAULT_PLAYBACK_DEV;
-      PJSUA_UNLOCK();
-    }
-  }];
+- (void)closeSoundDevice {
+  if (pjSoundPort != NULL) {
+    pjmedia_snd_port_disconnect(pjSoundPort);
+    pjmedia_snd_port_destroy(pjSoundPort);
+    pjSoundPort = NULL;
+  }
+  
+  if (pjSoundPool != NULL) {
+    pj_pool_release(pjSoundPool);
+    pjSoundPool = NULL;
+  }
 }
 
 //------------------------------------------------------------------------------
 
-- (void)disableAudio {
-  [self performAsync:^{
-    pjsua_set_no_snd_dev();
-    _audioEnabled = NO;
-  }];
+- (SBSCallFuture *)holdAll {
+  return [self performControlOnAllCalls:SBSCallControlHold status:SBSStatusCodeOk];
 }
 
 //------------------------------------------------------------------------------
 
-- (void)enableAudio {
+- (SBSCallFuture *)hangupAll {
+  return [self performControlOnAllCalls:SBSCallControlHangup status:SBSStatusCodeDecline];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)reinviteAll {
+  return [self performControlOnAllCalls:SBSCallControlReinvite status:SBSStatusCodeOk];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallFuture *)performControlOnAllCalls:(SBSCallControl)control status:(SBSStatusCode)code {
+  SBSCallFuture *future = [[SBSCallFuture alloc] initWithQueue:_eventDelivery.targetQueue];
+  
   [self performAsync:^{
-    pjsua_set_snd_dev(PJMEDIA_AUD_DEFAULT_CAPTURE_DEV, PJMEDIA_AUD_DEFAULT_PLAYBACK_DEV);
-    _audioEnabled = YES;
+    NSError *firstError = nil;
+    
+    // Each call is acted on with PJSUA's own locking. Holding the PJSUA lock around all of them would take it ahead
+    // of the calls' dialog locks, which is the reverse of PJSUA's order. The events the calls produce are still
+    // delivered together, like those of a single callback.
+    [_eventDelivery beginTurn];
+    
+    for (SBSCall *call in self.calls) {
+      SBSCallState state = call.state;
+      if (state == SBSCallStateDisconnecting || state == SBSCallStateDisconnected) {
+        continue;
+      }
+      
+      NSError *error = [call performControl:control status:code argument:nil];
+      if (error != nil && firstError == nil) {
+        firstError = error;
+      }
+    }
+    
+    [_eventDelivery endTurn];
+    
+    // And the application hears about all of them in one hop to the event queue
+    [future resolveWithError:firstError];
   }];
+  
+  return future;
 }
 
 //------------------------------------------------------------------------------
@@ -455,6 +1670,20 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
 
 //------------------------------------------------------------------------------
 
+- (void)performSync:(void (^)())block {
+  
+  // Until initialization starts the background thread, whichever thread is setting up or tearing down PJSUA is
+  // the only one using it, and waiting on the thread would never return
+  if (!_backgroundThread.executing) {
+    block();
+    return;
+  }
+  
+  [self performSelector:@selector(performAsyncWithBlock:) onThread:_backgroundThread withObject:block waitUntilDone:YES];
+}
+
+//------------------------------------------------------------------------------
+
 - (void)reconcileState {
   NSUInteger activeCalls = 0, ringingCalls = 0, ringbackCalls = 0;
   
@@ -476,8 +1705,8 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
     }
   }
   
-  // Play a ringback tone if we need to
-  if (ringbackCalls > 0 && !_playingRingback && _ringbackDescription != nil) {
+  // Play a ringback tone if we need to, once the tone generator has been created
+  if (ringbackCalls > 0 && !_playingRingback && _ringbackDescription != nil && pjRingbackPort != NULL) {
     pjmedia_tone_desc tones[_ringbackDescription.tones.count];
     pj_bzero(&tones, sizeof(tones));
     int i = 0;
@@ -506,6 +1735,15 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
     _playingRingback = NO;
   }
   
+  // Open or release the sound device when the first call starts or the last one goes away
+  BOOL soundDeviceNeeded = activeCalls > 0;
+  if (soundDeviceNeeded != _soundDeviceNeeded) {
+    _soundDeviceNeeded = soundDeviceNeeded;
+    [self performAsync:^{
+      [self reconcileSoundDevice];
+    }];
+  }
+  
   SBSEndpointState endpointState = SBSEndpointStateIdle;
   if (activeCalls > 0) {
     endpointState = SBSEndpointStateActiveCalls;
@@ -516,11 +1754,11 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
   if (endpointState != _state) {
     _state = endpointState;
     
-    dispatch_async(dispatch_get_main_queue(), ^{
+    [_eventDelivery deliverStateChange:^{
       if ([self.delegate respondsToSelector:@selector(endpoint:didChangeState:)]) {
         [self.delegate endpoint:self didChangeState:endpointState];
       }
-    });
+    } owner:self name:EndpointStateChange];
   }
 }
 
@@ -588,12 +1826,23 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
   config->cb.on_transport_state = &onTransportState;
   config->cb.on_call_sdp_created = &onSdpCreated;
   config->cb.on_create_media_transport_srtp = &onCreateMediaTransportSrtp;
+  config->cb.on_acquire_media_transport = &onAcquireMediaTransport;
   
   if (configuration.userAgent != nil) {
     config->user_agent = configuration.userAgent.pjString;
   }
   
   config->max_calls = (unsigned int) configuration.maxCalls;
+  
+  // Nameservers enable PJSIP's asynchronous resolver, instead of blocking in getaddrinfo
+  config->nameserver_count = 0;
+  for (NSString *nameserver in configuration.nameservers) {
+    if (config->nameserver_count == PJ_ARRAY_SIZE(config->nameserver)) {
+      break;
+    }
+    
+    config->nameserver[config->nameserver_count++] = nameserver.pjString;
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -603,7 +1852,7 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
   config->enable_ice = PJ_TRUE;
   config->ice_no_rtcp = PJ_TRUE;
   config->ice_always_update = PJ_FALSE;
-  config->ice_max_host_cands = 12;
+  config->ice_max_host_cands = (int) configuration.iceHostCandidatesPerFamily;
   config->snd_auto_close_time = 0;
   config->clock_rate = (unsigned int) configuration.clockRate == 0 ? PJSUA_DEFAULT_CLOCK_RATE : (unsigned int) configuration.clockRate;
   config->snd_clock_rate = (unsigned int) configuration.sndClockRate;
@@ -642,6 +1891,19 @@ static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx
   }
 }
 
+//------------------------------------------------------------------------------
+
+- (pj_srtp_bench_order)convertSrtpSuiteOrder:(SBSSrtpSuiteOrder)order {
+  switch (order) {
+    case SBSSrtpSuiteOrderStrongest:
+      return PJ_SRTP_BENCH_ORDER_STRONGEST;
+    case SBSSrtpSuiteOrderFastest:
+      return PJ_SRTP_BENCH_ORDER_FASTEST;
+    default:
+      return PJ_SRTP_BENCH_ORDER_BALANCED;
+  }
+}
+
 //------------------------------------------------------------------------------
 #pragma mark - Factory
 //------------------------------------------------------------------------------
@@ -671,67 +1933,110 @@ static void onLogMessage(int level, const char *input, int length) {
 }
 
 static void onRegState(pjsua_acc_id accountId, pjsua_reg_info *info) {
+  pj_uint64_t began = pj_cb_latency_now();
+  
   void *data = pjsua_acc_get_user_data(accountId);
-  if (data == NULL) {
-    return;
+  if (data != NULL) {
+    @autoreleasepool {
+      SBSAccount *account = (__bridge SBSAccount *) data;
+      SBSEventDelivery *delivery = account.endpoint.eventDelivery;
+      [delivery beginTurn];
+      [account handleRegistrationStateChange:info];
+      [delivery endTurn];
+    }
   }
   
-  @autoreleasepool {
-    SBSAccount *account = (__bridge SBSAccount *) data;
-    [account handleRegistrationStateChange:info];
-  }
+  pj_cb_latency_record(PJ_CB_LATENCY_REG_STATE, pj_cb_latency_now() - began);
 }
 
 static void onIncomingCall(pjsua_acc_id accountId, pjsua_call_id callId, pjsip_rx_data *rdata) {
+  pj_cb_record_incoming_call(accountId, callId, rdata);
+  pj_uint64_t began = pj_cb_latency_now();
+  
   void *data = pjsua_acc_get_user_data(accountId);
-  if (data == NULL) {
-    return;
+  if (data != NULL) {
+    @autoreleasepool {
+      SBSAccount *account = (__bridge SBSAccount *) data;
+      SBSEventDelivery *delivery = account.endpoint.eventDelivery;
+      [delivery beginTurn];
+      [account handleIncomingCall:callId data:rdata];
+      [account.endpoint reconcileState];
+      [delivery endTurn];
+    }
   }
   
-  @autoreleasepool {
-    SBSAccount *account = (__bridge SBSAccount *) data;
-    [account handleIncomingCall:callId data:rdata];
-    [account.endpoint reconcileState];
-  }
+  pj_uint64_t ended = pj_cb_latency_now();
+  pj_cb_latency_record(PJ_CB_LATENCY_INCOMING_CALL, ended - began);
+  pj_call_trace_span(pj_call_trace_find(callId), "on_incoming_call", began, ended);
 }
 
 static void onCallState(pjsua_call_id callId, pjsip_event *event) {
+  pj_cb_record_call_state(callId);
+  pj_uint64_t began = pj_cb_latency_now();
+  pj_call_trace_id trace = pj_call_trace_find(callId);
+  
   void *data = pjsua_call_get_user_data(callId);
-  if (data == NULL) {
-    return;
+  if (data != NULL) {
+    @autoreleasepool {
+      SBSCall *call = (__bridge SBSCall *) data;
+      SBSEventDelivery *delivery = call.account.endpoint.eventDelivery;
+      [delivery beginTurn];
+      [call handleCallStateChange];
+      [call.account.endpoint reconcileState];
+      [delivery endTurn];
+    }
   }
   
-  @autoreleasepool {
-    SBSCall *call = (__bridge SBSCall *) data;
-    [call handleCallStateChange];
-    [call.account.endpoint reconcileState];
-  }
+  pj_uint64_t ended = pj_cb_latency_now();
+  pj_cb_latency_record(PJ_CB_LATENCY_CALL_STATE, ended - began);
+  pj_call_trace_span(trace, "on_call_state", began, ended);
 }
 
 static void onCallMediaState(pjsua_call_id callId) {
+  pj_cb_record_call_media_state(callId);
+  pj_uint64_t began = pj_cb_latency_now();
+  pj_call_trace_id trace = pj_call_trace_find(callId);
+  
+  // Remember which interface ICE settled on, so it's preferred on the next call
+  pj_ice_host_rank_learn(callId);
+  
   void *data = pjsua_call_get_user_data(callId);
-  if (data == NULL) {
-    return;
+  if (data != NULL) {
+    @autoreleasepool {
+      SBSCall *call = (__bridge SBSCall *) data;
+      SBSEventDelivery *delivery = call.account.endpoint.eventDelivery;
+      [delivery beginTurn];
+      [call handleCallMediaStateChange];
+      [call.account.endpoint reconcileState];
+      [delivery endTurn];
+    }
   }
   
-  @autoreleasepool {
-    SBSCall *call = (__bridge SBSCall *) data;
-    [call handleCallMediaStateChange];
-    [call.account.endpoint reconcileState];
-  }
+  pj_uint64_t ended = pj_cb_latency_now();
+  pj_cb_latency_record(PJ_CB_LATENCY_CALL_MEDIA_STATE, ended - began);
+  pj_call_trace_span(trace, "on_call_media_state", began, ended);
 }
 
 static void onCallTsxState(pjsua_call_id callId, pjsip_transaction *tsx, pjsip_event *event) {
+  pj_cb_record_call_tsx_state(callId, tsx, event);
+  pj_uint64_t began = pj_cb_latency_now();
+  pj_call_trace_id trace = pj_call_trace_find(callId);
+  
   void *data = pjsua_call_get_user_data(callId);
-  if (data == NULL) {
-    return;
+  if (data != NULL) {
+    @autoreleasepool {
+      SBSCall *call = (__bridge SBSCall *) data;
+      SBSEventDelivery *delivery = call.account.endpoint.eventDelivery;
+      [delivery beginTurn];
+      [call handleTransactionStateChange:tsx event:event];
+      [call.account.endpoint reconcileState];
+      [delivery endTurn];
+    }
   }
   
-  @autoreleasepool {
-    SBSCall *call = (__bridge SBSCall *) data;
-    [call handleTransactionStateChange:tsx event:event];
-    [call.account.endpoint reconcileState];
-  }
+  pj_uint64_t ended = pj_cb_latency_now();
+  pj_cb_latency_record(PJ_CB_LATENCY_CALL_TSX_STATE, ended - began);
+  pj_call_trace_span(trace, "on_call_tsx_state", began, ended);
 }
 
 static void onRegStarted(pjsua_acc_id accountId, pjsua_reg_info *info) {
@@ -747,14 +2052,63 @@ static void onRegStarted(pjsua_acc_id accountId, pjsua_reg_info *info) {
 }
 
 static void onSdpCreated(pjsua_call_id call_id, pjmedia_sdp_session *sdp, pj_pool_t *pool, const pjmedia_sdp_session *remote) {
+  void *data = pjsua_acc_get_user_data(pjsua_var.calls[call_id].acc_id);
+  if (data == NULL || !pjsua_var.media_cfg.enable_ice) {
+    return;
+  }
   
+  @autoreleasepool {
+    SBSAccount *account = (__bridge SBSAccount *) data;
+    
+    // Tell the remote that more candidates may follow the ones in this SDP (RFC 8840)
+    if (account.configuration.trickleIce) {
+      pj_str_t value = pj_str("trickle");
+      pjmedia_sdp_attr *attr = pjmedia_sdp_attr_create(pool, "ice-options", &value);
+      pjmedia_sdp_attr_add(&sdp->attr_count, sdp->attr, attr);
+    }
+  }
 }
 
 static void onCreateMediaTransportSrtp(pjsua_call_id call_id, unsigned media_idx, pjmedia_srtp_setting *srtp_opt) {
+  pj_srtp_bench_apply(srtp_opt);
   
+  // Every suite offered is another a=crypto line in the SDP
+  if (pj_sip_compact_enabled()) {
+    pj_sip_compact_crypto(srtp_opt);
+  }
+}
+
+static pjmedia_transport *onAcquireMediaTransport(pjsua_call_id callId, unsigned mediaIndex, pjmedia_type type) {
+  if (type != PJMEDIA_TYPE_AUDIO) {
+    return NULL;
+  }
+  
+  pjsua_call *call = &pjsua_var.calls[callId];
+  void *data = pjsua_acc_get_user_data(call->acc_id);
+  if (data == NULL) {
+    return NULL;
+  }
+  
+  @autoreleasepool {
+    SBSAccount *account = (__bridge SBSAccount *) data;
+    return [account acquireMediaTransportForCallMedia:&call->media[mediaIndex]];
+  }
+}
+
+static pj_status_t onEndpointUnload(void) {
+  pj_sip_compact_shutdown();
+  pj_sip_capture_shutdown();
+  pj_srtp_bench_shutdown();
+  pj_call_trace_shutdown();
+  pj_ice_host_rank_shutdown();
+  pj_dns_cache_shutdown();
+  
+  return PJ_SUCCESS;
 }
 
 static void onTransportState(pjsip_transport *transport, pjsip_transport_state state, const pjsip_transport_state_info *info) {
+  pj_uint64_t began = pj_cb_latency_now();
+  
   @autoreleasepool {
     NSArray<NSValue *> *transports = [SBSEndpoint sharedEndpoint].activeTransports;
     
@@ -783,6 +2137,8 @@ static void onTransportState(pjsip_transport *transport, pjsip_transport_state s
       [account handleTransportStateChange:transport state:state info:info];
     }];
   }
+  
+  pj_cb_latency_record(PJ_CB_LATENCY_TRANSPORT_STATE, pj_cb_latency_now() - began);
 }
 
 static NSString *fromPjError(pj_status_t status) {
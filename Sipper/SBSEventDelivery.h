@@ -0,0 +1,85 @@
+//
+//  SBSEventDelivery.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class SBSEventDeliveryStatistics;
+
+/**
+ * Delivers call events and delegate calls to the application's queue in batches
+ *
+ * Every PJSUA callback is a turn, on the thread it runs on. What's delivered during a turn is held until the thread's
+ * outermost turn ends, then the whole batch is enqueued on the target queue as one block, in the order it was
+ * delivered. Outside of a turn (when the application answers or hangs up a call, say), a delivery is enqueued right
+ * away, even while other threads are in turns of their own. Either way, a batch that's still waiting for the queue is
+ * joined rather than followed by another block, so the target queue sees one block where it used to see one per event.
+ *
+ * When state change events are coalesced, a state change delivered for an owner and name that already has one in the
+ * same batch replaces it, and moves to the end of the batch so it still comes after the events delivered ahead of it.
+ * Listeners read the state from the call, so they see the same state either way, but only once.
+ *
+ * Deliveries may be made from any thread.
+ */
+@interface SBSEventDelivery : NSObject
+
+/**
+ * The queue batches are delivered on
+ */
+@property(strong, nonatomic, nonnull, readonly) dispatch_queue_t targetQueue;
+
+/**
+ * Whether redundant state change events are dropped
+ */
+@property(nonatomic, readonly) BOOL coalesceStateChanges;
+
+/**
+ * A snapshot of the delivery counters
+ */
+@property(nonatomic, readonly, nonnull) SBSEventDeliveryStatistics *statistics;
+
+/**
+ * Creates a new delivery
+ *
+ * @param targetQueue          the queue to deliver batches on
+ * @param coalesceStateChanges whether to drop redundant state change events
+ */
+- (instancetype _Nonnull)initWithTargetQueue:(dispatch_queue_t _Nonnull)targetQueue coalesceStateChanges:(BOOL)coalesceStateChanges;
+
+/**
+ * Starts a turn, holding the current thread's deliveries until it ends. Turns may be nested.
+ */
+- (void)beginTurn;
+
+/**
+ * Ends a turn, and enqueues what the current thread delivered during it once its outermost turn ends
+ */
+- (void)endTurn;
+
+/**
+ * Delivers a block to the target queue
+ *
+ * @param block the block to run on the target queue
+ */
+- (void)deliver:(dispatch_block_t _Nonnull)block;
+
+/**
+ * Delivers a state change to the target queue, replacing the one in the same batch for the same owner and name if
+ * state changes are coalesced
+ *
+ * @param block the block to run on the target queue
+ * @param owner the object whose state changed, compared by identity
+ * @param name  the name of the state that changed
+ */
+- (void)deliverStateChange:(dispatch_block_t _Nonnull)block owner:(id _Nonnull)owner name:(NSString *_Nonnull)name;
+
+/**
+ * Counts a call made or received, for the blocks per call
+ */
+- (void)countCall;
+
+@end
@@ -0,0 +1,233 @@
+//
+//  SBSEventDelivery.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSEventDelivery.h"
+
+#import "SBSEventDeliveryStatistics.h"
+
+#pragma mark - Batch
+
+/**
+ * Blocks waiting to be enqueued, with the owner and name of the state changes among them
+ */
+@interface SBSEventBatch : NSObject
+
+@property(nonatomic, strong) NSMutableArray<dispatch_block_t> *blocks;
+@property(nonatomic, strong) NSMutableArray *owners;
+@property(nonatomic, strong) NSMutableArray *names;
+@property(nonatomic) NSUInteger depth;
+
+@end
+
+@implementation SBSEventBatch
+
+//------------------------------------------------------------------------------
+
+- (instancetype)init {
+  if (self = [super init]) {
+    _blocks = [[NSMutableArray alloc] init];
+    _owners = [[NSMutableArray alloc] init];
+    _names = [[NSMutableArray alloc] init];
+  }
+  
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (BOOL)addBlock:(dispatch_block_t)block owner:(id)owner name:(id)name coalesce:(BOOL)coalesce {
+  BOOL coalesced = NO;
+  
+  // Batches are a handful of events, so a scan is cheaper than keeping an index of them. The replacement goes at the
+  // end, so it still comes after everything that was delivered ahead of it.
+  if (coalesce && owner != [NSNull null]) {
+    for (NSUInteger i = 0; i < _blocks.count; i++) {
+      if (_owners[i] == owner && [_names[i] isEqual:name]) {
+        [_blocks removeObjectAtIndex:i];
+        [_owners removeObjectAtIndex:i];
+        [_names removeObjectAtIndex:i];
+        coalesced = YES;
+        break;
+      }
+    }
+  }
+  
+  [_blocks addObject:block];
+  [_owners addObject:owner];
+  [_names addObject:name];
+  
+  return coalesced;
+}
+
+//------------------------------------------------------------------------------
+
+- (NSUInteger)addBatch:(SBSEventBatch *)batch coalesce:(BOOL)coalesce {
+  NSUInteger coalesced = 0;
+  
+  for (NSUInteger i = 0; i < batch.blocks.count; i++) {
+    if ([self addBlock:batch.blocks[i] owner:batch.owners[i] name:batch.names[i] coalesce:coalesce]) {
+      coalesced++;
+    }
+  }
+  
+  return coalesced;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)removeAllBlocks {
+  [_blocks removeAllObjects];
+  [_owners removeAllObjects];
+  [_names removeAllObjects];
+}
+
+@end
+
+#pragma mark - Delivery
+
+@implementation SBSEventDelivery {
+  SBSEventBatch *_pending;
+  NSString *_turnKey;
+  BOOL _enqueued;
+  
+  NSUInteger _events;
+  NSUInteger _coalesced;
+  NSUInteger _enqueuedBlocks;
+  NSUInteger _calls;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithTargetQueue:(dispatch_queue_t)targetQueue coalesceStateChanges:(BOOL)coalesceStateChanges {
+  if (self = [super init]) {
+    _targetQueue = targetQueue;
+    _coalesceStateChanges = coalesceStateChanges;
+    _pending = [[SBSEventBatch alloc] init];
+    
+    // Each thread keeps the turn it's in, if any, in its thread dictionary
+    _turnKey = [NSString stringWithFormat:@"com.switchboard.sipper.turn.%p", self];
+  }
+  
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)beginTurn {
+  NSMutableDictionary *threadDictionary = [NSThread currentThread].threadDictionary;
+  SBSEventBatch *turn = threadDictionary[_turnKey];
+  
+  if (turn == nil) {
+    turn = [[SBSEventBatch alloc] init];
+    threadDictionary[_turnKey] = turn;
+  }
+  
+  turn.depth++;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)endTurn {
+  NSMutableDictionary *threadDictionary = [NSThread currentThread].threadDictionary;
+  SBSEventBatch *turn = threadDictionary[_turnKey];
+  
+  if (turn == nil || --turn.depth > 0) {
+    return;
+  }
+  
+  [threadDictionary removeObjectForKey:_turnKey];
+  
+  @synchronized(self) {
+    _coalesced += [_pending addBatch:turn coalesce:_coalesceStateChanges];
+    [self enqueueIfNeeded];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)deliver:(dispatch_block_t)block {
+  [self addBlock:block owner:[NSNull null] name:[NSNull null]];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)deliverStateChange:(dispatch_block_t)block owner:(id)owner name:(NSString *)name {
+  [self addBlock:block owner:owner name:name];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)countCall {
+  @synchronized(self) {
+    _calls++;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSEventDeliveryStatistics *)statistics {
+  @synchronized(self) {
+    return [[SBSEventDeliveryStatistics alloc] initWithEvents:_events
+                                                    coalesced:_coalesced
+                                                       blocks:_enqueuedBlocks
+                                                        calls:_calls];
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)addBlock:(dispatch_block_t)block owner:(id)owner name:(id)name {
+  SBSEventBatch *turn = [NSThread currentThread].threadDictionary[_turnKey];
+  
+  @synchronized(self) {
+    _events++;
+    
+    // Outside of a turn, the block joins the pending batch right away
+    SBSEventBatch *batch = turn != nil ? turn : _pending;
+    if ([batch addBlock:block owner:owner name:name coalesce:_coalesceStateChanges]) {
+      _coalesced++;
+    }
+    
+    if (turn == nil) {
+      [self enqueueIfNeeded];
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (void)enqueueIfNeeded {
+  if (_enqueued || _pending.blocks.count == 0) {
+    return;
+  }
+  
+  _enqueued = YES;
+  _enqueuedBlocks++;
+  dispatch_async(_targetQueue, ^{
+    [self flush];
+  });
+}
+
+//------------------------------------------------------------------------------
+
+- (void)flush {
+  NSArray<dispatch_block_t> *blocks;
+  
+  // Anything delivered from here on goes in the next batch
+  @synchronized(self) {
+    blocks = [_pending.blocks copy];
+    [_pending removeAllBlocks];
+    _enqueued = NO;
+  }
+  
+  for (dispatch_block_t block in blocks) {
+    block();
+  }
+}
+
+@end
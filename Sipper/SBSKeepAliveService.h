@@ -0,0 +1,86 @@
+//
+//  SBSKeepAliveService.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/15/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import <pjsip.h>
+
+@class SBSKeepAliveStatistics;
+
+/**
+ * Sends keep-alives for every SIP flow from a single, aligned timer
+ *
+ * By default, each TCP/TLS transport in PJSIP runs its own keep-alive timer, and each account runs another one for
+ * its UDP flow. With many accounts that's a lot of timer entries firing at unrelated times. This service replaces all
+ * of them with one timer that fires on interval boundaries and sends a CRLF keep-alive on every flow in one pass.
+ *
+ * UDP flows get the same CRLF ping PJSUA sends, not the STUN Binding requests RFC 5626 calls for. PJSIP's UDP transport
+ * parses everything that arrives on the SIP socket as SIP, so a Binding response would be logged as an unparseable
+ * packet and dropped on every tick, and couldn't be used to notice a NAT rebinding, which is what STUN would add.
+ *
+ * The service is confined to the endpoint's background thread.
+ */
+@interface SBSKeepAliveService : NSObject
+
+/**
+ * The interval between keep-alives, in seconds
+ */
+@property(nonatomic, readonly) NSTimeInterval interval;
+
+/**
+ * Block returning the connection-oriented transports to keep alive, as NSValue-wrapped pjsip_transport pointers
+ *
+ * Each transport must come with a reference, which the service releases once it has sent on it.
+ */
+@property(nonatomic, copy, nullable) NSArray<NSValue *> *_Nonnull (^streamTransports)(void);
+
+/**
+ * A snapshot of the service's counters
+ */
+@property(nonatomic, readonly, nonnull) SBSKeepAliveStatistics *statistics;
+
+/**
+ * Creates a new service
+ *
+ * @param interval the interval between keep-alives, in seconds
+ */
+- (instancetype _Nonnull)initWithInterval:(NSTimeInterval)interval;
+
+/**
+ * Starts the timer on the current thread's run loop
+ */
+- (void)start;
+
+/**
+ * Stops the timer and releases all datagram flows
+ */
+- (void)stop;
+
+/**
+ * Starts keeping a datagram flow alive, replacing any flow previously registered with the same key
+ *
+ * The service holds a reference to the transport until the flow is removed.
+ *
+ * @param transport   the datagram transport to send from
+ * @param destination the remote address to send to
+ * @param length      the length of the remote address
+ * @param key         identifies the flow, for example the account it belongs to
+ */
+- (void)addDatagramFlow:(pjsip_transport *_Nonnull)transport
+            destination:(const pj_sockaddr *_Nonnull)destination
+                 length:(int)length
+                 forKey:(id<NSCopying> _Nonnull)key;
+
+/**
+ * Stops keeping a datagram flow alive
+ *
+ * @param key the key the flow was registered with
+ */
+- (void)removeDatagramFlowForKey:(id<NSCopying> _Nonnull)key;
+
+@end
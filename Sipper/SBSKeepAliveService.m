@@ -0,0 +1,203 @@
+//
+//  SBSKeepAliveService.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/15/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSKeepAliveService.h"
+
+#import <mach/mach.h>
+#import <pjsua.h>
+
+#import "SBSKeepAliveStatistics.h"
+
+/**
+ * Payload sent on every flow, UDP ones included (see the header). A double CRLF is the RFC 5626 ping, and is also what
+ * PJSIP sends by default.
+ */
+static char const KeepAlivePayload[] = "\r\n\r\n";
+
+#pragma mark - Flow
+
+@interface SBSKeepAliveFlow : NSObject
+
+@property(nonatomic) pjsip_transport *transport;
+@property(nonatomic) pj_sockaddr destination;
+@property(nonatomic) int length;
+
+@end
+
+@implementation SBSKeepAliveFlow
+@end
+
+#pragma mark - Service
+
+@interface SBSKeepAliveService ()
+
+@property(nonatomic, strong) NSTimer *timer;
+@property(nonatomic, strong) NSMutableDictionary<id<NSCopying>, SBSKeepAliveFlow *> *datagramFlows;
+
+@end
+
+@implementation SBSKeepAliveService {
+  NSUInteger _wakeups;
+  NSUInteger _keepAlivesSent;
+  NSUInteger _sendFailures;
+  NSUInteger _flows;
+  NSTimeInterval _cpuTime;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithInterval:(NSTimeInterval)interval {
+  if (self = [super init]) {
+    _interval = interval;
+    _datagramFlows = [[NSMutableDictionary alloc] init];
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)dealloc {
+  [self stop];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSKeepAliveStatistics *)statistics {
+  return [[SBSKeepAliveStatistics alloc] initWithWakeups:_wakeups
+                                          keepAlivesSent:_keepAlivesSent
+                                            sendFailures:_sendFailures
+                                                   flows:_flows
+                                                 cpuTime:_cpuTime];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)start {
+  [self.timer invalidate];
+
+  // Fire on interval boundaries of the wall clock, with some tolerance so the OS can coalesce us with other wakeups
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSDate *fireDate = [NSDate dateWithTimeIntervalSinceReferenceDate:ceil(now / _interval) * _interval];
+
+  self.timer = [[NSTimer alloc] initWithFireDate:fireDate interval:_interval target:self selector:@selector(tick:) userInfo:nil repeats:YES];
+  self.timer.tolerance = _interval / 10;
+  [[NSRunLoop currentRunLoop] addTimer:self.timer forMode:NSRunLoopCommonModes];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)stop {
+  [self.timer invalidate];
+  self.timer = nil;
+
+  for (SBSKeepAliveFlow *flow in _datagramFlows.allValues) {
+    pjsip_transport_dec_ref(flow.transport);
+  }
+
+  [_datagramFlows removeAllObjects];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)addDatagramFlow:(pjsip_transport *)transport destination:(const pj_sockaddr *)destination length:(int)length forKey:(id<NSCopying>)key {
+  [self removeDatagramFlowForKey:key];
+
+  SBSKeepAliveFlow *flow = [[SBSKeepAliveFlow alloc] init];
+  flow.transport = transport;
+  flow.destination = *destination;
+  flow.length = length;
+
+  pjsip_transport_add_ref(transport);
+  _datagramFlows[key] = flow;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)removeDatagramFlowForKey:(id<NSCopying>)key {
+  SBSKeepAliveFlow *flow = _datagramFlows[key];
+  if (flow == nil) {
+    return;
+  }
+
+  pjsip_transport_dec_ref(flow.transport);
+  [_datagramFlows removeObjectForKey:key];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)tick:(NSTimer *)timer {
+  NSTimeInterval started = [self threadCpuTime];
+  NSUInteger flows = 0;
+
+  _wakeups++;
+
+  // Connection-oriented flows are sent to whoever is on the other end of the connection
+  NSArray<NSValue *> *transports = self.streamTransports ? self.streamTransports() : @[];
+  for (NSValue *wrapper in transports) {
+    pjsip_transport *transport = (pjsip_transport *) wrapper.pointerValue;
+    [self sendOnTransport:transport destination:&transport->key.rem_addr length:transport->addr_len];
+    pjsip_transport_dec_ref(transport);
+    flows++;
+  }
+
+  // Datagram flows are sent to the address the registrar responded from
+  for (SBSKeepAliveFlow *flow in _datagramFlows.allValues) {
+    pj_sockaddr destination = flow.destination;
+    [self sendOnTransport:flow.transport destination:&destination length:flow.length];
+    flows++;
+  }
+
+  _flows = flows;
+  _cpuTime += [self threadCpuTime] - started;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)sendOnTransport:(pjsip_transport *)transport destination:(const pj_sockaddr *)destination length:(int)length {
+  pjsip_tpselector selector;
+  pj_bzero(&selector, sizeof(selector));
+  selector.type = PJSIP_TPSELECTOR_TRANSPORT;
+  selector.u.transport = transport;
+
+  pj_status_t status = pjsip_tpmgr_send_raw(pjsip_endpt_get_tpmgr(pjsua_get_pjsip_endpt()),
+                                            (pjsip_transport_type_e) transport->key.type,
+                                            &selector,
+                                            NULL,
+                                            KeepAlivePayload,
+                                            sizeof(KeepAlivePayload) - 1,
+                                            destination,
+                                            length,
+                                            NULL,
+                                            NULL);
+
+  if (status == PJ_SUCCESS || status == PJ_EPENDING) {
+    _keepAlivesSent++;
+  } else {
+    _sendFailures++;
+  }
+}
+
+//------------------------------------------------------------------------------
+
+- (NSTimeInterval)threadCpuTime {
+  thread_basic_info_data_t info;
+  mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+  mach_port_t thread = mach_thread_self();
+
+  kern_return_t result = thread_info(thread, THREAD_BASIC_INFO, (thread_info_t) &info, &count);
+  mach_port_deallocate(mach_task_self(), thread);
+
+  if (result != KERN_SUCCESS) {
+    return 0;
+  }
+
+  return info.user_time.seconds + info.user_time.microseconds / 1e6 + info.system_time.seconds + info.system_time.microseconds / 1e6;
+}
+
+@end
@@ -0,0 +1,125 @@
+//
+//  SBSRegistrationScheduler.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/12/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class SBSRegistrationMetrics;
+
+/**
+ * Block invoked to actually send a REGISTER for an account
+ *
+ * @param accountId the account to register
+ * @return YES if the request was sent, NO if it failed immediately
+ */
+typedef BOOL (^SBSRegistrationSender)(NSNumber *_Nonnull accountId);
+
+/**
+ * Spreads REGISTER requests for many accounts out over time
+ *
+ * Registrations are placed on a hashed timer wheel and sent as they become due, but never with more than
+ * maxInFlight requests outstanding at once. Failed registrations are retried with decorrelated-jitter backoff,
+ * so that a registrar outage doesn't turn into a synchronized storm of retries when it recovers.
+ *
+ * The scheduler does not keep time on its own. It is driven by calls to advanceToTime:, and is confined to the
+ * thread that drives it (the endpoint's background thread).
+ */
+@interface SBSRegistrationScheduler : NSObject
+
+/**
+ * The maximum number of REGISTER requests that may be awaiting a response at once
+ */
+@property(nonatomic, readonly) NSUInteger maxInFlight;
+
+/**
+ * How long a sent registration may go without a result before its slot is reclaimed, in seconds
+ *
+ * Default value: 32.0 (SIP timer F)
+ */
+@property(nonatomic) NSTimeInterval inFlightTimeout;
+
+/**
+ * Source of uniformly distributed random numbers in [0, 1)
+ *
+ * Exposed so tests can make the schedule deterministic. Defaults to arc4random.
+ */
+@property(nonatomic, copy, nonnull) double (^randomSource)(void);
+
+/**
+ * A snapshot of the scheduler's counters
+ */
+@property(nonatomic, readonly, nonnull) SBSRegistrationMetrics *metrics;
+
+/**
+ * Creates a new scheduler
+ *
+ * @param maxInFlight    the maximum number of outstanding REGISTER requests
+ * @param resolution     the duration of a single slot on the timer wheel, in seconds
+ * @param retryBaseDelay the shortest delay before retrying a failed registration, in seconds. Retries always wait for
+ *                       at least one slot.
+ * @param now            the current time, on the same clock that will be passed to advanceToTime:
+ * @param sender         block invoked to send a REGISTER
+ */
+- (instancetype _Nonnull)initWithMaxInFlight:(NSUInteger)maxInFlight
+                                  resolution:(NSTimeInterval)resolution
+                              retryBaseDelay:(NSTimeInterval)retryBaseDelay
+                                         now:(NSTimeInterval)now
+                                      sender:(SBSRegistrationSender _Nonnull)sender;
+
+/**
+ * Schedules a registration for the account, replacing any registration that is already pending for it
+ *
+ * @param accountId the account to register
+ * @param delay     the minimum delay before registering, in seconds
+ * @param jitter    a random delay of up to this many seconds is added on top
+ */
+- (void)scheduleRegistration:(NSNumber *_Nonnull)accountId after:(NSTimeInterval)delay jitter:(NSTimeInterval)jitter;
+
+/**
+ * Schedules a retry for an account whose registration failed or was lost
+ *
+ * Consecutive retries back off using decorrelated jitter: each delay is drawn uniformly between the base delay and
+ * three times the previous delay, capped at maxDelay. The backoff is reset when a registration succeeds.
+ *
+ * @param accountId the account to register
+ * @param maxDelay  the longest delay to wait before retrying, in seconds, or 0 for the default of 60 seconds
+ */
+- (void)scheduleRetry:(NSNumber *_Nonnull)accountId maxDelay:(NSTimeInterval)maxDelay;
+
+/**
+ * Counts a registration the scheduler didn't send, such as PJSIP refreshing one on its own, as in flight
+ *
+ * It can't be held back, but it takes a slot until its result is reported, so the scheduler sends fewer of its own
+ * in the meantime. A registration that's already in flight is left as it is.
+ *
+ * @param accountId the account that started registering
+ */
+- (void)startRegistration:(NSNumber *_Nonnull)accountId;
+
+/**
+ * Reports the result of a registration, releasing its in-flight slot
+ *
+ * @param accountId the account that finished registering
+ * @param success   whether the registration succeeded
+ */
+- (void)completeRegistration:(NSNumber *_Nonnull)accountId success:(BOOL)success;
+
+/**
+ * Removes any pending registration and backoff state for the account
+ *
+ * @param accountId the account to forget about
+ */
+- (void)cancelRegistration:(NSNumber *_Nonnull)accountId;
+
+/**
+ * Advances the timer wheel, sending any registrations that are due and fit under the in-flight limit
+ *
+ * @param now the current time, in seconds
+ */
+- (void)advanceToTime:(NSTimeInterval)now;
+
+@end
@@ -0,0 +1,303 @@
+//
+//  SBSRegistrationScheduler.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/12/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSRegistrationScheduler.h"
+
+#import "SBSRegistrationMetrics.h"
+
+/**
+ * Number of slots on the timer wheel. Delays longer than a full revolution are tracked with a round counter.
+ */
+static NSUInteger const RegistrationSchedulerSlots = 512;
+
+/**
+ * Longest retry delay used when a caller doesn't give one, or a send fails before a caller ever told us what it is
+ */
+static NSTimeInterval const RegistrationSchedulerDefaultMaxDelay = 60.0;
+
+#pragma mark - Entry
+
+@interface SBSRegistrationSchedulerEntry : NSObject
+
+@property(nonatomic, strong) NSNumber *accountId;
+@property(nonatomic) NSUInteger rounds;
+@property(nonatomic) BOOL cancelled;
+@property(nonatomic) BOOL deferred;
+
+@end
+
+@implementation SBSRegistrationSchedulerEntry
+@end
+
+#pragma mark - Scheduler
+
+@interface SBSRegistrationScheduler ()
+
+@property(nonatomic, copy) SBSRegistrationSender sender;
+@property(nonatomic) NSTimeInterval resolution;
+@property(nonatomic) NSTimeInterval retryBaseDelay;
+
+@end
+
+@implementation SBSRegistrationScheduler {
+  NSMutableArray<NSMutableArray<SBSRegistrationSchedulerEntry *> *> *_slots;
+  NSUInteger _cursor;
+  NSTimeInterval _tickTime;
+  NSTimeInterval _now;
+
+  NSMutableDictionary<NSNumber *, SBSRegistrationSchedulerEntry *> *_pending;
+  NSMutableArray<SBSRegistrationSchedulerEntry *> *_ready;
+  NSMutableDictionary<NSNumber *, NSNumber *> *_inFlight;
+  NSMutableDictionary<NSNumber *, NSNumber *> *_previousDelays;
+  NSMutableDictionary<NSNumber *, NSNumber *> *_maxDelays;
+
+  NSUInteger _registrationsSent;
+  NSUInteger _retriesScheduled;
+  NSUInteger _registrationsDeferred;
+  NSUInteger _registrationsTimedOut;
+  NSUInteger _peakInFlight;
+  BOOL _draining;
+}
+
+//------------------------------------------------------------------------------
+
+- (instancetype)initWithMaxInFlight:(NSUInteger)maxInFlight
+                         resolution:(NSTimeInterval)resolution
+                     retryBaseDelay:(NSTimeInterval)retryBaseDelay
+                                now:(NSTimeInterval)now
+                             sender:(SBSRegistrationSender)sender {
+  if (self = [super init]) {
+    _maxInFlight = MAX(maxInFlight, 1);
+    _resolution = resolution;
+    _retryBaseDelay = retryBaseDelay;
+    _sender = [sender copy];
+    _inFlightTimeout = 32.0;
+    _randomSource = ^double {
+      return arc4random() / ((double) UINT32_MAX + 1);
+    };
+
+    _slots = [[NSMutableArray alloc] initWithCapacity:RegistrationSchedulerSlots];
+    for (NSUInteger i = 0; i < RegistrationSchedulerSlots; i++) {
+      [_slots addObject:[[NSMutableArray alloc] init]];
+    }
+
+    _cursor = 0;
+    _tickTime = now;
+    _now = now;
+    _pending = [[NSMutableDictionary alloc] init];
+    _ready = [[NSMutableArray alloc] init];
+    _inFlight = [[NSMutableDictionary alloc] init];
+    _previousDelays = [[NSMutableDictionary alloc] init];
+    _maxDelays = [[NSMutableDictionary alloc] init];
+  }
+
+  return self;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSRegistrationMetrics *)metrics {
+  return [[SBSRegistrationMetrics alloc] initWithRegistrationsSent:_registrationsSent
+                                                  retriesScheduled:_retriesScheduled
+                                             registrationsDeferred:_registrationsDeferred
+                                             registrationsTimedOut:_registrationsTimedOut
+                                                          inFlight:_inFlight.count
+                                                      peakInFlight:_peakInFlight
+                                                           pending:_pending.count];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)scheduleRegistration:(NSNumber *)accountId after:(NSTimeInterval)delay jitter:(NSTimeInterval)jitter {
+  [self insert:accountId delay:delay + _randomSource() * jitter];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)scheduleRetry:(NSNumber *)accountId maxDelay:(NSTimeInterval)maxDelay {
+  maxDelay = MAX(maxDelay > 0 ? maxDelay : RegistrationSchedulerDefaultMaxDelay, _retryBaseDelay);
+  _maxDelays[accountId] = @(maxDelay);
+
+  // Decorrelated jitter: draw between the base and 3x the previous delay, so retries from accounts that failed
+  // at the same moment drift apart rather than staying in lockstep
+  NSTimeInterval previous = _previousDelays[accountId] ? _previousDelays[accountId].doubleValue : _retryBaseDelay;
+  NSTimeInterval delay = MIN(maxDelay, _retryBaseDelay + _randomSource() * (previous * 3 - _retryBaseDelay));
+  _previousDelays[accountId] = @(delay);
+
+  // A retry is never due right away, or a sender that fails synchronously would be retried in a loop
+  delay = MAX(delay, _resolution);
+
+  _retriesScheduled++;
+  [self insert:accountId delay:delay];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)startRegistration:(NSNumber *)accountId {
+  if (_inFlight[accountId] != nil) {
+    return;
+  }
+
+  _inFlight[accountId] = @(_now);
+  _peakInFlight = MAX(_peakInFlight, _inFlight.count);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)completeRegistration:(NSNumber *)accountId success:(BOOL)success {
+  [_inFlight removeObjectForKey:accountId];
+
+  if (success) {
+    [_previousDelays removeObjectForKey:accountId];
+  }
+
+  // A slot just opened up, so let the next registration through without waiting for a tick
+  [self drain];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)cancelRegistration:(NSNumber *)accountId {
+  [self removePending:accountId];
+  [_inFlight removeObjectForKey:accountId];
+  [_previousDelays removeObjectForKey:accountId];
+  [_maxDelays removeObjectForKey:accountId];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)advanceToTime:(NSTimeInterval)now {
+  _now = MAX(_now, now);
+
+  while (_tickTime + _resolution <= _now) {
+    _tickTime += _resolution;
+    _cursor = (_cursor + 1) % RegistrationSchedulerSlots;
+
+    NSMutableArray<SBSRegistrationSchedulerEntry *> *slot = _slots[_cursor];
+    NSMutableArray<SBSRegistrationSchedulerEntry *> *remaining = [[NSMutableArray alloc] init];
+
+    for (SBSRegistrationSchedulerEntry *entry in slot) {
+      if (entry.cancelled) {
+        continue;
+      }
+
+      if (entry.rounds > 0) {
+        entry.rounds--;
+        [remaining addObject:entry];
+      } else {
+        [_ready addObject:entry];
+      }
+    }
+
+    _slots[_cursor] = remaining;
+  }
+
+  [self expireInFlight];
+  [self drain];
+}
+
+//------------------------------------------------------------------------------
+#pragma mark - Private
+//------------------------------------------------------------------------------
+
+- (void)insert:(NSNumber *)accountId delay:(NSTimeInterval)delay {
+  [self removePending:accountId];
+
+  SBSRegistrationSchedulerEntry *entry = [[SBSRegistrationSchedulerEntry alloc] init];
+  entry.accountId = accountId;
+  _pending[accountId] = entry;
+
+  // Anything due now skips the wheel entirely
+  NSUInteger ticks = (NSUInteger) ceil(delay / _resolution);
+  if (ticks == 0) {
+    [_ready addObject:entry];
+    [self drain];
+    return;
+  }
+
+  entry.rounds = (ticks - 1) / RegistrationSchedulerSlots;
+  [_slots[(_cursor + ticks) % RegistrationSchedulerSlots] addObject:entry];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)removePending:(NSNumber *)accountId {
+  SBSRegistrationSchedulerEntry *entry = _pending[accountId];
+  if (entry == nil) {
+    return;
+  }
+
+  // Entries on the wheel are skipped lazily when their slot comes around
+  entry.cancelled = YES;
+  [_ready removeObjectIdenticalTo:entry];
+  [_pending removeObjectForKey:accountId];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)expireInFlight {
+  NSMutableArray<NSNumber *> *expired = [[NSMutableArray alloc] init];
+  [_inFlight enumerateKeysAndObjectsUsingBlock:^(NSNumber *accountId, NSNumber *sentAt, BOOL *stop) {
+    if (_now - sentAt.doubleValue >= _inFlightTimeout) {
+      [expired addObject:accountId];
+    }
+  }];
+
+  _registrationsTimedOut += expired.count;
+  [_inFlight removeObjectsForKeys:expired];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)drain {
+
+  // The sender may report back, or schedule more registrations, before it returns. Whatever that makes ready is
+  // picked up by the drain that's already running.
+  if (_draining) {
+    return;
+  }
+
+  _draining = YES;
+  NSMutableArray<SBSRegistrationSchedulerEntry *> *waiting = [[NSMutableArray alloc] init];
+
+  while (_ready.count > 0 && _inFlight.count < _maxInFlight) {
+    SBSRegistrationSchedulerEntry *entry = _ready.firstObject;
+    [_ready removeObjectAtIndex:0];
+
+    // The account still has a registration outstanding (a refresh, say), and this one goes out once it completes
+    if (_inFlight[entry.accountId] != nil) {
+      [waiting addObject:entry];
+      continue;
+    }
+
+    [_pending removeObjectForKey:entry.accountId];
+    _inFlight[entry.accountId] = @(_now);
+    _registrationsSent++;
+    _peakInFlight = MAX(_peakInFlight, _inFlight.count);
+
+    if (!_sender(entry.accountId)) {
+      [_inFlight removeObjectForKey:entry.accountId];
+
+      NSNumber *maxDelay = _maxDelays[entry.accountId];
+      [self scheduleRetry:entry.accountId maxDelay:maxDelay ? maxDelay.doubleValue : RegistrationSchedulerDefaultMaxDelay];
+    }
+  }
+
+  [_ready insertObjects:waiting atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, waiting.count)]];
+  _draining = NO;
+
+  // Whatever is left is due, but has to wait for a slot
+  for (SBSRegistrationSchedulerEntry *entry in _ready) {
+    if (!entry.deferred) {
+      entry.deferred = YES;
+      _registrationsDeferred++;
+    }
+  }
+}
+
+@end
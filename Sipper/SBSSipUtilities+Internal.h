@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 
 typedef struct pjsip_msg pjsip_msg;
+typedef struct pjsip_method pjsip_method;
 
 @interface SBSSipUtilities : NSObject
 
@@ -22,4 +23,13 @@ typedef struct pjsip_msg pjsip_msg;
  */
 + (NSDictionary<NSString *, NSString *> *)headersFromMessage:(pjsip_msg *)message;
 
+/**
+ * Gets the name of a SIP method
+ *
+ * The methods PJSIP knows about are named by constant strings, so only extension methods allocate a new string.
+ *
+ * @param method the method to name
+ */
++ (NSString *)nameOfMethod:(const pjsip_method *)method;
+
 @end
@@ -11,6 +11,48 @@
 #import "NSString+PJString.h"
 #import <pjsip.h>
 
+/**
+ * A name as it appears in messages, and the constant string it's given as
+ */
+typedef struct {
+  const char *name;
+  __unsafe_unretained NSString *string;
+} SipName;
+
+/**
+ * The headers most messages carry, whose lowercase keys are constant strings instead of being allocated for every
+ * message
+ */
+static SipName const CommonHeaderNames[] = {
+  {"Via", @"via"}, {"From", @"from"}, {"To", @"to"}, {"Call-ID", @"call-id"}, {"CSeq", @"cseq"},
+  {"Contact", @"contact"}, {"Max-Forwards", @"max-forwards"}, {"Content-Type", @"content-type"},
+  {"Content-Length", @"content-length"}, {"Allow", @"allow"}, {"Supported", @"supported"}, {"Require", @"require"},
+  {"User-Agent", @"user-agent"}, {"Server", @"server"}, {"Record-Route", @"record-route"}, {"Route", @"route"},
+  {"Expires", @"expires"}, {"Session-Expires", @"session-expires"}, {"Min-SE", @"min-se"},
+  {"Allow-Events", @"allow-events"}, {"Accept", @"accept"}, {"RSeq", @"rseq"}, {"RAck", @"rack"},
+  {"Reason", @"reason"}, {"P-Asserted-Identity", @"p-asserted-identity"}, {"Recv-Info", @"recv-info"},
+  {"Info-Package", @"info-package"}, {"WWW-Authenticate", @"www-authenticate"},
+  {"Proxy-Authenticate", @"proxy-authenticate"}
+};
+
+/**
+ * Extension methods calls commonly use, which PJSIP has no id for
+ */
+static SipName const ExtensionMethodNames[] = {
+  {"INFO", @"INFO"}, {"UPDATE", @"UPDATE"}, {"PRACK", @"PRACK"}, {"REFER", @"REFER"}, {"NOTIFY", @"NOTIFY"},
+  {"SUBSCRIBE", @"SUBSCRIBE"}, {"MESSAGE", @"MESSAGE"}
+};
+
+static NSString *keyForHeaderName(const pj_str_t *name) {
+  for (unsigned i = 0; i < PJ_ARRAY_SIZE(CommonHeaderNames); i++) {
+    if (pj_stricmp2(name, CommonHeaderNames[i].name) == 0) {
+      return CommonHeaderNames[i].string;
+    }
+  }
+  
+  return [[NSString stringWithPJString:*name] lowercaseString];
+}
+
 @implementation SBSSipUtilities
 
 + (NSDictionary<NSString *, NSString *> *)headersFromMessage:(pjsip_msg *)message {
@@ -21,27 +63,62 @@
   
   // Iterate over all of the headers, push to dictionary
   for (; hdr != end; hdr = hdr->next) {
-    NSString *headerName = [NSString stringWithPJString:hdr->name];
-    char value[512] = {0};
+    char value[512];
     
     // If we weren't able to read the string in 512 bytes... (we should fix this)
-    if (hdr->vptr->print_on(hdr, value, 512) == -1) {
+    int length = hdr->vptr->print_on(hdr, value, sizeof(value));
+    if (length < 0) {
       continue;
     }
     
-    // Always append the raw header value, even if we did something else above
-    NSString *headerValue = [[NSString alloc] initWithCString:value encoding:NSUTF8StringEncoding];
-    NSRange splitRange = [headerValue rangeOfString:@":"];
+    // Strip out the header name that's printed in front of the value, and the whitespace around it. This is done on
+    // the printed bytes, so the value is the only string that's allocated.
+    const char *start = (const char *) memchr(value, ':', (size_t) length);
+    const char *stop = value + length;
+    start = start != NULL ? start + 1 : value;
+    while (start < stop && (*start == ' ' || *start == '\t')) {
+      start++;
+    }
+    while (stop > start && (stop[-1] == ' ' || stop[-1] == '\t')) {
+      stop--;
+    }
     
-    // Strip out the header name from the value
-    if (splitRange.location != NSNotFound) {
-      headerValue = [[headerValue substringFromIndex:splitRange.location + 1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    NSString *headerValue = [[NSString alloc] initWithBytes:start length:(NSUInteger) (stop - start) encoding:NSUTF8StringEncoding];
+    if (headerValue == nil) {
+      continue;
     }
     
-    [headers setObject:headerValue forKey:[headerName lowercaseString]];
+    [headers setObject:headerValue forKey:keyForHeaderName(&hdr->name)];
   }
   
   return headers;
 }
 
++ (NSString *)nameOfMethod:(const pjsip_method *)method {
+  switch (method->id) {
+    case PJSIP_INVITE_METHOD:
+      return @"INVITE";
+    case PJSIP_CANCEL_METHOD:
+      return @"CANCEL";
+    case PJSIP_ACK_METHOD:
+      return @"ACK";
+    case PJSIP_BYE_METHOD:
+      return @"BYE";
+    case PJSIP_REGISTER_METHOD:
+      return @"REGISTER";
+    case PJSIP_OPTIONS_METHOD:
+      return @"OPTIONS";
+    case PJSIP_OTHER_METHOD:
+      break;
+  }
+  
+  for (unsigned i = 0; i < PJ_ARRAY_SIZE(ExtensionMethodNames); i++) {
+    if (pj_strcmp2(&method->name, ExtensionMethodNames[i].name) == 0) {
+      return ExtensionMethodNames[i].string;
+    }
+  }
+  
+  return [NSString stringWithPJString:method->name];
+}
+
 @end
@@ -10,13 +10,29 @@
 
 #import "SBSAccount.h"
 #import "SBSAccountConfiguration.h"
+#import "SBSAudioDeviceStatistics.h"
 #import "SBSCall.h"
+#import "SBSCallFuture.h"
+#import "SBSCallRecord.h"
+#import "SBSCallRecordStore.h"
+#import "SBSCallbackLatencyStatistics.h"
+#import "SBSCallbackReplayStatistics.h"
 #import "SBSCodecDescriptor.h"
 #import "SBSConstants.h"
+#import "SBSDNSCacheStatistics.h"
 #import "SBSEndpoint.h"
 #import "SBSEndpointConfiguration.h"
+#import "SBSEndpointStartupMetrics.h"
 #import "SBSEventBinding.h"
+#import "SBSEventDeliveryStatistics.h"
+#import "SBSICECandidateStatistics.h"
+#import "SBSKeepAliveStatistics.h"
 #import "SBSMediaDescription.h"
+#import "SBSMediaTapStatistics.h"
+#import "SBSMessageCompactionStatistics.h"
 #import "SBSNameAddressPair.h"
+#import "SBSRegistrationMetrics.h"
 #import "SBSRingtone.h"
+#import "SBSSrtpSuiteBenchmark.h"
+#import "SBSTLSHandshakeStatistics.h"
 #import "SBSTransportConfiguration.h"
\ No newline at end of file
@@ -0,0 +1,265 @@
+//
+//  call_state_machine.hpp
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef call_state_machine_hpp
+#define call_state_machine_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace sipper {
+
+/*
+ * The states of a call, in the same order as SBSCallState
+ */
+enum class call_state : std::uint8_t {
+  pending,
+  disconnecting,
+  disconnected,
+  calling,
+  incoming,
+  early,
+  connecting,
+  active
+};
+
+/*
+ * Which side holds a call, in the same order as SBSHoldState
+ */
+enum class hold_state : std::uint8_t {
+  none,
+  local,
+  remote
+};
+
+/*
+ * What can happen to a call. The first inputs are the invite session states, in the order PJSIP numbers them, then
+ * what the application asks for, then the hold state read from the call's media, then muting.
+ */
+enum class call_input : std::uint8_t {
+  sip_null,
+  sip_calling,
+  sip_incoming,
+  sip_early,
+  sip_connecting,
+  sip_confirmed,
+  sip_disconnected,
+  answer,
+  hangup,
+  end,
+
+  hold_none,
+  hold_local,
+  hold_remote,
+
+  mute,
+  unmute
+};
+
+/*
+ * What a transition asks the call to do, as bits of call_transition::actions
+ */
+namespace call_action {
+  /* The call, hold or mute state changed */
+  constexpr std::uint8_t state_changed = 1 << 0;
+  constexpr std::uint8_t hold_changed = 1 << 1;
+  constexpr std::uint8_t mute_changed = 1 << 2;
+  /* The call isn't ringing anymore. Asked for on every input outside of ringing, since stopping a ringtone that isn't
+   * playing does nothing, so it doesn't count as the transition having done something. */
+  constexpr std::uint8_t stop_ringtone = 1 << 3;
+  /* The call left the pending state for the first time */
+  constexpr std::uint8_t started = 1 << 4;
+  /* The call became active for the first time */
+  constexpr std::uint8_t activated = 1 << 5;
+  /* The invite session disconnected, and the call should be ended */
+  constexpr std::uint8_t ended = 1 << 6;
+}
+
+/*
+ * One input applied to a call. From and to are the state the input drives: a call_state, a hold_state, or whether the
+ * call is muted.
+ */
+struct call_transition {
+  call_input input;
+  std::uint8_t from;
+  std::uint8_t to;
+  std::uint8_t actions;
+
+  bool has(std::uint8_t action) const noexcept { return (actions & action) != 0; }
+};
+
+static_assert(sizeof(call_transition) == 4, "call transitions are kept by value in the history");
+
+namespace detail {
+
+  struct call_rule {
+    call_state next;
+    std::uint8_t actions;
+  };
+
+  constexpr call_state PND = call_state::pending;
+  constexpr call_state HUP = call_state::disconnecting;
+  constexpr call_state DSC = call_state::disconnected;
+  constexpr call_state CLG = call_state::calling;
+  constexpr call_state INC = call_state::incoming;
+  constexpr call_state ERL = call_state::early;
+  constexpr call_state CON = call_state::connecting;
+  constexpr call_state ACT = call_state::active;
+
+  constexpr std::uint8_t STOP = call_action::stop_ringtone;
+  constexpr std::uint8_t START = call_action::started;
+  constexpr std::uint8_t ACTIVE = call_action::activated;
+  constexpr std::uint8_t END = call_action::ended;
+
+  constexpr std::size_t call_inputs = static_cast<std::size_t>(call_input::end) + 1;
+
+  /*
+   * The call state that each input leads to from each state, and what the call does about it. A call that's hanging
+   * up stays that way until its session disconnects, and a disconnected call stays disconnected. The ringtone stops
+   * whenever the call isn't incoming or early.
+   */
+  constexpr call_rule call_table[8][call_inputs] = {
+    /*                   null                 calling              incoming             early                connecting           confirmed                     disconnected               answer       hangup       end */
+    /* pending */       {{PND, STOP},         {CLG, STOP | START}, {INC, START},        {ERL, START},        {CON, STOP | START}, {ACT, STOP | START | ACTIVE}, {DSC, STOP | START | END}, {PND, STOP}, {HUP, STOP}, {DSC, STOP}},
+    /* disconnecting */ {{HUP, STOP | START}, {HUP, STOP | START}, {HUP, STOP | START}, {HUP, STOP | START}, {HUP, STOP | START}, {HUP, STOP | START},          {DSC, STOP | START | END}, {HUP, STOP}, {HUP, STOP}, {DSC, STOP}},
+    /* disconnected */  {{DSC, STOP},         {DSC, STOP},         {DSC, STOP},         {DSC, STOP},         {DSC, STOP},         {DSC, STOP},                  {DSC, STOP},               {DSC, STOP}, {DSC, STOP}, {DSC, STOP}},
+    /* calling */       {{PND, STOP},         {CLG, STOP | START}, {INC, START},        {ERL, START},        {CON, STOP | START}, {ACT, STOP | START | ACTIVE}, {DSC, STOP | START | END}, {CLG, STOP}, {HUP, STOP}, {DSC, STOP}},
+    /* incoming */      {{PND, STOP},         {CLG, STOP | START}, {INC, START},        {ERL, START},        {CON, STOP | START}, {ACT, STOP | START | ACTIVE}, {DSC, STOP | START | END}, {INC, STOP}, {HUP, STOP}, {DSC, STOP}},
+    /* early */         {{PND, STOP},         {CLG, STOP | START}, {INC, START},        {ERL, START},        {CON, STOP | START}, {ACT, STOP | START | ACTIVE}, {DSC, STOP | START | END}, {ERL, STOP}, {HUP, STOP}, {DSC, STOP}},
+    /* connecting */    {{PND, STOP},         {CLG, STOP | START}, {INC, START},        {ERL, START},        {CON, STOP | START}, {ACT, STOP | START | ACTIVE}, {DSC, STOP | START | END}, {CON, STOP}, {HUP, STOP}, {DSC, STOP}},
+    /* active */        {{PND, STOP},         {CLG, STOP | START}, {INC, START},        {ERL, START},        {CON, STOP | START}, {ACT, STOP | START | ACTIVE}, {DSC, STOP | START | END}, {ACT, STOP}, {HUP, STOP}, {DSC, STOP}},
+  };
+
+  /* The hold state follows the media, whatever it was before */
+  constexpr hold_state hold_table[3][3] = {
+    /*            none              local              remote */
+    /* none */   {hold_state::none, hold_state::local, hold_state::remote},
+    /* local */  {hold_state::none, hold_state::local, hold_state::remote},
+    /* remote */ {hold_state::none, hold_state::local, hold_state::remote},
+  };
+
+  /* As does muting follow the application */
+  constexpr bool mute_table[2][2] = {
+    /*                mute  unmute */
+    /* unmuted */    {true, false},
+    /* muted */      {true, false},
+  };
+
+}
+
+/*
+ * The call, hold and mute state of one call, driven by tables. Applying an input returns a transition saying what
+ * changed and what the call should do about it, and the last History transitions that changed a state or asked for
+ * more than stopping the ringtone are kept for inspection. Nothing is allocated.
+ *
+ * A call's inputs come from more than one thread, so the machine is guarded by its own lock, and each input is
+ * applied whole: a hangup and a session state that race each other end up in the same state whichever comes first.
+ * What the caller does about a transition happens after the lock is released.
+ */
+template <std::size_t History = 16>
+class call_state_machine {
+public:
+  static_assert(History > 0, "the history keeps at least one transition");
+
+  call_state state() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+  }
+
+  hold_state hold() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hold_;
+  }
+
+  bool muted() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return muted_;
+  }
+
+  /*
+   * Apply an input, and record the transition if it did anything
+   */
+  call_transition apply(call_input input) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    call_transition transition;
+    transition.input = input;
+
+    if (input <= call_input::end) {
+      const detail::call_rule &rule = detail::call_table[index(state_)][index(input)];
+      transition.from = index(state_);
+      transition.to = index(rule.next);
+      transition.actions = static_cast<std::uint8_t>(rule.actions & ~once_);
+      once_ |= rule.actions & (call_action::started | call_action::activated | call_action::ended);
+      if (rule.next != state_) {
+        transition.actions |= call_action::state_changed;
+      }
+      state_ = rule.next;
+    } else if (input <= call_input::hold_remote) {
+      hold_state next = detail::hold_table[index(hold_)][index(input) - index(call_input::hold_none)];
+      transition.from = index(hold_);
+      transition.to = index(next);
+      transition.actions = next != hold_ ? call_action::hold_changed : std::uint8_t(0);
+      hold_ = next;
+    } else {
+      bool next = detail::mute_table[muted_ ? 1 : 0][index(input) - index(call_input::mute)];
+      transition.from = muted_ ? 1 : 0;
+      transition.to = next ? 1 : 0;
+      transition.actions = next != muted_ ? call_action::mute_changed : std::uint8_t(0);
+      muted_ = next;
+    }
+
+    if ((transition.actions & ~call_action::stop_ringtone) != 0) {
+      history_[recorded_++ % History] = transition;
+    }
+
+    return transition;
+  }
+
+  /*
+   * The number of transitions recorded since the machine was made, of which the last History are kept
+   */
+  std::uint64_t recorded() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recorded_;
+  }
+
+  /*
+   * The number of transitions kept
+   */
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return kept();
+  }
+
+  /*
+   * A kept transition, oldest first. Inputs applied between two reads shift what each index refers to.
+   */
+  call_transition operator[](std::size_t i) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return history_[(recorded_ - kept() + i) % History];
+  }
+
+private:
+  template <typename T>
+  static constexpr std::uint8_t index(T value) noexcept { return static_cast<std::uint8_t>(value); }
+
+  std::size_t kept() const noexcept { return recorded_ < History ? static_cast<std::size_t>(recorded_) : History; }
+
+  mutable std::mutex mutex_;
+  call_state state_ = call_state::pending;
+  hold_state hold_ = hold_state::none;
+  bool muted_ = false;
+  std::uint8_t once_ = 0;
+  std::uint64_t recorded_ = 0;
+  call_transition history_[History];
+};
+
+}
+
+#endif /* call_state_machine_hpp */
@@ -0,0 +1,164 @@
+//
+//  call_state_machine_tests.cpp
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+//  The state machine's tests, without Foundation or XCTest, so they run wherever there's a C++11 compiler:
+//
+//    c++ -std=c++11 -Wall -Wextra -pthread -o call_state_machine_tests call_state_machine_tests.cpp
+//    ./call_state_machine_tests
+//
+
+#include "call_state_machine.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using sipper::call_action::activated;
+using sipper::call_action::ended;
+using sipper::call_action::hold_changed;
+using sipper::call_action::mute_changed;
+using sipper::call_action::started;
+using sipper::call_action::state_changed;
+using sipper::call_action::stop_ringtone;
+using sipper::call_input;
+using sipper::call_state;
+using sipper::hold_state;
+
+static int failures = 0;
+
+#define EXPECT(condition)                                                   \
+  do {                                                                      \
+    if (!(condition)) {                                                     \
+      std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition);  \
+      failures++;                                                           \
+    }                                                                       \
+  } while (0)
+
+/*
+ * The inputs of an outgoing call that's put on hold, muted, and hung up
+ */
+static const call_input OutgoingCall[] = {
+  call_input::sip_calling, call_input::sip_early, call_input::sip_connecting, call_input::sip_confirmed,
+  call_input::hold_local, call_input::hold_none, call_input::mute, call_input::unmute,
+  call_input::hangup, call_input::sip_disconnected, call_input::end
+};
+
+static void incoming_call_rings_until_answered() {
+  sipper::call_state_machine<> machine;
+
+  sipper::call_transition transition = machine.apply(call_input::sip_incoming);
+  EXPECT(machine.state() == call_state::incoming);
+  EXPECT(transition.actions == (state_changed | started));
+
+  transition = machine.apply(call_input::answer);
+  EXPECT(machine.state() == call_state::incoming);
+  EXPECT(transition.actions == stop_ringtone);
+
+  machine.apply(call_input::sip_connecting);
+  transition = machine.apply(call_input::sip_confirmed);
+  EXPECT(machine.state() == call_state::active);
+  EXPECT(transition.has(activated));
+  EXPECT(!transition.has(started));
+}
+
+static void hangup_waits_for_the_session_to_disconnect() {
+  sipper::call_state_machine<> machine;
+  machine.apply(call_input::sip_calling);
+  machine.apply(call_input::sip_early);
+
+  EXPECT(machine.apply(call_input::hangup).has(state_changed));
+  EXPECT(machine.state() == call_state::disconnecting);
+  EXPECT(!machine.apply(call_input::sip_early).has(state_changed));
+  EXPECT(machine.state() == call_state::disconnecting);
+
+  sipper::call_transition transition = machine.apply(call_input::sip_disconnected);
+  EXPECT(machine.state() == call_state::disconnected);
+  EXPECT(transition.has(ended));
+}
+
+static void disconnected_call_records_nothing_more() {
+  sipper::call_state_machine<> machine;
+  machine.apply(call_input::sip_incoming);
+  machine.apply(call_input::end);
+  std::uint64_t recorded = machine.recorded();
+
+  for (std::uint8_t input = 0; input <= static_cast<std::uint8_t>(call_input::end); input++) {
+    sipper::call_transition transition = machine.apply(static_cast<call_input>(input));
+    EXPECT(machine.state() == call_state::disconnected);
+    EXPECT(!transition.has(state_changed));
+    EXPECT(!transition.has(ended));
+  }
+
+  EXPECT(machine.recorded() == recorded);
+}
+
+static void hold_and_mute_change_only_once() {
+  sipper::call_state_machine<> machine;
+
+  EXPECT(machine.apply(call_input::hold_none).actions == 0);
+  EXPECT(machine.apply(call_input::hold_remote).actions == hold_changed);
+  EXPECT(machine.hold() == hold_state::remote);
+  EXPECT(machine.apply(call_input::hold_remote).actions == 0);
+
+  EXPECT(machine.apply(call_input::mute).actions == mute_changed);
+  EXPECT(machine.muted());
+  EXPECT(machine.apply(call_input::mute).actions == 0);
+  EXPECT(machine.state() == call_state::pending);
+}
+
+static void history_keeps_the_last_transitions() {
+  sipper::call_state_machine<4> machine;
+
+  machine.apply(call_input::unmute);
+  for (call_input input : OutgoingCall) {
+    machine.apply(input);
+  }
+
+  // Neither the first unmute nor the final end changed anything
+  EXPECT(machine.recorded() == 10);
+  EXPECT(machine.size() == 4);
+  EXPECT(machine[0].input == call_input::mute);
+  EXPECT(machine[1].input == call_input::unmute);
+  EXPECT(machine[2].input == call_input::hangup);
+  EXPECT(machine[3].input == call_input::sip_disconnected);
+  EXPECT(machine[3].to == static_cast<std::uint8_t>(call_state::disconnected));
+}
+
+static void hangup_survives_racing_session_states() {
+  for (int round = 0; round < 1000; round++) {
+    sipper::call_state_machine<> machine;
+    machine.apply(call_input::sip_calling);
+
+    // PJSIP's worker reports the session ringing while the application hangs up
+    std::thread worker([&machine] {
+      for (int i = 0; i < 100; i++) {
+        machine.apply(call_input::sip_early);
+      }
+    });
+    machine.apply(call_input::hangup);
+    worker.join();
+
+    EXPECT(machine.state() == call_state::disconnecting);
+  }
+}
+
+int main() {
+  incoming_call_rings_until_answered();
+  hangup_waits_for_the_session_to_disconnect();
+  disconnected_call_records_nothing_more();
+  hold_and_mute_change_only_once();
+  history_keeps_the_last_transitions();
+  hangup_survives_racing_session_states();
+
+  if (failures != 0) {
+    std::fprintf(stderr, "%d failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  std::printf("call_state_machine_tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,354 @@
+//
+//  pj_call_trace.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_call_trace.h"
+
+#include <pjsua.h>
+#include <stdlib.h>
+
+#define THIS_FILE "pj_call_trace.c"
+
+/* Longest line written for one span: the fixed fields, and a name that's escaped at every character */
+#define TRACE_MAX_LINE          (160 + 6 * PJ_CALL_TRACE_NAME_LEN)
+
+/* Chrome trace phases */
+#define TRACE_PHASE_COMPLETE    'X'
+#define TRACE_PHASE_INSTANT     'i'
+#define TRACE_PHASE_METADATA    'M'
+
+typedef struct trace_event {
+  pj_call_trace_id trace;
+  unsigned tid;
+  char phase;
+  char name[PJ_CALL_TRACE_NAME_LEN];
+  pj_uint64_t ts;
+  pj_uint64_t dur;
+} trace_event;
+
+typedef struct trace_call {
+  pj_call_trace_id trace;
+  char sip_call_id[PJ_CALL_TRACE_NAME_LEN];
+} trace_call;
+
+static struct call_trace {
+  pj_bool_t initialized;
+  pj_pool_t *pool;
+  pj_mutex_t *mutex;
+  trace_event *events;
+  unsigned capacity;
+  pj_uint64_t head;
+  pj_call_trace_id next_trace;
+  unsigned next_tid;
+  trace_call calls[PJSUA_MAX_CALLS];
+} tracer;
+
+/* Set while a call is being made, so the messages it sends before its Call-ID is known can be attributed */
+static _Thread_local pj_call_trace_id current_trace;
+
+/* Each thread gets a small number of its own, so spans on the same thread share a row */
+static _Thread_local unsigned current_tid;
+
+/* Callers hold the lock */
+static void record(pj_call_trace_id trace, char phase, const char *name, pj_uint64_t ts, pj_uint64_t dur)
+{
+  if (current_tid == 0) {
+    current_tid = ++tracer.next_tid;
+  }
+
+  trace_event *event = &tracer.events[tracer.head++ % tracer.capacity];
+  event->trace = trace;
+  event->tid = current_tid;
+  event->phase = phase;
+  event->ts = ts;
+  event->dur = dur;
+  pj_ansi_strncpy(event->name, name, sizeof(event->name) - 1);
+  event->name[sizeof(event->name) - 1] = '\0';
+}
+
+pj_status_t pj_call_trace_init(pj_pool_factory *pf, unsigned events)
+{
+  pj_status_t status;
+
+  PJ_ASSERT_RETURN(events > 0, PJ_EINVAL);
+
+  pj_call_trace_shutdown();
+  pj_bzero(&tracer, sizeof(tracer));
+
+  tracer.pool = pj_pool_create(pf, "calltrace", 512, 512, NULL);
+  if (tracer.pool == NULL) {
+    return PJ_ENOMEM;
+  }
+
+  status = pj_mutex_create_simple(tracer.pool, "calltrace", &tracer.mutex);
+  if (status != PJ_SUCCESS) {
+    pj_pool_release(tracer.pool);
+    return status;
+  }
+
+  tracer.events = (trace_event *) pj_pool_calloc(tracer.pool, events, sizeof(trace_event));
+  if (tracer.events == NULL) {
+    pj_mutex_destroy(tracer.mutex);
+    pj_pool_release(tracer.pool);
+    return PJ_ENOMEM;
+  }
+
+  tracer.capacity = events;
+  tracer.initialized = PJ_TRUE;
+
+  return PJ_SUCCESS;
+}
+
+void pj_call_trace_shutdown(void)
+{
+  if (!tracer.initialized) {
+    return;
+  }
+
+  tracer.initialized = PJ_FALSE;
+  pj_mutex_destroy(tracer.mutex);
+  pj_pool_release(tracer.pool);
+}
+
+pj_bool_t pj_call_trace_enabled(void)
+{
+  return tracer.initialized;
+}
+
+pj_call_trace_id pj_call_trace_create(void)
+{
+  if (!tracer.initialized) {
+    return 0;
+  }
+
+  pj_mutex_lock(tracer.mutex);
+  pj_call_trace_id trace = ++tracer.next_trace;
+  pj_mutex_unlock(tracer.mutex);
+
+  return trace;
+}
+
+void pj_call_trace_bind(pj_call_trace_id trace, pjsua_call_id call_id, const pj_str_t *sip_call_id)
+{
+  if (!tracer.initialized || trace == 0 || call_id < 0 || call_id >= PJSUA_MAX_CALLS) {
+    return;
+  }
+
+  pj_mutex_lock(tracer.mutex);
+
+  trace_call *call = &tracer.calls[call_id];
+  call->trace = trace;
+  call->sip_call_id[0] = '\0';
+
+  if (sip_call_id != NULL && sip_call_id->slen > 0) {
+    int len = (int) PJ_MIN(sip_call_id->slen, (pj_ssize_t) sizeof(call->sip_call_id) - 1);
+    pj_memcpy(call->sip_call_id, sip_call_id->ptr, len);
+    call->sip_call_id[len] = '\0';
+
+    // Names the call's track, which is otherwise just its number
+    record(trace, TRACE_PHASE_METADATA, call->sip_call_id, 0, 0);
+  }
+
+  pj_mutex_unlock(tracer.mutex);
+}
+
+void pj_call_trace_unbind(pjsua_call_id call_id)
+{
+  if (!tracer.initialized || call_id < 0 || call_id >= PJSUA_MAX_CALLS) {
+    return;
+  }
+
+  pj_mutex_lock(tracer.mutex);
+  pj_bzero(&tracer.calls[call_id], sizeof(trace_call));
+  pj_mutex_unlock(tracer.mutex);
+}
+
+pj_call_trace_id pj_call_trace_find(pjsua_call_id call_id)
+{
+  if (!tracer.initialized) {
+    return 0;
+  }
+
+  if (call_id < 0 || call_id >= PJSUA_MAX_CALLS) {
+    return current_trace;
+  }
+
+  pj_mutex_lock(tracer.mutex);
+  pj_call_trace_id trace = tracer.calls[call_id].trace;
+  pj_mutex_unlock(tracer.mutex);
+
+  return trace != 0 ? trace : current_trace;
+}
+
+pj_call_trace_id pj_call_trace_find_message(const pj_str_t *sip_call_id)
+{
+  if (!tracer.initialized) {
+    return 0;
+  }
+
+  pj_call_trace_id trace = 0;
+  if (sip_call_id != NULL && sip_call_id->slen > 0) {
+    pj_mutex_lock(tracer.mutex);
+    for (unsigned i = 0; i < PJSUA_MAX_CALLS && trace == 0; i++) {
+      if (tracer.calls[i].trace != 0 && pj_strcmp2(sip_call_id, tracer.calls[i].sip_call_id) == 0) {
+        trace = tracer.calls[i].trace;
+      }
+    }
+    pj_mutex_unlock(tracer.mutex);
+  }
+
+  return trace != 0 ? trace : current_trace;
+}
+
+void pj_call_trace_set_current(pj_call_trace_id trace)
+{
+  current_trace = trace;
+}
+
+void pj_call_trace_span(pj_call_trace_id trace, const char *name, pj_uint64_t begin, pj_uint64_t end)
+{
+  if (!tracer.initialized || trace == 0) {
+    return;
+  }
+
+  pj_mutex_lock(tracer.mutex);
+  record(trace, TRACE_PHASE_COMPLETE, name, begin, end > begin ? end - begin : 0);
+  pj_mutex_unlock(tracer.mutex);
+}
+
+void pj_call_trace_instant(pj_call_trace_id trace, const char *name, pj_uint64_t ts)
+{
+  if (!tracer.initialized || trace == 0) {
+    return;
+  }
+
+  pj_mutex_lock(tracer.mutex);
+  record(trace, TRACE_PHASE_INSTANT, name, ts, 0);
+  pj_mutex_unlock(tracer.mutex);
+}
+
+/* Names are printed as JSON strings, so quotes, backslashes and control characters are escaped */
+static void escape_name(const char *name, char *out)
+{
+  for (; *name != '\0'; name++) {
+    unsigned char c = (unsigned char) *name;
+    if (c == '"' || c == '\\') {
+      *out++ = '\\';
+      *out++ = (char) c;
+    } else if (c < 0x20) {
+      out += pj_ansi_sprintf(out, "\\u%04x", c);
+    } else {
+      *out++ = (char) c;
+    }
+  }
+
+  *out = '\0';
+}
+
+static pj_status_t write_event(pj_oshandle_t fd, const trace_event *event, pj_bool_t first)
+{
+  char name[6 * PJ_CALL_TRACE_NAME_LEN];
+  char line[TRACE_MAX_LINE];
+  int len;
+
+  escape_name(event->name, name);
+  const char *separator = first ? "" : ",\n";
+
+  // Chrome traces count in microseconds, which loses the nanoseconds unless they're kept as a fraction
+  if (event->phase == TRACE_PHASE_METADATA) {
+    len = pj_ansi_snprintf(line, sizeof(line),
+                           "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"Call %u (%s)\"}}",
+                           separator, event->trace, event->trace, name);
+  } else if (event->phase == TRACE_PHASE_INSTANT) {
+    len = pj_ansi_snprintf(line, sizeof(line),
+                           "%s{\"name\":\"%s\",\"cat\":\"call\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%llu.%03u,"
+                           "\"pid\":%u,\"tid\":%u}",
+                           separator, name, (unsigned long long) (event->ts / 1000), (unsigned) (event->ts % 1000),
+                           event->trace, event->tid);
+  } else {
+    len = pj_ansi_snprintf(line, sizeof(line),
+                           "%s{\"name\":\"%s\",\"cat\":\"call\",\"ph\":\"X\",\"ts\":%llu.%03u,\"dur\":%llu.%03u,"
+                           "\"pid\":%u,\"tid\":%u}",
+                           separator, name, (unsigned long long) (event->ts / 1000), (unsigned) (event->ts % 1000),
+                           (unsigned long long) (event->dur / 1000), (unsigned) (event->dur % 1000),
+                           event->trace, event->tid);
+  }
+
+  pj_ssize_t size = len;
+  return pj_file_write(fd, line, &size);
+}
+
+pj_status_t pj_call_trace_write(const char *path, pj_call_trace_id trace, unsigned *count)
+{
+  pj_status_t status;
+  unsigned written = 0;
+
+  if (count != NULL) {
+    *count = 0;
+  }
+
+  if (!tracer.initialized) {
+    return PJ_EINVALIDOP;
+  }
+
+  // Copied out, so spans keep being recorded while the file is written
+  pj_mutex_lock(tracer.mutex);
+  pj_uint64_t head = tracer.head;
+  unsigned available = (unsigned) PJ_MIN(head, (pj_uint64_t) tracer.capacity);
+  trace_event *events = (trace_event *) malloc(PJ_MAX(available, 1) * sizeof(trace_event));
+  if (events == NULL) {
+    pj_mutex_unlock(tracer.mutex);
+    return PJ_ENOMEM;
+  }
+
+  unsigned copied = 0;
+  for (pj_uint64_t i = head - available; i < head; i++) {
+    const trace_event *event = &tracer.events[i % tracer.capacity];
+    if (trace == 0 || event->trace == trace) {
+      events[copied++] = *event;
+    }
+  }
+  pj_mutex_unlock(tracer.mutex);
+
+  pj_oshandle_t fd;
+  status = pj_file_open(NULL, path, PJ_O_WRONLY, &fd);
+  if (status != PJ_SUCCESS) {
+    free(events);
+    return status;
+  }
+
+  const char *preamble = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  pj_ssize_t size = (pj_ssize_t) pj_ansi_strlen(preamble);
+  status = pj_file_write(fd, preamble, &size);
+
+  for (unsigned i = 0; i < copied && status == PJ_SUCCESS; i++) {
+    status = write_event(fd, &events[i], i == 0);
+    if (events[i].phase != TRACE_PHASE_METADATA) {
+      written++;
+    }
+  }
+
+  if (status == PJ_SUCCESS) {
+    const char *trailer = "\n]}\n";
+    size = (pj_ssize_t) pj_ansi_strlen(trailer);
+    status = pj_file_write(fd, trailer, &size);
+  }
+
+  pj_file_close(fd);
+  free(events);
+
+  if (status != PJ_SUCCESS) {
+    PJ_PERROR(3, (THIS_FILE, status, "Failed to write call trace to %s", path));
+    return status;
+  }
+
+  if (count != NULL) {
+    *count = written;
+  }
+
+  return PJ_SUCCESS;
+}
@@ -0,0 +1,100 @@
+//
+//  pj_call_trace.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_call_trace_h
+#define pj_call_trace_h
+
+#import <pjsua.h>
+
+/* Longest span name that's kept, including the terminator. Longer names are truncated. */
+#define PJ_CALL_TRACE_NAME_LEN  64
+
+/* Identifies the spans of one call. 0 is no call, and spans recorded against it are dropped. */
+typedef pj_uint32_t pj_call_trace_id;
+
+/*
+ * Start tracing call setup. Spans go into a buffer that keeps the most recent ones, and can be written out as a
+ * Chrome trace, which chrome://tracing and Perfetto show as a timeline with a track for each call.
+ * @param pf      Pool factory for the buffer and its lock.
+ * @param events  The number of spans the buffer keeps.
+ */
+pj_status_t pj_call_trace_init(pj_pool_factory *pf, unsigned events);
+
+/*
+ * Stop tracing, and release the buffer
+ */
+void pj_call_trace_shutdown(void);
+
+/*
+ * Whether calls are being traced
+ */
+pj_bool_t pj_call_trace_enabled(void);
+
+/*
+ * Start a trace for a new call
+ * @return  The trace, or 0 if calls aren't being traced.
+ */
+pj_call_trace_id pj_call_trace_create(void);
+
+/*
+ * Associate a trace with a PJSUA call, so the spans of PJSUA callbacks and of the call's messages can be found. This
+ * also names the call's track after its Call-ID.
+ * @param trace        The trace.
+ * @param call_id      The PJSUA call.
+ * @param sip_call_id  Optional, the Call-ID of the call's dialog.
+ */
+void pj_call_trace_bind(pj_call_trace_id trace, pjsua_call_id call_id, const pj_str_t *sip_call_id);
+
+/*
+ * Forget the trace of a PJSUA call, whose index is about to be reused. Spans already recorded are kept.
+ */
+void pj_call_trace_unbind(pjsua_call_id call_id);
+
+/*
+ * Find the trace of a PJSUA call. A call that's still being made, and isn't bound yet, belongs to the trace the
+ * thread set with pj_call_trace_set_current.
+ * @return  The trace, or 0 if the call isn't part of a traced call.
+ */
+pj_call_trace_id pj_call_trace_find(pjsua_call_id call_id);
+
+/*
+ * Find the trace of a SIP message by its Call-ID. Messages sent while a call is being made, before its Call-ID is
+ * known, belong to the trace the thread set with pj_call_trace_set_current.
+ * @return  The trace, or 0 if the message isn't part of a traced call.
+ */
+pj_call_trace_id pj_call_trace_find_message(const pj_str_t *sip_call_id);
+
+/*
+ * Attribute messages sent on this thread to a trace, until it's cleared by setting 0
+ */
+void pj_call_trace_set_current(pj_call_trace_id trace);
+
+/*
+ * Record a span of time, with timestamps from pj_cb_latency_now
+ * @param trace  The call the span belongs to.
+ * @param name   What happened.
+ * @param begin  When it started, in nanoseconds.
+ * @param end    When it finished, in nanoseconds.
+ */
+void pj_call_trace_span(pj_call_trace_id trace, const char *name, pj_uint64_t begin, pj_uint64_t end);
+
+/*
+ * Record something that happened at an instant, with a timestamp from pj_cb_latency_now
+ */
+void pj_call_trace_instant(pj_call_trace_id trace, const char *name, pj_uint64_t ts);
+
+/*
+ * Write the spans in the buffer to a Chrome trace JSON file, oldest first
+ * @param path   The file to write, which is replaced if it exists.
+ * @param trace  The call to write the spans of, or 0 to write every call.
+ * @param count  Optional, set to the number of spans written.
+ * @return       PJ_EINVALIDOP if calls aren't being traced.
+ */
+pj_status_t pj_call_trace_write(const char *path, pj_call_trace_id trace, unsigned *count);
+
+#endif /* pj_call_trace_h */
@@ -0,0 +1,170 @@
+//
+//  pj_cb_latency.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_cb_latency.h"
+
+#include <stdatomic.h>
+#include <time.h>
+
+#define THIS_FILE "pj_cb_latency.c"
+
+#define LATENCY_SUB_BUCKETS     (1u << PJ_CB_LATENCY_SUB_BUCKET_BITS)
+
+/* Times below the sub-bucket count are exact, and each power of two above it up to the maximum gets its own range */
+#define LATENCY_MAX_EXPONENT    40
+#define LATENCY_BUCKETS         ((LATENCY_MAX_EXPONENT - PJ_CB_LATENCY_SUB_BUCKET_BITS + 2) * LATENCY_SUB_BUCKETS)
+
+typedef struct latency_histogram {
+  _Atomic uint64_t count;
+  _Atomic uint64_t sum;
+  _Atomic uint64_t max;
+  _Atomic uint64_t buckets[LATENCY_BUCKETS];
+} latency_histogram;
+
+static const char *latency_names[PJ_CB_LATENCY_COUNT] = {
+  "on_reg_state2",
+  "on_incoming_call",
+  "on_call_state",
+  "on_call_media_state",
+  "on_call_tsx_state",
+  "on_transport_state"
+};
+
+/* Static, so callbacks can be timed before anything is initialized, and there's nothing to tear down */
+static latency_histogram histograms[PJ_CB_LATENCY_COUNT];
+
+/* Below 2^bits, a bucket per value. Above, a power of two is split into 2^bits buckets by its top bits. */
+static unsigned latency_bucket(pj_uint64_t nsec)
+{
+  if (nsec < LATENCY_SUB_BUCKETS) {
+    return (unsigned) nsec;
+  }
+
+  unsigned exponent = 63 - (unsigned) __builtin_clzll(nsec);
+  unsigned shift = exponent - PJ_CB_LATENCY_SUB_BUCKET_BITS;
+  return shift * LATENCY_SUB_BUCKETS + (unsigned) (nsec >> shift);
+}
+
+/* The highest time that lands in a bucket */
+static pj_uint64_t latency_bucket_highest(unsigned bucket)
+{
+  if (bucket < 2 * LATENCY_SUB_BUCKETS) {
+    return bucket;
+  }
+
+  unsigned shift = bucket / LATENCY_SUB_BUCKETS - 1;
+  pj_uint64_t lowest = (pj_uint64_t) (bucket - shift * LATENCY_SUB_BUCKETS) << shift;
+  return lowest + ((pj_uint64_t) 1 << shift) - 1;
+}
+
+pj_uint64_t pj_cb_latency_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (pj_uint64_t) ts.tv_sec * 1000000000 + (pj_uint64_t) ts.tv_nsec;
+}
+
+void pj_cb_latency_record(pj_cb_latency_id id, pj_uint64_t nsec)
+{
+  if (id >= PJ_CB_LATENCY_COUNT) {
+    return;
+  }
+
+  latency_histogram *histogram = &histograms[id];
+  if (nsec > PJ_CB_LATENCY_MAX_NSEC) {
+    nsec = PJ_CB_LATENCY_MAX_NSEC;
+  }
+
+  atomic_fetch_add_explicit(&histogram->buckets[latency_bucket(nsec)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->sum, nsec, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+
+  // A new maximum is rare once a callback has run a few times, so this is almost always just the load
+  uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+  while (nsec > max &&
+         !atomic_compare_exchange_weak_explicit(&histogram->max, &max, nsec, memory_order_relaxed, memory_order_relaxed)) {
+  }
+}
+
+pj_uint64_t pj_cb_latency_percentile(pj_cb_latency_id id, double percentile)
+{
+  if (id >= PJ_CB_LATENCY_COUNT) {
+    return 0;
+  }
+
+  latency_histogram *histogram = &histograms[id];
+
+  // Count from the buckets themselves, so the walk below always reaches its target
+  pj_uint64_t total = 0;
+  for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+    total += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+  }
+
+  if (total == 0) {
+    return 0;
+  }
+
+  if (percentile < 0) {
+    percentile = 0;
+  } else if (percentile > 100) {
+    percentile = 100;
+  }
+
+  pj_uint64_t target = (pj_uint64_t) (percentile / 100.0 * total + 0.5);
+  if (target == 0) {
+    target = 1;
+  } else if (target > total) {
+    target = total;
+  }
+
+  pj_uint64_t seen = 0;
+  pj_uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+  for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+    if (seen >= target) {
+      pj_uint64_t highest = latency_bucket_highest(i);
+      return highest < max ? highest : max;
+    }
+  }
+
+  return max;
+}
+
+void pj_cb_latency_get_stat(pj_cb_latency_id id, pj_cb_latency_stat *stat)
+{
+  pj_bzero(stat, sizeof(*stat));
+  if (id >= PJ_CB_LATENCY_COUNT) {
+    return;
+  }
+
+  latency_histogram *histogram = &histograms[id];
+  stat->name = latency_names[id];
+  stat->count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+  stat->max_nsec = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+  if (stat->count > 0) {
+    stat->mean_nsec = atomic_load_explicit(&histogram->sum, memory_order_relaxed) / stat->count;
+  }
+
+  stat->p50_nsec = pj_cb_latency_percentile(id, 50);
+  stat->p90_nsec = pj_cb_latency_percentile(id, 90);
+  stat->p99_nsec = pj_cb_latency_percentile(id, 99);
+  stat->p999_nsec = pj_cb_latency_percentile(id, 99.9);
+}
+
+void pj_cb_latency_reset(void)
+{
+  for (unsigned id = 0; id < PJ_CB_LATENCY_COUNT; id++) {
+    latency_histogram *histogram = &histograms[id];
+    for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+      atomic_store_explicit(&histogram->buckets[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&histogram->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram->max, 0, memory_order_relaxed);
+  }
+}
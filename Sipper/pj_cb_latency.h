@@ -0,0 +1,86 @@
+//
+//  pj_cb_latency.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_cb_latency_h
+#define pj_cb_latency_h
+
+#import <pjsua.h>
+
+/* Linear sub-buckets in each power of two. Recorded times are reported to within 1 / 2^bits of their value. */
+#define PJ_CB_LATENCY_SUB_BUCKET_BITS  5
+
+/* Longest time that's told apart from longer ones, in nanoseconds (about 18 minutes) */
+#define PJ_CB_LATENCY_MAX_NSEC         ((pj_uint64_t) 1 << 40)
+
+/*
+ * The PJSUA callbacks that are timed
+ */
+typedef enum pj_cb_latency_id {
+  PJ_CB_LATENCY_REG_STATE,
+  PJ_CB_LATENCY_INCOMING_CALL,
+  PJ_CB_LATENCY_CALL_STATE,
+  PJ_CB_LATENCY_CALL_MEDIA_STATE,
+  PJ_CB_LATENCY_CALL_TSX_STATE,
+  PJ_CB_LATENCY_TRANSPORT_STATE,
+  PJ_CB_LATENCY_COUNT
+} pj_cb_latency_id;
+
+/**
+ * A snapshot of the times recorded for one callback */
+typedef struct pj_cb_latency_stat {
+  /** Name of the PJSUA callback, like on_call_state */
+  const char *name;
+  /** Number of times the callback ran */
+  pj_uint64_t count;
+  /** Average time spent in the callback, in nanoseconds */
+  pj_uint64_t mean_nsec;
+  /** Longest time spent in the callback, in nanoseconds */
+  pj_uint64_t max_nsec;
+  /** Median, 90th, 99th and 99.9th percentile times, in nanoseconds */
+  pj_uint64_t p50_nsec;
+  pj_uint64_t p90_nsec;
+  pj_uint64_t p99_nsec;
+  pj_uint64_t p999_nsec;
+} pj_cb_latency_stat;
+
+/*
+ * Read the monotonic clock that callbacks are timed with, in nanoseconds
+ */
+pj_uint64_t pj_cb_latency_now(void);
+
+/*
+ * Record the time spent in one run of a callback. Each callback has a log-linear histogram, like an HDR histogram,
+ * whose counters are bumped without taking a lock, so this is safe to call from any number of threads at once and
+ * cheap enough to leave on.
+ * @param id    The callback.
+ * @param nsec  Time spent in it, in nanoseconds. Longer than PJ_CB_LATENCY_MAX_NSEC is counted as that.
+ */
+void pj_cb_latency_record(pj_cb_latency_id id, pj_uint64_t nsec);
+
+/*
+ * Get the time under which a percentage of the runs of a callback finished. It's the highest time in the bucket the
+ * percentile falls in, so it overstates by less than 1 / 2^PJ_CB_LATENCY_SUB_BUCKET_BITS, and never reports more than
+ * the longest run.
+ * @param id          The callback.
+ * @param percentile  From 0 to 100.
+ * @return            The time, in nanoseconds, or 0 if the callback hasn't run.
+ */
+pj_uint64_t pj_cb_latency_percentile(pj_cb_latency_id id, double percentile);
+
+/*
+ * Get a snapshot of the times recorded for a callback. Runs recorded while the snapshot is taken may be counted in
+ * some of its fields and not others.
+ */
+void pj_cb_latency_get_stat(pj_cb_latency_id id, pj_cb_latency_stat *stat);
+
+/*
+ * Forget every recorded time
+ */
+void pj_cb_latency_reset(void);
+
+#endif /* pj_cb_latency_h */
@@ -0,0 +1,512 @@
+//
+//  pj_cb_record.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_cb_record.h"
+#include "pj_cb_latency.h"
+
+#include <pjsua.h>
+#include <stdlib.h>
+
+#define THIS_FILE "pj_cb_record.c"
+
+/* A recording starts with this, then its version */
+#define RECORD_MAGIC            "SBCB"
+#define RECORD_VERSION          1
+#define RECORD_HEADER_LEN       8
+
+/* Callbacks are buffered, so most don't touch the disk */
+#define RECORD_BUFFER_LEN       (64 * 1024)
+
+/* Longest a record can be besides its strings: every number as a 10 byte varint */
+#define RECORD_MAX_FIXED        ((20 + 3 * PJMEDIA_MAX_SDP_MEDIA) * 10)
+
+/* Longest codec name that's kept */
+#define RECORD_CODEC_LEN        64
+
+struct pj_cb_record_reader {
+  pj_uint8_t *data;
+  pj_size_t size;
+  pj_size_t offset;
+  pj_uint64_t ts;
+  pj_cb_record_event calls[PJSUA_MAX_CALLS];
+};
+
+static struct cb_recorder {
+  pj_bool_t active;
+  pj_pool_t *pool;
+  pj_mutex_t *mutex;
+  pj_oshandle_t fd;
+  pj_uint8_t *buffer;
+  pj_size_t length;
+  pj_status_t status;
+  unsigned count;
+  pj_uint64_t last_ts;
+} recorder;
+
+/* The recording this thread's call info reads are served from */
+static _Thread_local pj_cb_record_reader *replay;
+
+static pj_uint8_t *put_varint(pj_uint8_t *p, pj_uint64_t value)
+{
+  while (value >= 0x80) {
+    *p++ = (pj_uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+
+  *p++ = (pj_uint8_t) value;
+  return p;
+}
+
+static pj_uint8_t *put_str(pj_uint8_t *p, const pj_str_t *str)
+{
+  p = put_varint(p, (pj_uint64_t) str->slen);
+  pj_memcpy(p, str->ptr, str->slen);
+  return p + str->slen;
+}
+
+/* Callers hold the lock. A failed write is kept and reported when recording stops. */
+static void flush(void)
+{
+  if (recorder.length == 0) {
+    return;
+  }
+
+  pj_ssize_t size = (pj_ssize_t) recorder.length;
+  pj_status_t status = pj_file_write(recorder.fd, recorder.buffer, &size);
+  if (status != PJ_SUCCESS && recorder.status == PJ_SUCCESS) {
+    recorder.status = status;
+  }
+
+  recorder.length = 0;
+}
+
+static void read_codec(pjsua_call_id call_id, const pjsua_call_info *info, char *buffer, pj_str_t *codec)
+{
+  codec->ptr = buffer;
+  codec->slen = 0;
+
+  for (unsigned i = 0; i < info->media_cnt; i++) {
+    pjmedia_stream_info stream_info;
+    if (info->media[i].type == PJMEDIA_TYPE_AUDIO && info->media[i].status == PJSUA_CALL_MEDIA_ACTIVE &&
+        pjsua_call_get_stream_info(call_id, i, &stream_info) == PJ_SUCCESS) {
+      int len = pj_ansi_snprintf(buffer, RECORD_CODEC_LEN, "%.*s/%u", (int) stream_info.fmt.encoding_name.slen,
+                                 stream_info.fmt.encoding_name.ptr, stream_info.fmt.clock_rate);
+      codec->slen = PJ_MIN(len, RECORD_CODEC_LEN - 1);
+      return;
+    }
+  }
+}
+
+static void record(pj_cb_record_type type, pjsua_acc_id acc_id, pjsua_call_id call_id, pjsip_transaction *tsx,
+                   pjsip_event *event, pjsip_rx_data *rdata)
+{
+  pjsua_call_info info;
+  char codec_buffer[RECORD_CODEC_LEN];
+  pj_str_t codec = {codec_buffer, 0};
+  pj_str_t empty = {NULL, 0};
+  pj_str_t message = empty;
+
+  // Replayed callbacks aren't recorded again
+  if (!recorder.active || replay != NULL) {
+    return;
+  }
+
+  // Read before taking the lock, since PJSUA takes its own
+  pj_bool_t has_info = pjsua_call_get_info(call_id, &info) == PJ_SUCCESS;
+  if (has_info) {
+    acc_id = info.acc_id;
+    read_codec(call_id, &info, codec_buffer, &codec);
+  }
+
+  if (rdata != NULL) {
+    message.ptr = rdata->msg_info.msg_buf;
+    message.slen = rdata->msg_info.len;
+  }
+
+  pj_size_t length = RECORD_MAX_FIXED + codec.slen + (tsx != NULL ? tsx->method.name.slen : 0) + message.slen +
+                     (has_info ? info.remote_info.slen + info.call_id.slen : 0);
+  if (length > RECORD_BUFFER_LEN) {
+    length -= message.slen;
+    message = empty;
+  }
+
+  pj_uint64_t now = pj_cb_latency_now();
+
+  pj_mutex_lock(recorder.mutex);
+
+  if (!recorder.active) {
+    pj_mutex_unlock(recorder.mutex);
+    return;
+  }
+
+  if (recorder.length + length > RECORD_BUFFER_LEN) {
+    flush();
+  }
+
+  // Callbacks on other threads may have got the lock first, with a later time
+  pj_uint64_t delta = now > recorder.last_ts ? now - recorder.last_ts : 0;
+  recorder.last_ts += delta;
+
+  pj_uint8_t *p = recorder.buffer + recorder.length;
+  *p++ = (pj_uint8_t) type;
+  p = put_varint(p, delta);
+  p = put_varint(p, (pj_uint64_t) (acc_id + 1));
+  p = put_varint(p, (pj_uint64_t) (call_id + 1));
+  *p++ = (pj_uint8_t) has_info;
+
+  if (has_info) {
+    p = put_varint(p, info.state);
+    p = put_varint(p, info.last_status);
+    p = put_str(p, &info.remote_info);
+    p = put_str(p, &info.call_id);
+    p = put_str(p, &codec);
+    p = put_varint(p, info.media_cnt);
+    for (unsigned i = 0; i < info.media_cnt; i++) {
+      p = put_varint(p, info.media[i].type);
+      p = put_varint(p, info.media[i].status);
+      p = put_varint(p, info.media[i].dir);
+    }
+  }
+
+  if (type == PJ_CB_RECORD_CALL_TSX_STATE) {
+    p = put_varint(p, tsx->role);
+    p = put_str(p, &tsx->method.name);
+    p = put_varint(p, tsx->state);
+    p = put_varint(p, (pj_uint64_t) tsx->transport_err);
+    p = put_varint(p, event->type == PJSIP_EVENT_TSX_STATE ? event->body.tsx_state.type : PJSIP_EVENT_UNKNOWN);
+  }
+
+  p = put_str(p, &message);
+
+  recorder.length = (pj_size_t) (p - recorder.buffer);
+  recorder.count++;
+
+  pj_mutex_unlock(recorder.mutex);
+}
+
+pj_status_t pj_cb_record_start(pj_pool_factory *pf, const char *path)
+{
+  pj_status_t status;
+
+  if (recorder.active) {
+    return PJ_EINVALIDOP;
+  }
+
+  pj_bzero(&recorder, sizeof(recorder));
+
+  recorder.pool = pj_pool_create(pf, "cbrecord", RECORD_BUFFER_LEN + 1024, 512, NULL);
+  if (recorder.pool == NULL) {
+    return PJ_ENOMEM;
+  }
+
+  recorder.buffer = (pj_uint8_t *) pj_pool_alloc(recorder.pool, RECORD_BUFFER_LEN);
+  status = pj_mutex_create_simple(recorder.pool, "cbrecord", &recorder.mutex);
+  if (status != PJ_SUCCESS) {
+    pj_pool_release(recorder.pool);
+    return status;
+  }
+
+  status = pj_file_open(NULL, path, PJ_O_WRONLY, &recorder.fd);
+  if (status != PJ_SUCCESS) {
+    pj_mutex_destroy(recorder.mutex);
+    pj_pool_release(recorder.pool);
+    return status;
+  }
+
+  pj_memcpy(recorder.buffer, RECORD_MAGIC, 4);
+  recorder.buffer[4] = RECORD_VERSION;
+  recorder.buffer[5] = recorder.buffer[6] = recorder.buffer[7] = 0;
+  recorder.length = RECORD_HEADER_LEN;
+  recorder.last_ts = pj_cb_latency_now();
+  recorder.active = PJ_TRUE;
+
+  return PJ_SUCCESS;
+}
+
+pj_status_t pj_cb_record_stop(unsigned *count)
+{
+  if (count != NULL) {
+    *count = 0;
+  }
+
+  if (!recorder.active) {
+    return PJ_EINVALIDOP;
+  }
+
+  pj_mutex_lock(recorder.mutex);
+  recorder.active = PJ_FALSE;
+  flush();
+  pj_file_close(recorder.fd);
+  pj_mutex_unlock(recorder.mutex);
+
+  pj_status_t status = recorder.status;
+  if (status != PJ_SUCCESS) {
+    PJ_PERROR(3, (THIS_FILE, status, "Failed to write callback recording"));
+  } else if (count != NULL) {
+    *count = recorder.count;
+  }
+
+  pj_mutex_destroy(recorder.mutex);
+  pj_pool_release(recorder.pool);
+
+  return status;
+}
+
+pj_bool_t pj_cb_record_enabled(void)
+{
+  return recorder.active;
+}
+
+void pj_cb_record_incoming_call(pjsua_acc_id acc_id, pjsua_call_id call_id, pjsip_rx_data *rdata)
+{
+  record(PJ_CB_RECORD_INCOMING_CALL, acc_id, call_id, NULL, NULL, rdata);
+}
+
+void pj_cb_record_call_state(pjsua_call_id call_id)
+{
+  record(PJ_CB_RECORD_CALL_STATE, PJSUA_INVALID_ID, call_id, NULL, NULL, NULL);
+}
+
+void pj_cb_record_call_media_state(pjsua_call_id call_id)
+{
+  record(PJ_CB_RECORD_CALL_MEDIA_STATE, PJSUA_INVALID_ID, call_id, NULL, NULL, NULL);
+}
+
+void pj_cb_record_call_tsx_state(pjsua_call_id call_id, pjsip_transaction *tsx, pjsip_event *event)
+{
+  pjsip_rx_data *rdata = NULL;
+  if (event->type == PJSIP_EVENT_TSX_STATE && event->body.tsx_state.type == PJSIP_EVENT_RX_MSG) {
+    rdata = event->body.tsx_state.src.rdata;
+  }
+
+  record(PJ_CB_RECORD_CALL_TSX_STATE, PJSUA_INVALID_ID, call_id, tsx, event, rdata);
+}
+
+pj_status_t pj_cb_record_open(pj_pool_t *pool, const char *path, pj_cb_record_reader **reader)
+{
+  pj_status_t status;
+  pj_oshandle_t fd;
+
+  pj_off_t size = pj_file_size(path);
+  if (size < 0) {
+    return PJ_ENOTFOUND;
+  }
+
+  if (size < RECORD_HEADER_LEN) {
+    return PJ_EINVAL;
+  }
+
+  pj_cb_record_reader *opened = PJ_POOL_ZALLOC_T(pool, pj_cb_record_reader);
+  opened->data = (pj_uint8_t *) malloc((size_t) size);
+  if (opened->data == NULL) {
+    return PJ_ENOMEM;
+  }
+
+  status = pj_file_open(NULL, path, PJ_O_RDONLY, &fd);
+  if (status != PJ_SUCCESS) {
+    free(opened->data);
+    return status;
+  }
+
+  while (status == PJ_SUCCESS && opened->size < (pj_size_t) size) {
+    pj_ssize_t read = (pj_ssize_t) ((pj_size_t) size - opened->size);
+    status = pj_file_read(fd, opened->data + opened->size, &read);
+    if (status == PJ_SUCCESS && read <= 0) {
+      status = PJ_EEOF;
+    }
+    opened->size += status == PJ_SUCCESS ? (pj_size_t) read : 0;
+  }
+  pj_file_close(fd);
+
+  if (status == PJ_SUCCESS && (pj_memcmp(opened->data, RECORD_MAGIC, 4) != 0 || opened->data[4] != RECORD_VERSION)) {
+    status = PJ_EINVAL;
+  }
+
+  if (status != PJ_SUCCESS) {
+    free(opened->data);
+    return status;
+  }
+
+  opened->offset = RECORD_HEADER_LEN;
+  *reader = opened;
+
+  return PJ_SUCCESS;
+}
+
+static pj_bool_t get_varint(pj_cb_record_reader *reader, pj_uint64_t *value)
+{
+  *value = 0;
+  for (unsigned shift = 0; shift < 64 && reader->offset < reader->size; shift += 7) {
+    pj_uint8_t byte = reader->data[reader->offset++];
+    *value |= (pj_uint64_t) (byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return PJ_TRUE;
+    }
+  }
+
+  return PJ_FALSE;
+}
+
+static pj_bool_t get_str(pj_cb_record_reader *reader, pj_str_t *str)
+{
+  pj_uint64_t length;
+  if (!get_varint(reader, &length) || length > reader->size - reader->offset) {
+    return PJ_FALSE;
+  }
+
+  str->ptr = (char *) reader->data + reader->offset;
+  str->slen = (pj_ssize_t) length;
+  reader->offset += (pj_size_t) length;
+  return PJ_TRUE;
+}
+
+/* A call or account id, which are recorded one higher so that PJSUA_INVALID_ID fits */
+static pj_bool_t get_id(pj_cb_record_reader *reader, int max, int *id)
+{
+  pj_uint64_t value;
+  if (!get_varint(reader, &value) || value > (pj_uint64_t) max) {
+    return PJ_FALSE;
+  }
+
+  *id = (int) value - 1;
+  return PJ_TRUE;
+}
+
+pj_status_t pj_cb_record_read(pj_cb_record_reader *reader, pj_cb_record_event *event)
+{
+  pj_uint64_t delta, state, last_status, media_cnt, role, tsx_state, transport_err, event_type;
+
+  if (reader->offset >= reader->size) {
+    return PJ_EEOF;
+  }
+
+  pj_bzero(event, sizeof(*event));
+  event->type = (pj_cb_record_type) reader->data[reader->offset++];
+  if (event->type < PJ_CB_RECORD_INCOMING_CALL || event->type > PJ_CB_RECORD_CALL_TSX_STATE ||
+      !get_varint(reader, &delta) ||
+      !get_id(reader, PJSUA_MAX_ACC, &event->acc_id) ||
+      !get_id(reader, PJSUA_MAX_CALLS, &event->call_id) ||
+      reader->offset >= reader->size) {
+    return PJ_EINVAL;
+  }
+
+  reader->ts += delta;
+  event->ts = reader->ts;
+  event->has_info = reader->data[reader->offset++] != 0;
+
+  if (event->has_info) {
+    if (!get_varint(reader, &state) || !get_varint(reader, &last_status) ||
+        !get_str(reader, &event->remote_info) || !get_str(reader, &event->sip_call_id) ||
+        !get_str(reader, &event->codec) || !get_varint(reader, &media_cnt) || media_cnt > PJMEDIA_MAX_SDP_MEDIA) {
+      return PJ_EINVAL;
+    }
+
+    event->state = (pjsip_inv_state) state;
+    event->last_status = (pjsip_status_code) last_status;
+    event->media_cnt = (unsigned) media_cnt;
+
+    for (unsigned i = 0; i < event->media_cnt; i++) {
+      pj_uint64_t type, status, dir;
+      if (!get_varint(reader, &type) || !get_varint(reader, &status) || !get_varint(reader, &dir)) {
+        return PJ_EINVAL;
+      }
+
+      event->media[i].type = (pjmedia_type) type;
+      event->media[i].status = (pjsua_call_media_status) status;
+      event->media[i].dir = (pjmedia_dir) dir;
+    }
+  }
+
+  if (event->type == PJ_CB_RECORD_CALL_TSX_STATE) {
+    if (!get_varint(reader, &role) || !get_str(reader, &event->method) || !get_varint(reader, &tsx_state) ||
+        !get_varint(reader, &transport_err) || !get_varint(reader, &event_type)) {
+      return PJ_EINVAL;
+    }
+
+    event->role = (pjsip_role_e) role;
+    event->tsx_state = (pjsip_tsx_state_e) tsx_state;
+    event->transport_err = (pj_status_t) transport_err;
+    event->event_type = (pjsip_event_id_e) event_type;
+  }
+
+  if (!get_str(reader, &event->message)) {
+    return PJ_EINVAL;
+  }
+
+  // What the call's info reads return while this is replayed
+  if (event->call_id >= 0) {
+    reader->calls[event->call_id] = *event;
+  }
+
+  return PJ_SUCCESS;
+}
+
+void pj_cb_record_close(pj_cb_record_reader *reader)
+{
+  if (replay == reader) {
+    replay = NULL;
+  }
+
+  free(reader->data);
+  reader->data = NULL;
+  reader->size = reader->offset = 0;
+}
+
+void pj_cb_record_set_replay(pj_cb_record_reader *reader)
+{
+  replay = reader;
+}
+
+pj_status_t pj_cb_record_get_call_info(pjsua_call_id call_id, pjsua_call_info *info)
+{
+  if (replay == NULL) {
+    return pjsua_call_get_info(call_id, info);
+  }
+
+  if (call_id < 0 || call_id >= PJSUA_MAX_CALLS) {
+    return PJ_EINVAL;
+  }
+
+  // Like PJSUA, a call whose session has gone has no info
+  const pj_cb_record_event *event = &replay->calls[call_id];
+  if (!event->has_info) {
+    return PJSIP_ESESSIONTERMINATED;
+  }
+
+  pj_bzero(info, sizeof(*info));
+  info->id = call_id;
+  info->acc_id = event->acc_id;
+  info->remote_info = event->remote_info;
+  info->call_id = event->sip_call_id;
+  info->state = event->state;
+  info->state_text = pj_str((char *) pjsip_inv_state_name(event->state));
+  info->last_status = event->last_status;
+  info->last_status_text = *pjsip_get_status_text(event->last_status);
+  info->conf_slot = PJSUA_INVALID_ID;
+  info->media_cnt = event->media_cnt;
+
+  for (unsigned i = 0; i < event->media_cnt; i++) {
+    info->media[i].index = i;
+    info->media[i].type = event->media[i].type;
+    info->media[i].status = event->media[i].status;
+    info->media[i].dir = event->media[i].dir;
+    info->media[i].stream.aud.conf_slot = PJSUA_INVALID_ID;
+  }
+
+  return PJ_SUCCESS;
+}
+
+pj_bool_t pj_cb_record_get_replay_codec(pjsua_call_id call_id, pj_str_t *codec)
+{
+  if (replay == NULL || call_id < 0 || call_id >= PJSUA_MAX_CALLS || replay->calls[call_id].codec.slen == 0) {
+    return PJ_FALSE;
+  }
+
+  *codec = replay->calls[call_id].codec;
+  return PJ_TRUE;
+}
@@ -0,0 +1,139 @@
+//
+//  pj_cb_record.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_cb_record_h
+#define pj_cb_record_h
+
+#import <pjsua.h>
+
+/*
+ * The PJSUA callbacks that are recorded
+ */
+typedef enum pj_cb_record_type {
+  PJ_CB_RECORD_INCOMING_CALL = 1,
+  PJ_CB_RECORD_CALL_STATE,
+  PJ_CB_RECORD_CALL_MEDIA_STATE,
+  PJ_CB_RECORD_CALL_TSX_STATE
+} pj_cb_record_type;
+
+/**
+ * One media line of a call, as the callback saw it */
+typedef struct pj_cb_record_media {
+  pjmedia_type type;
+  pjsua_call_media_status status;
+  pjmedia_dir dir;
+} pj_cb_record_media;
+
+/**
+ * One recorded callback. Strings point into the reader, and stay valid until it's closed. */
+typedef struct pj_cb_record_event {
+  /** Which callback ran */
+  pj_cb_record_type type;
+  /** When it ran, in nanoseconds since recording started */
+  pj_uint64_t ts;
+  /** The call's account */
+  pjsua_acc_id acc_id;
+  /** The call */
+  pjsua_call_id call_id;
+
+  /** Whether the call's info could be read. A call whose session has terminated has none. */
+  pj_bool_t has_info;
+  /** The call's info: its invite session state, last status, remote party and Call-ID */
+  pjsip_inv_state state;
+  pjsip_status_code last_status;
+  pj_str_t remote_info;
+  pj_str_t sip_call_id;
+  /** The codec of the call's active audio, as name/clock rate, or empty if it has none */
+  pj_str_t codec;
+  /** The call's media lines */
+  unsigned media_cnt;
+  pj_cb_record_media media[PJMEDIA_MAX_SDP_MEDIA];
+
+  /** For PJ_CB_RECORD_CALL_TSX_STATE, the transaction and the event that changed its state */
+  pjsip_role_e role;
+  pj_str_t method;
+  pjsip_tsx_state_e tsx_state;
+  pj_status_t transport_err;
+  pjsip_event_id_e event_type;
+
+  /** The message that was received, for incoming calls and transactions that received one, or empty */
+  pj_str_t message;
+} pj_cb_record_event;
+
+/* Reads a recording back */
+typedef struct pj_cb_record_reader pj_cb_record_reader;
+
+/*
+ * Start recording the call callbacks to a file. Each callback is written with the call info it would read, and any
+ * message it received, in a compact binary form: a few bytes plus the strings, so recording can stay on while calls
+ * are made.
+ * @param pf    Pool factory for the write buffer and its lock.
+ * @param path  The file to write, which is replaced if it exists.
+ * @return      PJ_EINVALIDOP if the callbacks are already being recorded.
+ */
+pj_status_t pj_cb_record_start(pj_pool_factory *pf, const char *path);
+
+/*
+ * Stop recording, and write out whatever is buffered
+ * @param count  Optional, set to the number of callbacks recorded.
+ */
+pj_status_t pj_cb_record_stop(unsigned *count);
+
+/*
+ * Whether the callbacks are being recorded
+ */
+pj_bool_t pj_cb_record_enabled(void);
+
+/*
+ * Record a callback. These do nothing unless recording, and nothing for the callbacks a thread is replaying.
+ */
+void pj_cb_record_incoming_call(pjsua_acc_id acc_id, pjsua_call_id call_id, pjsip_rx_data *rdata);
+void pj_cb_record_call_state(pjsua_call_id call_id);
+void pj_cb_record_call_media_state(pjsua_call_id call_id);
+void pj_cb_record_call_tsx_state(pjsua_call_id call_id, pjsip_transaction *tsx, pjsip_event *event);
+
+/*
+ * Open a recording. The whole file is read up front, so replaying it doesn't wait on the disk.
+ * @param pool    Pool the reader is allocated from.
+ * @param path    The recording.
+ * @param reader  Set to the reader.
+ * @return        PJ_EINVAL if the file isn't a recording.
+ */
+pj_status_t pj_cb_record_open(pj_pool_t *pool, const char *path, pj_cb_record_reader **reader);
+
+/*
+ * Read the next callback. The reader keeps the last info read for each call, which is what the call info reads of a
+ * replaying thread return.
+ * @return  PJ_EEOF after the last callback, or PJ_EINVAL if the file is truncated or corrupt.
+ */
+pj_status_t pj_cb_record_read(pj_cb_record_reader *reader, pj_cb_record_event *event);
+
+/*
+ * Close a recording, and release the file's contents
+ */
+void pj_cb_record_close(pj_cb_record_reader *reader);
+
+/*
+ * Serve the call info reads of this thread from a recording, until it's cleared by setting NULL. Calls that are
+ * replayed exist only in the recording, so their info can't come from PJSUA.
+ */
+void pj_cb_record_set_replay(pj_cb_record_reader *reader);
+
+/*
+ * Get a call's info: from the recording if this thread is replaying one, and from PJSUA otherwise. Replayed media
+ * has no conference port, so its conf_slot is PJSUA_INVALID_ID.
+ */
+pj_status_t pj_cb_record_get_call_info(pjsua_call_id call_id, pjsua_call_info *info);
+
+/*
+ * Get the codec of a replayed call's active audio, which has no stream to read it from
+ * @return  PJ_FALSE if this thread isn't replaying, or the call had no active audio.
+ */
+pj_bool_t pj_cb_record_get_replay_codec(pjsua_call_id call_id, pj_str_t *codec);
+
+#endif /* pj_cb_record_h */
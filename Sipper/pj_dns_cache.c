@@ -0,0 +1,914 @@
+//
+//  pj_dns_cache.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/16/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_dns_cache.h"
+
+#include <pjsua.h>
+#include <pjlib-util.h>
+
+#define THIS_FILE "pj_dns_cache.c"
+
+/* Number of records kept. When full, the least recently used record is evicted. */
+#define DNS_CACHE_SIZE          64
+
+/* Bounds applied to record TTLs, in seconds */
+#define DNS_CACHE_MIN_TTL       1
+#define DNS_CACHE_MAX_TTL       86400
+
+/* How long pj_dns_cache_getaddrinfo() results are kept, in seconds, since getaddrinfo doesn't say. They're never
+ * prefetched or served stale, so a lookup after this long blocks again.
+ */
+#define DNS_CACHE_ADDRINFO_TTL  300
+
+#define DNS_CACHE_KEY_LEN       (PJ_MAX_HOSTNAME + 32)
+
+struct dns_query;
+struct dns_lookup;
+
+typedef struct dns_waiter {
+  PJ_DECL_LIST_MEMBER(struct dns_waiter);
+  void *token;
+  pjsip_resolver_callback *cb;
+} dns_waiter;
+
+typedef struct dns_entry {
+  pj_bool_t in_use;
+  pj_bool_t valid;
+  pj_bool_t addrinfo;
+  pj_bool_t used;                    // looked up since it was last resolved, so worth prefetching
+  char key[DNS_CACHE_KEY_LEN];
+  char host[PJ_MAX_HOSTNAME];
+  pjsip_host_info target;
+  pjsip_server_addresses addresses;
+  pj_time_val expires;
+  pj_time_val last_used;
+  struct dns_query *query;           // resolution in flight for this record, if any
+} dns_entry;
+
+/* A single SRV or A/AAAA lookup made on behalf of a query */
+typedef struct dns_lookup {
+  PJ_DECL_LIST_MEMBER(struct dns_lookup);
+  struct dns_query *query;
+  pj_dns_async_query *async;         // the resolver's query, until it has answered
+  pj_bool_t answered;
+  pj_uint16_t port;
+  unsigned priority;
+  unsigned weight;
+} dns_lookup;
+
+typedef struct dns_query {
+  PJ_DECL_LIST_MEMBER(struct dns_query);
+  pj_pool_t *pool;
+  dns_entry *entry;                  // NULL once the record was evicted or cleared
+  pjsip_host_info target;
+  pjsip_server_addresses result;
+  pj_uint32_t ttl;
+  unsigned pending;
+  pj_status_t last_error;
+  dns_waiter waiters;
+  dns_lookup lookups;
+} dns_query;
+
+static struct dns_cache {
+  pj_bool_t initialized;
+  pj_pool_t *pool;
+  pj_pool_factory *pf;
+  pj_mutex_t *mutex;
+  pj_dns_resolver *resolver;
+  pj_timer_heap_t *timer_heap;
+  pj_timer_entry prefetch_timer;
+  unsigned prefetch_window;
+  unsigned max_stale;
+  dns_entry entries[DNS_CACHE_SIZE];
+  dns_query queries;                 // every resolution in flight, so shutdown can cancel them
+  pj_dns_cache_stat stat;
+} cache;
+
+static void begin_query(dns_query *query);
+
+static int get_ip_addr_ver(const pj_str_t *host)
+{
+  pj_in_addr dummy;
+  pj_in6_addr dummy6;
+
+  if (pj_inet_pton(pj_AF_INET(), host, &dummy) == PJ_SUCCESS) {
+    return 4;
+  }
+
+  if (pj_inet_pton(pj_AF_INET6(), host, &dummy6) == PJ_SUCCESS) {
+    return 6;
+  }
+
+  return 0;
+}
+
+static pjsip_transport_type_e normalize_type(const pjsip_host_info *target)
+{
+  if (target->type != PJSIP_TRANSPORT_UNSPECIFIED) {
+    return target->type;
+  }
+
+  // Without NAPTR, pjsip assumes UDP (or TLS for sips) for targets that don't name a transport
+  return (target->flag & PJSIP_TRANSPORT_SECURE) ? PJSIP_TRANSPORT_TLS : PJSIP_TRANSPORT_UDP;
+}
+
+static void make_key(char *key, const char *kind, int type, const pj_str_t *host, int port)
+{
+  int length = pj_ansi_snprintf(key, DNS_CACHE_KEY_LEN, "%s|%d|%.*s|%d", kind, type, (int) host->slen, host->ptr, port);
+
+  // Host names are case insensitive
+  for (int i = 0; i < length && i < DNS_CACHE_KEY_LEN; i++) {
+    key[i] = (char) pj_tolower(key[i]);
+  }
+}
+
+static pj_bool_t prefetch_due(const dns_entry *entry, const pj_time_val *now)
+{
+  pj_time_val due = entry->expires;
+  due.sec -= (long) cache.prefetch_window;
+
+  return entry->valid && entry->used && !entry->addrinfo && entry->query == NULL && PJ_TIME_VAL_GTE(*now, due);
+}
+
+static pj_status_t resolve_ip_address(const pjsip_host_info *target, int ip_ver, pjsip_server_addresses *addresses)
+{
+  pjsip_transport_type_e type = target->type;
+  pj_uint16_t port = target->addr.port;
+
+  if (ip_ver == 6) {
+    type = (pjsip_transport_type_e) ((int) type | PJSIP_TRANSPORT_IPV6);
+  }
+
+  if (port == 0) {
+    port = (pj_uint16_t) pjsip_transport_get_default_port_for_type(type);
+  }
+
+  addresses->count = 1;
+  addresses->entry[0].type = type;
+  addresses->entry[0].priority = 0;
+  addresses->entry[0].weight = 0;
+
+  pj_status_t status = pj_sockaddr_init(ip_ver == 6 ? pj_AF_INET6() : pj_AF_INET(), &addresses->entry[0].addr, &target->addr.host, port);
+  addresses->entry[0].addr_len = pj_sockaddr_get_len(&addresses->entry[0].addr);
+
+  return status;
+}
+
+static dns_entry *find_entry_locked(const char *key)
+{
+  for (unsigned i = 0; i < DNS_CACHE_SIZE; i++) {
+    if (cache.entries[i].in_use && pj_ansi_strcmp(cache.entries[i].key, key) == 0) {
+      return &cache.entries[i];
+    }
+  }
+
+  return NULL;
+}
+
+static dns_entry *alloc_entry_locked(const char *key)
+{
+  dns_entry *entry = NULL;
+
+  // Take a free slot, or else the least recently used record that isn't being resolved
+  for (unsigned i = 0; i < DNS_CACHE_SIZE; i++) {
+    dns_entry *candidate = &cache.entries[i];
+    if (!candidate->in_use) {
+      entry = candidate;
+      break;
+    }
+
+    if (candidate->query == NULL && (entry == NULL || PJ_TIME_VAL_LT(candidate->last_used, entry->last_used))) {
+      entry = candidate;
+    }
+  }
+
+  if (entry == NULL) {
+    return NULL;
+  }
+
+  pj_bzero(entry, sizeof(*entry));
+  entry->in_use = PJ_TRUE;
+  pj_ansi_strncpy(entry->key, key, DNS_CACHE_KEY_LEN - 1);
+
+  return entry;
+}
+
+static void set_entry_target_locked(dns_entry *entry, const pjsip_host_info *target)
+{
+  pj_size_t length = PJ_MIN((pj_size_t) target->addr.host.slen, sizeof(entry->host));
+  pj_memcpy(entry->host, target->addr.host.ptr, length);
+
+  entry->target = *target;
+  entry->target.addr.host.ptr = entry->host;
+  entry->target.addr.host.slen = (pj_ssize_t) length;
+}
+
+static void schedule_prefetch_locked(void)
+{
+  pj_time_val now, earliest, delay;
+  pj_bool_t found = PJ_FALSE;
+
+  if (cache.timer_heap == NULL || cache.resolver == NULL) {
+    return;
+  }
+
+  pj_timer_heap_cancel(cache.timer_heap, &cache.prefetch_timer);
+
+  // A single timer covers every record, set for whichever is due to be prefetched first
+  for (unsigned i = 0; i < DNS_CACHE_SIZE; i++) {
+    dns_entry *entry = &cache.entries[i];
+    if (!entry->in_use || !entry->valid || !entry->used || entry->addrinfo || entry->query != NULL) {
+      continue;
+    }
+
+    pj_time_val due = entry->expires;
+    due.sec -= (long) cache.prefetch_window;
+    if (!found || PJ_TIME_VAL_LT(due, earliest)) {
+      earliest = due;
+      found = PJ_TRUE;
+    }
+  }
+
+  if (!found) {
+    return;
+  }
+
+  pj_gettickcount(&now);
+  delay = earliest;
+  PJ_TIME_VAL_SUB(delay, now);
+  if (delay.sec < 0) {
+    delay.sec = 0;
+    delay.msec = 0;
+  }
+
+  pj_timer_heap_schedule(cache.timer_heap, &cache.prefetch_timer, &delay);
+}
+
+static dns_query *create_query_locked(dns_entry *entry, const pjsip_host_info *target)
+{
+  pj_pool_t *pool = pj_pool_create(cache.pf, "dnsq%p", 512, 512, NULL);
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  dns_query *query = PJ_POOL_ZALLOC_T(pool, dns_query);
+  query->pool = pool;
+  query->entry = entry;
+  query->target.flag = target->flag;
+  query->target.type = target->type;
+  query->target.addr.port = target->addr.port;
+  pj_strdup(pool, &query->target.addr.host, &target->addr.host);
+  query->ttl = DNS_CACHE_MAX_TTL;
+  query->last_error = PJ_SUCCESS;
+  pj_list_init(&query->waiters);
+  pj_list_init(&query->lookups);
+  pj_list_push_back(&cache.queries, query);
+
+  if (entry != NULL) {
+    entry->query = query;
+  }
+
+  return query;
+}
+
+static void add_waiter_locked(dns_query *query, void *token, pjsip_resolver_callback *cb)
+{
+  dns_waiter *waiter = PJ_POOL_ZALLOC_T(query->pool, dns_waiter);
+  waiter->token = token;
+  waiter->cb = cb;
+  pj_list_push_back(&query->waiters, waiter);
+}
+
+static void add_record_locked(dns_query *query, const pj_dns_parsed_rr *rr, const dns_lookup *lookup)
+{
+  pjsip_transport_type_e type = query->target.type;
+
+  if (rr->type == PJ_DNS_TYPE_CNAME) {
+    query->ttl = PJ_MIN(query->ttl, rr->ttl);
+    return;
+  }
+
+  if ((rr->type != PJ_DNS_TYPE_A && rr->type != PJ_DNS_TYPE_AAAA) || query->result.count >= PJSIP_MAX_RESOLVED_ADDRESSES) {
+    return;
+  }
+
+  unsigned index = query->result.count++;
+  pj_sockaddr *addr = &query->result.entry[index].addr;
+
+  if (rr->type == PJ_DNS_TYPE_A) {
+    pj_sockaddr_init(pj_AF_INET(), addr, NULL, lookup->port);
+    addr->ipv4.sin_addr = rr->rdata.a.ip_addr;
+    type = (pjsip_transport_type_e) ((int) type & ~PJSIP_TRANSPORT_IPV6);
+  } else {
+    pj_sockaddr_init(pj_AF_INET6(), addr, NULL, lookup->port);
+    addr->ipv6.sin6_addr = rr->rdata.aaaa.ip_addr;
+    type = (pjsip_transport_type_e) ((int) type | PJSIP_TRANSPORT_IPV6);
+  }
+
+  query->result.entry[index].type = type;
+  query->result.entry[index].priority = lookup->priority;
+  query->result.entry[index].weight = lookup->weight;
+  query->result.entry[index].addr_len = pj_sockaddr_get_len(addr);
+  query->ttl = PJ_MIN(query->ttl, rr->ttl);
+}
+
+static void finish_query(dns_query *query)
+{
+  pj_status_t status = PJ_SUCCESS;
+
+  if (query->result.count == 0) {
+    status = query->last_error != PJ_SUCCESS ? query->last_error : PJLIB_UTIL_EDNSNOANSWERREC;
+  }
+
+  pj_mutex_lock(cache.mutex);
+  pj_list_erase(query);
+
+  dns_entry *entry = query->entry;
+  if (entry != NULL) {
+    entry->query = NULL;
+    entry->used = PJ_FALSE;
+
+    if (status == PJ_SUCCESS) {
+      entry->addresses = query->result;
+      entry->valid = PJ_TRUE;
+      pj_gettickcount(&entry->expires);
+      entry->expires.sec += (long) PJ_MAX(DNS_CACHE_MIN_TTL, PJ_MIN(query->ttl, DNS_CACHE_MAX_TTL));
+    } else if (!entry->valid) {
+      entry->in_use = PJ_FALSE;
+    }
+
+    // A failed refresh leaves a stale record in place until it's too old to serve
+  }
+
+  if (status != PJ_SUCCESS) {
+    cache.stat.failures++;
+  }
+
+  schedule_prefetch_locked();
+  pj_mutex_unlock(cache.mutex);
+
+  // Nothing else can reach the query anymore, so the waiters can be notified without the lock
+  for (dns_waiter *waiter = query->waiters.next; waiter != &query->waiters; waiter = waiter->next) {
+    (*waiter->cb)(status, waiter->token, status == PJ_SUCCESS ? &query->result : NULL);
+  }
+
+  pj_pool_release(query->pool);
+}
+
+static void query_done(dns_query *query, pj_status_t status)
+{
+  pj_bool_t finished;
+
+  pj_mutex_lock(cache.mutex);
+  if (status != PJ_SUCCESS) {
+    query->last_error = status;
+  }
+  finished = --query->pending == 0;
+  pj_mutex_unlock(cache.mutex);
+
+  if (finished) {
+    finish_query(query);
+  }
+}
+
+static dns_lookup *create_lookup(dns_query *query, pj_uint16_t port, unsigned priority, unsigned weight)
+{
+  pj_mutex_lock(cache.mutex);
+  dns_lookup *lookup = PJ_POOL_ZALLOC_T(query->pool, dns_lookup);
+  lookup->query = query;
+  lookup->port = port;
+  lookup->priority = priority;
+  lookup->weight = weight;
+  pj_list_push_back(&query->lookups, lookup);
+  pj_mutex_unlock(cache.mutex);
+
+  return lookup;
+}
+
+static void lookup_answered(dns_lookup *lookup)
+{
+  pj_mutex_lock(cache.mutex);
+  lookup->async = NULL;
+  lookup->answered = PJ_TRUE;
+  pj_mutex_unlock(cache.mutex);
+}
+
+static void send_query(dns_lookup *lookup, const pj_str_t *name, int type, pj_dns_callback *cb)
+{
+  dns_query *query = lookup->query;
+  pj_dns_async_query *async = NULL;
+
+  pj_mutex_lock(cache.mutex);
+  query->pending++;
+  cache.stat.queries++;
+  pj_mutex_unlock(cache.mutex);
+
+  // The resolver may call back before this returns, so the lock must not be held here
+  pj_status_t status = pj_dns_resolver_start_query(cache.resolver, name, type, 0, cb, lookup, &async);
+  if (status != PJ_SUCCESS) {
+    PJ_LOG(4, (THIS_FILE, "Could not start DNS query for %.*s: %d", (int) name->slen, name->ptr, status));
+    lookup_answered(lookup);
+    query_done(query, status);
+    return;
+  }
+
+  // Only a query that hasn't answered yet can be cancelled
+  pj_mutex_lock(cache.mutex);
+  if (!lookup->answered) {
+    lookup->async = async;
+  }
+  pj_mutex_unlock(cache.mutex);
+}
+
+static void on_address_response(void *user_data, pj_status_t status, pj_dns_parsed_packet *response)
+{
+  dns_lookup *lookup = (dns_lookup *) user_data;
+  lookup_answered(lookup);
+
+  if (status == PJ_SUCCESS) {
+    pj_mutex_lock(cache.mutex);
+    for (unsigned i = 0; i < response->hdr.anscount; i++) {
+      add_record_locked(lookup->query, &response->ans[i], lookup);
+    }
+    pj_mutex_unlock(cache.mutex);
+  }
+
+  query_done(lookup->query, status);
+}
+
+static void lookup_addresses(dns_query *query, const pj_str_t *name, pj_uint16_t port, unsigned priority, unsigned weight)
+{
+  int type = (query->target.type & PJSIP_TRANSPORT_IPV6) ? PJ_DNS_TYPE_AAAA : PJ_DNS_TYPE_A;
+  dns_lookup *lookup = create_lookup(query, port, priority, weight);
+
+  send_query(lookup, name, type, &on_address_response);
+}
+
+static void on_srv_response(void *user_data, pj_status_t status, pj_dns_parsed_packet *response)
+{
+  dns_query *query = ((dns_lookup *) user_data)->query;
+  const pj_dns_parsed_rr *targets[PJSIP_MAX_RESOLVED_ADDRESSES];
+  unsigned count = 0;
+
+  lookup_answered((dns_lookup *) user_data);
+
+  // Collect the SRV records in the order they should be tried: lowest priority, then highest weight
+  for (unsigned i = 0; status == PJ_SUCCESS && i < response->hdr.anscount; i++) {
+    const pj_dns_parsed_rr *rr = &response->ans[i];
+    if (rr->type != PJ_DNS_TYPE_SRV || count >= PJSIP_MAX_RESOLVED_ADDRESSES) {
+      continue;
+    }
+
+    // A target of "." means the service is decidedly not available at this domain
+    if (rr->rdata.srv.target.slen == 0 || (rr->rdata.srv.target.slen == 1 && rr->rdata.srv.target.ptr[0] == '.')) {
+      continue;
+    }
+
+    unsigned j = count++;
+    while (j > 0 && (targets[j - 1]->rdata.srv.prio > rr->rdata.srv.prio ||
+                     (targets[j - 1]->rdata.srv.prio == rr->rdata.srv.prio && targets[j - 1]->rdata.srv.weight < rr->rdata.srv.weight))) {
+      targets[j] = targets[j - 1];
+      j--;
+    }
+    targets[j] = rr;
+  }
+
+  // Without SRV records, fall back to the domain's own addresses on the default port, as pjsip does
+  if (count == 0) {
+    pj_uint16_t port = (pj_uint16_t) pjsip_transport_get_default_port_for_type(query->target.type);
+    lookup_addresses(query, &query->target.addr.host, port, 0, 0);
+    query_done(query, PJ_SUCCESS);
+    return;
+  }
+
+  for (unsigned i = 0; i < count; i++) {
+    const pj_dns_parsed_rr *srv = targets[i];
+    dns_lookup lookup;
+    unsigned before;
+
+    pj_bzero(&lookup, sizeof(lookup));
+    lookup.query = query;
+    lookup.port = srv->rdata.srv.port;
+    lookup.priority = srv->rdata.srv.prio;
+    lookup.weight = srv->rdata.srv.weight;
+
+    pj_mutex_lock(cache.mutex);
+    query->ttl = PJ_MIN(query->ttl, srv->ttl);
+    before = query->result.count;
+
+    // Most servers include the target's addresses in the additional section, which saves a round trip
+    for (unsigned j = 0; j < response->hdr.arcount; j++) {
+      if (pj_stricmp(&response->arr[j].name, &srv->rdata.srv.target) == 0) {
+        add_record_locked(query, &response->arr[j], &lookup);
+      }
+    }
+
+    pj_bool_t found = query->result.count > before;
+    pj_mutex_unlock(cache.mutex);
+
+    if (!found) {
+      lookup_addresses(query, &srv->rdata.srv.target, lookup.port, lookup.priority, lookup.weight);
+    }
+  }
+
+  query_done(query, PJ_SUCCESS);
+}
+
+static void begin_query(dns_query *query)
+{
+  const pj_str_t *host = &query->target.addr.host;
+
+  // Hold a count of our own so the query can't finish while lookups are still being started
+  pj_mutex_lock(cache.mutex);
+  query->pending = 1;
+  pj_mutex_unlock(cache.mutex);
+
+  if (query->target.addr.port != 0) {
+    lookup_addresses(query, host, query->target.addr.port, 0, 0);
+  } else {
+    const char *prefix;
+    switch ((int) query->target.type & ~PJSIP_TRANSPORT_IPV6) {
+      case PJSIP_TRANSPORT_TLS:
+        prefix = "_sips._tcp.";
+        break;
+      case PJSIP_TRANSPORT_TCP:
+        prefix = "_sip._tcp.";
+        break;
+      default:
+        prefix = "_sip._udp.";
+        break;
+    }
+
+    // Waiters may be added to the pool concurrently, so allocate under the lock
+    pj_str_t name;
+    pj_size_t prefix_length = pj_ansi_strlen(prefix);
+    pj_mutex_lock(cache.mutex);
+    name.ptr = (char *) pj_pool_alloc(query->pool, prefix_length + (pj_size_t) host->slen);
+    pj_mutex_unlock(cache.mutex);
+    pj_memcpy(name.ptr, prefix, prefix_length);
+    pj_memcpy(name.ptr + prefix_length, host->ptr, (pj_size_t) host->slen);
+    name.slen = (pj_ssize_t) (prefix_length + (pj_size_t) host->slen);
+
+    send_query(create_lookup(query, 0, 0, 0), &name, PJ_DNS_TYPE_SRV, &on_srv_response);
+  }
+
+  query_done(query, PJ_SUCCESS);
+}
+
+static void on_prefetch_timer(pj_timer_heap_t *timer_heap, pj_timer_entry *timer)
+{
+  dns_query *queries[DNS_CACHE_SIZE];
+  unsigned count = 0;
+  pj_time_val now;
+
+  PJ_UNUSED_ARG(timer_heap);
+  PJ_UNUSED_ARG(timer);
+
+  pj_mutex_lock(cache.mutex);
+  pj_gettickcount(&now);
+
+  for (unsigned i = 0; i < DNS_CACHE_SIZE; i++) {
+    dns_entry *entry = &cache.entries[i];
+    if (!entry->in_use || !prefetch_due(entry, &now)) {
+      continue;
+    }
+
+    dns_query *query = create_query_locked(entry, &entry->target);
+    if (query != NULL) {
+      queries[count++] = query;
+      cache.stat.prefetches++;
+    }
+  }
+
+  schedule_prefetch_locked();
+  pj_mutex_unlock(cache.mutex);
+
+  for (unsigned i = 0; i < count; i++) {
+    begin_query(queries[i]);
+  }
+}
+
+static void on_ext_resolve(pjsip_resolver_t *resolver, pj_pool_t *pool, const pjsip_host_info *target, void *token, pjsip_resolver_callback *cb)
+{
+  PJ_UNUSED_ARG(resolver);
+  PJ_UNUSED_ARG(pool);
+
+  pj_dns_cache_resolve(target, token, cb);
+}
+
+static pjsip_ext_resolver ext_resolver = {
+  &on_ext_resolve
+};
+
+pj_status_t pj_dns_cache_init(pj_pool_factory *pf,
+                              pj_dns_resolver *resolver,
+                              pj_timer_heap_t *timer_heap,
+                              unsigned prefetch_window,
+                              unsigned max_stale)
+{
+  pj_status_t status;
+
+  pj_dns_cache_shutdown();
+  pj_bzero(&cache, sizeof(cache));
+  pj_list_init(&cache.queries);
+
+  cache.pool = pj_pool_create(pf, "dnscache", 512, 512, NULL);
+  if (cache.pool == NULL) {
+    return PJ_ENOMEM;
+  }
+
+  status = pj_mutex_create_simple(cache.pool, "dnscache", &cache.mutex);
+  if (status != PJ_SUCCESS) {
+    pj_pool_release(cache.pool);
+    return status;
+  }
+
+  cache.pf = pf;
+  cache.resolver = resolver;
+  cache.timer_heap = timer_heap;
+  cache.prefetch_window = prefetch_window;
+  cache.max_stale = max_stale;
+  pj_timer_entry_init(&cache.prefetch_timer, 0, NULL, &on_prefetch_timer);
+
+  // The resolver's cache hands back records with their original TTL rather than what's left of it, which would
+  // make our refreshes extend records past their real expiry
+  if (resolver != NULL) {
+    pj_dns_settings settings;
+    pj_dns_resolver_get_settings(resolver, &settings);
+    settings.cache_max_ttl = 0;
+    pj_dns_resolver_set_settings(resolver, &settings);
+  }
+
+  cache.initialized = PJ_TRUE;
+  return PJ_SUCCESS;
+}
+
+void pj_dns_cache_shutdown(void)
+{
+  dns_query queries;
+
+  if (!cache.initialized) {
+    return;
+  }
+
+  pj_dns_cache_clear();
+
+  pj_mutex_lock(cache.mutex);
+  cache.initialized = PJ_FALSE;
+
+  // The resolver would otherwise answer into pools and a lock that are about to go away
+  pj_list_init(&queries);
+  pj_list_merge_last(&queries, &cache.queries);
+  for (dns_query *query = queries.next; query != &queries; query = query->next) {
+    for (dns_lookup *lookup = query->lookups.next; lookup != &query->lookups; lookup = lookup->next) {
+      if (lookup->async != NULL) {
+        pj_dns_resolver_cancel_query(lookup->async, PJ_FALSE);
+        lookup->async = NULL;
+      }
+    }
+  }
+
+  pj_mutex_unlock(cache.mutex);
+
+  while (!pj_list_empty(&queries)) {
+    dns_query *query = queries.next;
+    pj_list_erase(query);
+    pj_pool_release(query->pool);
+  }
+
+  pj_mutex_destroy(cache.mutex);
+  pj_pool_release(cache.pool);
+}
+
+pj_status_t pj_dns_cache_enable_sip_resolver(pjsip_endpoint *endpt)
+{
+  PJ_ASSERT_RETURN(cache.initialized && cache.resolver != NULL, PJ_EINVALIDOP);
+
+  return pjsip_endpt_set_ext_resolver(endpt, &ext_resolver);
+}
+
+void pj_dns_cache_resolve(const pjsip_host_info *target, void *token, pjsip_resolver_callback *cb)
+{
+  pjsip_host_info normalized = *target;
+  pjsip_server_addresses addresses;
+  char key[DNS_CACHE_KEY_LEN];
+  dns_query *query = NULL;
+  pj_bool_t served = PJ_FALSE;
+  pj_bool_t waiting = PJ_FALSE;
+  pj_bool_t was_used = PJ_TRUE;
+  pj_time_val now;
+
+  normalized.type = normalize_type(target);
+
+  // IP addresses don't need resolving
+  int ip_ver = get_ip_addr_ver(&target->addr.host);
+  if (ip_ver != 0) {
+    pj_status_t status = resolve_ip_address(&normalized, ip_ver, &addresses);
+    (*cb)(status, token, status == PJ_SUCCESS ? &addresses : NULL);
+    return;
+  }
+
+  if (!cache.initialized || cache.resolver == NULL) {
+    (*cb)(PJ_EINVALIDOP, token, NULL);
+    return;
+  }
+
+  make_key(key, "sip", normalized.type, &normalized.addr.host, normalized.addr.port);
+
+  pj_mutex_lock(cache.mutex);
+  pj_gettickcount(&now);
+
+  dns_entry *entry = find_entry_locked(key);
+  if (entry != NULL && entry->valid) {
+    pj_time_val stale_until = entry->expires;
+    was_used = entry->used;
+    stale_until.sec += (long) cache.max_stale;
+
+    if (PJ_TIME_VAL_LT(now, entry->expires)) {
+      cache.stat.hits++;
+      served = PJ_TRUE;
+
+      entry->used = PJ_TRUE;
+      if (prefetch_due(entry, &now)) {
+        query = create_query_locked(entry, &entry->target);
+        cache.stat.prefetches++;
+      }
+    } else if (PJ_TIME_VAL_LT(now, stale_until)) {
+      cache.stat.stale_hits++;
+      served = PJ_TRUE;
+
+      // Serve the old answer right away, and revalidate it in the background
+      entry->used = PJ_TRUE;
+      if (entry->query == NULL) {
+        query = create_query_locked(entry, &entry->target);
+      }
+    } else {
+      entry->valid = PJ_FALSE;
+    }
+
+    if (served) {
+      addresses = entry->addresses;
+    }
+
+    // A record that's in use again needs to be on the prefetch timer
+    if (served && !was_used && query == NULL) {
+      schedule_prefetch_locked();
+    }
+  }
+
+  if (!served) {
+    cache.stat.misses++;
+
+    if (entry == NULL) {
+      entry = alloc_entry_locked(key);
+      if (entry != NULL) {
+        set_entry_target_locked(entry, &normalized);
+      }
+    }
+
+    // Join a resolution that's already in flight for the same target rather than starting another one
+    if (entry != NULL && entry->query != NULL) {
+      add_waiter_locked(entry->query, token, cb);
+      waiting = PJ_TRUE;
+    } else {
+      query = create_query_locked(entry, &normalized);
+      if (query != NULL) {
+        add_waiter_locked(query, token, cb);
+        waiting = PJ_TRUE;
+      } else if (entry != NULL) {
+        entry->in_use = PJ_FALSE;
+      }
+    }
+  }
+
+  if (entry != NULL && entry->in_use) {
+    entry->last_used = now;
+  }
+
+  pj_mutex_unlock(cache.mutex);
+
+  if (served) {
+    (*cb)(PJ_SUCCESS, token, &addresses);
+  } else if (!waiting) {
+    (*cb)(PJ_ENOMEM, token, NULL);
+  }
+
+  if (query != NULL) {
+    begin_query(query);
+  }
+}
+
+pj_status_t pj_dns_cache_getaddrinfo(int af, const pj_str_t *name, unsigned *count, pj_addrinfo ai[])
+{
+  pj_addrinfo resolved[PJSIP_MAX_RESOLVED_ADDRESSES];
+  unsigned resolved_count = PJSIP_MAX_RESOLVED_ADDRESSES;
+  char key[DNS_CACHE_KEY_LEN];
+  pj_time_val now;
+  pj_status_t status;
+
+  if (!cache.initialized) {
+    return pj_getaddrinfo(af, name, count, ai);
+  }
+
+  make_key(key, "ai", af, name, 0);
+
+  pj_mutex_lock(cache.mutex);
+  pj_gettickcount(&now);
+
+  dns_entry *entry = find_entry_locked(key);
+  if (entry != NULL && entry->valid && PJ_TIME_VAL_LT(now, entry->expires)) {
+    cache.stat.hits++;
+    entry->last_used = now;
+
+    *count = PJ_MIN(*count, entry->addresses.count);
+    for (unsigned i = 0; i < *count; i++) {
+      pj_bzero(&ai[i], sizeof(ai[i]));
+      ai[i].ai_addr = entry->addresses.entry[i].addr;
+    }
+
+    pj_mutex_unlock(cache.mutex);
+    return PJ_SUCCESS;
+  }
+
+  cache.stat.misses++;
+  pj_mutex_unlock(cache.mutex);
+
+  // getaddrinfo blocks, so it must not be called with the lock held
+  status = pj_getaddrinfo(af, name, &resolved_count, resolved);
+  if (status != PJ_SUCCESS || resolved_count == 0) {
+    pj_mutex_lock(cache.mutex);
+    cache.stat.failures++;
+    pj_mutex_unlock(cache.mutex);
+
+    *count = 0;
+    return status != PJ_SUCCESS ? status : PJ_ERESOLVE;
+  }
+
+  pj_mutex_lock(cache.mutex);
+  entry = find_entry_locked(key);
+  if (entry == NULL) {
+    entry = alloc_entry_locked(key);
+  }
+
+  if (entry != NULL) {
+    entry->addrinfo = PJ_TRUE;
+    entry->valid = PJ_TRUE;
+    entry->last_used = now;
+    entry->expires = now;
+    entry->expires.sec += DNS_CACHE_ADDRINFO_TTL;
+    entry->addresses.count = resolved_count;
+    for (unsigned i = 0; i < resolved_count; i++) {
+      entry->addresses.entry[i].addr = resolved[i].ai_addr;
+      entry->addresses.entry[i].addr_len = pj_sockaddr_get_len(&resolved[i].ai_addr);
+    }
+  }
+  pj_mutex_unlock(cache.mutex);
+
+  *count = PJ_MIN(*count, resolved_count);
+  for (unsigned i = 0; i < *count; i++) {
+    ai[i] = resolved[i];
+  }
+
+  return PJ_SUCCESS;
+}
+
+void pj_dns_cache_clear(void)
+{
+  if (!cache.initialized) {
+    return;
+  }
+
+  pj_mutex_lock(cache.mutex);
+
+  // Resolutions in flight still report to their waiters, they just don't update the cache anymore
+  for (unsigned i = 0; i < DNS_CACHE_SIZE; i++) {
+    if (cache.entries[i].query != NULL) {
+      cache.entries[i].query->entry = NULL;
+    }
+
+    pj_bzero(&cache.entries[i], sizeof(cache.entries[i]));
+  }
+
+  if (cache.timer_heap != NULL) {
+    pj_timer_heap_cancel(cache.timer_heap, &cache.prefetch_timer);
+  }
+
+  pj_mutex_unlock(cache.mutex);
+}
+
+void pj_dns_cache_get_stat(pj_dns_cache_stat *stat)
+{
+  if (!cache.initialized) {
+    pj_bzero(stat, sizeof(*stat));
+    return;
+  }
+
+  pj_mutex_lock(cache.mutex);
+  *stat = cache.stat;
+  pj_mutex_unlock(cache.mutex);
+}
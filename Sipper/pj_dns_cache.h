@@ -0,0 +1,89 @@
+//
+//  pj_dns_cache.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/16/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_dns_cache_h
+#define pj_dns_cache_h
+
+#import <pjsua.h>
+
+/**
+ * Counters for the DNS cache
+ */
+typedef struct pj_dns_cache_stat {
+  /** Lookups answered from a record that had not expired */
+  unsigned hits;
+  /** Lookups answered from an expired record while it was being revalidated */
+  unsigned stale_hits;
+  /** Lookups that had to wait for the network */
+  unsigned misses;
+  /** Records refreshed before they expired */
+  unsigned prefetches;
+  /** DNS queries sent to the nameservers */
+  unsigned queries;
+  /** Resolutions that failed */
+  unsigned failures;
+} pj_dns_cache_stat;
+
+/*
+ * Initialize the DNS cache.
+ * @param pf              Pool factory for per-resolution pools.
+ * @param resolver        Asynchronous resolver used to answer misses and refreshes. May be NULL, in which
+ *                        case only pj_dns_cache_getaddrinfo() results are cached. The resolver's own cache is
+ *                        disabled, since it would hand back records without their remaining TTL.
+ * @param timer_heap      Timer heap used to schedule prefetches.
+ * @param prefetch_window Records that were looked up since they were last resolved are refreshed this many
+ *                        seconds before they expire.
+ * @param max_stale       Expired records may still be served for this many seconds while they're revalidated.
+ */
+pj_status_t pj_dns_cache_init(pj_pool_factory *pf,
+                              pj_dns_resolver *resolver,
+                              pj_timer_heap_t *timer_heap,
+                              unsigned prefetch_window,
+                              unsigned max_stale);
+
+/*
+ * Shut down the DNS cache. Resolutions still in flight are cancelled without being reported, since this is meant
+ * to be called as the endpoint unloads, after the transactions waiting on them are gone. Nothing may be resolving
+ * through the cache meanwhile (PJSUA has stopped its worker threads by then).
+ */
+void pj_dns_cache_shutdown(void);
+
+/*
+ * Route every SIP target resolution of the endpoint through the cache. The cache must have been initialized
+ * with a resolver.
+ */
+pj_status_t pj_dns_cache_enable_sip_resolver(pjsip_endpoint *endpt);
+
+/*
+ * Resolve a SIP target the same way pjsip_resolve() does (SRV, then A/AAAA), consulting the cache first.
+ * The callback is invoked synchronously for cached records and IP addresses.
+ */
+void pj_dns_cache_resolve(const pjsip_host_info *target, void *token, pjsip_resolver_callback *cb);
+
+/*
+ * Drop-in replacement for pj_getaddrinfo() whose results are cached. Since addresses synthesized for NAT64
+ * depend on the network, call pj_dns_cache_clear() when it changes.
+ *
+ * Unlike pj_dns_cache_resolve(), a miss blocks on getaddrinfo, and results are kept for a fixed 300 seconds since
+ * getaddrinfo doesn't report TTLs. They're neither prefetched nor served stale. The asynchronous resolver can't
+ * take over: it's getaddrinfo that synthesizes IPv6 addresses for IPv4 literals from the network's NAT64 prefix,
+ * and the NAT64 rewrite needs its answer before the message it's rewriting goes on.
+ */
+pj_status_t pj_dns_cache_getaddrinfo(int af, const pj_str_t *name, unsigned *count, pj_addrinfo ai[]);
+
+/*
+ * Forget every cached record, for instance after a network change
+ */
+void pj_dns_cache_clear(void);
+
+/*
+ * Get a snapshot of the cache counters
+ */
+void pj_dns_cache_get_stat(pj_dns_cache_stat *stat);
+
+#endif /* pj_dns_cache_h */
@@ -0,0 +1,352 @@
+//
+//  pj_dtmf.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_dtmf.h"
+
+#include <math.h>
+
+#include <pjsua.h>
+
+#define THIS_FILE "pj_dtmf.c"
+
+/* The sine table has 2^DTMF_TABLE_BITS entries, indexed by the top bits of a tone's phase */
+#define DTMF_TABLE_BITS   10
+#define DTMF_TABLE_SIZE   (1 << DTMF_TABLE_BITS)
+
+/* Each tone peaks at about -9 dBFS, so the two of them together stay clear of clipping */
+#define DTMF_AMPLITUDE    11000
+
+/* A tone has to carry this fraction of the block's energy, out of the quarter a pure tone would */
+#define DTMF_MIN_TONE_SHARE  0.08
+
+/* And be this many times stronger than the next strongest frequency of its group */
+#define DTMF_MIN_GROUP_RATIO  4.0
+
+/* Blocks quieter than this, as a mean square, are silence. That's about -50 dBFS. */
+#define DTMF_MIN_ENERGY  100.0
+
+static const char dtmf_keys[4][4] = {
+  {'1', '2', '3', 'A'},
+  {'4', '5', '6', 'B'},
+  {'7', '8', '9', 'C'},
+  {'*', '0', '#', 'D'}
+};
+
+static const unsigned dtmf_low[4] = {697, 770, 852, 941};
+static const unsigned dtmf_high[4] = {1209, 1336, 1477, 1633};
+
+/* Built the first time a tone starts. Building it twice writes the same values, so it needs no lock. */
+static pj_int16_t sine_table[DTMF_TABLE_SIZE];
+static volatile pj_bool_t sine_table_built;
+
+typedef struct dtmf_port {
+  pjmedia_port base;
+  pj_lock_t *lock;
+  unsigned clock_rate;
+  unsigned channel_count;
+  pj_dtmf_tone tone;
+  unsigned remaining;
+} dtmf_port;
+
+static void build_sine_table(void)
+{
+  if (sine_table_built) {
+    return;
+  }
+
+  for (unsigned i = 0; i < DTMF_TABLE_SIZE; i++) {
+    sine_table[i] = (pj_int16_t) lround(DTMF_AMPLITUDE * sin(2 * M_PI * i / DTMF_TABLE_SIZE));
+  }
+
+  sine_table_built = PJ_TRUE;
+}
+
+static pj_bool_t find_digit(char digit, unsigned *row, unsigned *col)
+{
+  if (digit >= 'a' && digit <= 'd') {
+    digit = (char) (digit - 'a' + 'A');
+  }
+
+  for (unsigned r = 0; r < 4; r++) {
+    for (unsigned c = 0; c < 4; c++) {
+      if (dtmf_keys[r][c] == digit) {
+        *row = r;
+        *col = c;
+        return PJ_TRUE;
+      }
+    }
+  }
+
+  return PJ_FALSE;
+}
+
+static pj_uint32_t phase_step(unsigned frequency, unsigned clock_rate)
+{
+  return (pj_uint32_t) (frequency * 4294967296.0 / clock_rate + 0.5);
+}
+
+pj_bool_t pj_dtmf_is_digit(char digit)
+{
+  unsigned row, col;
+  return find_digit(digit, &row, &col);
+}
+
+pj_status_t pj_dtmf_tone_init(pj_dtmf_tone *tone, char digit, unsigned clock_rate)
+{
+  unsigned row, col;
+  PJ_ASSERT_RETURN(tone && clock_rate, PJ_EINVAL);
+
+  if (!find_digit(digit, &row, &col)) {
+    return PJ_EINVAL;
+  }
+
+  build_sine_table();
+
+  tone->low_phase = 0;
+  tone->low_step = phase_step(dtmf_low[row], clock_rate);
+  tone->high_phase = 0;
+  tone->high_step = phase_step(dtmf_high[col], clock_rate);
+  return PJ_SUCCESS;
+}
+
+void pj_dtmf_tone_render(pj_dtmf_tone *tone, pj_int16_t *samples, unsigned count)
+{
+  for (unsigned i = 0; i < count; i++) {
+    samples[i] = (pj_int16_t) (sine_table[tone->low_phase >> (32 - DTMF_TABLE_BITS)] +
+                               sine_table[tone->high_phase >> (32 - DTMF_TABLE_BITS)]);
+    tone->low_phase += tone->low_step;
+    tone->high_phase += tone->high_step;
+  }
+}
+
+static double goertzel(const pj_int16_t *samples, unsigned count, unsigned frequency, unsigned clock_rate)
+{
+  double coeff = 2 * cos(2 * M_PI * frequency / clock_rate);
+  double s1 = 0, s2 = 0;
+
+  for (unsigned i = 0; i < count; i++) {
+    double s0 = samples[i] + coeff * s1 - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+
+  return s1 * s1 + s2 * s2 - coeff * s1 * s2;
+}
+
+/* The strongest frequency of a group, if it stands out from the rest of it and from the block */
+static int strongest(const double power[4], double energy, unsigned count)
+{
+  int best = 0;
+  for (int i = 1; i < 4; i++) {
+    if (power[i] > power[best]) {
+      best = i;
+    }
+  }
+
+  if (power[best] < DTMF_MIN_TONE_SHARE * energy * count) {
+    return -1;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    if (i != best && power[i] * DTMF_MIN_GROUP_RATIO > power[best]) {
+      return -1;
+    }
+  }
+
+  return best;
+}
+
+char pj_dtmf_detect(const pj_int16_t *samples, unsigned count, unsigned clock_rate)
+{
+  if (count == 0 || clock_rate == 0) {
+    return 0;
+  }
+
+  double energy = 0;
+  for (unsigned i = 0; i < count; i++) {
+    energy += (double) samples[i] * samples[i];
+  }
+
+  if (energy / count < DTMF_MIN_ENERGY) {
+    return 0;
+  }
+
+  double low[4], high[4];
+  for (unsigned i = 0; i < 4; i++) {
+    low[i] = goertzel(samples, count, dtmf_low[i], clock_rate);
+    high[i] = goertzel(samples, count, dtmf_high[i], clock_rate);
+  }
+
+  int row = strongest(low, energy, count);
+  int col = strongest(high, energy, count);
+  if (row < 0 || col < 0) {
+    return 0;
+  }
+
+  return dtmf_keys[row][col];
+}
+
+int pj_dtmf_relay_print(char digit, unsigned duration, char *buf, pj_size_t size)
+{
+  if (!pj_dtmf_is_digit(digit)) {
+    return -1;
+  }
+
+  int len = pj_ansi_snprintf(buf, size, "Signal=%c\r\nDuration=%u\r\n", digit, duration);
+  if (len < 0 || (pj_size_t) len >= size) {
+    return -1;
+  }
+
+  return len;
+}
+
+pj_status_t pj_dtmf_relay_parse(const pj_str_t *body, char *digit, unsigned *duration)
+{
+  pj_bool_t has_signal = PJ_FALSE;
+  const char *p = body->ptr;
+  const char *end = body->ptr + body->slen;
+
+  *duration = 0;
+
+  while (p < end) {
+    const char *eol = p;
+    while (eol < end && *eol != '\r' && *eol != '\n') {
+      eol++;
+    }
+
+    const char *equals = p;
+    while (equals < eol && *equals != '=') {
+      equals++;
+    }
+
+    if (equals < eol) {
+      pj_str_t name = pj_str((char *) p);
+      name.slen = equals - p;
+      pj_str_t value = pj_str((char *) equals + 1);
+      value.slen = eol - equals - 1;
+      pj_strtrim(&name);
+      pj_strtrim(&value);
+
+      if (pj_stricmp2(&name, "Signal") == 0 && value.slen == 1 && pj_dtmf_is_digit(value.ptr[0])) {
+        *digit = value.ptr[0];
+        has_signal = PJ_TRUE;
+      } else if (pj_stricmp2(&name, "Duration") == 0) {
+        *duration = (unsigned) pj_strtoul(&value);
+      }
+    }
+
+    p = eol;
+    while (p < end && (*p == '\r' || *p == '\n')) {
+      p++;
+    }
+  }
+
+  return has_signal ? PJ_SUCCESS : PJ_EINVAL;
+}
+
+static pj_status_t dtmf_port_get_frame(pjmedia_port *this_port, pjmedia_frame *frame)
+{
+  dtmf_port *port = (dtmf_port *) this_port;
+  pj_int16_t *samples = (pj_int16_t *) frame->buf;
+  unsigned count = PJMEDIA_PIA_SPF(&this_port->info) / port->channel_count;
+
+  pj_lock_acquire(port->lock);
+
+  if (port->remaining == 0) {
+    pj_lock_release(port->lock);
+    frame->type = PJMEDIA_FRAME_TYPE_NONE;
+    frame->size = 0;
+    return PJ_SUCCESS;
+  }
+
+  // The digit ends part way through its last frame, which is padded with silence
+  unsigned rendered = PJ_MIN(count, port->remaining);
+  pj_dtmf_tone_render(&port->tone, samples, rendered);
+  pj_bzero(samples + rendered, (count - rendered) * sizeof(pj_int16_t));
+  port->remaining -= rendered;
+
+  pj_lock_release(port->lock);
+
+  // Spread the mono tone across the channels, from the back so nothing is overwritten before it's copied
+  if (port->channel_count > 1) {
+    for (unsigned i = count; i-- > 0;) {
+      for (unsigned c = 0; c < port->channel_count; c++) {
+        samples[i * port->channel_count + c] = samples[i];
+      }
+    }
+  }
+
+  frame->type = PJMEDIA_FRAME_TYPE_AUDIO;
+  frame->size = PJMEDIA_PIA_SPF(&this_port->info) * sizeof(pj_int16_t);
+  return PJ_SUCCESS;
+}
+
+static pj_status_t dtmf_port_on_destroy(pjmedia_port *this_port)
+{
+  dtmf_port *port = (dtmf_port *) this_port;
+  pj_lock_destroy(port->lock);
+  return PJ_SUCCESS;
+}
+
+pj_status_t pj_dtmf_port_create(pj_pool_t *pool,
+                                unsigned clock_rate,
+                                unsigned channel_count,
+                                unsigned samples_per_frame,
+                                pjmedia_port **p_port)
+{
+  PJ_ASSERT_RETURN(pool && clock_rate && channel_count && samples_per_frame && p_port, PJ_EINVAL);
+
+  dtmf_port *port = PJ_POOL_ZALLOC_T(pool, dtmf_port);
+  pj_str_t name = pj_str((char *) "dtmf");
+
+  pj_status_t status = pj_lock_create_simple_mutex(pool, "dtmf", &port->lock);
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  pjmedia_port_info_init(&port->base.info, &name, PJMEDIA_SIG_CLASS_PORT_AUD('D', 'T'), clock_rate, channel_count,
+                         16, samples_per_frame);
+  port->base.get_frame = &dtmf_port_get_frame;
+  port->base.on_destroy = &dtmf_port_on_destroy;
+  port->clock_rate = clock_rate;
+  port->channel_count = channel_count;
+
+  build_sine_table();
+
+  *p_port = &port->base;
+  return PJ_SUCCESS;
+}
+
+pj_status_t pj_dtmf_port_play(pjmedia_port *this_port, char digit, unsigned duration)
+{
+  dtmf_port *port = (dtmf_port *) this_port;
+  pj_dtmf_tone tone;
+
+  pj_status_t status = pj_dtmf_tone_init(&tone, digit, port->clock_rate);
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  pj_lock_acquire(port->lock);
+  port->tone = tone;
+  port->remaining = (unsigned) ((pj_uint64_t) port->clock_rate * duration / 1000);
+  pj_lock_release(port->lock);
+
+  return PJ_SUCCESS;
+}
+
+pj_bool_t pj_dtmf_port_is_playing(pjmedia_port *this_port)
+{
+  dtmf_port *port = (dtmf_port *) this_port;
+
+  pj_lock_acquire(port->lock);
+  pj_bool_t playing = port->remaining > 0;
+  pj_lock_release(port->lock);
+
+  return playing;
+}
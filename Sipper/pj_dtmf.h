@@ -0,0 +1,101 @@
+//
+//  pj_dtmf.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_dtmf_h
+#define pj_dtmf_h
+
+#import <pjsua.h>
+
+/* The content type that digits are sent in over SIP INFO */
+#define PJ_DTMF_RELAY_CONTENT_TYPE  "application"
+#define PJ_DTMF_RELAY_CONTENT_SUB   "dtmf-relay"
+
+/*
+ * A DTMF digit being rendered: the phase of its two tones, which step through a precomputed sine table
+ */
+typedef struct pj_dtmf_tone {
+  pj_uint32_t low_phase;
+  pj_uint32_t low_step;
+  pj_uint32_t high_phase;
+  pj_uint32_t high_step;
+} pj_dtmf_tone;
+
+/*
+ * Whether a character is a DTMF digit: 0-9, *, #, or A-D in either case
+ */
+pj_bool_t pj_dtmf_is_digit(char digit);
+
+/*
+ * Start rendering a digit.
+ * @param tone        The tone to start.
+ * @param digit       The digit.
+ * @param clock_rate  The sample rate it's rendered at.
+ * @return            PJ_EINVAL if the character isn't a DTMF digit.
+ */
+pj_status_t pj_dtmf_tone_init(pj_dtmf_tone *tone, char digit, unsigned clock_rate);
+
+/*
+ * Render the next samples of a digit, carrying on from where the last call left off
+ */
+void pj_dtmf_tone_render(pj_dtmf_tone *tone, pj_int16_t *samples, unsigned count);
+
+/*
+ * Find the digit in a block of mono audio, with a Goertzel filter for each of the eight DTMF frequencies. A block of
+ * 20ms or more tells all the frequencies apart.
+ * @return  The digit, or 0 if the block is silent or isn't a DTMF tone.
+ */
+char pj_dtmf_detect(const pj_int16_t *samples, unsigned count, unsigned clock_rate);
+
+/*
+ * Print an application/dtmf-relay body.
+ * @param digit     The digit.
+ * @param duration  How long the digit lasts, in MS.
+ * @param buf       The buffer to print into.
+ * @param size      The size of the buffer.
+ * @return          The length of the body, or -1 if it didn't fit.
+ */
+int pj_dtmf_relay_print(char digit, unsigned duration, char *buf, pj_size_t size);
+
+/*
+ * Parse an application/dtmf-relay body.
+ * @param body      The body.
+ * @param digit     The digit in its Signal line.
+ * @param duration  The MS in its Duration line, or 0 if it had none.
+ * @return          PJ_EINVAL if the body has no Signal line, or it isn't a DTMF digit.
+ */
+pj_status_t pj_dtmf_relay_parse(const pj_str_t *body, char *digit, unsigned *duration);
+
+/*
+ * Create a port that plays digits in-band. It's added to the conference bridge and connected to a call's slot, so its
+ * tones are mixed into whatever else the call is sending. It returns no frame when it isn't playing, which the bridge
+ * skips.
+ * @param pool               Pool the port is allocated from.
+ * @param clock_rate         The bridge's sample rate.
+ * @param channel_count      The bridge's channels. Every channel gets the same tone.
+ * @param samples_per_frame  The bridge's samples per frame, of all channels.
+ * @param p_port             Set to the port.
+ */
+pj_status_t pj_dtmf_port_create(pj_pool_t *pool,
+                                unsigned clock_rate,
+                                unsigned channel_count,
+                                unsigned samples_per_frame,
+                                pjmedia_port **p_port);
+
+/*
+ * Play a digit on a port, replacing whatever it was playing.
+ * @param duration  How long to play it, in MS.
+ * @return          PJ_EINVAL if the character isn't a DTMF digit.
+ */
+pj_status_t pj_dtmf_port_play(pjmedia_port *port, char digit, unsigned duration);
+
+/*
+ * Whether a port has any of its digit left to play
+ */
+pj_bool_t pj_dtmf_port_is_playing(pjmedia_port *port);
+
+#endif /* pj_dtmf_h */
@@ -0,0 +1,402 @@
+//
+//  pj_ice_host_rank.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/18/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_ice_host_rank.h"
+
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+
+#include <pjsua.h>
+#include <pjnath.h>
+
+#define THIS_FILE "pj_ice_host_rank.c"
+
+/* Most addresses considered per ranking, which is more than any transport asks for */
+#define HOST_RANK_MAX_ADDRS       32
+
+/* Number of interfaces whose past successes are remembered */
+#define HOST_RANK_MAX_INTERFACES  16
+
+/* Scores. The default route outweighs any interface type, and past successes can move an interface up one type. */
+#define HOST_RANK_DEFAULT_ROUTE   40
+#define HOST_RANK_LAN             30
+#define HOST_RANK_CELLULAR        20
+#define HOST_RANK_TUNNEL          10
+#define HOST_RANK_OTHER           5
+#define HOST_RANK_EXCLUDED        -1
+#define HOST_RANK_PER_SUCCESS     5
+#define HOST_RANK_MAX_SUCCESSES   3
+
+typedef struct ranked_addr {
+  pj_sockaddr addr;
+  const char *ifname;
+  int score;
+  unsigned spread;                   // how many better addresses the same interface already contributed
+} ranked_addr;
+
+typedef struct interface_record {
+  char name[IFNAMSIZ];
+  unsigned successes;
+} interface_record;
+
+static struct host_rank {
+  pj_bool_t initialized;
+  pj_pool_t *pool;
+  pj_mutex_t *mutex;
+  interface_record interfaces[HOST_RANK_MAX_INTERFACES];
+  unsigned interface_cnt;
+  pj_ice_host_rank_stat stat;
+} rank;
+
+static pj_bool_t has_prefix(const char *name, const char *prefix)
+{
+  return pj_ansi_strncmp(name, prefix, pj_ansi_strlen(prefix)) == 0;
+}
+
+static int interface_score(const char *ifname)
+{
+  if (ifname == NULL) {
+    return HOST_RANK_OTHER;
+  }
+
+  // Peer-to-peer Wi-Fi, loopback and tethering interfaces never reach the other party
+  if (has_prefix(ifname, "awdl") || has_prefix(ifname, "llw") || has_prefix(ifname, "lo") ||
+      has_prefix(ifname, "bridge") || has_prefix(ifname, "ap") || has_prefix(ifname, "anpi")) {
+    return HOST_RANK_EXCLUDED;
+  }
+
+  if (has_prefix(ifname, "en") || has_prefix(ifname, "eth") || has_prefix(ifname, "wlan")) {
+    return HOST_RANK_LAN;
+  }
+
+  if (has_prefix(ifname, "pdp_ip") || has_prefix(ifname, "rmnet")) {
+    return HOST_RANK_CELLULAR;
+  }
+
+  if (has_prefix(ifname, "utun") || has_prefix(ifname, "ipsec") || has_prefix(ifname, "ppp") ||
+      has_prefix(ifname, "tun") || has_prefix(ifname, "tap")) {
+    return HOST_RANK_TUNNEL;
+  }
+
+  return HOST_RANK_OTHER;
+}
+
+static pj_bool_t is_link_local(const pj_sockaddr *addr)
+{
+  const pj_uint8_t *bytes = (const pj_uint8_t *) pj_sockaddr_get_addr(addr);
+
+  if (addr->addr.sa_family == pj_AF_INET()) {
+    return bytes[0] == 169 && bytes[1] == 254;
+  } else if (addr->addr.sa_family == pj_AF_INET6()) {
+    return bytes[0] == 0xfe && (bytes[1] & 0xc0) == 0x80;
+  }
+
+  return PJ_FALSE;
+}
+
+static pj_bool_t same_address(const pj_sockaddr *a, const pj_sockaddr *b)
+{
+  return a->addr.sa_family == b->addr.sa_family &&
+         pj_memcmp(pj_sockaddr_get_addr(a), pj_sockaddr_get_addr(b), pj_sockaddr_get_addr_len(a)) == 0;
+}
+
+static pj_bool_t same_interface(const char *a, const char *b)
+{
+  return a != NULL && b != NULL && pj_ansi_strcmp(a, b) == 0;
+}
+
+// Must be called with the lock held
+static interface_record *find_interface(const char *ifname, pj_bool_t create)
+{
+  for (unsigned i = 0; i < rank.interface_cnt; i++) {
+    if (pj_ansi_strcmp(rank.interfaces[i].name, ifname) == 0) {
+      return &rank.interfaces[i];
+    }
+  }
+
+  if (!create || rank.interface_cnt == HOST_RANK_MAX_INTERFACES) {
+    return NULL;
+  }
+
+  interface_record *record = &rank.interfaces[rank.interface_cnt++];
+  pj_ansi_strncpy(record->name, ifname, sizeof(record->name) - 1);
+  record->name[sizeof(record->name) - 1] = '\0';
+  record->successes = 0;
+  return record;
+}
+
+static int success_score(const char *ifname)
+{
+  int score = 0;
+
+  if (!rank.initialized || ifname == NULL) {
+    return 0;
+  }
+
+  pj_mutex_lock(rank.mutex);
+  interface_record *record = find_interface(ifname, PJ_FALSE);
+  if (record != NULL) {
+    score = (int) PJ_MIN(record->successes, HOST_RANK_MAX_SUCCESSES) * HOST_RANK_PER_SUCCESS;
+  }
+  pj_mutex_unlock(rank.mutex);
+
+  return score;
+}
+
+// Stable, so addresses with equal scores keep the order the operating system reported them in
+static void sort_ranked(ranked_addr *ranked, unsigned count)
+{
+  for (unsigned i = 1; i < count; i++) {
+    ranked_addr current = ranked[i];
+    unsigned j = i;
+
+    while (j > 0 && (ranked[j - 1].spread > current.spread ||
+                     (ranked[j - 1].spread == current.spread && ranked[j - 1].score < current.score))) {
+      ranked[j] = ranked[j - 1];
+      j--;
+    }
+
+    ranked[j] = current;
+  }
+}
+
+void pj_ice_host_rank_apply(int af,
+                            pj_sockaddr addrs[],
+                            const char *ifnames[],
+                            unsigned *count,
+                            unsigned max_cnt,
+                            const pj_sockaddr *default_addr)
+{
+  ranked_addr ranked[HOST_RANK_MAX_ADDRS];
+  unsigned ranked_cnt = 0;
+  unsigned found = PJ_MIN(*count, HOST_RANK_MAX_ADDRS);
+
+  for (unsigned i = 0; i < found; i++) {
+    int score = interface_score(ifnames[i]);
+    if (score == HOST_RANK_EXCLUDED || is_link_local(&addrs[i])) {
+      continue;
+    }
+
+    if (default_addr != NULL && same_address(&addrs[i], default_addr)) {
+      score += HOST_RANK_DEFAULT_ROUTE;
+    }
+
+    ranked[ranked_cnt].addr = addrs[i];
+    ranked[ranked_cnt].ifname = ifnames[i];
+    ranked[ranked_cnt].score = score + success_score(ifnames[i]);
+    ranked[ranked_cnt].spread = 0;
+    ranked_cnt++;
+  }
+
+  // Rank by score first, then let every interface contribute its best address before any contributes another
+  sort_ranked(ranked, ranked_cnt);
+  for (unsigned i = 0; i < ranked_cnt; i++) {
+    for (unsigned j = 0; j < i; j++) {
+      if (same_interface(ranked[i].ifname, ranked[j].ifname)) {
+        ranked[i].spread++;
+      }
+    }
+  }
+  sort_ranked(ranked, ranked_cnt);
+
+  *count = PJ_MIN(ranked_cnt, max_cnt);
+  for (unsigned i = 0; i < *count; i++) {
+    addrs[i] = ranked[i].addr;
+    ifnames[i] = ranked[i].ifname;
+
+    char addr_buf[PJ_INET6_ADDRSTRLEN];
+    PJ_LOG(5, (THIS_FILE, "Host candidate %d: %s (%s, score %d)", i,
+               pj_sockaddr_print(&ranked[i].addr, addr_buf, sizeof(addr_buf), 0),
+               ranked[i].ifname ? ranked[i].ifname : "unknown", ranked[i].score));
+  }
+
+  if (rank.initialized) {
+    pj_mutex_lock(rank.mutex);
+    rank.stat.rankings++;
+    rank.stat.addresses += found;
+    rank.stat.candidates += *count;
+    pj_mutex_unlock(rank.mutex);
+  }
+
+  PJ_UNUSED_ARG(af);
+}
+
+// Fills in the interface name of each address. Names point into the names buffer.
+static void lookup_interfaces(const pj_sockaddr addrs[], unsigned count, char names[][IFNAMSIZ], const char *ifnames[])
+{
+  struct ifaddrs *interfaces;
+
+  for (unsigned i = 0; i < count; i++) {
+    ifnames[i] = NULL;
+  }
+
+  if (getifaddrs(&interfaces) != 0) {
+    return;
+  }
+
+  for (struct ifaddrs *ifa = interfaces; ifa != NULL; ifa = ifa->ifa_next) {
+    if (ifa->ifa_addr == NULL) {
+      continue;
+    }
+
+    const void *ifa_addr;
+    unsigned ifa_addr_len;
+    if (ifa->ifa_addr->sa_family == AF_INET) {
+      ifa_addr = &((struct sockaddr_in *) ifa->ifa_addr)->sin_addr;
+      ifa_addr_len = sizeof(struct in_addr);
+    } else if (ifa->ifa_addr->sa_family == AF_INET6) {
+      ifa_addr = &((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr;
+      ifa_addr_len = sizeof(struct in6_addr);
+    } else {
+      continue;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+      if (ifnames[i] == NULL &&
+          pj_sockaddr_get_addr_len(&addrs[i]) == ifa_addr_len &&
+          pj_memcmp(pj_sockaddr_get_addr(&addrs[i]), ifa_addr, ifa_addr_len) == 0) {
+        pj_ansi_strncpy(names[i], ifa->ifa_name, IFNAMSIZ - 1);
+        names[i][IFNAMSIZ - 1] = '\0';
+        ifnames[i] = names[i];
+      }
+    }
+  }
+
+  freeifaddrs(interfaces);
+}
+
+static void on_host_filter(int af, pj_sockaddr addrs[], unsigned *count, unsigned max_cnt)
+{
+  char names[HOST_RANK_MAX_ADDRS][IFNAMSIZ];
+  const char *ifnames[HOST_RANK_MAX_ADDRS];
+  unsigned found = PJ_MIN(*count, HOST_RANK_MAX_ADDRS);
+  pj_sockaddr default_addr;
+
+  lookup_interfaces(addrs, found, names, ifnames);
+
+  // This doesn't send anything, it only asks the routing table which address would be used
+  pj_bool_t has_default = pj_getdefaultipinterface(af, &default_addr) == PJ_SUCCESS;
+
+  *count = found;
+  pj_ice_host_rank_apply(af, addrs, ifnames, count, max_cnt, has_default ? &default_addr : NULL);
+}
+
+pj_status_t pj_ice_host_rank_init(pj_pool_factory *pf)
+{
+  pj_status_t status;
+
+  pj_ice_host_rank_shutdown();
+  pj_bzero(&rank, sizeof(rank));
+
+  rank.pool = pj_pool_create(pf, "hostrank", 256, 256, NULL);
+  if (rank.pool == NULL) {
+    return PJ_ENOMEM;
+  }
+
+  status = pj_mutex_create_simple(rank.pool, "hostrank", &rank.mutex);
+  if (status != PJ_SUCCESS) {
+    pj_pool_release(rank.pool);
+    return status;
+  }
+
+  rank.initialized = PJ_TRUE;
+  pj_ice_strans_set_host_filter(&on_host_filter);
+
+  return PJ_SUCCESS;
+}
+
+void pj_ice_host_rank_shutdown(void)
+{
+  if (!rank.initialized) {
+    return;
+  }
+
+  pj_ice_strans_set_host_filter(NULL);
+  rank.initialized = PJ_FALSE;
+
+  pj_mutex_destroy(rank.mutex);
+  pj_pool_release(rank.pool);
+}
+
+void pj_ice_host_rank_learn(pjsua_call_id call_id)
+{
+  pjsua_call_info call_info;
+
+  if (!rank.initialized || pjsua_call_get_info(call_id, &call_info) != PJ_SUCCESS) {
+    return;
+  }
+
+  for (unsigned i = 0; i < call_info.media_cnt; i++) {
+    if (call_info.media[i].type != PJMEDIA_TYPE_AUDIO || call_info.media[i].status != PJSUA_CALL_MEDIA_ACTIVE) {
+      continue;
+    }
+
+    pjmedia_transport_info tp_info;
+    pjmedia_transport_info_init(&tp_info);
+    if (pjsua_call_get_med_transport_info(call_id, i, &tp_info) != PJ_SUCCESS) {
+      continue;
+    }
+
+    for (unsigned j = 0; j < tp_info.specific_info_cnt; j++) {
+      if (tp_info.spc_info[j].type != PJMEDIA_TRANSPORT_TYPE_ICE) {
+        continue;
+      }
+
+      const pjmedia_ice_transport_info *ice_info = (const pjmedia_ice_transport_info *) tp_info.spc_info[j].buffer;
+      if (ice_info->sess_state != PJ_ICE_STRANS_STATE_RUNNING || ice_info->comp_cnt == 0) {
+        continue;
+      }
+
+      // Only host candidates carry an interface address. Everything else was gathered through the default route.
+      pj_sockaddr local_addr = ice_info->comp[0].lcand_addr;
+      if (ice_info->comp[0].lcand_type != PJ_ICE_CAND_TYPE_HOST &&
+          pj_getdefaultipinterface(local_addr.addr.sa_family, &local_addr) != PJ_SUCCESS) {
+        continue;
+      }
+
+      char name[1][IFNAMSIZ];
+      const char *ifname[1];
+      lookup_interfaces(&local_addr, 1, name, ifname);
+      if (ifname[0] == NULL) {
+        continue;
+      }
+
+      pj_mutex_lock(rank.mutex);
+      interface_record *record = find_interface(ifname[0], PJ_TRUE);
+      if (record != NULL) {
+        record->successes++;
+      }
+      rank.stat.successes++;
+      pj_mutex_unlock(rank.mutex);
+    }
+  }
+}
+
+void pj_ice_host_rank_count_suppressed(void)
+{
+  if (!rank.initialized) {
+    return;
+  }
+
+  pj_mutex_lock(rank.mutex);
+  rank.stat.suppressed++;
+  pj_mutex_unlock(rank.mutex);
+}
+
+void pj_ice_host_rank_get_stat(pj_ice_host_rank_stat *stat)
+{
+  if (!rank.initialized) {
+    pj_bzero(stat, sizeof(*stat));
+    return;
+  }
+
+  pj_mutex_lock(rank.mutex);
+  *stat = rank.stat;
+  pj_mutex_unlock(rank.mutex);
+}
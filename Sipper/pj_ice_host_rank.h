@@ -0,0 +1,75 @@
+//
+//  pj_ice_host_rank.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/18/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_ice_host_rank_h
+#define pj_ice_host_rank_h
+
+#import <pjsua.h>
+
+/**
+ * Counters for host candidate ranking */
+typedef struct pj_ice_host_rank_stat {
+  /** Times host addresses were ranked, once per address family of every ICE transport */
+  unsigned rankings;
+  /** Local addresses found while gathering */
+  unsigned addresses;
+  /** Addresses that became host candidates */
+  unsigned candidates;
+  /** Synthesized NAT64 candidates that were left out because they were redundant or unroutable */
+  unsigned suppressed;
+  /** ICE sessions that completed, and were credited to the interface they used */
+  unsigned successes;
+} pj_ice_host_rank_stat;
+
+/*
+ * Start ranking host candidates for every ICE transport created from now on. Each address family keeps at most
+ * the transport's max_host_cands addresses, preferring the interface of the default route, then interfaces by
+ * type (Wi-Fi/Ethernet over cellular over VPN), then interfaces that ICE succeeded on before. Each interface
+ * contributes one address before any interface contributes a second one, and link-local addresses and
+ * peer-to-peer interfaces are never used.
+ * @param pf  Pool factory for the module's lock.
+ */
+pj_status_t pj_ice_host_rank_init(pj_pool_factory *pf);
+
+/*
+ * Stop ranking host candidates
+ */
+void pj_ice_host_rank_shutdown(void);
+
+/*
+ * Rank and trim addresses. This is what ICE transports are filtered with, and is exposed for testing.
+ * @param af            The address family of the addresses.
+ * @param addrs         The addresses, reordered and trimmed in place.
+ * @param ifnames       The name of the interface of each address (NULL if unknown), reordered along with them.
+ * @param count         On input, the number of addresses. On output, the number kept.
+ * @param max_cnt       The maximum number of addresses to keep.
+ * @param default_addr  The local address of the default route, or NULL if there isn't one.
+ */
+void pj_ice_host_rank_apply(int af,
+                            pj_sockaddr addrs[],
+                            const char *ifnames[],
+                            unsigned *count,
+                            unsigned max_cnt,
+                            const pj_sockaddr *default_addr);
+
+/*
+ * Credit the interface that a call's completed ICE session is using, so it ranks higher next time
+ */
+void pj_ice_host_rank_learn(pjsua_call_id call_id);
+
+/*
+ * Count a synthesized candidate that was left out of an SDP
+ */
+void pj_ice_host_rank_count_suppressed(void);
+
+/*
+ * Get a snapshot of the ranking counters
+ */
+void pj_ice_host_rank_get_stat(pj_ice_host_rank_stat *stat);
+
+#endif /* pj_ice_host_rank_h */
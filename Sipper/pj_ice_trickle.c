@@ -0,0 +1,196 @@
+//
+//  pj_ice_trickle.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/18/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_ice_trickle.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <pjsua.h>
+#include <pjnath.h>
+
+#define THIS_FILE "pj_ice_trickle.c"
+
+/* Longest foundation accepted from the remote, which is far more than anyone sends */
+#define TRICKLE_MAX_FOUNDATION  32
+
+static int print_line(char *buf, pj_size_t size, int len, const char *format, ...)
+{
+  if (len < 0 || (pj_size_t) len >= size) {
+    return -1;
+  }
+
+  va_list args;
+  va_start(args, format);
+  int printed = pj_ansi_vsnprintf(buf + len, size - len, format, args);
+  va_end(args);
+
+  if (printed < 0 || (pj_size_t) printed >= size - len) {
+    return -1;
+  }
+
+  return len + printed;
+}
+
+int pj_ice_trickle_print_sdpfrag(const pj_str_t *ufrag,
+                                 const pj_str_t *pwd,
+                                 const pj_ice_sess_cand cands[],
+                                 unsigned count,
+                                 pj_bool_t end_of_cands,
+                                 char *buf,
+                                 pj_size_t size)
+{
+  int len = 0;
+
+  // The m= line only ties the candidates to the first media stream, its port and format are placeholders
+  len = print_line(buf, size, len, "a=ice-ufrag:%.*s\r\n", (int) ufrag->slen, ufrag->ptr);
+  len = print_line(buf, size, len, "a=ice-pwd:%.*s\r\n", (int) pwd->slen, pwd->ptr);
+  len = print_line(buf, size, len, "m=audio 9 RTP/AVP 0\r\n");
+
+  for (unsigned i = 0; i < count; i++) {
+    const pj_ice_sess_cand *cand = &cands[i];
+    if (cand->type == PJ_ICE_CAND_TYPE_HOST) {
+      continue;
+    }
+
+    char addr[PJ_INET6_ADDRSTRLEN];
+    char rel_addr[PJ_INET6_ADDRSTRLEN];
+    pj_sockaddr_print(&cand->addr, addr, sizeof(addr), 0);
+    pj_sockaddr_print(&cand->rel_addr, rel_addr, sizeof(rel_addr), 0);
+
+    len = print_line(buf, size, len, "a=candidate:%.*s %u UDP %u %s %u typ %s raddr %s rport %u\r\n",
+                     (int) cand->foundation.slen, cand->foundation.ptr,
+                     cand->comp_id,
+                     cand->prio,
+                     addr,
+                     pj_sockaddr_get_port(&cand->addr),
+                     pj_ice_get_cand_type_name(cand->type),
+                     rel_addr,
+                     pj_sockaddr_get_port(&cand->rel_addr));
+  }
+
+  if (end_of_cands) {
+    len = print_line(buf, size, len, "a=end-of-candidates\r\n");
+  }
+
+  return len;
+}
+
+static pj_bool_t parse_addr(const char *host, unsigned port, pj_sockaddr *addr)
+{
+  pj_str_t str = pj_str((char *) host);
+  int af = pj_ansi_strchr(host, ':') != NULL ? pj_AF_INET6() : pj_AF_INET();
+
+  // Don't let pj_sockaddr_init() fall back to resolving names, which would block the SIP thread
+  pj_uint8_t scratch[sizeof(pj_in6_addr)];
+  if (pj_inet_pton(af, &str, scratch) != PJ_SUCCESS) {
+    return PJ_FALSE;
+  }
+
+  return pj_sockaddr_init(af, addr, &str, (pj_uint16_t) port) == PJ_SUCCESS;
+}
+
+pj_bool_t pj_ice_trickle_parse_candidate(pj_pool_t *pool, const char *line, pj_ice_sess_cand *cand)
+{
+  char foundation[TRICKLE_MAX_FOUNDATION + 1];
+  char transport[8];
+  char addr[PJ_INET6_ADDRSTRLEN];
+  char type[8];
+  char rel_addr[PJ_INET6_ADDRSTRLEN];
+  unsigned comp_id, prio, port, rel_port;
+
+  int fields = sscanf(line, "%32s %u %7s %u %45s %u typ %7s raddr %45s rport %u",
+                      foundation, &comp_id, transport, &prio, addr, &port, type, rel_addr, &rel_port);
+  if (fields < 7 || pj_ansi_stricmp(transport, "UDP") != 0 || comp_id == 0 || port > 65535) {
+    return PJ_FALSE;
+  }
+
+  pj_bzero(cand, sizeof(*cand));
+  if (pj_ansi_strcmp(type, "host") == 0) {
+    cand->type = PJ_ICE_CAND_TYPE_HOST;
+  } else if (pj_ansi_strcmp(type, "srflx") == 0) {
+    cand->type = PJ_ICE_CAND_TYPE_SRFLX;
+  } else if (pj_ansi_strcmp(type, "prflx") == 0) {
+    cand->type = PJ_ICE_CAND_TYPE_PRFLX;
+  } else if (pj_ansi_strcmp(type, "relay") == 0) {
+    cand->type = PJ_ICE_CAND_TYPE_RELAYED;
+  } else {
+    return PJ_FALSE;
+  }
+
+  if (!parse_addr(addr, port, &cand->addr)) {
+    return PJ_FALSE;
+  }
+
+  if (fields == 9 && rel_port <= 65535) {
+    parse_addr(rel_addr, rel_port, &cand->rel_addr);
+  }
+
+  cand->comp_id = (pj_uint8_t) comp_id;
+  cand->prio = prio;
+  cand->status = PJ_SUCCESS;
+  pj_strdup2(pool, &cand->foundation, foundation);
+  pj_sockaddr_cp(&cand->base_addr, &cand->addr);
+
+  return PJ_TRUE;
+}
+
+pj_status_t pj_ice_trickle_parse_sdpfrag(pj_pool_t *pool,
+                                         const pj_str_t *body,
+                                         pj_str_t *ufrag,
+                                         pj_ice_sess_cand cands[],
+                                         unsigned *count,
+                                         pj_bool_t *end_of_cands)
+{
+  unsigned max_cnt = *count;
+  pj_bool_t fragment = PJ_FALSE;
+  pj_ssize_t pos = 0;
+
+  *count = 0;
+  *end_of_cands = PJ_FALSE;
+  ufrag->ptr = NULL;
+  ufrag->slen = 0;
+
+  while (pos < body->slen) {
+    pj_ssize_t end = pos;
+    while (end < body->slen && body->ptr[end] != '\r' && body->ptr[end] != '\n') {
+      end++;
+    }
+
+    // Copy the line so it can be scanned as a C string
+    pj_str_t raw = { body->ptr + pos, end - pos };
+    char line[256];
+    pj_ssize_t len = PJ_MIN(raw.slen, (pj_ssize_t) sizeof(line) - 1);
+    pj_memcpy(line, raw.ptr, len);
+    line[len] = '\0';
+
+    if (len >= 2 && line[1] == '=') {
+      fragment = PJ_TRUE;
+    }
+
+    if (pj_ansi_strncmp(line, "a=candidate:", 12) == 0) {
+      if (*count < max_cnt && pj_ice_trickle_parse_candidate(pool, line + 12, &cands[*count])) {
+        (*count)++;
+      } else {
+        PJ_LOG(5, (THIS_FILE, "Ignored trickled candidate: %s", line));
+      }
+    } else if (pj_ansi_strncmp(line, "a=ice-ufrag:", 12) == 0) {
+      pj_strdup2(pool, ufrag, line + 12);
+    } else if (pj_ansi_strcmp(line, "a=end-of-candidates") == 0) {
+      *end_of_cands = PJ_TRUE;
+    }
+
+    // Skip past the line ending, whether it's CRLF or a bare LF
+    pos = end;
+    while (pos < body->slen && (body->ptr[pos] == '\r' || body->ptr[pos] == '\n')) {
+      pos++;
+    }
+  }
+
+  return fragment ? PJ_SUCCESS : PJMEDIA_SDP_EINSDP;
+}
@@ -0,0 +1,66 @@
+//
+//  pj_ice_trickle.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/18/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_ice_trickle_h
+#define pj_ice_trickle_h
+
+#import <pjsua.h>
+
+/* The Info-Package and content type that trickled candidates are sent in over SIP INFO (RFC 8840) */
+#define PJ_ICE_TRICKLE_PACKAGE       "trickle-ice"
+#define PJ_ICE_TRICKLE_CONTENT_TYPE  "application"
+#define PJ_ICE_TRICKLE_CONTENT_SUB   "trickle-ice-sdpfrag"
+
+/*
+ * Print an application/trickle-ice-sdpfrag body for a single audio stream.
+ * @param ufrag         The local ICE username fragment.
+ * @param pwd           The local ICE password.
+ * @param cands         The candidates to send. Host candidates are left out, since they're always in the offer
+ *                      or answer.
+ * @param count         The number of candidates.
+ * @param end_of_cands  Whether gathering is done, and a=end-of-candidates should be included.
+ * @param buf           The buffer to print into.
+ * @param size          The size of the buffer.
+ * @return              The length of the body, or -1 if it didn't fit.
+ */
+int pj_ice_trickle_print_sdpfrag(const pj_str_t *ufrag,
+                                 const pj_str_t *pwd,
+                                 const pj_ice_sess_cand cands[],
+                                 unsigned count,
+                                 pj_bool_t end_of_cands,
+                                 char *buf,
+                                 pj_size_t size);
+
+/*
+ * Parse the candidates out of an application/trickle-ice-sdpfrag body. Candidates that aren't UDP, or whose
+ * address isn't an IP literal (like mDNS names), are skipped.
+ * @param pool          Pool for the candidate foundations and the username fragment.
+ * @param body          The body.
+ * @param ufrag         The remote ICE username fragment, or an empty string if the body didn't have one.
+ * @param cands         The parsed candidates.
+ * @param count         On input, the size of the candidate array. On output, the number of candidates parsed.
+ * @param end_of_cands  Whether the body had a=end-of-candidates.
+ * @return              PJ_SUCCESS, or PJMEDIA_SDP_EINSDP if the body wasn't an SDP fragment.
+ */
+pj_status_t pj_ice_trickle_parse_sdpfrag(pj_pool_t *pool,
+                                         const pj_str_t *body,
+                                         pj_str_t *ufrag,
+                                         pj_ice_sess_cand cands[],
+                                         unsigned *count,
+                                         pj_bool_t *end_of_cands);
+
+/*
+ * Parse the value of an a=candidate attribute, with the same rules as pj_ice_trickle_parse_sdpfrag().
+ * @param pool          Pool for the candidate foundation.
+ * @param value         The attribute value, without the "candidate:" prefix, as a C string.
+ * @param cand          The parsed candidate.
+ * @return              PJ_TRUE if the candidate could be used.
+ */
+pj_bool_t pj_ice_trickle_parse_candidate(pj_pool_t *pool, const char *value, pj_ice_sess_cand *cand);
+
+#endif /* pj_ice_trickle_h */
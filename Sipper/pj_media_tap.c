@@ -0,0 +1,231 @@
+//
+//  pj_media_tap.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_media_tap.h"
+
+#include <pjsua.h>
+#include <stdlib.h>
+
+#define THIS_FILE "pj_media_tap.c"
+
+/*
+ * The producer and the consumer only ever share the ring's two indexes. Each one writes its own index with release
+ * ordering and reads the other's with acquire ordering, so a slot's contents are visible before the index that hands
+ * it over. The counters are only ever written by the producer, and are read by anyone without ordering.
+ */
+#define TAP_LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define TAP_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define TAP_LOAD_RELAXED(p)     __atomic_load_n((p), __ATOMIC_RELAXED)
+#define TAP_STORE_RELAXED(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+/* Keeps the producer's and the consumer's halves of a ring off each other's cache lines */
+#define TAP_CACHE_LINE  64
+
+typedef struct tap_slot {
+  pj_int16_t *samples;
+  unsigned sample_count;
+  pj_bool_t silent;
+  pj_uint64_t seq;
+  pj_timestamp timestamp;
+} tap_slot;
+
+typedef struct tap_port {
+  pjmedia_port base;
+  tap_slot *slots;
+  unsigned size;
+  unsigned samples_per_frame;
+
+  /* Written only by the producer */
+  char producer_pad[TAP_CACHE_LINE];
+  pj_uint32_t head;
+  pj_uint64_t seq;
+  pj_uint64_t frames;
+  pj_uint64_t overflows;
+  unsigned max_depth;
+
+  /* Written only by the consumer */
+  char consumer_pad[TAP_CACHE_LINE];
+  pj_uint32_t tail;
+  char end_pad[TAP_CACHE_LINE];
+} tap_port;
+
+struct pj_media_tap {
+  tap_port *ports[PJ_MEDIA_TAP_DIR_COUNT];
+};
+
+static pj_status_t tap_put_frame(pjmedia_port *this_port, pjmedia_frame *frame)
+{
+  tap_port *port = (tap_port *) this_port;
+  pj_uint32_t head = port->head;
+  pj_uint32_t tail = TAP_LOAD_ACQUIRE(&port->tail);
+  pj_uint64_t seq = port->seq++;
+
+  // The consumer hasn't kept up, and the frame is dropped rather than waiting on it
+  if (head - tail == port->size) {
+    TAP_STORE_RELAXED(&port->overflows, port->overflows + 1);
+    return PJ_SUCCESS;
+  }
+
+  tap_slot *slot = &port->slots[head & (port->size - 1)];
+  unsigned count = frame->type == PJMEDIA_FRAME_TYPE_AUDIO ? (unsigned) (frame->size / sizeof(pj_int16_t)) : 0;
+
+  // A frame the bridge had nothing for still takes its time, as silence, so the consumer's timeline has no holes
+  if (count == 0) {
+    pjmedia_zero_samples(slot->samples, port->samples_per_frame);
+    slot->sample_count = port->samples_per_frame;
+    slot->silent = PJ_TRUE;
+  } else {
+    slot->sample_count = PJ_MIN(count, port->samples_per_frame);
+    pjmedia_copy_samples(slot->samples, (const pj_int16_t *) frame->buf, slot->sample_count);
+    slot->silent = PJ_FALSE;
+  }
+
+  slot->seq = seq;
+  slot->timestamp = frame->timestamp;
+  TAP_STORE_RELEASE(&port->head, head + 1);
+
+  TAP_STORE_RELAXED(&port->frames, port->frames + 1);
+  unsigned depth = head + 1 - tail;
+  if (depth > port->max_depth) {
+    TAP_STORE_RELAXED(&port->max_depth, depth);
+  }
+
+  return PJ_SUCCESS;
+}
+
+static pj_status_t tap_get_frame(pjmedia_port *this_port, pjmedia_frame *frame)
+{
+  // Taps only listen, so the bridge has nothing to mix from them
+  frame->type = PJMEDIA_FRAME_TYPE_NONE;
+  frame->size = 0;
+  return PJ_SUCCESS;
+}
+
+static void destroy_port(tap_port *port)
+{
+  if (port == NULL) {
+    return;
+  }
+
+  if (port->slots != NULL) {
+    free(port->slots[0].samples);
+  }
+  free(port->slots);
+  free(port);
+}
+
+static tap_port *create_port(const char *name,
+                             unsigned clock_rate,
+                             unsigned channel_count,
+                             unsigned samples_per_frame,
+                             unsigned ring_size)
+{
+  tap_port *port = (tap_port *) calloc(1, sizeof(tap_port));
+  if (port == NULL) {
+    return NULL;
+  }
+  port->size = ring_size;
+  port->samples_per_frame = samples_per_frame;
+
+  // Every slot's samples are allocated up front, back to back
+  port->slots = (tap_slot *) calloc(ring_size, sizeof(tap_slot));
+  pj_int16_t *samples = (pj_int16_t *) calloc((size_t) ring_size * samples_per_frame, sizeof(pj_int16_t));
+  if (port->slots == NULL || samples == NULL) {
+    free(samples);
+    free(port->slots);
+    free(port);
+    return NULL;
+  }
+
+  for (unsigned i = 0; i < ring_size; i++) {
+    port->slots[i].samples = samples + i * samples_per_frame;
+  }
+
+  pj_str_t port_name = pj_str((char *) name);
+  pjmedia_port_info_init(&port->base.info, &port_name, PJMEDIA_SIG_CLASS_PORT_AUD('M', 'T'), clock_rate,
+                         channel_count, 16, samples_per_frame);
+  port->base.put_frame = &tap_put_frame;
+  port->base.get_frame = &tap_get_frame;
+
+  return port;
+}
+
+pj_status_t pj_media_tap_create(unsigned clock_rate,
+                                unsigned channel_count,
+                                unsigned samples_per_frame,
+                                unsigned ring_size,
+                                pj_media_tap **p_tap)
+{
+  PJ_ASSERT_RETURN(clock_rate && channel_count && samples_per_frame && p_tap, PJ_EINVAL);
+  PJ_ASSERT_RETURN(ring_size > 0 && (ring_size & (ring_size - 1)) == 0, PJ_EINVAL);
+
+  pj_media_tap *tap = (pj_media_tap *) calloc(1, sizeof(pj_media_tap));
+  if (tap == NULL) {
+    return PJ_ENOMEM;
+  }
+
+  tap->ports[PJ_MEDIA_TAP_UPLINK] = create_port("tap-up", clock_rate, channel_count, samples_per_frame, ring_size);
+  tap->ports[PJ_MEDIA_TAP_DOWNLINK] = create_port("tap-down", clock_rate, channel_count, samples_per_frame, ring_size);
+  if (tap->ports[PJ_MEDIA_TAP_UPLINK] == NULL || tap->ports[PJ_MEDIA_TAP_DOWNLINK] == NULL) {
+    pj_media_tap_destroy(tap);
+    return PJ_ENOMEM;
+  }
+
+  *p_tap = tap;
+  return PJ_SUCCESS;
+}
+
+void pj_media_tap_destroy(pj_media_tap *tap)
+{
+  for (int dir = 0; dir < PJ_MEDIA_TAP_DIR_COUNT; dir++) {
+    destroy_port(tap->ports[dir]);
+  }
+  free(tap);
+}
+
+pjmedia_port *pj_media_tap_get_port(pj_media_tap *tap, pj_media_tap_dir dir)
+{
+  return &tap->ports[dir]->base;
+}
+
+pj_bool_t pj_media_tap_peek(pj_media_tap *tap, pj_media_tap_dir dir, pj_media_tap_frame *frame)
+{
+  tap_port *port = tap->ports[dir];
+  pj_uint32_t tail = port->tail;
+
+  if (TAP_LOAD_ACQUIRE(&port->head) == tail) {
+    return PJ_FALSE;
+  }
+
+  const tap_slot *slot = &port->slots[tail & (port->size - 1)];
+  frame->samples = slot->samples;
+  frame->sample_count = slot->sample_count;
+  frame->silent = slot->silent;
+  frame->seq = slot->seq;
+  frame->timestamp = slot->timestamp;
+  return PJ_TRUE;
+}
+
+void pj_media_tap_release(pj_media_tap *tap, pj_media_tap_dir dir)
+{
+  tap_port *port = tap->ports[dir];
+  TAP_STORE_RELEASE(&port->tail, port->tail + 1);
+}
+
+void pj_media_tap_get_stat(pj_media_tap *tap, pj_media_tap_dir dir, pj_media_tap_stat *stat)
+{
+  tap_port *port = tap->ports[dir];
+
+  stat->frames = TAP_LOAD_RELAXED(&port->frames);
+  stat->overflows = TAP_LOAD_RELAXED(&port->overflows);
+
+  // The tail is read first, since it can't pass the head however long the read takes
+  pj_uint32_t tail = TAP_LOAD_ACQUIRE(&port->tail);
+  stat->depth = (unsigned) (TAP_LOAD_ACQUIRE(&port->head) - tail);
+  stat->max_depth = TAP_LOAD_RELAXED(&port->max_depth);
+}
@@ -0,0 +1,104 @@
+//
+//  pj_media_tap.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_media_tap_h
+#define pj_media_tap_h
+
+#import <pjsua.h>
+
+/*
+ * The two sides of a call a tap sees: what's sent to the remote, and what's received from it
+ */
+typedef enum pj_media_tap_dir {
+  PJ_MEDIA_TAP_UPLINK,
+  PJ_MEDIA_TAP_DOWNLINK,
+  PJ_MEDIA_TAP_DIR_COUNT
+} pj_media_tap_dir;
+
+typedef struct pj_media_tap pj_media_tap;
+
+/*
+ * A frame waiting in a tap's ring. It points into the ring itself, and stays valid until it's released.
+ */
+typedef struct pj_media_tap_frame {
+  /** The frame's samples, interleaved when there's more than one channel */
+  const pj_int16_t *samples;
+  /** Number of samples, of all channels */
+  unsigned sample_count;
+  /** Whether the bridge had nothing for this frame, and it's silence */
+  pj_bool_t silent;
+  /** Counts every frame the bridge offered, so frames that were dropped show up as a gap */
+  pj_uint64_t seq;
+  /** The bridge's timestamp for the frame */
+  pj_timestamp timestamp;
+} pj_media_tap_frame;
+
+/*
+ * How one side of a tap has kept up
+ */
+typedef struct pj_media_tap_stat {
+  /** Number of frames put in the ring */
+  pj_uint64_t frames;
+  /** Number of frames dropped because the ring was full */
+  pj_uint64_t overflows;
+  /** Frames waiting in the ring now, and the most that ever have */
+  unsigned depth;
+  unsigned max_depth;
+} pj_media_tap_stat;
+
+/*
+ * Create a tap: a port for each direction, which is added to the conference bridge and connected from whatever it
+ * should hear. The bridge's thread is the only producer, and each port's put_frame copies the frame into the next
+ * free slot of the port's ring and publishes it, without locking or allocating. A full ring drops the frame and
+ * counts it, so a consumer that falls behind never holds up the bridge.
+ *
+ * A single consumer reads each ring in place, with pj_media_tap_peek() and pj_media_tap_release(). It doesn't need
+ * to be a PJLIB thread.
+ *
+ * The tap isn't allocated from a pool, so it doesn't depend on PJSUA's pool factory, and the consumer can finish
+ * with it and destroy it on its own time, even after PJSUA is gone.
+ * @param clock_rate         The bridge's sample rate.
+ * @param channel_count      The bridge's channels.
+ * @param samples_per_frame  The bridge's samples per frame, of all channels.
+ * @param ring_size          Frames each ring holds, which must be a power of two.
+ * @param p_tap              Set to the tap.
+ */
+pj_status_t pj_media_tap_create(unsigned clock_rate,
+                                unsigned channel_count,
+                                unsigned samples_per_frame,
+                                unsigned ring_size,
+                                pj_media_tap **p_tap);
+
+/*
+ * Destroy a tap, once both ports are off the bridge and the consumer is done with it
+ */
+void pj_media_tap_destroy(pj_media_tap *tap);
+
+/*
+ * The port that feeds one side of a tap
+ */
+pjmedia_port *pj_media_tap_get_port(pj_media_tap *tap, pj_media_tap_dir dir);
+
+/*
+ * Look at the oldest frame in one side's ring, without taking it out. Only the consumer may call this.
+ * @return  PJ_TRUE if there was a frame, or PJ_FALSE if the ring is empty.
+ */
+pj_bool_t pj_media_tap_peek(pj_media_tap *tap, pj_media_tap_dir dir, pj_media_tap_frame *frame);
+
+/*
+ * Hand the oldest frame in one side's ring back to the producer. Only the consumer may call this, and only after a
+ * successful peek.
+ */
+void pj_media_tap_release(pj_media_tap *tap, pj_media_tap_dir dir);
+
+/*
+ * Read one side's counters. This may be called from any thread, and each counter is read on its own.
+ */
+void pj_media_tap_get_stat(pj_media_tap *tap, pj_media_tap_dir dir, pj_media_tap_stat *stat);
+
+#endif /* pj_media_tap_h */
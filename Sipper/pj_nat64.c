@@ -7,6 +7,10 @@
 //
 
 #include "pj_nat64.h"
+#include "pj_call_trace.h"
+#include "pj_cb_latency.h"
+#include "pj_dns_cache.h"
+#include "pj_ice_host_rank.h"
 
 #include <pjsua.h>
 #include <pjnath.h>
@@ -41,7 +45,9 @@ static pj_bool_t resolve_or_synthesize_ipv4_to_ipv6(pj_str_t* host_or_ip, char*
 {
   unsigned int count = 1;
   pj_addrinfo ai[1];
-  pj_getaddrinfo(PJ_AF_UNSPEC, host_or_ip, &count, ai);
+  
+  // The same addresses show up in every SDP on a call, so go through the endpoint's DNS cache
+  pj_dns_cache_getaddrinfo(PJ_AF_UNSPEC, host_or_ip, &count, ai);
   
   if (count > 0) {
     if (ai[0].ai_addr.addr.sa_family == PJ_AF_INET) {
@@ -59,6 +65,26 @@ static pj_bool_t resolve_or_synthesize_ipv4_to_ipv6(pj_str_t* host_or_ip, char*
   return PJ_TRUE;
 }
 
+// Private, shared, link-local and loopback IPv4 addresses only mean something on the peer's own network, so an
+// address synthesized from one through the NAT64 prefix can't reach them
+static pj_bool_t is_unroutable_ipv4(const char *host)
+{
+  pj_in_addr addr;
+  pj_str_t host_str = pj_str((char *) host);
+  
+  if (pj_inet_aton(&host_str, &addr) == 0) {
+    return PJ_FALSE;
+  }
+  
+  pj_uint32_t value = pj_ntohl(addr.s_addr);
+  return (value >> 24) == 10 ||           // 10.0.0.0/8
+         (value >> 20) == 0xAC1 ||        // 172.16.0.0/12
+         (value >> 16) == 0xC0A8 ||       // 192.168.0.0/16
+         (value >> 22) == 0x191 ||        // 100.64.0.0/10
+         (value >> 16) == 0xA9FE ||       // 169.254.0.0/16
+         (value >> 24) == 127;            // 127.0.0.0/8
+}
+
 static pj_status_t synthesize_ipv6_default_address(pj_pool_t *pool, char *org_buffer, char *new_buffer)
 {
   PJ_USE_EXCEPTION;
@@ -215,12 +241,39 @@ static pj_status_t append_synthesized_ice_candidates(pj_pool_t *pool, pjmedia_sd
       }
     }
     
-    // Append synthesized records to the end as long as we have space
+    // Append synthesized records to the end as long as we have space. Every candidate adds a row to the check
+    // list, so leave out the ones that can't work, and the ones that would duplicate a record we already added
+    char synthesized[PJMEDIA_MAX_SDP_ATTR][PJ_INET6_ADDRSTRLEN + 16];
+    int synthesized_cnt = 0;
     for (int i = 0; i < candidates_cnt && media->attr_count < PJMEDIA_MAX_SDP_ATTR; i++) {
       struct ice_candidate candidate = candidates[i];
       pj_str_t host = pj_str(candidate.host);
       char resolved[PJ_INET6_ADDRSTRLEN];
+      
+      if (is_unroutable_ipv4(candidate.host)) {
+        PJ_LOG(5, (THIS_FILE, "Not synthesizing IPv6 ICE candidate for unroutable address %s", candidate.host));
+        pj_ice_host_rank_count_suppressed();
+        continue;
+      }
+      
       if (resolve_or_synthesize_ipv4_to_ipv6(&host, resolved, PJ_INET6_ADDRSTRLEN)) {
+        char transport_address[PJ_INET6_ADDRSTRLEN + 16];
+        pj_ansi_snprintf(transport_address, sizeof(transport_address), "%s %s %s %s", candidate.component,
+                         candidate.transport, resolved, candidate.port);
+        
+        pj_bool_t duplicate = PJ_FALSE;
+        for (int j = 0; j < synthesized_cnt && !duplicate; j++) {
+          duplicate = pj_ansi_stricmp(synthesized[j], transport_address) == 0;
+        }
+        
+        if (duplicate) {
+          PJ_LOG(5, (THIS_FILE, "Not appending duplicate synthesized IPv6 ICE candidate %s", transport_address));
+          pj_ice_host_rank_count_suppressed();
+          continue;
+        }
+        
+        pj_ansi_strcpy(synthesized[synthesized_cnt++], transport_address);
+        
         int adjusted_length = (int) candidate.length + (int) (strlen(resolved) - host.slen) + 1;
         char output[adjusted_length];
         pj_ansi_snprintf(output, adjusted_length, "%s %s %s %d %s %s %s", candidate.foundation, candidate.component,
@@ -247,6 +300,7 @@ pj_status_t append_ipv4_ice_candidate(pj_pool_t *pool, pjmedia_sdp_session *sess
     struct ice_candidate candidate;
     pjmedia_sdp_media *media = session->media[i];
     pj_bool_t candidate_found = PJ_FALSE;
+    pj_bool_t has_ipv4_candidate = PJ_FALSE;
     
     for (int j = 0; j < media->attr_count; j++) {
       pjmedia_sdp_attr *attr = media->attr[j];
@@ -266,6 +320,10 @@ pj_status_t append_ipv4_ice_candidate(pj_pool_t *pool, pjmedia_sdp_session *sess
           continue;
         }
         
+        if (!pj_ansi_strchr(host, ':')) {
+          has_ipv4_candidate = PJ_TRUE;
+        }
+        
         // Calculate the priority for the candidate
         int priority_val = atoi(priority);
         
@@ -284,6 +342,13 @@ pj_status_t append_ipv4_ice_candidate(pj_pool_t *pool, pjmedia_sdp_session *sess
       }
     }
     
+    // A dual-stack peer already has a real IPv4 candidate to pair with, so the fake one would only add checks
+    if (has_ipv4_candidate) {
+      PJ_LOG(5, (THIS_FILE, "Media already has an IPv4 candidate, not adding a fake one"));
+      pj_ice_host_rank_count_suppressed();
+      continue;
+    }
+    
     // Append synthesized records to the end as long as we have space
     if (media->attr_count < PJMEDIA_MAX_SDP_ATTR && candidate_found) {
       pj_str_t host = pj_str("169.254.169.254");
@@ -335,6 +400,7 @@ static pj_status_t ipv6_mod_on_rx(pjsip_rx_data *rdata)
   if (cseq != NULL && cseq->method.id == PJSIP_INVITE_METHOD && (transport_type & PJSIP_TRANSPORT_IPV6) == PJSIP_TRANSPORT_IPV6) {
     if (ctype && msg && msg->body && pj_stricmp(&ctype->media.type, &app_sdp.type) == 0 && pj_stricmp(&ctype->media.subtype, &app_sdp.subtype) == 0) {
       PJ_LOG(4, (THIS_FILE, "Received incoming response to INVITE via IPv6, synthesizing IPv6 addresses from IPv4 candidates in SDP"));
+      pj_uint64_t began = pj_cb_latency_now();
       PJ_LOG(5, (THIS_FILE, "Printing packet before mangling SDP: %.*s", rdata->msg_info.len, rdata->msg_info.msg_buf));
       char *buffer = rdata->msg_info.msg_buf;
       
@@ -393,6 +459,9 @@ static pj_status_t ipv6_mod_on_rx(pjsip_rx_data *rdata)
       rdata->pkt_info.len = strlen(rdata->pkt_info.packet);
       rdata->msg_info.len = (int)rdata->pkt_info.len;
       rdata->tp_info.transport->last_recv_len = rdata->pkt_info.len;
+      
+      pj_call_trace_span(pj_call_trace_find_message(rdata->msg_info.cid ? &rdata->msg_info.cid->id : NULL),
+                         "NAT64 rx rewrite", began, pj_cb_latency_now());
     }
   }
   
@@ -412,6 +481,7 @@ pj_status_t ipv6_mod_on_tx(pjsip_tx_data *tdata)
     // If this is an SDP...
     if (pjsip_media_type_cmp(&app_sdp, &media_type, 0) == 0) {
       PJ_LOG(3, (THIS_FILE, "Detected outgoing INVITE with SDP, adding fake IPv4 candidate to list"));
+      pj_uint64_t began = pj_cb_latency_now();
       pjmedia_sdp_session *sdp = (pjmedia_sdp_session *) msg->body->data;
       pjmedia_sdp_session *cloned = pjmedia_sdp_session_clone(tdata->pool, sdp);
 
@@ -430,6 +500,9 @@ pj_status_t ipv6_mod_on_tx(pjsip_tx_data *tdata)
         PJ_LOG(3, (THIS_FILE, "Error encountered while encoding SIP message in the TX data"));
         return PJ_SUCCESS;
       }
+      
+      pjsip_cid_hdr *cid = PJSIP_MSG_CID_HDR(msg);
+      pj_call_trace_span(pj_call_trace_find_message(cid ? &cid->id : NULL), "NAT64 tx rewrite", began, pj_cb_latency_now());
     }
   }
   
@@ -0,0 +1,281 @@
+//
+//  pj_rate_port.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_rate_port.h"
+
+#include <pjsua.h>
+
+#include "pj_cb_latency.h"
+
+#define THIS_FILE "pj_rate_port.c"
+
+static const unsigned rate_port_rates[] = PJ_RATE_PORT_RATES;
+
+#define RATE_PORT_RATE_COUNT  PJ_ARRAY_SIZE(rate_port_rates)
+
+/*
+ * The resamplers for one device rate: capture goes from the device to the attached port, and playback the other
+ * way. A rate that's the same as the attached port's has neither, and frames are passed as they are.
+ */
+typedef struct rate_pair {
+  unsigned clock_rate;
+  unsigned samples_per_frame;
+  pjmedia_resample *capture;
+  pjmedia_resample *playback;
+} rate_pair;
+
+typedef struct rate_port {
+  pjmedia_port base;
+  pjmedia_port *dn_port;
+  pj_lock_t *lock;
+
+  rate_pair pairs[RATE_PORT_RATE_COUNT + 1];
+  unsigned pair_count;
+  rate_pair *pair;
+
+  /* One frame of the attached port, in each direction */
+  pj_int16_t *capture_buf;
+  pj_int16_t *playback_buf;
+
+  /* When the last frame passed, and whether the rate changed since */
+  pj_uint64_t last_frame_at;
+  pj_bool_t switched;
+
+  pj_rate_port_stat stat;
+} rate_port;
+
+static rate_pair *find_pair(rate_port *port, unsigned clock_rate)
+{
+  for (unsigned i = 0; i < port->pair_count; i++) {
+    if (port->pairs[i].clock_rate == clock_rate) {
+      return &port->pairs[i];
+    }
+  }
+
+  return NULL;
+}
+
+/* Count a frame, and the gap before it if it's the first since a switch */
+static void record_frame(rate_port *port, pj_uint64_t started, pj_uint64_t converted)
+{
+  if (port->switched && port->last_frame_at != 0) {
+    pj_uint64_t gap = started - port->last_frame_at;
+    port->stat.last_gap_nsec = gap;
+    port->stat.max_gap_nsec = PJ_MAX(port->stat.max_gap_nsec, gap);
+  }
+
+  port->switched = PJ_FALSE;
+  port->last_frame_at = started;
+  port->stat.frames++;
+  port->stat.frame_nsec += converted;
+  port->stat.max_frame_nsec = PJ_MAX(port->stat.max_frame_nsec, converted);
+}
+
+static pj_status_t rate_port_put_frame(pjmedia_port *this_port, pjmedia_frame *frame)
+{
+  rate_port *port = (rate_port *) this_port;
+  pj_uint64_t started = pj_cb_latency_now();
+
+  pj_lock_acquire(port->lock);
+
+  rate_pair *pair = port->pair;
+  pjmedia_frame converted = *frame;
+
+  if (pair->capture != NULL && frame->type == PJMEDIA_FRAME_TYPE_AUDIO && frame->size > 0) {
+    pjmedia_resample_run(pair->capture, (const pj_int16_t *) frame->buf, port->capture_buf);
+    converted.buf = port->capture_buf;
+    converted.size = PJMEDIA_PIA_SPF(&port->dn_port->info) * sizeof(pj_int16_t);
+  }
+
+  record_frame(port, started, pj_cb_latency_now() - started);
+  pj_lock_release(port->lock);
+
+  return pjmedia_port_put_frame(port->dn_port, &converted);
+}
+
+static pj_status_t rate_port_get_frame(pjmedia_port *this_port, pjmedia_frame *frame)
+{
+  rate_port *port = (rate_port *) this_port;
+
+  // The attached port fills its own frame, which the device's is converted from
+  pjmedia_frame attached = *frame;
+  attached.buf = port->playback_buf;
+  attached.size = PJMEDIA_PIA_SPF(&port->dn_port->info) * sizeof(pj_int16_t);
+
+  pj_status_t status = pjmedia_port_get_frame(port->dn_port, &attached);
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  pj_uint64_t started = pj_cb_latency_now();
+  pj_lock_acquire(port->lock);
+
+  rate_pair *pair = port->pair;
+  frame->type = attached.type;
+  frame->timestamp = attached.timestamp;
+  frame->bit_info = attached.bit_info;
+
+  if (attached.type != PJMEDIA_FRAME_TYPE_AUDIO || attached.size == 0) {
+    frame->size = 0;
+  } else if (pair->playback != NULL) {
+    pjmedia_resample_run(pair->playback, port->playback_buf, (pj_int16_t *) frame->buf);
+    frame->size = pair->samples_per_frame * sizeof(pj_int16_t);
+  } else {
+    pjmedia_copy_samples((pj_int16_t *) frame->buf, port->playback_buf, pair->samples_per_frame);
+    frame->size = pair->samples_per_frame * sizeof(pj_int16_t);
+  }
+
+  record_frame(port, started, pj_cb_latency_now() - started);
+  pj_lock_release(port->lock);
+
+  return PJ_SUCCESS;
+}
+
+static pj_status_t rate_port_on_destroy(pjmedia_port *this_port)
+{
+  rate_port *port = (rate_port *) this_port;
+
+  for (unsigned i = 0; i < port->pair_count; i++) {
+    if (port->pairs[i].capture != NULL) {
+      pjmedia_resample_destroy(port->pairs[i].capture);
+    }
+    if (port->pairs[i].playback != NULL) {
+      pjmedia_resample_destroy(port->pairs[i].playback);
+    }
+  }
+
+  pj_lock_destroy(port->lock);
+  return PJ_SUCCESS;
+}
+
+static pj_status_t add_pair(rate_port *port,
+                            pj_pool_t *pool,
+                            unsigned clock_rate,
+                            pj_bool_t high_quality,
+                            pj_bool_t large_filter)
+{
+  const pjmedia_port_info *dn_info = &port->dn_port->info;
+  unsigned dn_rate = PJMEDIA_PIA_SRATE(dn_info);
+  unsigned dn_spf = PJMEDIA_PIA_SPF(dn_info);
+  unsigned channel_count = PJMEDIA_PIA_CCNT(dn_info);
+
+  if (find_pair(port, clock_rate) != NULL) {
+    return PJ_SUCCESS;
+  }
+
+  // The device's frames last as long as the attached port's
+  rate_pair *pair = &port->pairs[port->pair_count];
+  pair->clock_rate = clock_rate;
+  pair->samples_per_frame = (unsigned) ((pj_uint64_t) dn_spf * clock_rate / dn_rate);
+
+  if (clock_rate != dn_rate) {
+    pj_status_t status = pjmedia_resample_create(pool, high_quality, large_filter, channel_count, clock_rate, dn_rate,
+                                                 pair->samples_per_frame, &pair->capture);
+    if (status != PJ_SUCCESS) {
+      return status;
+    }
+
+    status = pjmedia_resample_create(pool, high_quality, large_filter, channel_count, dn_rate, clock_rate, dn_spf,
+                                     &pair->playback);
+    if (status != PJ_SUCCESS) {
+      pjmedia_resample_destroy(pair->capture);
+      return status;
+    }
+  }
+
+  port->pair_count++;
+  return PJ_SUCCESS;
+}
+
+pj_status_t pj_rate_port_create(pj_pool_t *pool,
+                                pjmedia_port *dn_port,
+                                unsigned clock_rate,
+                                pj_bool_t high_quality,
+                                pj_bool_t large_filter,
+                                pjmedia_port **p_port)
+{
+  PJ_ASSERT_RETURN(pool && dn_port && p_port, PJ_EINVAL);
+  PJ_ASSERT_RETURN(PJMEDIA_PIA_BITS(&dn_port->info) == 16, PJMEDIA_ENCBITS);
+
+  rate_port *port = PJ_POOL_ZALLOC_T(pool, rate_port);
+  port->dn_port = dn_port;
+
+  pj_status_t status = pj_lock_create_simple_mutex(pool, "ratelock", &port->lock);
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  // The attached port's own rate is always there, so a device at that rate passes frames straight through
+  status = add_pair(port, pool, PJMEDIA_PIA_SRATE(&dn_port->info), high_quality, large_filter);
+  for (unsigned i = 0; i < RATE_PORT_RATE_COUNT && status == PJ_SUCCESS; i++) {
+    status = add_pair(port, pool, rate_port_rates[i], high_quality, large_filter);
+  }
+
+  if (status != PJ_SUCCESS) {
+    rate_port_on_destroy(&port->base);
+    return status;
+  }
+
+  unsigned dn_spf = PJMEDIA_PIA_SPF(&dn_port->info);
+  port->capture_buf = (pj_int16_t *) pj_pool_zalloc(pool, dn_spf * sizeof(pj_int16_t));
+  port->playback_buf = (pj_int16_t *) pj_pool_zalloc(pool, dn_spf * sizeof(pj_int16_t));
+
+  port->pair = find_pair(port, clock_rate);
+  if (port->pair == NULL) {
+    rate_port_on_destroy(&port->base);
+    return PJ_EINVAL;
+  }
+
+  pj_str_t name = pj_str((char *) "rate");
+  pjmedia_port_info_init(&port->base.info, &name, PJMEDIA_SIG_CLASS_PORT_AUD('R', 'P'), clock_rate,
+                         PJMEDIA_PIA_CCNT(&dn_port->info), 16, port->pair->samples_per_frame);
+  port->base.put_frame = &rate_port_put_frame;
+  port->base.get_frame = &rate_port_get_frame;
+  port->base.on_destroy = &rate_port_on_destroy;
+
+  *p_port = &port->base;
+  return PJ_SUCCESS;
+}
+
+pj_status_t pj_rate_port_set_clock_rate(pjmedia_port *this_port, unsigned clock_rate)
+{
+  rate_port *port = (rate_port *) this_port;
+
+  pj_lock_acquire(port->lock);
+
+  rate_pair *pair = find_pair(port, clock_rate);
+  if (pair == NULL) {
+    pj_lock_release(port->lock);
+    return PJ_EINVAL;
+  }
+
+  if (pair != port->pair) {
+    port->pair = pair;
+    port->switched = PJ_TRUE;
+    port->stat.switches++;
+
+    // Whoever connects to the port next sees the new rate
+    pjmedia_audio_format_detail *detail = pjmedia_format_get_audio_format_detail(&this_port->info.fmt, PJ_TRUE);
+    detail->clock_rate = clock_rate;
+    detail->frame_time_usec = (pj_uint32_t) ((pj_uint64_t) pair->samples_per_frame * 1000000 /
+                                             detail->channel_count / clock_rate);
+    detail->avg_bps = detail->max_bps = clock_rate * detail->channel_count * detail->bits_per_sample;
+  }
+
+  pj_lock_release(port->lock);
+  return PJ_SUCCESS;
+}
+
+void pj_rate_port_get_stat(pjmedia_port *this_port, pj_rate_port_stat *stat)
+{
+  rate_port *port = (rate_port *) this_port;
+
+  pj_lock_acquire(port->lock);
+  *stat = port->stat;
+  pj_lock_release(port->lock);
+}
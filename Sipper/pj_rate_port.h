@@ -0,0 +1,66 @@
+//
+//  pj_rate_port.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_rate_port_h
+#define pj_rate_port_h
+
+#import <pjsua.h>
+
+/* The device clock rates a rate port can switch between */
+#define PJ_RATE_PORT_RATES  {8000, 16000, 32000, 44100, 48000}
+
+/*
+ * How a rate port has been switching, and what its frames cost
+ */
+typedef struct pj_rate_port_stat {
+  /** Number of times the device clock rate changed */
+  unsigned switches;
+  /** The time between the last frame at the old rate and the first at the new one, for the last switch and the
+   *  longest, in nanoseconds. Switches made while no frames were flowing have no gap. */
+  pj_uint64_t last_gap_nsec;
+  pj_uint64_t max_gap_nsec;
+  /** Number of frames passed in either direction */
+  pj_uint64_t frames;
+  /** Time the port spent converting those frames, leaving out the port it's attached to, in nanoseconds */
+  pj_uint64_t frame_nsec;
+  pj_uint64_t max_frame_nsec;
+} pj_rate_port_stat;
+
+/*
+ * Create a port that sits between a sound device and a port with a fixed clock rate, like the conference bridge's
+ * master port, and converts between the two. Resamplers for every rate in PJ_RATE_PORT_RATES are created up front,
+ * along with their buffers, so switching the device's rate only picks a different pair and never allocates or
+ * touches the port it's attached to.
+ * @param pool          Pool the port, resamplers, and buffers are allocated from.
+ * @param dn_port       The port to attach to. Its frames must be 16 bit.
+ * @param clock_rate    The device's clock rate to start with, which must be one of PJ_RATE_PORT_RATES or dn_port's.
+ * @param high_quality  Whether the resamplers use a filter instead of linear interpolation.
+ * @param large_filter  Whether that filter is the large one.
+ * @param p_port        Set to the port.
+ */
+pj_status_t pj_rate_port_create(pj_pool_t *pool,
+                                pjmedia_port *dn_port,
+                                unsigned clock_rate,
+                                pj_bool_t high_quality,
+                                pj_bool_t large_filter,
+                                pjmedia_port **p_port);
+
+/*
+ * Switch the device's clock rate. The port's info changes to match it right away, so a sound port can be connected
+ * at the new rate, and the next frame in either direction is converted at the new ratio. A sound port still running
+ * at the old rate should be disconnected first, since its frames are the wrong size from then on.
+ * @return  PJ_EINVAL if the rate is neither one of PJ_RATE_PORT_RATES nor the attached port's.
+ */
+pj_status_t pj_rate_port_set_clock_rate(pjmedia_port *port, unsigned clock_rate);
+
+/*
+ * Read a port's counters
+ */
+void pj_rate_port_get_stat(pjmedia_port *port, pj_rate_port_stat *stat);
+
+#endif /* pj_rate_port_h */
@@ -0,0 +1,551 @@
+//
+//  pj_sip_capture.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_sip_capture.h"
+
+#include <pjsua.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define THIS_FILE "pj_sip_capture.c"
+
+/* pcapng block types, options and the raw IP link type (so IPv4 and IPv6 can share one interface) */
+#define PCAPNG_SHB              0x0A0D0D0A
+#define PCAPNG_IDB              0x00000001
+#define PCAPNG_EPB              0x00000006
+#define PCAPNG_BYTE_ORDER       0x1A2B3C4D
+#define PCAPNG_OPT_END          0
+#define PCAPNG_OPT_COMMENT      1
+#define PCAPNG_OPT_EPB_FLAGS    2
+#define PCAPNG_LINKTYPE_RAW     101
+
+/* Direction bits of epb_flags */
+#define PCAPNG_INBOUND          1
+#define PCAPNG_OUTBOUND         2
+
+/* Largest synthesized header, IPv6 and TCP */
+#define CAPTURE_MAX_HEADER      (40 + 20)
+
+/* Largest enhanced packet block: the fixed fields, the packet, and the flags and comment options */
+#define CAPTURE_MAX_BLOCK       (32 + CAPTURE_MAX_HEADER + PJ_SIP_CAPTURE_SNAPLEN + 3 + 12 + 4 + 16 + 4)
+
+/* TCP flows whose sequence numbers are tracked while a file is written */
+#define CAPTURE_MAX_FLOWS       32
+
+typedef struct capture_slot {
+  _Atomic uint64_t seq;                 /* 2 * ticket + 1 while it's written, 2 * ticket + 2 once it's complete */
+  pj_time_val ts;
+  pj_sockaddr local;
+  pj_sockaddr remote;
+  pjsip_transport_type_e type;
+  pj_bool_t outgoing;
+  unsigned len;
+  unsigned caplen;
+  char data[PJ_SIP_CAPTURE_SNAPLEN];
+} capture_slot;
+
+typedef struct capture_flow {
+  pj_sockaddr src;
+  pj_sockaddr dst;
+  pj_uint32_t seq;
+} capture_flow;
+
+typedef struct capture_writer {
+  pj_oshandle_t fd;
+  capture_flow flows[CAPTURE_MAX_FLOWS];
+  unsigned flow_count;
+  unsigned next_flow;
+  char block[CAPTURE_MAX_BLOCK];
+  unsigned len;
+} capture_writer;
+
+static struct sip_capture {
+  atomic_bool initialized;
+  atomic_uint users;                    /* Callers using the ring, which shutdown waits out before releasing it */
+  pjsip_endpoint *endpt;
+  capture_slot *slots;
+  unsigned capacity;
+  _Atomic uint64_t head;
+  atomic_ulong dropped;
+  atomic_ulong truncated;
+} capture;
+
+static pj_status_t capture_on_unload(void);
+static pj_bool_t capture_on_rx(pjsip_rx_data *rdata);
+static pj_status_t capture_on_tx(pjsip_tx_data *tdata);
+
+/* Sees incoming messages before any other module, and outgoing ones after, compaction included */
+static pjsip_module capture_module = {
+  NULL, NULL,                     /* prev, next.      */
+  { "mod-capture", 11 },          /* Name.            */
+  -1,                             /* Id               */
+  -2,                             /* Priority         */
+  NULL,                           /* load()           */
+  NULL,                           /* start()          */
+  NULL,                           /* stop()           */
+  &capture_on_unload,             /* unload()         */
+  &capture_on_rx,                 /* on_rx_request()  */
+  &capture_on_rx,                 /* on_rx_response() */
+  &capture_on_tx,                 /* on_tx_request.   */
+  &capture_on_tx,                 /* on_tx_response() */
+  NULL,                           /* on_tsx_state()   */
+};
+
+static pj_status_t capture_on_unload(void)
+{
+  // The endpoint unregisters every module as it's destroyed, which may be before this is shut down
+  capture.endpt = NULL;
+  return PJ_SUCCESS;
+}
+
+static pj_bool_t capture_on_rx(pjsip_rx_data *rdata)
+{
+  pjsip_transport *tp = rdata->tp_info.transport;
+  pj_sip_capture_packet(PJ_FALSE, (pjsip_transport_type_e) tp->key.type, &tp->local_addr, &rdata->pkt_info.src_addr,
+                        &rdata->pkt_info.timestamp, rdata->msg_info.msg_buf, (pj_size_t) rdata->msg_info.len);
+  return PJ_FALSE;
+}
+
+static pj_status_t capture_on_tx(pjsip_tx_data *tdata)
+{
+  pjsip_transport *tp = tdata->tp_info.transport;
+  if (tp == NULL) {
+    return PJ_SUCCESS;
+  }
+
+  pj_time_val now;
+  pj_gettimeofday(&now);
+  pj_sip_capture_packet(PJ_TRUE, (pjsip_transport_type_e) tp->key.type, &tp->local_addr, &tdata->tp_info.dst_addr,
+                        &now, tdata->buf.start, (pj_size_t) (tdata->buf.cur - tdata->buf.start));
+  return PJ_SUCCESS;
+}
+
+static pj_bool_t capture_enter(void)
+{
+  // Counted before the flag is checked, and shutdown clears the flag before it checks the count, so either this sees
+  // the flag cleared or shutdown waits for it
+  atomic_fetch_add_explicit(&capture.users, 1, memory_order_seq_cst);
+  if (!atomic_load_explicit(&capture.initialized, memory_order_seq_cst)) {
+    atomic_fetch_sub_explicit(&capture.users, 1, memory_order_release);
+    return PJ_FALSE;
+  }
+
+  return PJ_TRUE;
+}
+
+static void capture_leave(void)
+{
+  atomic_fetch_sub_explicit(&capture.users, 1, memory_order_release);
+}
+
+static void capture_copy(pj_bool_t outgoing,
+                         pjsip_transport_type_e type,
+                         const pj_sockaddr_t *local,
+                         const pj_sockaddr_t *remote,
+                         const pj_time_val *ts,
+                         const char *data,
+                         pj_size_t len)
+{
+  uint64_t ticket = atomic_fetch_add_explicit(&capture.head, 1, memory_order_relaxed);
+  capture_slot *slot = &capture.slots[ticket & (capture.capacity - 1)];
+
+  // A writer a whole lap behind may still be filling this slot. Rather than wait on it, this packet is dropped.
+  uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  if ((seq & 1) || seq > 2 * ticket ||
+      !atomic_compare_exchange_strong_explicit(&slot->seq, &seq, 2 * ticket + 1, memory_order_acq_rel, memory_order_relaxed)) {
+    atomic_fetch_add_explicit(&capture.dropped, 1, memory_order_relaxed);
+    return;
+  }
+
+  // Readers that see the odd sequence after copying know the copy is torn
+  atomic_thread_fence(memory_order_release);
+
+  slot->ts = *ts;
+  pj_sockaddr_cp(&slot->local, local);
+  pj_sockaddr_cp(&slot->remote, remote);
+  slot->type = type;
+  slot->outgoing = outgoing;
+  slot->len = (unsigned) len;
+  slot->caplen = (unsigned) PJ_MIN(len, PJ_SIP_CAPTURE_SNAPLEN);
+  pj_memcpy(slot->data, data, slot->caplen);
+
+  if (slot->caplen < len) {
+    atomic_fetch_add_explicit(&capture.truncated, 1, memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&slot->seq, 2 * ticket + 2, memory_order_release);
+}
+
+void pj_sip_capture_packet(pj_bool_t outgoing,
+                           pjsip_transport_type_e type,
+                           const pj_sockaddr_t *local,
+                           const pj_sockaddr_t *remote,
+                           const pj_time_val *ts,
+                           const char *data,
+                           pj_size_t len)
+{
+  if (!capture_enter()) {
+    return;
+  }
+
+  capture_copy(outgoing, type, local, remote, ts, data, len);
+  capture_leave();
+}
+
+static pj_uint32_t checksum_add(pj_uint32_t sum, const void *data, unsigned len)
+{
+  const pj_uint8_t *bytes = (const pj_uint8_t *) data;
+  for (unsigned i = 0; i + 1 < len; i += 2) {
+    sum += (pj_uint32_t) (bytes[i] << 8 | bytes[i + 1]);
+  }
+  if (len & 1) {
+    sum += (pj_uint32_t) (bytes[len - 1] << 8);
+  }
+  return sum;
+}
+
+static pj_uint16_t checksum_finish(pj_uint32_t sum)
+{
+  while (sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return pj_htons((pj_uint16_t) ~sum);
+}
+
+static void put16(pj_uint8_t *out, pj_uint16_t value)
+{
+  pj_memcpy(out, &value, sizeof(value));
+}
+
+static void put32(pj_uint8_t *out, pj_uint32_t value)
+{
+  pj_memcpy(out, &value, sizeof(value));
+}
+
+static pj_uint32_t next_tcp_seq(capture_writer *writer, const pj_sockaddr *src, const pj_sockaddr *dst, unsigned len)
+{
+  capture_flow *flow = NULL;
+  for (unsigned i = 0; i < writer->flow_count && flow == NULL; i++) {
+    if (pj_sockaddr_cmp(&writer->flows[i].src, src) == 0 && pj_sockaddr_cmp(&writer->flows[i].dst, dst) == 0) {
+      flow = &writer->flows[i];
+    }
+  }
+
+  // Past the limit the oldest flows start over, which Wireshark only sees as a gap
+  if (flow == NULL) {
+    flow = &writer->flows[writer->next_flow];
+    writer->next_flow = (writer->next_flow + 1) % CAPTURE_MAX_FLOWS;
+    writer->flow_count = PJ_MIN(writer->flow_count + 1, CAPTURE_MAX_FLOWS);
+    pj_sockaddr_cp(&flow->src, src);
+    pj_sockaddr_cp(&flow->dst, dst);
+    flow->seq = 1;
+  }
+
+  pj_uint32_t seq = flow->seq;
+  flow->seq += len;
+  return seq;
+}
+
+/*
+ * Write the IP and transport headers a packet would have had on the wire. TLS is shown as plain TCP, since the
+ * capture has the decrypted messages.
+ */
+static unsigned build_headers(capture_writer *writer, const capture_slot *packet, pj_uint8_t *out)
+{
+  const pj_sockaddr *src = packet->outgoing ? &packet->local : &packet->remote;
+  const pj_sockaddr *dst = packet->outgoing ? &packet->remote : &packet->local;
+  int af = src->addr.sa_family;
+  if (af != dst->addr.sa_family || (af != pj_AF_INET() && af != pj_AF_INET6())) {
+    return 0;
+  }
+
+  pj_bool_t reliable = (pjsip_transport_get_flag_from_type(packet->type) & PJSIP_TRANSPORT_RELIABLE) != 0;
+  unsigned ip_len = af == pj_AF_INET() ? 20 : 40;
+  unsigned tp_len = reliable ? 20 : 8;
+  unsigned addr_len = af == pj_AF_INET() ? 4 : 16;
+  pj_uint8_t protocol = reliable ? 6 : 17;
+  pj_uint8_t *ip = out;
+  pj_uint8_t *tp = out + ip_len;
+
+  pj_bzero(out, ip_len + tp_len);
+
+  if (af == pj_AF_INET()) {
+    ip[0] = 0x45;
+    put16(ip + 2, pj_htons((pj_uint16_t) PJ_MIN(ip_len + tp_len + packet->len, 0xFFFF)));
+    put16(ip + 6, pj_htons(0x4000));
+    ip[8] = 64;
+    ip[9] = protocol;
+    pj_memcpy(ip + 12, pj_sockaddr_get_addr(src), addr_len);
+    pj_memcpy(ip + 16, pj_sockaddr_get_addr(dst), addr_len);
+    put16(ip + 10, checksum_finish(checksum_add(0, ip, ip_len)));
+  } else {
+    ip[0] = 0x60;
+    put16(ip + 4, pj_htons((pj_uint16_t) PJ_MIN(tp_len + packet->len, 0xFFFF)));
+    ip[6] = protocol;
+    ip[7] = 64;
+    pj_memcpy(ip + 8, pj_sockaddr_get_addr(src), addr_len);
+    pj_memcpy(ip + 24, pj_sockaddr_get_addr(dst), addr_len);
+  }
+
+  put16(tp, pj_htons(pj_sockaddr_get_port(src)));
+  put16(tp + 2, pj_htons(pj_sockaddr_get_port(dst)));
+
+  if (reliable) {
+    put32(tp + 4, pj_htonl(next_tcp_seq(writer, src, dst, packet->len)));
+    tp[12] = 5 << 4;
+    tp[13] = 0x18;                        /* PSH, ACK */
+    put16(tp + 14, pj_htons(0xFFFF));
+  } else {
+    put16(tp + 4, pj_htons((pj_uint16_t) PJ_MIN(tp_len + packet->len, 0xFFFF)));
+  }
+
+  // A truncated packet can't be checksummed. Zero means no checksum for UDP over IPv4, and is just wrong elsewhere.
+  if (packet->caplen == packet->len) {
+    pj_uint32_t sum = checksum_add(0, pj_sockaddr_get_addr(src), addr_len);
+    sum = checksum_add(sum, pj_sockaddr_get_addr(dst), addr_len);
+    sum += protocol + tp_len + packet->len;
+    sum = checksum_add(sum, tp, tp_len);
+    sum = checksum_add(sum, packet->data, packet->caplen);
+
+    pj_uint16_t checksum = checksum_finish(sum);
+    put16(reliable ? tp + 16 : tp + 6, !reliable && checksum == 0 ? 0xFFFF : checksum);
+  }
+
+  return ip_len + tp_len;
+}
+
+static void block_append(capture_writer *writer, const void *data, unsigned len)
+{
+  pj_memcpy(writer->block + writer->len, data, len);
+  writer->len += len;
+}
+
+static void block_append32(capture_writer *writer, pj_uint32_t value)
+{
+  block_append(writer, &value, sizeof(value));
+}
+
+static void block_pad(capture_writer *writer)
+{
+  while (writer->len % 4) {
+    writer->block[writer->len++] = 0;
+  }
+}
+
+static void block_option(capture_writer *writer, pj_uint16_t code, const void *data, pj_uint16_t len)
+{
+  pj_uint16_t header[2] = { code, len };
+  block_append(writer, header, sizeof(header));
+  block_append(writer, data, len);
+  block_pad(writer);
+}
+
+static pj_status_t block_flush(capture_writer *writer)
+{
+  // Every block ends with its total length, which is also the second word
+  block_append32(writer, writer->len + 4);
+  put32((pj_uint8_t *) writer->block + 4, writer->len);
+
+  pj_ssize_t size = writer->len;
+  writer->len = 0;
+  return pj_file_write(writer->fd, writer->block, &size);
+}
+
+static pj_status_t write_preamble(capture_writer *writer)
+{
+  pj_status_t status;
+
+  block_append32(writer, PCAPNG_SHB);
+  block_append32(writer, 0);
+  block_append32(writer, PCAPNG_BYTE_ORDER);
+  block_append32(writer, 1);                /* Version 1.0 */
+  block_append32(writer, 0xFFFFFFFF);       /* Section length isn't known */
+  block_append32(writer, 0xFFFFFFFF);
+  status = block_flush(writer);
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  block_append32(writer, PCAPNG_IDB);
+  block_append32(writer, 0);
+  block_append32(writer, PCAPNG_LINKTYPE_RAW);
+  block_append32(writer, 0);                /* No snap length */
+  return block_flush(writer);
+}
+
+static pj_status_t write_packet(capture_writer *writer, const capture_slot *packet)
+{
+  pj_uint8_t headers[CAPTURE_MAX_HEADER];
+  unsigned header_len = build_headers(writer, packet, headers);
+  if (header_len == 0) {
+    return PJ_SUCCESS;
+  }
+
+  pj_uint64_t usec = (pj_uint64_t) packet->ts.sec * 1000000 + (pj_uint64_t) packet->ts.msec * 1000;
+  pj_uint32_t flags = packet->outgoing ? PCAPNG_OUTBOUND : PCAPNG_INBOUND;
+  const char *transport = pjsip_transport_get_type_name(packet->type);
+
+  block_append32(writer, PCAPNG_EPB);
+  block_append32(writer, 0);
+  block_append32(writer, 0);                /* Interface */
+  block_append32(writer, (pj_uint32_t) (usec >> 32));
+  block_append32(writer, (pj_uint32_t) usec);
+  block_append32(writer, header_len + packet->caplen);
+  block_append32(writer, header_len + packet->len);
+  block_append(writer, headers, header_len);
+  block_append(writer, packet->data, packet->caplen);
+  block_pad(writer);
+  block_option(writer, PCAPNG_OPT_EPB_FLAGS, &flags, sizeof(flags));
+  block_option(writer, PCAPNG_OPT_COMMENT, transport, (pj_uint16_t) PJ_MIN(pj_ansi_strlen(transport), 16));
+  block_option(writer, PCAPNG_OPT_END, NULL, 0);
+  return block_flush(writer);
+}
+
+pj_status_t pj_sip_capture_write(const char *path, unsigned *count)
+{
+  pj_status_t status;
+
+  if (count != NULL) {
+    *count = 0;
+  }
+
+  if (!capture_enter()) {
+    return PJ_EINVALIDOP;
+  }
+
+  // The writer and the copy of each packet are too large for the stack
+  capture_writer *writer = (capture_writer *) malloc(sizeof(capture_writer));
+  capture_slot *packet = (capture_slot *) malloc(sizeof(capture_slot));
+  if (writer == NULL || packet == NULL) {
+    free(writer);
+    free(packet);
+    capture_leave();
+    return PJ_ENOMEM;
+  }
+
+  pj_bzero(writer, sizeof(*writer));
+  status = pj_file_open(NULL, path, PJ_O_WRONLY, &writer->fd);
+  if (status != PJ_SUCCESS) {
+    free(writer);
+    free(packet);
+    capture_leave();
+    return status;
+  }
+
+  status = write_preamble(writer);
+
+  uint64_t head = atomic_load_explicit(&capture.head, memory_order_acquire);
+  uint64_t ticket = head > capture.capacity ? head - capture.capacity : 0;
+
+  for (; ticket < head && status == PJ_SUCCESS; ticket++) {
+    capture_slot *slot = &capture.slots[ticket & (capture.capacity - 1)];
+
+    // Slots that are still being written, or have already been reused, are skipped. So is a copy that raced a
+    // writer, which shows up as a changed sequence afterwards.
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != 2 * ticket + 2) {
+      continue;
+    }
+
+    pj_memcpy(packet, slot, sizeof(*packet));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq || packet->caplen > PJ_SIP_CAPTURE_SNAPLEN) {
+      continue;
+    }
+
+    status = write_packet(writer, packet);
+    if (status == PJ_SUCCESS && count != NULL) {
+      (*count)++;
+    }
+  }
+
+  capture_leave();
+
+  pj_file_close(writer->fd);
+  free(writer);
+  free(packet);
+
+  if (status != PJ_SUCCESS) {
+    PJ_PERROR(3, (THIS_FILE, status, "Error writing SIP capture to %s", path));
+  }
+
+  return status;
+}
+
+pj_status_t pj_sip_capture_init(pjsip_endpoint *endpt, unsigned packets)
+{
+  pj_status_t status;
+
+  pj_sip_capture_shutdown();
+  pj_bzero(&capture, sizeof(capture));
+
+  // Slots are picked by masking the ticket
+  unsigned capacity = 1;
+  while (capacity < packets) {
+    capacity <<= 1;
+  }
+
+  // Not from a pool, which only aligns to PJ_POOL_ALIGNMENT, and the sequences have to be 8 byte aligned to be atomic
+  capture.slots = (capture_slot *) calloc(capacity, sizeof(capture_slot));
+  if (capture.slots == NULL) {
+    return PJ_ENOMEM;
+  }
+  capture.capacity = capacity;
+
+  if (endpt != NULL) {
+    status = pjsip_endpt_register_module(endpt, &capture_module);
+    if (status != PJ_SUCCESS) {
+      free(capture.slots);
+      return status;
+    }
+  }
+
+  capture.endpt = endpt;
+  atomic_store_explicit(&capture.initialized, PJ_TRUE, memory_order_release);
+
+  return PJ_SUCCESS;
+}
+
+void pj_sip_capture_shutdown(void)
+{
+  if (!atomic_load_explicit(&capture.initialized, memory_order_acquire)) {
+    return;
+  }
+
+  // Unregistering waits for the endpoint's callbacks to finish, so the module can't capture anything after this
+  if (capture.endpt != NULL) {
+    pjsip_endpt_unregister_module(capture.endpt, &capture_module);
+  }
+  atomic_store_explicit(&capture.initialized, PJ_FALSE, memory_order_seq_cst);
+
+  // Anyone else who got in before the flag was cleared is still copying into or out of the ring
+  while (atomic_load_explicit(&capture.users, memory_order_seq_cst) != 0) {
+    sched_yield();
+  }
+
+  free(capture.slots);
+  capture.slots = NULL;
+}
+
+pj_bool_t pj_sip_capture_enabled(void)
+{
+  return atomic_load_explicit(&capture.initialized, memory_order_acquire);
+}
+
+void pj_sip_capture_get_stat(pj_sip_capture_stat *stat)
+{
+  pj_bzero(stat, sizeof(*stat));
+  if (!atomic_load_explicit(&capture.initialized, memory_order_acquire)) {
+    return;
+  }
+
+  stat->dropped = atomic_load_explicit(&capture.dropped, memory_order_relaxed);
+  stat->truncated = atomic_load_explicit(&capture.truncated, memory_order_relaxed);
+  stat->captured = (unsigned long) atomic_load_explicit(&capture.head, memory_order_relaxed) - stat->dropped;
+}
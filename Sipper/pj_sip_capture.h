@@ -0,0 +1,83 @@
+//
+//  pj_sip_capture.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_sip_capture_h
+#define pj_sip_capture_h
+
+#import <pjsua.h>
+
+/* Largest part of a packet that's kept. Anything longer is truncated, like a pcap snap length. */
+#define PJ_SIP_CAPTURE_SNAPLEN  PJSIP_MAX_PKT_LEN
+
+/**
+ * Counters for packet capture */
+typedef struct pj_sip_capture_stat {
+  /** Packets copied into the ring */
+  unsigned long captured;
+  /** Packets that were dropped because a slower writer still held their slot */
+  unsigned long dropped;
+  /** Packets that were longer than the snap length, and truncated */
+  unsigned long truncated;
+} pj_sip_capture_stat;
+
+/*
+ * Start capturing SIP packets. Every message that's received is copied before any module has seen it, and every
+ * message that's sent is copied after every module has rewritten it, along with the transport, the addresses and
+ * the time. Packets go into a ring that keeps the most recent ones, without taking a lock.
+ * @param endpt    The SIP endpoint to register the module with, or NULL to only capture the packets given to
+ *                 pj_sip_capture_packet.
+ * @param packets  The number of packets the ring keeps, rounded up to a power of two. Each one takes a little over
+ *                 PJ_SIP_CAPTURE_SNAPLEN bytes.
+ */
+pj_status_t pj_sip_capture_init(pjsip_endpoint *endpt, unsigned packets);
+
+/*
+ * Stop capturing SIP packets, and release the ring once the module is unregistered and anyone still copying into or
+ * out of it has finished
+ */
+void pj_sip_capture_shutdown(void);
+
+/*
+ * Whether SIP packets are being captured
+ */
+pj_bool_t pj_sip_capture_enabled(void);
+
+/*
+ * Copy a packet into the ring. This is what the module captures with, and is exposed for testing. It's safe to call
+ * from any number of threads at once.
+ * @param outgoing  Whether the packet was sent, rather than received.
+ * @param type      The transport the packet went over.
+ * @param local     The local address of the transport.
+ * @param remote    The address the packet was sent to or received from.
+ * @param ts        When the packet was sent or received.
+ * @param data      The packet.
+ * @param len       The length of the packet, in bytes.
+ */
+void pj_sip_capture_packet(pj_bool_t outgoing,
+                           pjsip_transport_type_e type,
+                           const pj_sockaddr_t *local,
+                           const pj_sockaddr_t *remote,
+                           const pj_time_val *ts,
+                           const char *data,
+                           pj_size_t len);
+
+/*
+ * Write the packets in the ring to a pcapng file, oldest first. Each one is given a synthesized IP and UDP or TCP
+ * header, so the file opens in Wireshark as SIP. Packets are captured while this runs, and those that are
+ * overwritten before they're written are skipped.
+ * @param path   The file to write, which is replaced if it exists.
+ * @param count  Optional, set to the number of packets written.
+ */
+pj_status_t pj_sip_capture_write(const char *path, unsigned *count);
+
+/*
+ * Get a snapshot of the capture counters
+ */
+void pj_sip_capture_get_stat(pj_sip_capture_stat *stat);
+
+#endif /* pj_sip_capture_h */
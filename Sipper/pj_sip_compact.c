@@ -0,0 +1,426 @@
+//
+//  pj_sip_compact.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_sip_compact.h"
+
+#include <pjsua.h>
+#include <pjnath.h>
+
+#include "pj_ice_trickle.h"
+
+#define THIS_FILE "pj_sip_compact.c"
+
+/* Most candidates considered for trimming in one SDP */
+#define COMPACT_MAX_CANDS       (PJ_ICE_MAX_CAND * 2)
+
+/* Payload types below this are static (RFC 3551), so their rtpmap only repeats what the number already says */
+#define COMPACT_FIRST_DYNAMIC_PT  35
+
+typedef struct sdp_cand {
+  pjmedia_sdp_media *media;
+  pjmedia_sdp_attr *attr;
+  pj_ice_sess_cand cand;
+  unsigned media_idx;
+  pj_bool_t keep;
+} sdp_cand;
+
+static struct sip_compact {
+  pj_bool_t initialized;
+  pj_pool_t *pool;
+  pj_mutex_t *mutex;
+  pjsip_endpoint *endpt;
+  unsigned budget;
+  pj_bool_t compact_form;
+  pj_sip_compact_stat stat;
+} compact;
+
+static pj_status_t compact_on_unload(void);
+static pj_status_t compact_on_tx(pjsip_tx_data *tdata);
+
+/* Runs after every other module on outgoing messages, including the NAT64 rewrite at priority 0 */
+static pjsip_module compact_module = {
+  NULL, NULL,                     /* prev, next.      */
+  { "mod-compact", 11 },          /* Name.            */
+  -1,                             /* Id               */
+  -1,                             /* Priority         */
+  NULL,                           /* load()           */
+  NULL,                           /* start()          */
+  NULL,                           /* stop()           */
+  &compact_on_unload,             /* unload()         */
+  NULL,                           /* on_rx_request()  */
+  NULL,                           /* on_rx_response() */
+  &compact_on_tx,                 /* on_tx_request.   */
+  &compact_on_tx,                 /* on_tx_response() */
+  NULL,                           /* on_tsx_state()   */
+};
+
+static const char *preferred_crypto[] = {
+  "AES_CM_128_HMAC_SHA1_80",
+  "AES_CM_128_HMAC_SHA1_32"
+};
+
+static pj_bool_t is_disabled(pjmedia_codec_mgr *codec_mgr, const pjmedia_sdp_attr *attr)
+{
+  pjmedia_sdp_rtpmap rtpmap;
+  if (pjmedia_sdp_attr_get_rtpmap(attr, &rtpmap) != PJ_SUCCESS) {
+    return PJ_FALSE;
+  }
+
+  char id[64];
+  if (rtpmap.param.slen > 0) {
+    pj_ansi_snprintf(id, sizeof(id), "%.*s/%u/%.*s", (int) rtpmap.enc_name.slen, rtpmap.enc_name.ptr,
+                     rtpmap.clock_rate, (int) rtpmap.param.slen, rtpmap.param.ptr);
+  } else {
+    pj_ansi_snprintf(id, sizeof(id), "%.*s/%u", (int) rtpmap.enc_name.slen, rtpmap.enc_name.ptr, rtpmap.clock_rate);
+  }
+
+  pj_str_t codec_id = pj_str(id);
+  const pjmedia_codec_info *info[8];
+  unsigned prio[8];
+  unsigned count = PJ_ARRAY_SIZE(info);
+  if (pjmedia_codec_mgr_find_codecs_by_id(codec_mgr, &codec_id, &count, info, prio) != PJ_SUCCESS || count == 0) {
+    // Not a codec, like telephone-event
+    return PJ_FALSE;
+  }
+
+  for (unsigned i = 0; i < count; i++) {
+    if (prio[i] != PJMEDIA_CODEC_PRIO_DISABLED) {
+      return PJ_FALSE;
+    }
+  }
+
+  return PJ_TRUE;
+}
+
+static void remove_format_attrs(pjmedia_sdp_media *media, const pj_str_t *fmt)
+{
+  pjmedia_sdp_attr *attr;
+  while ((attr = pjmedia_sdp_media_find_attr2(media, "rtpmap", fmt)) != NULL) {
+    pjmedia_sdp_attr_remove(&media->attr_count, media->attr, attr);
+  }
+  while ((attr = pjmedia_sdp_media_find_attr2(media, "fmtp", fmt)) != NULL) {
+    pjmedia_sdp_attr_remove(&media->attr_count, media->attr, attr);
+  }
+}
+
+static void remove_disabled_formats(pjmedia_codec_mgr *codec_mgr, pjmedia_sdp_media *media, pj_sip_compact_stat *stat)
+{
+  // PJSUA only offers enabled codecs, but an SDP can outlive the policy it was created under, like the local SDP
+  // that's reused for re-INVITEs. The last format stays, since a media line can't be empty.
+  for (unsigned i = media->desc.fmt_count; i-- > 0 && media->desc.fmt_count > 1;) {
+    const pjmedia_sdp_attr *attr = pjmedia_sdp_media_find_attr2(media, "rtpmap", &media->desc.fmt[i]);
+    if (attr == NULL || !is_disabled(codec_mgr, attr)) {
+      continue;
+    }
+
+    pj_str_t fmt = media->desc.fmt[i];
+    remove_format_attrs(media, &fmt);
+    pj_array_erase(media->desc.fmt, sizeof(pj_str_t), media->desc.fmt_count, i);
+    media->desc.fmt_count--;
+    stat->formats++;
+  }
+}
+
+static void remove_redundant_attrs(pjmedia_sdp_session *sdp, pjmedia_sdp_media *media, pj_sip_compact_stat *stat)
+{
+  for (unsigned i = 0; i < media->desc.fmt_count; i++) {
+    if (pj_strtoul(&media->desc.fmt[i]) >= COMPACT_FIRST_DYNAMIC_PT) {
+      continue;
+    }
+
+    pjmedia_sdp_attr *attr = pjmedia_sdp_media_find_attr2(media, "rtpmap", &media->desc.fmt[i]);
+    if (attr != NULL) {
+      pjmedia_sdp_attr_remove(&media->attr_count, media->attr, attr);
+      stat->attributes++;
+    }
+  }
+
+  // RTCP on the next port up at the same address is what a receiver assumes without the attribute (RFC 3605)
+  pjmedia_sdp_attr *attr = pjmedia_sdp_media_find_attr2(media, "rtcp", NULL);
+  pjmedia_sdp_conn *conn = media->conn ? media->conn : sdp->conn;
+  pjmedia_sdp_rtcp_attr rtcp;
+  if (attr != NULL && conn != NULL && pjmedia_sdp_attr_get_rtcp(attr, &rtcp) == PJ_SUCCESS &&
+      rtcp.port == media->desc.port + 1u && (rtcp.addr.slen == 0 || pj_strcmp(&rtcp.addr, &conn->addr) == 0)) {
+    pjmedia_sdp_attr_remove(&media->attr_count, media->attr, attr);
+    stat->attributes++;
+  }
+}
+
+static unsigned collect_candidates(pj_pool_t *pool, pjmedia_sdp_session *sdp, sdp_cand cands[])
+{
+  unsigned count = 0;
+
+  for (unsigned i = 0; i < sdp->media_count; i++) {
+    pjmedia_sdp_media *media = sdp->media[i];
+    pjmedia_sdp_conn *conn = media->conn ? media->conn : sdp->conn;
+
+    // The candidate matching the m= and c= lines is what a peer without ICE sends to
+    pj_sockaddr default_addr;
+    pj_bool_t has_default = conn != NULL && pj_sockaddr_parse(pj_AF_UNSPEC(), 0, &conn->addr, &default_addr) == PJ_SUCCESS;
+    if (has_default) {
+      pj_sockaddr_set_port(&default_addr, (pj_uint16_t) media->desc.port);
+    }
+
+    for (unsigned j = 0; j < media->attr_count && count < COMPACT_MAX_CANDS; j++) {
+      pjmedia_sdp_attr *attr = media->attr[j];
+      if (pj_stricmp2(&attr->name, "candidate") != 0) {
+        continue;
+      }
+
+      char value[256];
+      pj_ssize_t len = PJ_MIN(attr->value.slen, (pj_ssize_t) sizeof(value) - 1);
+      pj_memcpy(value, attr->value.ptr, len);
+      value[len] = '\0';
+
+      sdp_cand *cand = &cands[count];
+      if (!pj_ice_trickle_parse_candidate(pool, value, &cand->cand)) {
+        continue;
+      }
+
+      cand->media = media;
+      cand->media_idx = i;
+      cand->attr = attr;
+      cand->keep = has_default && cand->cand.comp_id == 1 && pj_sockaddr_cmp(&cand->cand.addr, &default_addr) == 0;
+      count++;
+    }
+  }
+
+  // Keep the best candidate of each type, for each component and address family. Candidates with the same
+  // address as a better one are duplicates, and never the best.
+  for (unsigned i = 0; i < count; i++) {
+    pj_bool_t best = PJ_TRUE;
+
+    for (unsigned j = 0; j < count && best; j++) {
+      if (i == j || cands[i].media_idx != cands[j].media_idx || cands[i].cand.comp_id != cands[j].cand.comp_id) {
+        continue;
+      }
+
+      pj_bool_t better = cands[j].cand.prio > cands[i].cand.prio || (cands[j].cand.prio == cands[i].cand.prio && j < i);
+      pj_bool_t duplicate = pj_sockaddr_cmp(&cands[i].cand.addr, &cands[j].cand.addr) == 0;
+      pj_bool_t same_kind = cands[i].cand.type == cands[j].cand.type &&
+                            cands[i].cand.addr.addr.sa_family == cands[j].cand.addr.addr.sa_family;
+
+      if (better && (duplicate || same_kind)) {
+        best = PJ_FALSE;
+      }
+    }
+
+    cands[i].keep = cands[i].keep || best;
+  }
+
+  return count;
+}
+
+static void trim_candidates(pj_pool_t *pool, pjmedia_sdp_session *sdp, int max_len, int *len, char *buf,
+                            pj_size_t size, pj_sip_compact_stat *stat)
+{
+  sdp_cand cands[COMPACT_MAX_CANDS];
+  unsigned count = collect_candidates(pool, sdp, cands);
+
+  while (*len > max_len) {
+    sdp_cand *worst = NULL;
+    for (unsigned i = 0; i < count; i++) {
+      if (!cands[i].keep && (worst == NULL || cands[i].cand.prio < worst->cand.prio)) {
+        worst = &cands[i];
+      }
+    }
+
+    if (worst == NULL) {
+      break;
+    }
+
+    PJ_LOG(5, (THIS_FILE, "Trimming candidate to fit the size budget: %.*s",
+               (int) worst->attr->value.slen, worst->attr->value.ptr));
+
+    pjmedia_sdp_attr_remove(&worst->media->attr_count, worst->media->attr, worst->attr);
+    worst->keep = PJ_TRUE;
+    stat->candidates++;
+
+    *len = pjmedia_sdp_print(sdp, buf, size);
+  }
+}
+
+int pj_sip_compact_sdp(pj_pool_t *pool,
+                       pjmedia_codec_mgr *codec_mgr,
+                       pjmedia_sdp_session *sdp,
+                       int max_len,
+                       pj_sip_compact_stat *stat)
+{
+  char buf[PJSIP_MAX_PKT_LEN];
+
+  for (unsigned i = 0; i < sdp->media_count; i++) {
+    pjmedia_sdp_media *media = sdp->media[i];
+    if (media->desc.port == 0) {
+      continue;
+    }
+
+    if (codec_mgr != NULL && pj_stricmp2(&media->desc.media, "audio") == 0) {
+      remove_disabled_formats(codec_mgr, media, stat);
+    }
+
+    remove_redundant_attrs(sdp, media, stat);
+  }
+
+  int len = pjmedia_sdp_print(sdp, buf, sizeof(buf));
+  if (len > max_len) {
+    trim_candidates(pool, sdp, max_len, &len, buf, sizeof(buf), stat);
+  }
+
+  return len;
+}
+
+void pj_sip_compact_crypto(pjmedia_srtp_setting *setting)
+{
+  pjmedia_srtp_crypto preferred[PJ_ARRAY_SIZE(preferred_crypto)];
+  unsigned count = 0;
+
+  // Keep the setting's own order, so its first preference is still offered first
+  for (unsigned i = 0; i < setting->crypto_count; i++) {
+    for (unsigned j = 0; j < PJ_ARRAY_SIZE(preferred_crypto); j++) {
+      if (count < PJ_ARRAY_SIZE(preferred) && pj_stricmp2(&setting->crypto[i].name, preferred_crypto[j]) == 0) {
+        preferred[count++] = setting->crypto[i];
+        break;
+      }
+    }
+  }
+
+  if (count == 0) {
+    return;
+  }
+
+  pj_memcpy(setting->crypto, preferred, count * sizeof(preferred[0]));
+  setting->crypto_count = count;
+}
+
+static pj_status_t compact_on_tx(pjsip_tx_data *tdata)
+{
+  pjsip_msg_body *body = tdata->msg->body;
+  if (!compact.initialized || body == NULL ||
+      pj_stricmp2(&body->content_type.type, "application") != 0 ||
+      pj_stricmp2(&body->content_type.subtype, "sdp") != 0) {
+    return PJ_SUCCESS;
+  }
+
+  char buf[PJSIP_MAX_PKT_LEN];
+  pjmedia_sdp_session *original = (pjmedia_sdp_session *) body->data;
+  int original_len = pjmedia_sdp_print(original, buf, sizeof(buf));
+  if (original_len < 0) {
+    return PJ_SUCCESS;
+  }
+
+  // The message has already been printed by the time it gets here, so everything but the body is known
+  int encoded_len = (int) (tdata->buf.cur - tdata->buf.start);
+  int overhead = encoded_len - original_len;
+
+  // The negotiator still holds the original, so the compacted body is a copy
+  pj_sip_compact_stat stat;
+  pj_bzero(&stat, sizeof(stat));
+  pjmedia_sdp_session *sdp = pjmedia_sdp_session_clone(tdata->pool, original);
+  pjmedia_codec_mgr *codec_mgr = pjmedia_endpt_get_codec_mgr(pjsua_get_pjmedia_endpt());
+  int len = pj_sip_compact_sdp(tdata->pool, codec_mgr, sdp, (int) compact.budget - overhead, &stat);
+
+  if (len >= 0 && len < original_len) {
+    body->data = sdp;
+    pjsip_tx_data_invalidate_msg(tdata);
+    if (pjsip_tx_data_encode(tdata) != PJ_SUCCESS) {
+      PJ_LOG(3, (THIS_FILE, "Error encountered while encoding the compacted SIP message"));
+      return PJ_SUCCESS;
+    }
+
+    encoded_len = (int) (tdata->buf.cur - tdata->buf.start);
+  }
+
+  pj_mutex_lock(compact.mutex);
+  compact.stat.messages++;
+  compact.stat.formats += stat.formats;
+  compact.stat.attributes += stat.attributes;
+  compact.stat.candidates += stat.candidates;
+  compact.stat.trimmed += stat.candidates > 0 ? 1 : 0;
+  compact.stat.over_budget += encoded_len > (int) compact.budget ? 1 : 0;
+  compact.stat.bytes_saved += len >= 0 && len < original_len ? (unsigned) (original_len - len) : 0;
+  compact.stat.largest = PJ_MAX(compact.stat.largest, (unsigned) encoded_len);
+  pj_mutex_unlock(compact.mutex);
+
+  return PJ_SUCCESS;
+}
+
+static pj_status_t compact_on_unload(void)
+{
+  // The endpoint unregisters every module as it's destroyed, which may be before this is shut down
+  compact.endpt = NULL;
+  return PJ_SUCCESS;
+}
+
+pj_status_t pj_sip_compact_init(pj_pool_factory *pf, pjsip_endpoint *endpt, unsigned budget)
+{
+  pj_status_t status;
+
+  pj_sip_compact_shutdown();
+  pj_bzero(&compact, sizeof(compact));
+
+  compact.pool = pj_pool_create(pf, "compact", 256, 256, NULL);
+  if (compact.pool == NULL) {
+    return PJ_ENOMEM;
+  }
+
+  status = pj_mutex_create_simple(compact.pool, "compact", &compact.mutex);
+  if (status != PJ_SUCCESS) {
+    pj_pool_release(compact.pool);
+    return status;
+  }
+
+  status = pjsip_endpt_register_module(endpt, &compact_module);
+  if (status != PJ_SUCCESS) {
+    pj_mutex_destroy(compact.mutex);
+    pj_pool_release(compact.pool);
+    return status;
+  }
+
+  // Every header that has a compact form (Via, From, To, Call-ID, Contact, ...) is printed with it
+  compact.compact_form = pjsip_cfg()->endpt.use_compact_form;
+  pjsip_cfg()->endpt.use_compact_form = PJ_TRUE;
+
+  compact.endpt = endpt;
+  compact.budget = budget;
+  compact.initialized = PJ_TRUE;
+
+  return PJ_SUCCESS;
+}
+
+void pj_sip_compact_shutdown(void)
+{
+  if (!compact.initialized) {
+    return;
+  }
+
+  pjsip_cfg()->endpt.use_compact_form = compact.compact_form;
+  if (compact.endpt != NULL) {
+    pjsip_endpt_unregister_module(compact.endpt, &compact_module);
+  }
+  compact.initialized = PJ_FALSE;
+
+  pj_mutex_destroy(compact.mutex);
+  pj_pool_release(compact.pool);
+}
+
+pj_bool_t pj_sip_compact_enabled(void)
+{
+  return compact.initialized;
+}
+
+void pj_sip_compact_get_stat(pj_sip_compact_stat *stat)
+{
+  if (!compact.initialized) {
+    pj_bzero(stat, sizeof(*stat));
+    return;
+  }
+
+  pj_mutex_lock(compact.mutex);
+  *stat = compact.stat;
+  pj_mutex_unlock(compact.mutex);
+}
@@ -0,0 +1,85 @@
+//
+//  pj_sip_compact.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_sip_compact_h
+#define pj_sip_compact_h
+
+#import <pjsua.h>
+
+/**
+ * Counters for message compaction */
+typedef struct pj_sip_compact_stat {
+  /** Outgoing messages with an SDP body that were compacted */
+  unsigned messages;
+  /** Messages that were over the size budget, and had candidates trimmed */
+  unsigned trimmed;
+  /** Messages that were still over the size budget once nothing else could be trimmed */
+  unsigned over_budget;
+  /** Formats of codecs that were disabled after the SDP was created */
+  unsigned formats;
+  /** Redundant attributes removed: rtpmaps of static payload types and default a=rtcp lines */
+  unsigned attributes;
+  /** Candidates trimmed to fit the size budget */
+  unsigned candidates;
+  /** Bytes removed from SDP bodies */
+  unsigned bytes_saved;
+  /** The largest message sent, in bytes */
+  unsigned largest;
+} pj_sip_compact_stat;
+
+/*
+ * Start compacting outgoing SIP messages. Header names are sent in their compact form, and SDP bodies are stripped
+ * of formats whose codec has since been disabled, of rtpmap attributes for static payload types and of a=rtcp
+ * attributes that only state the default. When a message would still be larger than the size budget, candidates
+ * that are redundant with a better one for the same component and address family are trimmed, lowest priority
+ * first. The default candidate and the best candidate of each type are always kept.
+ * @param pf      Pool factory for the module's lock.
+ * @param endpt   The SIP endpoint to register the module with. This must happen after the NAT64 module has been
+ *                registered, so that its synthesized candidates count against the budget.
+ * @param budget  The largest a message should be, in bytes.
+ */
+pj_status_t pj_sip_compact_init(pj_pool_factory *pf, pjsip_endpoint *endpt, unsigned budget);
+
+/*
+ * Stop compacting outgoing SIP messages
+ */
+void pj_sip_compact_shutdown(void);
+
+/*
+ * Compact an SDP. This is what outgoing bodies are compacted with, and is exposed for testing.
+ * @param pool       Pool for the candidates parsed out of the SDP.
+ * @param codec_mgr  Codec manager to check whether codecs are still enabled with, or NULL to keep every format.
+ * @param sdp        The SDP, compacted in place.
+ * @param max_len    The largest the printed SDP should be, in bytes. Candidates are only trimmed when it's larger.
+ * @param stat       Counters to add the removals to.
+ * @return           The length of the printed SDP, or -1 if it couldn't be printed.
+ */
+int pj_sip_compact_sdp(pj_pool_t *pool,
+                       pjmedia_codec_mgr *codec_mgr,
+                       pjmedia_sdp_session *sdp,
+                       int max_len,
+                       pj_sip_compact_stat *stat);
+
+/*
+ * Limit the crypto suites offered for SRTP to the preferred ones, AES_CM_128_HMAC_SHA1_80 and
+ * AES_CM_128_HMAC_SHA1_32, so that each media line carries at most two a=crypto attributes. The setting is left
+ * alone if it has none of them.
+ */
+void pj_sip_compact_crypto(pjmedia_srtp_setting *setting);
+
+/*
+ * Whether outgoing messages are being compacted
+ */
+pj_bool_t pj_sip_compact_enabled(void);
+
+/*
+ * Get a snapshot of the compaction counters
+ */
+void pj_sip_compact_get_stat(pj_sip_compact_stat *stat);
+
+#endif /* pj_sip_compact_h */
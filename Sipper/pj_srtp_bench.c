@@ -0,0 +1,300 @@
+//
+//  pj_srtp_bench.c
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#include "pj_srtp_bench.h"
+
+#include <pjsua.h>
+#include <srtp.h>
+
+#define THIS_FILE "pj_srtp_bench.c"
+
+/* Packets per timed batch, one second of audio at a 20 ms ptime */
+#define SRTP_BENCH_BATCH          50
+
+#define SRTP_BENCH_RTP_HEADER     12
+#define SRTP_BENCH_PACKET_SIZE    (SRTP_BENCH_RTP_HEADER + PJ_SRTP_BENCH_PAYLOAD + SRTP_MAX_TRAILER_LEN)
+
+/* Long enough for the master key and salt of any suite */
+#define SRTP_BENCH_MAX_KEY        64
+
+typedef struct bench_suite {
+  const char *name;
+  unsigned key_bits;
+  unsigned tag_bits;
+  unsigned key_len;                  // master key and salt, in bytes
+  void (*rtp_policy)(crypto_policy_t *);
+  void (*rtcp_policy)(crypto_policy_t *);
+} bench_suite;
+
+/* The suites transport_srtp.c can offer, with the policies it sets up for each one */
+static const bench_suite suites[] = {
+  { "AES_256_CM_HMAC_SHA1_80", 256, 80, 46, &crypto_policy_set_aes_cm_256_hmac_sha1_80, &crypto_policy_set_aes_cm_256_hmac_sha1_80 },
+  { "AES_256_CM_HMAC_SHA1_32", 256, 32, 46, &crypto_policy_set_aes_cm_256_hmac_sha1_32, &crypto_policy_set_aes_cm_256_hmac_sha1_80 },
+  { "AES_CM_128_HMAC_SHA1_80", 128, 80, 30, &crypto_policy_set_aes_cm_128_hmac_sha1_80, &crypto_policy_set_aes_cm_128_hmac_sha1_80 },
+  { "AES_CM_128_HMAC_SHA1_32", 128, 32, 30, &crypto_policy_set_aes_cm_128_hmac_sha1_32, &crypto_policy_set_aes_cm_128_hmac_sha1_80 }
+};
+
+/* The calibration. It's read and replaced in PJLIB's critical section, which outlives any lock the module could own. */
+static struct srtp_bench {
+  pj_bool_t initialized;
+  pj_srtp_bench_result results[PJ_SRTP_BENCH_MAX_SUITES];
+  unsigned count;
+} bench;
+
+static const bench_suite *find_suite(const char *name)
+{
+  for (unsigned i = 0; i < PJ_ARRAY_SIZE(suites); i++) {
+    if (pj_ansi_stricmp(suites[i].name, name) == 0) {
+      return &suites[i];
+    }
+  }
+
+  return NULL;
+}
+
+static pj_status_t create_session(const bench_suite *suite, ssrc_type_t direction, unsigned char *key, srtp_t *session)
+{
+  srtp_policy_t policy;
+  pj_bzero(&policy, sizeof(policy));
+
+  suite->rtp_policy(&policy.rtp);
+  suite->rtcp_policy(&policy.rtcp);
+  policy.ssrc.type = direction;
+  policy.key = key;
+  policy.window_size = 128;
+  policy.next = NULL;
+
+  return srtp_create(session, &policy) == err_status_ok ? PJ_SUCCESS : PJ_ENOTSUP;
+}
+
+static void write_packet(unsigned char *packet, pj_uint16_t seq)
+{
+  pj_uint32_t ts = (pj_uint32_t) seq * PJ_SRTP_BENCH_PAYLOAD;
+
+  packet[0] = 0x80;                  // version 2, no padding, extension or CSRCs
+  packet[1] = 0;                     // PCMU
+  packet[2] = (unsigned char) (seq >> 8);
+  packet[3] = (unsigned char) seq;
+  packet[4] = (unsigned char) (ts >> 24);
+  packet[5] = (unsigned char) (ts >> 16);
+  packet[6] = (unsigned char) (ts >> 8);
+  packet[7] = (unsigned char) ts;
+  packet[8] = 0x5b;
+  packet[9] = 0x1d;
+  packet[10] = 0x42;
+  packet[11] = 0x07;
+
+  for (unsigned i = 0; i < PJ_SRTP_BENCH_PAYLOAD; i++) {
+    packet[SRTP_BENCH_RTP_HEADER + i] = (unsigned char) pj_rand();
+  }
+}
+
+/* Protects and unprotects one batch, adding the time each took */
+static pj_status_t run_batch(srtp_t tx, srtp_t rx, unsigned char *packets, pj_uint16_t *seq,
+                             pj_uint64_t *protect_nsec, pj_uint64_t *unprotect_nsec)
+{
+  int lengths[SRTP_BENCH_BATCH];
+  pj_timestamp start, end;
+
+  for (unsigned i = 0; i < SRTP_BENCH_BATCH; i++) {
+    write_packet(packets + i * SRTP_BENCH_PACKET_SIZE, (*seq)++);
+    lengths[i] = SRTP_BENCH_RTP_HEADER + PJ_SRTP_BENCH_PAYLOAD;
+  }
+
+  pj_get_timestamp(&start);
+  for (unsigned i = 0; i < SRTP_BENCH_BATCH; i++) {
+    if (srtp_protect(tx, packets + i * SRTP_BENCH_PACKET_SIZE, &lengths[i]) != err_status_ok) {
+      return PJ_EBUG;
+    }
+  }
+  pj_get_timestamp(&end);
+  *protect_nsec += pj_elapsed_nanosec(&start, &end);
+
+  pj_get_timestamp(&start);
+  for (unsigned i = 0; i < SRTP_BENCH_BATCH; i++) {
+    if (srtp_unprotect(rx, packets + i * SRTP_BENCH_PACKET_SIZE, &lengths[i]) != err_status_ok) {
+      return PJ_EBUG;
+    }
+  }
+  pj_get_timestamp(&end);
+  *unprotect_nsec += pj_elapsed_nanosec(&start, &end);
+
+  return PJ_SUCCESS;
+}
+
+pj_status_t pj_srtp_bench_run(pj_pool_t *pool, const char *name, unsigned packets, pj_srtp_bench_result *result)
+{
+  const bench_suite *suite = find_suite(name);
+  if (suite == NULL) {
+    return PJ_ENOTSUP;
+  }
+
+  unsigned char key[SRTP_BENCH_MAX_KEY];
+  for (unsigned i = 0; i < suite->key_len; i++) {
+    key[i] = (unsigned char) pj_rand();
+  }
+
+  srtp_t tx = NULL, rx = NULL;
+  pj_status_t status = create_session(suite, ssrc_any_outbound, key, &tx);
+  if (status == PJ_SUCCESS) {
+    status = create_session(suite, ssrc_any_inbound, key, &rx);
+  }
+
+  unsigned char *buffer = pj_pool_alloc(pool, SRTP_BENCH_BATCH * SRTP_BENCH_PACKET_SIZE);
+  unsigned batches = PJ_MAX(1, (packets + SRTP_BENCH_BATCH - 1) / SRTP_BENCH_BATCH);
+  pj_uint64_t protect_nsec = 0, unprotect_nsec = 0;
+  pj_uint16_t seq = 1;
+
+  // The first batch pays for key derivation and cold caches, and isn't counted
+  if (status == PJ_SUCCESS) {
+    status = run_batch(tx, rx, buffer, &seq, &protect_nsec, &unprotect_nsec);
+    protect_nsec = unprotect_nsec = 0;
+  }
+
+  for (unsigned i = 0; i < batches && status == PJ_SUCCESS; i++) {
+    status = run_batch(tx, rx, buffer, &seq, &protect_nsec, &unprotect_nsec);
+  }
+
+  if (tx != NULL) {
+    srtp_dealloc(tx);
+  }
+  if (rx != NULL) {
+    srtp_dealloc(rx);
+  }
+
+  if (status != PJ_SUCCESS) {
+    return status;
+  }
+
+  result->name = suite->name;
+  result->key_bits = suite->key_bits;
+  result->tag_bits = suite->tag_bits;
+  result->protect_nsec = (unsigned) (protect_nsec / (batches * SRTP_BENCH_BATCH));
+  result->unprotect_nsec = (unsigned) (unprotect_nsec / (batches * SRTP_BENCH_BATCH));
+
+  return PJ_SUCCESS;
+}
+
+static int compare_results(const pj_srtp_bench_result *a, const pj_srtp_bench_result *b, pj_srtp_bench_order order)
+{
+  if (order == PJ_SRTP_BENCH_ORDER_STRONGEST && a->key_bits != b->key_bits) {
+    return a->key_bits > b->key_bits ? -1 : 1;
+  }
+
+  if (order != PJ_SRTP_BENCH_ORDER_FASTEST && a->tag_bits != b->tag_bits) {
+    return a->tag_bits > b->tag_bits ? -1 : 1;
+  }
+
+  unsigned cost_a = a->protect_nsec + a->unprotect_nsec;
+  unsigned cost_b = b->protect_nsec + b->unprotect_nsec;
+  if (cost_a != cost_b) {
+    return cost_a < cost_b ? -1 : 1;
+  }
+
+  return 0;
+}
+
+void pj_srtp_bench_sort(pj_srtp_bench_result results[], unsigned count, pj_srtp_bench_order order)
+{
+  // Insertion sort keeps suites that tie in their original order
+  for (unsigned i = 1; i < count; i++) {
+    pj_srtp_bench_result result = results[i];
+    unsigned j = i;
+
+    while (j > 0 && compare_results(&result, &results[j - 1], order) < 0) {
+      results[j] = results[j - 1];
+      j--;
+    }
+
+    results[j] = result;
+  }
+}
+
+pj_status_t pj_srtp_bench_calibrate(pj_pool_factory *pf, pj_srtp_bench_order order, unsigned packets)
+{
+  pj_srtp_bench_result results[PJ_SRTP_BENCH_MAX_SUITES];
+  unsigned count = 0;
+
+  pj_pool_t *pool = pj_pool_create(pf, "srtpbench", SRTP_BENCH_BATCH * SRTP_BENCH_PACKET_SIZE, 256, NULL);
+  if (pool == NULL) {
+    return PJ_ENOMEM;
+  }
+
+  // Suites are measured outside the critical section, and calls keep using the previous calibration until it's done
+  for (unsigned i = 0; i < PJ_ARRAY_SIZE(suites) && count < PJ_SRTP_BENCH_MAX_SUITES; i++) {
+    pj_status_t status = pj_srtp_bench_run(pool, suites[i].name, packets, &results[count]);
+    if (status != PJ_SUCCESS) {
+      PJ_PERROR(4, (THIS_FILE, status, "Not calibrating SRTP suite %s", suites[i].name));
+      continue;
+    }
+
+    PJ_LOG(4, (THIS_FILE, "SRTP suite %s costs %u ns to protect and %u ns to unprotect a packet", suites[i].name,
+               results[count].protect_nsec, results[count].unprotect_nsec));
+    count++;
+  }
+
+  pj_pool_release(pool);
+
+  pj_srtp_bench_sort(results, count, order);
+
+  pj_enter_critical_section();
+  pj_memcpy(bench.results, results, count * sizeof(results[0]));
+  bench.count = count;
+  bench.initialized = PJ_TRUE;
+  pj_leave_critical_section();
+
+  return PJ_SUCCESS;
+}
+
+void pj_srtp_bench_shutdown(void)
+{
+  pj_enter_critical_section();
+  bench.initialized = PJ_FALSE;
+  bench.count = 0;
+  pj_leave_critical_section();
+}
+
+void pj_srtp_bench_apply(pjmedia_srtp_setting *setting)
+{
+  pjmedia_srtp_crypto ordered[PJMEDIA_SRTP_MAX_CRYPTOS];
+  pj_bool_t used[PJMEDIA_SRTP_MAX_CRYPTOS] = { PJ_FALSE };
+  unsigned count = 0;
+
+  pj_enter_critical_section();
+  if (!bench.initialized) {
+    pj_leave_critical_section();
+    return;
+  }
+
+  for (unsigned i = 0; i < bench.count; i++) {
+    for (unsigned j = 0; j < setting->crypto_count; j++) {
+      if (!used[j] && pj_stricmp2(&setting->crypto[j].name, bench.results[i].name) == 0) {
+        ordered[count++] = setting->crypto[j];
+        used[j] = PJ_TRUE;
+        break;
+      }
+    }
+  }
+  pj_leave_critical_section();
+
+  for (unsigned j = 0; j < setting->crypto_count; j++) {
+    if (!used[j]) {
+      ordered[count++] = setting->crypto[j];
+    }
+  }
+
+  pj_memcpy(setting->crypto, ordered, count * sizeof(ordered[0]));
+}
+
+void pj_srtp_bench_get_results(pj_srtp_bench_result results[], unsigned *count)
+{
+  pj_enter_critical_section();
+  *count = bench.initialized ? PJ_MIN(*count, bench.count) : 0;
+  pj_memcpy(results, bench.results, *count * sizeof(results[0]));
+  pj_leave_critical_section();
+}
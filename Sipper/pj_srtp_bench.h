@@ -0,0 +1,94 @@
+//
+//  pj_srtp_bench.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#ifndef pj_srtp_bench_h
+#define pj_srtp_bench_h
+
+#import <pjsua.h>
+
+/* Most suites that can be benchmarked */
+#define PJ_SRTP_BENCH_MAX_SUITES  8
+
+/* RTP payload of a 20 ms G.711 frame, the largest audio frame offered at the default ptime */
+#define PJ_SRTP_BENCH_PAYLOAD     160
+
+/*
+ * How calibrated suites are ordered in offers
+ */
+typedef enum pj_srtp_bench_order {
+  /** 80-bit authentication tags before 32-bit ones, then the cheapest suite first */
+  PJ_SRTP_BENCH_ORDER_BALANCED,
+  /** 256-bit keys before 128-bit ones, 80-bit tags before 32-bit ones, then the cheapest suite first */
+  PJ_SRTP_BENCH_ORDER_STRONGEST,
+  /** The cheapest suite first */
+  PJ_SRTP_BENCH_ORDER_FASTEST
+} pj_srtp_bench_order;
+
+/**
+ * The measured cost of one suite */
+typedef struct pj_srtp_bench_result {
+  /** Name of the suite, as it appears in a=crypto attributes */
+  const char *name;
+  /** Length of the master key, in bits */
+  unsigned key_bits;
+  /** Length of the RTP authentication tag, in bits */
+  unsigned tag_bits;
+  /** Average time to protect one packet, in nanoseconds */
+  unsigned protect_nsec;
+  /** Average time to unprotect one packet, in nanoseconds */
+  unsigned unprotect_nsec;
+} pj_srtp_bench_result;
+
+/*
+ * Measure what protecting and unprotecting one packet costs with a suite. Packets carry PJ_SRTP_BENCH_PAYLOAD bytes,
+ * as a 20 ms frame would, and are protected and unprotected in batches of one second of audio so that the clock is
+ * read once per batch. libsrtp must have been initialized, which PJSUA does when it starts its media subsystem.
+ * @param pool     Pool for the packet buffers.
+ * @param name     Name of the suite, like AES_CM_128_HMAC_SHA1_80.
+ * @param packets  Number of packets to measure, after a warm-up batch.
+ * @param result   The measured cost.
+ * @return         PJ_ENOTSUP if libsrtp doesn't have the suite.
+ */
+pj_status_t pj_srtp_bench_run(pj_pool_t *pool, const char *name, unsigned packets, pj_srtp_bench_result *result);
+
+/*
+ * Benchmark every suite PJMEDIA can offer, and remember the order they should be offered in. Suites that libsrtp
+ * doesn't have are left out. Calls keep the previous calibration until this one is done, and it's safe to calibrate
+ * while other threads apply or read the calibration.
+ * @param pf       Pool factory for the packet buffers.
+ * @param order    How suites are ordered.
+ * @param packets  Number of packets to measure each suite with.
+ */
+pj_status_t pj_srtp_bench_calibrate(pj_pool_factory *pf, pj_srtp_bench_order order, unsigned packets);
+
+/*
+ * Forget the calibration
+ */
+void pj_srtp_bench_shutdown(void);
+
+/*
+ * Sort results in the order they should be offered in. This is what the calibration is ordered with, and is
+ * exposed for testing.
+ */
+void pj_srtp_bench_sort(pj_srtp_bench_result results[], unsigned count, pj_srtp_bench_order order);
+
+/*
+ * Reorder the crypto suites of an SRTP setting to match the calibration. Suites that weren't benchmarked are
+ * offered last, in their original order. The setting is left alone if there's no calibration.
+ */
+void pj_srtp_bench_apply(pjmedia_srtp_setting *setting);
+
+/*
+ * Get the calibrated suites, in the order they're offered in
+ * @param results  Array to copy the results into.
+ * @param count    On input, the size of the array. On output, the number of results copied, which is 0 if there's
+ *                 no calibration.
+ */
+void pj_srtp_bench_get_results(pj_srtp_bench_result results[], unsigned *count);
+
+#endif /* pj_srtp_bench_h */
@@ -0,0 +1,197 @@
+//
+//  SBSCallFutureTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SBSAccount.h"
+#import "SBSAccountConfiguration.h"
+#import "SBSCall.h"
+#import "SBSCallFuture+Internal.h"
+#import "SBSEndpoint.h"
+#import "SBSEndpointConfiguration.h"
+#import "SBSTransportConfiguration.h"
+
+/**
+ * Calls acted on by the bulk benchmark
+ */
+static NSUInteger const BulkTestCalls = 32;
+
+/**
+ * Times every call is acted on in the bulk benchmark
+ */
+static NSUInteger const BulkTestRounds = 100;
+
+@interface SBSCallFutureTests : XCTestCase
+
+@end
+
+@implementation SBSCallFutureTests
+
+- (NSError *)error {
+  return [NSError errorWithDomain:@"test" code:1 userInfo:nil];
+}
+
+- (void)waitFor:(SBSCallFuture *)future {
+  XCTestExpectation *expectation = [self expectationWithDescription:@"completed"];
+  [future onComplete:^(BOOL successful, NSError *error) {
+    XCTAssertTrue([NSThread isMainThread]);
+    [expectation fulfill];
+  }];
+
+  [self waitForExpectationsWithTimeout:10 handler:nil];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testThenRunsTheNextActionOnSuccess {
+  SBSCallFuture *first = [[SBSCallFuture alloc] init];
+  SBSCallFuture *second = [[SBSCallFuture alloc] init];
+  __block BOOL started = NO;
+
+  SBSCallFuture *chained = [first then:^SBSCallFuture * {
+    started = YES;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+      [second resolveWithError:nil];
+    });
+    return second;
+  }];
+
+  [first resolveWithError:nil];
+  [self waitFor:chained];
+
+  XCTAssertTrue(started);
+  XCTAssertTrue(chained.successful);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testThenSkipsTheNextActionOnFailure {
+  SBSCallFuture *first = [[SBSCallFuture alloc] init];
+  __block BOOL started = NO;
+
+  SBSCallFuture *chained = [first then:^SBSCallFuture * {
+    started = YES;
+    return [[SBSCallFuture alloc] init];
+  }];
+
+  [first resolveWithError:[self error]];
+  [self waitFor:chained];
+
+  XCTAssertFalse(started);
+  XCTAssertFalse(chained.successful);
+  XCTAssertEqual(chained.error.code, 1);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testAllWaitsForEveryFuture {
+  NSArray<SBSCallFuture *> *futures = @[[[SBSCallFuture alloc] init], [[SBSCallFuture alloc] init], [[SBSCallFuture alloc] init]];
+  SBSCallFuture *all = [SBSCallFuture all:futures];
+
+  [futures[1] resolveWithError:[self error]];
+  [futures[0] resolveWithError:nil];
+  XCTAssertFalse(all.completed);
+
+  [futures[2] resolveWithError:nil];
+  [self waitFor:all];
+
+  XCTAssertFalse(all.successful);
+  XCTAssertEqual(all.error.code, 1);
+  XCTAssertTrue([SBSCallFuture all:@[]].successful);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCompletesOnce {
+  SBSCallFuture *future = [[SBSCallFuture alloc] init];
+  [future resolveWithError:nil];
+  [future resolveWithError:[self error]];
+
+  // Blocks added afterwards still run
+  [self waitFor:future];
+  XCTAssertTrue(future.successful);
+  XCTAssertNil(future.error);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCompletesOnItsQueue {
+  static void *QueueKey = &QueueKey;
+  dispatch_queue_t queue = dispatch_queue_create("events", DISPATCH_QUEUE_SERIAL);
+  dispatch_queue_set_specific(queue, QueueKey, QueueKey, NULL);
+
+  SBSCallFuture *future = [[SBSCallFuture alloc] initWithQueue:queue];
+  SBSCallFuture *chained = [future then:^SBSCallFuture * {
+    return [SBSCallFuture all:@[[[SBSCallFuture alloc] initWithQueue:queue]]];
+  }];
+
+  XCTestExpectation *expectation = [self expectationWithDescription:@"completed"];
+  [chained onComplete:^(BOOL successful, NSError *error) {
+    XCTAssertEqual(dispatch_get_specific(QueueKey), QueueKey);
+    [expectation fulfill];
+  }];
+
+  [future resolveWithError:[self error]];
+  [self waitForExpectationsWithTimeout:10 handler:nil];
+  XCTAssertEqual(chained.error.code, 1);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testBulkControlBenchmark {
+  SBSEndpointConfiguration *configuration = [[SBSEndpointConfiguration alloc] init];
+  configuration.transportConfigurations = @[[SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeUDP]];
+
+  SBSAccountConfiguration *accountConfiguration = [[SBSAccountConfiguration alloc] init];
+  accountConfiguration.sipProxyServer = @"sip:127.0.0.1:5080";
+  accountConfiguration.sipDomain = @"test.com";
+  accountConfiguration.sipAccount = @"test";
+  accountConfiguration.sipPassword = @"asdf";
+
+  NSError *error;
+  SBSEndpoint *endpoint = [SBSEndpoint sharedEndpoint];
+  XCTAssertTrue([endpoint initializeEndpointWithConfiguration:configuration error:&error], @"%@", error);
+  SBSAccount *account = [endpoint createAccountWithConfiguration:accountConfiguration error:&error];
+  XCTAssertNotNil(account, @"%@", error);
+
+  // Calls that aren't placed can be acted on without a remote, and fail the same way each time. That leaves the
+  // cost of getting to the background thread and back, which is what bulk actions save.
+  NSMutableArray<SBSCall *> *calls = [[NSMutableArray alloc] init];
+  for (NSUInteger i = 0; i < BulkTestCalls; i++) {
+    [calls addObject:[account callWithDestination:[NSString stringWithFormat:@"sip:%lu@test.com", (unsigned long) i] headers:nil start:NO]];
+  }
+
+  NSDate *start = [NSDate date];
+  for (NSUInteger round = 0; round < BulkTestRounds; round++) {
+    NSMutableArray<SBSCallFuture *> *futures = [[NSMutableArray alloc] init];
+    for (SBSCall *call in calls) {
+      [futures addObject:[call hold]];
+    }
+
+    SBSCallFuture *all = [SBSCallFuture all:futures];
+    [self waitFor:all];
+    XCTAssertEqual(all.error.code, SBSCallErrorCallNotReady);
+  }
+  NSTimeInterval individual = -[start timeIntervalSinceNow];
+
+  start = [NSDate date];
+  for (NSUInteger round = 0; round < BulkTestRounds; round++) {
+    SBSCallFuture *all = [endpoint holdAll];
+    [self waitFor:all];
+    XCTAssertEqual(all.error.code, SBSCallErrorCallNotReady);
+  }
+  NSTimeInterval bulk = -[start timeIntervalSinceNow];
+
+  NSLog(@"Holding %lu calls: %.1f us one at a time, %.1f us with holdAll", (unsigned long) BulkTestCalls,
+        individual / BulkTestRounds * 1e6, bulk / BulkTestRounds * 1e6);
+
+  [calls removeAllObjects];
+  [endpoint destroyEndpointWithError:nil];
+}
+
+@end
@@ -0,0 +1,199 @@
+//
+//  SBSCallRecordStoreTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SBSCallRecord.h"
+#import "SBSCallRecordStore.h"
+
+@interface SBSCallRecordStoreTests : XCTestCase
+
+@end
+
+@implementation SBSCallRecordStoreTests {
+  NSString *_directory;
+  NSString *_path;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  _directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+  _path = [_directory stringByAppendingPathComponent:@"calls"];
+  [[NSFileManager defaultManager] createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeItemAtPath:_directory error:nil];
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallRecord *)recordWithStatus:(NSInteger)status {
+  NSDate *startedAt = [NSDate dateWithTimeIntervalSince1970:1495200000];
+  return [[SBSCallRecord alloc] initWithSequence:0
+                                            uuid:[NSUUID UUID]
+                                       direction:SBSCallDirectionInbound
+                                          remote:@"\"Alice\" <sip:alice@example.com>"
+                                       startedAt:startedAt
+                                        activeAt:[startedAt dateByAddingTimeInterval:4]
+                                     completedAt:[startedAt dateByAddingTimeInterval:64]
+                                        duration:60
+                                      statusCode:status
+                                       transport:@"TLS"
+                                           codec:@"opus/48000"
+                                        lossRate:0.02f
+                                  remoteLossRate:0.01f
+                                          jitter:0.004
+                                   roundTripTime:0.120];
+}
+
+- (SBSCallRecordStore *)openWithCapacity:(NSUInteger)capacity files:(NSUInteger)files {
+  NSError *error;
+  SBSCallRecordStore *store = [[SBSCallRecordStore alloc] initWithPath:_path capacity:capacity files:files error:&error];
+  XCTAssertNotNil(store, @"%@", error);
+  return store;
+}
+
+- (NSArray<SBSCallRecord *> *)recordsInStore:(SBSCallRecordStore *)store {
+  NSMutableArray<SBSCallRecord *> *records = [[NSMutableArray alloc] init];
+  [store enumerateRecordsUsingBlock:^(SBSCallRecord *record, BOOL *stop) {
+    [records addObject:record];
+  }];
+  return records;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testRecordsRoundTrip {
+  SBSCallRecordStore *store = [self openWithCapacity:16 files:2];
+  SBSCallRecord *record = [self recordWithStatus:200];
+  [store appendRecord:record];
+  [store close];
+
+  NSArray<SBSCallRecord *> *records = [self recordsInStore:[self openWithCapacity:16 files:2]];
+  XCTAssertEqual(records.count, 1);
+
+  SBSCallRecord *read = records.firstObject;
+  XCTAssertEqual(read.sequence, 1);
+  XCTAssertEqualObjects(read.uuid, record.uuid);
+  XCTAssertEqual(read.direction, SBSCallDirectionInbound);
+  XCTAssertEqualObjects(read.remote, record.remote);
+  XCTAssertEqualObjects(read.startedAt, record.startedAt);
+  XCTAssertEqualObjects(read.completedAt, record.completedAt);
+  XCTAssertEqualWithAccuracy(read.duration, 60, 0.001);
+  XCTAssertEqual(read.statusCode, 200);
+  XCTAssertEqualObjects(read.transport, @"TLS");
+  XCTAssertEqualObjects(read.codec, @"opus/48000");
+  XCTAssertEqualWithAccuracy(read.lossRate, 0.02f, 0.0001);
+  XCTAssertEqualWithAccuracy(read.jitter, 0.004, 0.000001);
+  XCTAssertEqualWithAccuracy(read.roundTripTime, 0.120, 0.000001);
+}
+
+- (void)testFullFilesAreRotatedAndTheOldestDropped {
+  SBSCallRecordStore *store = [self openWithCapacity:4 files:3];
+  for (NSInteger i = 0; i < 14; i++) {
+    [store appendRecord:[self recordWithStatus:100 + i]];
+  }
+
+  // Three files of four hold the last twelve, which puts two in the current file
+  NSArray<SBSCallRecord *> *records = [self recordsInStore:store];
+  XCTAssertEqual(records.count, 10);
+  XCTAssertEqual(records.firstObject.sequence, 5);
+  XCTAssertEqual(records.lastObject.sequence, 14);
+  XCTAssertEqual(records.lastObject.statusCode, 113);
+
+  for (NSUInteger i = 1; i < records.count; i++) {
+    XCTAssertEqual(records[i].sequence, records[i - 1].sequence + 1);
+  }
+
+  XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[_path stringByAppendingString:@".3"]]);
+}
+
+- (void)testTornRecordIsDroppedAndOverwritten {
+  SBSCallRecordStore *store = [self openWithCapacity:16 files:1];
+  for (NSInteger i = 0; i < 3; i++) {
+    [store appendRecord:[self recordWithStatus:200]];
+  }
+  [store close];
+
+  // Flip a byte in the middle of the last record, as if only some of its pages reached the disk
+  NSFileHandle *handle = [NSFileHandle fileHandleForUpdatingAtPath:_path];
+  [handle seekToFileOffset:64 + 2 * 256 + 100];
+  [handle writeData:[NSData dataWithBytes:"\xff" length:1]];
+  [handle closeFile];
+
+  store = [self openWithCapacity:16 files:1];
+  XCTAssertEqual([self recordsInStore:store].count, 2);
+
+  [store appendRecord:[self recordWithStatus:486]];
+  NSArray<SBSCallRecord *> *records = [self recordsInStore:store];
+  XCTAssertEqual(records.count, 3);
+  XCTAssertEqual(records.lastObject.sequence, 3);
+  XCTAssertEqual(records.lastObject.statusCode, 486);
+}
+
+- (void)testFileWithAnotherCapacityIsKeptAsHistory {
+  SBSCallRecordStore *store = [self openWithCapacity:8 files:2];
+  [store appendRecord:[self recordWithStatus:200]];
+  [store close];
+
+  store = [self openWithCapacity:16 files:2];
+  [store appendRecord:[self recordWithStatus:404]];
+
+  NSArray<SBSCallRecord *> *records = [self recordsInStore:store];
+  XCTAssertEqual(records.count, 2);
+  XCTAssertEqual(records.lastObject.sequence, 2);
+}
+
+- (void)testLongStringsAreTruncatedOnCharacterBoundaries {
+  NSString *remote = [@"" stringByPaddingToLength:127 withString:@"a" startingAtIndex:0];
+  remote = [remote stringByAppendingString:@"é"];
+
+  SBSCallRecordStore *store = [self openWithCapacity:4 files:1];
+  [store appendRecord:[[SBSCallRecord alloc] initWithSequence:0 uuid:[NSUUID UUID] direction:SBSCallDirectionOutbound
+                                                       remote:remote startedAt:nil activeAt:nil completedAt:nil
+                                                     duration:0 statusCode:0 transport:nil codec:nil lossRate:0
+                                               remoteLossRate:0 jitter:0 roundTripTime:0]];
+
+  SBSCallRecord *read = [self recordsInStore:store].firstObject;
+  XCTAssertEqual(read.remote.length, 127);
+  XCTAssertNil(read.startedAt);
+  XCTAssertNil(read.codec);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testAppendThroughput {
+  NSUInteger const count = 100000;
+  SBSCallRecord *record = [self recordWithStatus:200];
+  SBSCallRecordStore *store = [self openWithCapacity:4096 files:4];
+
+  // Rotations are part of the cost, so the run goes through several of them
+  NSDate *start = [NSDate date];
+  for (NSUInteger i = 0; i < count; i++) {
+    [store appendRecord:record];
+  }
+  [store synchronize];
+  NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+
+  start = [NSDate date];
+  __block NSUInteger read = 0;
+  [store enumerateRecordsUsingBlock:^(SBSCallRecord *record, BOOL *stop) {
+    read++;
+  }];
+  NSTimeInterval readElapsed = -[start timeIntervalSinceNow];
+
+  XCTAssertEqual(read, 3 * 4096 + count % 4096);
+  NSLog(@"Call records: appended %lu in %.3fs (%.0f/s), read %lu in %.3fs (%.0f/s)", (unsigned long) count, elapsed,
+        count / elapsed, (unsigned long) read, readElapsed, read / readElapsed);
+}
+
+@end
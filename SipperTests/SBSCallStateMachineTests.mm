@@ -0,0 +1,174 @@
+//
+//  SBSCallStateMachineTests.mm
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SBSCall.h"
+#import "call_state_machine.hpp"
+
+using sipper::call_action::activated;
+using sipper::call_action::ended;
+using sipper::call_action::hold_changed;
+using sipper::call_action::mute_changed;
+using sipper::call_action::started;
+using sipper::call_action::state_changed;
+using sipper::call_action::stop_ringtone;
+using sipper::call_input;
+using sipper::call_state;
+using sipper::hold_state;
+
+/**
+ * Calls driven through the machine by the throughput test
+ */
+static unsigned const ThroughputCalls = 1000000;
+
+/**
+ * The inputs of an outgoing call that's put on hold, muted, and hung up
+ */
+static call_input const OutgoingCall[] = {
+  call_input::sip_calling, call_input::sip_early, call_input::sip_connecting, call_input::sip_confirmed,
+  call_input::hold_local, call_input::hold_none, call_input::mute, call_input::unmute,
+  call_input::hangup, call_input::sip_disconnected, call_input::end
+};
+
+@interface SBSCallStateMachineTests : XCTestCase
+
+@end
+
+@implementation SBSCallStateMachineTests
+
+- (void)testStatesMatchTheCallStates {
+  XCTAssertEqual((NSInteger) call_state::pending, SBSCallStatePending);
+  XCTAssertEqual((NSInteger) call_state::disconnecting, SBSCallStateDisconnecting);
+  XCTAssertEqual((NSInteger) call_state::disconnected, SBSCallStateDisconnected);
+  XCTAssertEqual((NSInteger) call_state::calling, SBSCallStateCalling);
+  XCTAssertEqual((NSInteger) call_state::incoming, SBSCallStateIncoming);
+  XCTAssertEqual((NSInteger) call_state::early, SBSCallStateEarly);
+  XCTAssertEqual((NSInteger) call_state::connecting, SBSCallStateConnecting);
+  XCTAssertEqual((NSInteger) call_state::active, SBSCallStateActive);
+  XCTAssertEqual((NSInteger) hold_state::none, SBSHoldStateNone);
+  XCTAssertEqual((NSInteger) hold_state::local, SBSHoldStateLocal);
+  XCTAssertEqual((NSInteger) hold_state::remote, SBSHoldStateRemote);
+}
+
+- (void)testIncomingCallRingsUntilAnswered {
+  sipper::call_state_machine<> machine;
+
+  sipper::call_transition transition = machine.apply(call_input::sip_incoming);
+  XCTAssertEqual(machine.state(), call_state::incoming);
+  XCTAssertEqual(transition.actions, (uint8_t) (state_changed | started));
+
+  // Saying it's ringing doesn't stop the ringtone, but answering it does
+  transition = machine.apply(call_input::sip_early);
+  XCTAssertEqual(transition.actions, (uint8_t) state_changed);
+  transition = machine.apply(call_input::answer);
+  XCTAssertEqual(machine.state(), call_state::early);
+  XCTAssertEqual(transition.actions, (uint8_t) stop_ringtone);
+
+  machine.apply(call_input::sip_connecting);
+  transition = machine.apply(call_input::sip_confirmed);
+  XCTAssertEqual(machine.state(), call_state::active);
+  XCTAssertTrue(transition.has(activated));
+  XCTAssertFalse(transition.has(started));
+
+  // Only the first time the call is active counts
+  machine.apply(call_input::sip_connecting);
+  XCTAssertFalse(machine.apply(call_input::sip_confirmed).has(activated));
+}
+
+- (void)testHangupWaitsForTheSessionToDisconnect {
+  sipper::call_state_machine<> machine;
+  machine.apply(call_input::sip_calling);
+  machine.apply(call_input::sip_early);
+
+  sipper::call_transition transition = machine.apply(call_input::hangup);
+  XCTAssertEqual(machine.state(), call_state::disconnecting);
+  XCTAssertEqual(transition.from, (uint8_t) call_state::early);
+  XCTAssertEqual(transition.actions, (uint8_t) (state_changed | stop_ringtone));
+
+  // The session can still be answered while the hangup is on its way, which the call doesn't hear about
+  transition = machine.apply(call_input::sip_confirmed);
+  XCTAssertEqual(machine.state(), call_state::disconnecting);
+  XCTAssertFalse(transition.has(state_changed));
+  XCTAssertFalse(transition.has(activated));
+
+  transition = machine.apply(call_input::sip_disconnected);
+  XCTAssertEqual(machine.state(), call_state::disconnected);
+  XCTAssertTrue(transition.has(state_changed));
+  XCTAssertTrue(transition.has(ended));
+}
+
+- (void)testDisconnectedCallStaysDisconnected {
+  sipper::call_state_machine<> machine;
+  machine.apply(call_input::sip_incoming);
+  XCTAssertTrue(machine.apply(call_input::end).has(state_changed));
+
+  for (uint8_t input = 0; input <= (uint8_t) call_input::end; input++) {
+    sipper::call_transition transition = machine.apply((call_input) input);
+    XCTAssertEqual(machine.state(), call_state::disconnected);
+    XCTAssertFalse(transition.has(state_changed));
+    XCTAssertFalse(transition.has(ended));
+  }
+}
+
+- (void)testHoldAndMuteChangeOnlyOnce {
+  sipper::call_state_machine<> machine;
+
+  XCTAssertEqual(machine.apply(call_input::hold_none).actions, (uint8_t) 0);
+  XCTAssertEqual(machine.apply(call_input::hold_remote).actions, hold_changed);
+  XCTAssertEqual(machine.hold(), hold_state::remote);
+  XCTAssertEqual(machine.apply(call_input::hold_remote).actions, (uint8_t) 0);
+  XCTAssertEqual(machine.apply(call_input::hold_local).actions, hold_changed);
+
+  XCTAssertEqual(machine.apply(call_input::mute).actions, mute_changed);
+  XCTAssertTrue(machine.muted());
+  XCTAssertEqual(machine.apply(call_input::mute).actions, (uint8_t) 0);
+  XCTAssertEqual(machine.apply(call_input::unmute).actions, mute_changed);
+  XCTAssertFalse(machine.muted());
+
+  // Neither has anything to do with the call's state
+  XCTAssertEqual(machine.state(), call_state::pending);
+}
+
+- (void)testHistoryKeepsTheLastTransitions {
+  sipper::call_state_machine<4> machine;
+
+  // Inputs that do nothing aren't kept, and neither is ending a call that has already disconnected
+  machine.apply(call_input::unmute);
+  for (call_input input : OutgoingCall) {
+    machine.apply(input);
+  }
+
+  XCTAssertEqual(machine.recorded(), (uint64_t) 10);
+  XCTAssertEqual(machine.size(), (size_t) 4);
+  XCTAssertEqual(machine[0].input, call_input::mute);
+  XCTAssertEqual(machine[1].input, call_input::unmute);
+  XCTAssertEqual(machine[2].input, call_input::hangup);
+  XCTAssertEqual(machine[3].input, call_input::sip_disconnected);
+  XCTAssertEqual(machine[3].to, (uint8_t) call_state::disconnected);
+}
+
+- (void)testThroughput {
+  uint64_t transitions = 0;
+
+  NSDate *start = [NSDate date];
+  for (unsigned i = 0; i < ThroughputCalls; i++) {
+    sipper::call_state_machine<> machine;
+    for (call_input input : OutgoingCall) {
+      transitions += machine.apply(input).actions != 0;
+    }
+  }
+  NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+
+  NSUInteger inputs = ThroughputCalls * sizeof(OutgoingCall) / sizeof(OutgoingCall[0]);
+  XCTAssertEqual(transitions, (uint64_t) inputs);
+  NSLog(@"Call state machine: %lu inputs for %u calls in %.3fs (%.0f inputs/s)", (unsigned long) inputs, ThroughputCalls,
+        elapsed, inputs / elapsed);
+}
+
+@end
@@ -0,0 +1,141 @@
+//
+//  SBSCallTraceTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+
+#import "SBSPjTestCase.h"
+#import "pj_call_trace.h"
+#import "pj_cb_latency.h"
+
+@interface SBSCallTraceTests : SBSPjTestCase
+
+@end
+
+@implementation SBSCallTraceTests {
+  NSString *_path;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  _path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown {
+  pj_call_trace_shutdown();
+  [[NSFileManager defaultManager] removeItemAtPath:_path error:nil];
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (NSArray<NSDictionary *> *)eventsInFile {
+  NSData *data = [NSData dataWithContentsOfFile:_path];
+  XCTAssertNotNil(data);
+
+  NSError *error;
+  NSDictionary *trace = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+  XCTAssertNotNil(trace, @"%@", error);
+  return trace[@"traceEvents"];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testSpansAreWrittenAsChromeTraceEvents {
+  XCTAssertEqual(pj_call_trace_init(&_cp.factory, 16), PJ_SUCCESS);
+
+  pj_call_trace_id trace = pj_call_trace_create();
+  pj_str_t callId = pj_str("5b1e0f7a-\"4c1d\"");
+  pj_call_trace_bind(trace, 3, &callId);
+  pj_call_trace_span(trace, "pjsua_call_make_call", 1000000, 1500250);
+  pj_call_trace_instant(trace, "rx 180 INVITE", 2000000);
+
+  unsigned count;
+  XCTAssertEqual(pj_call_trace_write(_path.UTF8String, 0, &count), PJ_SUCCESS);
+  XCTAssertEqual(count, 2);
+
+  NSArray<NSDictionary *> *events = [self eventsInFile];
+  XCTAssertEqual(events.count, 3);
+  XCTAssertEqualObjects(events[0][@"ph"], @"M");
+  XCTAssertEqualObjects(events[0][@"args"][@"name"], @"Call 1 (5b1e0f7a-\"4c1d\")");
+
+  // Microseconds, with the nanoseconds kept as a fraction
+  XCTAssertEqualObjects(events[1][@"ph"], @"X");
+  XCTAssertEqualObjects(events[1][@"name"], @"pjsua_call_make_call");
+  XCTAssertEqualWithAccuracy([events[1][@"ts"] doubleValue], 1000, 0.0001);
+  XCTAssertEqualWithAccuracy([events[1][@"dur"] doubleValue], 500.25, 0.0001);
+  XCTAssertEqualObjects(events[2][@"ph"], @"i");
+  XCTAssertEqualObjects(events[2][@"pid"], @(trace));
+}
+
+- (void)testOneCallCanBeWritten {
+  XCTAssertEqual(pj_call_trace_init(&_cp.factory, 16), PJ_SUCCESS);
+
+  pj_call_trace_id first = pj_call_trace_create();
+  pj_call_trace_id second = pj_call_trace_create();
+  pj_call_trace_span(first, "performAsync", 0, 10);
+  pj_call_trace_span(second, "performAsync", 0, 10);
+  pj_call_trace_span(second, "pjsua_call_make_call", 10, 20);
+
+  unsigned count;
+  XCTAssertEqual(pj_call_trace_write(_path.UTF8String, second, &count), PJ_SUCCESS);
+  XCTAssertEqual(count, 2);
+
+  for (NSDictionary *event in [self eventsInFile]) {
+    XCTAssertEqualObjects(event[@"pid"], @(second));
+  }
+}
+
+- (void)testCallsAreFoundByIndexCallIdAndThread {
+  XCTAssertEqual(pj_call_trace_init(&_cp.factory, 16), PJ_SUCCESS);
+
+  pj_call_trace_id trace = pj_call_trace_create();
+  pj_str_t callId = pj_str("5b1e0f7a-4c1d");
+
+  // While the call is being made, before it's bound
+  pj_call_trace_set_current(trace);
+  XCTAssertEqual(pj_call_trace_find(3), trace);
+  XCTAssertEqual(pj_call_trace_find_message(&callId), trace);
+  pj_call_trace_set_current(0);
+  XCTAssertEqual(pj_call_trace_find(3), 0);
+
+  pj_call_trace_bind(trace, 3, &callId);
+  XCTAssertEqual(pj_call_trace_find(3), trace);
+  XCTAssertEqual(pj_call_trace_find_message(&callId), trace);
+
+  pj_call_trace_unbind(3);
+  XCTAssertEqual(pj_call_trace_find(3), 0);
+  XCTAssertEqual(pj_call_trace_find_message(&callId), 0);
+}
+
+- (void)testBufferKeepsTheMostRecentSpans {
+  XCTAssertEqual(pj_call_trace_init(&_cp.factory, 4), PJ_SUCCESS);
+
+  pj_call_trace_id trace = pj_call_trace_create();
+  for (int i = 0; i < 10; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "span %d", i);
+    pj_call_trace_span(trace, name, i, i + 1);
+  }
+
+  unsigned count;
+  XCTAssertEqual(pj_call_trace_write(_path.UTF8String, 0, &count), PJ_SUCCESS);
+  XCTAssertEqual(count, 4);
+
+  NSArray<NSDictionary *> *events = [self eventsInFile];
+  XCTAssertEqualObjects(events.firstObject[@"name"], @"span 6");
+  XCTAssertEqualObjects(events.lastObject[@"name"], @"span 9");
+}
+
+- (void)testNothingIsTracedWhenDisabled {
+  XCTAssertEqual(pj_call_trace_create(), 0);
+  XCTAssertEqual(pj_call_trace_write(_path.UTF8String, 0, NULL), PJ_EINVALIDOP);
+}
+
+@end
@@ -0,0 +1,136 @@
+//
+//  SBSCallbackLatencyTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <pjlib.h>
+
+#import "pj_cb_latency.h"
+
+@interface SBSCallbackLatencyTests : XCTestCase
+
+@end
+
+@implementation SBSCallbackLatencyTests
+
+- (void)setUp {
+  [super setUp];
+
+  pj_cb_latency_reset();
+}
+
+- (void)tearDown {
+  pj_cb_latency_reset();
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testPercentilesAreWithinTheBucketPrecision {
+  for (pj_uint64_t nsec = 1; nsec <= 100000; nsec++) {
+    pj_cb_latency_record(PJ_CB_LATENCY_CALL_STATE, nsec);
+  }
+
+  pj_cb_latency_stat stat;
+  pj_cb_latency_get_stat(PJ_CB_LATENCY_CALL_STATE, &stat);
+  XCTAssertEqual(strcmp(stat.name, "on_call_state"), 0);
+  XCTAssertEqual(stat.count, 100000);
+  XCTAssertEqual(stat.mean_nsec, 50000);
+  XCTAssertEqual(stat.max_nsec, 100000);
+
+  // Reported as the top of the bucket, so never under and at most one bucket over
+  double precision = 1.0 / (1 << PJ_CB_LATENCY_SUB_BUCKET_BITS);
+  XCTAssertGreaterThanOrEqual(stat.p50_nsec, 50000);
+  XCTAssertLessThanOrEqual(stat.p50_nsec, 50000 * (1 + precision));
+  XCTAssertGreaterThanOrEqual(stat.p99_nsec, 99000);
+  XCTAssertLessThanOrEqual(stat.p99_nsec, 100000);
+}
+
+- (void)testSmallTimesAreExact {
+  for (pj_uint64_t nsec = 1; nsec < (1 << PJ_CB_LATENCY_SUB_BUCKET_BITS); nsec++) {
+    pj_cb_latency_reset();
+    pj_cb_latency_record(PJ_CB_LATENCY_REG_STATE, nsec);
+    XCTAssertEqual(pj_cb_latency_percentile(PJ_CB_LATENCY_REG_STATE, 50), nsec);
+  }
+}
+
+- (void)testLongTimesAreClamped {
+  pj_cb_latency_record(PJ_CB_LATENCY_TRANSPORT_STATE, PJ_CB_LATENCY_MAX_NSEC * 4);
+  XCTAssertEqual(pj_cb_latency_percentile(PJ_CB_LATENCY_TRANSPORT_STATE, 100), PJ_CB_LATENCY_MAX_NSEC);
+}
+
+- (void)testCallbacksAreRecordedSeparately {
+  pj_cb_latency_record(PJ_CB_LATENCY_INCOMING_CALL, 1000);
+
+  pj_cb_latency_stat stat;
+  pj_cb_latency_get_stat(PJ_CB_LATENCY_CALL_MEDIA_STATE, &stat);
+  XCTAssertEqual(stat.count, 0);
+  XCTAssertEqual(stat.p99_nsec, 0);
+
+  pj_cb_latency_reset();
+  pj_cb_latency_get_stat(PJ_CB_LATENCY_INCOMING_CALL, &stat);
+  XCTAssertEqual(stat.count, 0);
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * Every callback timed from a thread per core at once, around a little work like the callbacks do, with the p99 of
+ * each and what timing costs
+ */
+- (void)testLoad {
+  NSUInteger const runs = 200000;
+  NSUInteger threads = [NSProcessInfo processInfo].activeProcessorCount;
+
+  NSDate *start = [NSDate date];
+  dispatch_apply(threads, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+    pj_uint32_t seed = (pj_uint32_t) thread + 1;
+    volatile pj_uint32_t sink = 0;
+
+    for (NSUInteger i = 0; i < runs; i++) {
+      pj_cb_latency_id callback = (pj_cb_latency_id) (i % PJ_CB_LATENCY_COUNT);
+      pj_uint64_t began = pj_cb_latency_now();
+
+      seed = seed * 1103515245 + 12345;
+      for (pj_uint32_t work = (seed >> 16) % (100 * (callback + 1)); work > 0; work--) {
+        sink += work;
+      }
+
+      pj_cb_latency_record(callback, pj_cb_latency_now() - began);
+    }
+  });
+  NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+
+  pj_uint64_t recorded = 0;
+  for (unsigned i = 0; i < PJ_CB_LATENCY_COUNT; i++) {
+    pj_cb_latency_stat stat;
+    pj_cb_latency_get_stat((pj_cb_latency_id) i, &stat);
+    recorded += stat.count;
+
+    XCTAssertLessThanOrEqual(stat.p50_nsec, stat.p99_nsec);
+    XCTAssertLessThanOrEqual(stat.p99_nsec, stat.max_nsec);
+    NSLog(@"%-20s p50 %6llu ns, p99 %6llu ns, p99.9 %6llu ns, max %8llu ns", stat.name, stat.p50_nsec,
+          stat.p99_nsec, stat.p999_nsec, stat.max_nsec);
+  }
+  XCTAssertEqual(recorded, runs * threads);
+
+  // Timing an empty callback is two clock reads and a record
+  pj_cb_latency_reset();
+  pj_uint64_t began = pj_cb_latency_now();
+  for (NSUInteger i = 0; i < runs; i++) {
+    pj_uint64_t now = pj_cb_latency_now();
+    pj_cb_latency_record(PJ_CB_LATENCY_CALL_STATE, pj_cb_latency_now() - now);
+  }
+  pj_uint64_t overhead = (pj_cb_latency_now() - began) / runs;
+
+  NSLog(@"Callback latency: %lu runs across %lu threads in %.3fs, %llu ns to time a callback",
+        (unsigned long) (runs * threads), (unsigned long) threads, elapsed, overhead);
+}
+
+@end
@@ -0,0 +1,473 @@
+//
+//  SBSCallbackReplayTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SBSAccount.h"
+#import "SBSAccountConfiguration.h"
+#import "SBSCallbackReplayStatistics.h"
+#import "SBSEndpoint.h"
+#import "SBSEndpointConfiguration.h"
+#import "SBSEventDeliveryStatistics.h"
+#import "SBSTransportConfiguration.h"
+#import "pj_cb_record.h"
+
+#import <pthread.h>
+
+/**
+ * Calls in each recording, half of them incoming and half outgoing
+ */
+static NSUInteger const ReplayTestCalls = 2000;
+
+/**
+ * Called by libmalloc for every allocation and free, which is how malloc stack logging sees them. It's private to
+ * libmalloc, so only the tests hook it, to count what the endpoint's thread allocates while it replays.
+ */
+typedef void (ReplayMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t frames);
+extern ReplayMallocLogger *malloc_logger;
+
+/**
+ * The type flag malloc_logger is called with for allocations, which reallocations have as well
+ */
+static uint32_t const ReplayMallocLogAllocate = 0x2;
+
+static pthread_t replayThread;
+static volatile NSUInteger replayAllocations;
+static ReplayMallocLogger *replayPreviousMallocLogger;
+
+static void countReplayAllocation(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t frames) {
+  if ((type & ReplayMallocLogAllocate) != 0 && pthread_equal(pthread_self(), replayThread)) {
+    replayAllocations++;
+  }
+
+  // Malloc stack logging may have been using the hook first
+  ReplayMallocLogger *previous = replayPreviousMallocLogger;
+  if (previous != NULL) {
+    previous(type, arg1, arg2, arg3, result, frames);
+  }
+}
+
+@interface SBSCallbackReplayTests : XCTestCase
+
+@end
+
+@implementation SBSCallbackReplayTests {
+  NSString *_path;
+  SBSAccount *_account;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  [self startEndpoint:nil];
+  _path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeItemAtPath:_path error:nil];
+  _account = nil;
+  [[SBSEndpoint sharedEndpoint] destroyEndpointWithError:nil];
+
+  [super tearDown];
+}
+
+- (void)startEndpoint:(void (^)(SBSEndpointConfiguration *configuration))configure {
+  SBSEndpointConfiguration *configuration = [[SBSEndpointConfiguration alloc] init];
+  configuration.transportConfigurations = @[[SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeUDP]];
+  if (configure != nil) {
+    configure(configuration);
+  }
+
+  SBSAccountConfiguration *accountConfiguration = [[SBSAccountConfiguration alloc] init];
+  accountConfiguration.sipProxyServer = @"sip:127.0.0.1:5080";
+  accountConfiguration.sipDomain = @"test.com";
+  accountConfiguration.sipAccount = @"test";
+  accountConfiguration.sipPassword = @"asdf";
+
+  NSError *error;
+  SBSEndpoint *endpoint = [SBSEndpoint sharedEndpoint];
+  XCTAssertTrue([endpoint initializeEndpointWithConfiguration:configuration error:&error], @"%@", error);
+  _account = [endpoint createAccountWithConfiguration:accountConfiguration error:&error];
+  XCTAssertNotNil(_account, @"%@", error);
+}
+
+//------------------------------------------------------------------------------
+// Recordings are written by hand, in the format pj_cb_record writes, so calls can be replayed without being made
+//------------------------------------------------------------------------------
+
+static void appendVarint(NSMutableData *data, uint64_t value) {
+  uint8_t bytes[10];
+  unsigned length = 0;
+
+  while (value >= 0x80) {
+    bytes[length++] = (uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+  bytes[length++] = (uint8_t) value;
+
+  [data appendBytes:bytes length:length];
+}
+
+static void appendString(NSMutableData *data, const char *string) {
+  size_t length = string != NULL ? strlen(string) : 0;
+  appendVarint(data, length);
+  [data appendBytes:string length:length];
+}
+
+static void appendEvent(NSMutableData *data, const pj_cb_record_event *event, const char *remote, const char *callId,
+                        const char *codec, const char *method, const char *message) {
+  uint8_t type = (uint8_t) event->type;
+  [data appendBytes:&type length:1];
+  appendVarint(data, 1000);
+  appendVarint(data, (uint64_t) (event->acc_id + 1));
+  appendVarint(data, (uint64_t) (event->call_id + 1));
+
+  uint8_t hasInfo = 1;
+  [data appendBytes:&hasInfo length:1];
+  appendVarint(data, event->state);
+  appendVarint(data, event->last_status);
+  appendString(data, remote);
+  appendString(data, callId);
+  appendString(data, codec);
+  appendVarint(data, event->media_cnt);
+  for (unsigned i = 0; i < event->media_cnt; i++) {
+    appendVarint(data, event->media[i].type);
+    appendVarint(data, event->media[i].status);
+    appendVarint(data, event->media[i].dir);
+  }
+
+  if (event->type == PJ_CB_RECORD_CALL_TSX_STATE) {
+    appendVarint(data, event->role);
+    appendString(data, method);
+    appendVarint(data, event->tsx_state);
+    appendVarint(data, (uint64_t) event->transport_err);
+    appendVarint(data, event->event_type);
+  }
+
+  appendString(data, message);
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * Appends the callbacks of a call that rings, is answered, has audio, and is hung up by the remote
+ */
+- (NSUInteger)appendIncomingCall:(NSUInteger)index toData:(NSMutableData *)data {
+  NSString *invite = [NSString stringWithFormat:@"INVITE sip:test@test.com SIP/2.0\r\n"
+                                                 "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK-%lu\r\n"
+                                                 "From: \"Alice\" <sip:alice@test.com>;tag=a%lu\r\n"
+                                                 "To: <sip:test@test.com>\r\n"
+                                                 "Call-ID: call-%lu\r\n"
+                                                 "CSeq: 1 INVITE\r\n"
+                                                 "Contact: <sip:alice@10.0.0.1:5060>\r\n"
+                                                 "Max-Forwards: 70\r\n"
+                                                 "Content-Length: 0\r\n\r\n",
+                                                 (unsigned long) index, (unsigned long) index, (unsigned long) index];
+  NSString *bye = [invite stringByReplacingOccurrencesOfString:@"INVITE" withString:@"BYE"];
+  const char *callId = [NSString stringWithFormat:@"call-%lu", (unsigned long) index].UTF8String;
+  const char *remote = "\"Alice\" <sip:alice@test.com>";
+
+  pj_cb_record_event event;
+  pj_bzero(&event, sizeof(event));
+  event.acc_id = 0;
+  event.call_id = 0;
+
+  event.type = PJ_CB_RECORD_INCOMING_CALL;
+  event.state = PJSIP_INV_STATE_INCOMING;
+  appendEvent(data, &event, remote, callId, NULL, NULL, invite.UTF8String);
+
+  event.type = PJ_CB_RECORD_CALL_STATE;
+  event.state = PJSIP_INV_STATE_EARLY;
+  event.last_status = PJSIP_SC_RINGING;
+  appendEvent(data, &event, remote, callId, NULL, NULL, NULL);
+
+  event.state = PJSIP_INV_STATE_CONNECTING;
+  event.last_status = PJSIP_SC_OK;
+  appendEvent(data, &event, remote, callId, NULL, NULL, NULL);
+
+  event.type = PJ_CB_RECORD_CALL_MEDIA_STATE;
+  event.media_cnt = 1;
+  event.media[0].type = PJMEDIA_TYPE_AUDIO;
+  event.media[0].status = PJSUA_CALL_MEDIA_ACTIVE;
+  event.media[0].dir = PJMEDIA_DIR_ENCODING_DECODING;
+  appendEvent(data, &event, remote, callId, "opus/48000", NULL, NULL);
+
+  event.type = PJ_CB_RECORD_CALL_STATE;
+  event.state = PJSIP_INV_STATE_CONFIRMED;
+  appendEvent(data, &event, remote, callId, "opus/48000", NULL, NULL);
+
+  event.type = PJ_CB_RECORD_CALL_TSX_STATE;
+  event.role = PJSIP_ROLE_UAS;
+  event.tsx_state = PJSIP_TSX_STATE_TRYING;
+  event.event_type = PJSIP_EVENT_RX_MSG;
+  appendEvent(data, &event, remote, callId, "opus/48000", "BYE", bye.UTF8String);
+
+  event.type = PJ_CB_RECORD_CALL_STATE;
+  event.state = PJSIP_INV_STATE_DISCONNECTED;
+  event.media[0].status = PJSUA_CALL_MEDIA_NONE;
+  appendEvent(data, &event, remote, callId, NULL, NULL, NULL);
+
+  return 7;
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * Appends the callbacks of a call that's made, rings, is answered, has audio, and is hung up locally
+ */
+- (NSUInteger)appendOutgoingCall:(NSUInteger)index toData:(NSMutableData *)data {
+  NSString *ringing = [NSString stringWithFormat:@"SIP/2.0 180 Ringing\r\n"
+                                                  "Via: SIP/2.0/UDP 10.0.0.2:5060;branch=z9hG4bK-%lu\r\n"
+                                                  "From: <sip:test@test.com>;tag=t%lu\r\n"
+                                                  "To: <sip:bob@test.com>;tag=b%lu\r\n"
+                                                  "Call-ID: call-%lu\r\n"
+                                                  "CSeq: 1 INVITE\r\n"
+                                                  "Contact: <sip:bob@10.0.0.3:5060>\r\n"
+                                                  "Content-Length: 0\r\n\r\n",
+                                                  (unsigned long) index, (unsigned long) index, (unsigned long) index, (unsigned long) index];
+  NSString *ok = [ringing stringByReplacingOccurrencesOfString:@"180 Ringing" withString:@"200 OK"];
+  const char *callId = [NSString stringWithFormat:@"call-%lu", (unsigned long) index].UTF8String;
+  const char *remote = "<sip:bob@test.com>";
+
+  pj_cb_record_event event;
+  pj_bzero(&event, sizeof(event));
+  event.acc_id = 0;
+  event.call_id = 1;
+
+  event.type = PJ_CB_RECORD_CALL_STATE;
+  event.state = PJSIP_INV_STATE_CALLING;
+  appendEvent(data, &event, remote, callId, NULL, NULL, NULL);
+
+  event.type = PJ_CB_RECORD_CALL_TSX_STATE;
+  event.role = PJSIP_ROLE_UAC;
+  event.tsx_state = PJSIP_TSX_STATE_PROCEEDING;
+  event.event_type = PJSIP_EVENT_RX_MSG;
+  event.state = PJSIP_INV_STATE_EARLY;
+  event.last_status = PJSIP_SC_RINGING;
+  appendEvent(data, &event, remote, callId, NULL, "INVITE", ringing.UTF8String);
+
+  event.type = PJ_CB_RECORD_CALL_STATE;
+  appendEvent(data, &event, remote, callId, NULL, NULL, NULL);
+
+  event.type = PJ_CB_RECORD_CALL_TSX_STATE;
+  event.tsx_state = PJSIP_TSX_STATE_TERMINATED;
+  event.state = PJSIP_INV_STATE_CONNECTING;
+  event.last_status = PJSIP_SC_OK;
+  appendEvent(data, &event, remote, callId, NULL, "INVITE", ok.UTF8String);
+
+  event.type = PJ_CB_RECORD_CALL_MEDIA_STATE;
+  event.media_cnt = 1;
+  event.media[0].type = PJMEDIA_TYPE_AUDIO;
+  event.media[0].status = PJSUA_CALL_MEDIA_ACTIVE;
+  event.media[0].dir = PJMEDIA_DIR_ENCODING_DECODING;
+  appendEvent(data, &event, remote, callId, "PCMU/8000", NULL, NULL);
+
+  event.type = PJ_CB_RECORD_CALL_STATE;
+  event.state = PJSIP_INV_STATE_CONFIRMED;
+  appendEvent(data, &event, remote, callId, "PCMU/8000", NULL, NULL);
+
+  event.type = PJ_CB_RECORD_CALL_TSX_STATE;
+  event.tsx_state = PJSIP_TSX_STATE_CALLING;
+  event.event_type = PJSIP_EVENT_TX_MSG;
+  appendEvent(data, &event, remote, callId, "PCMU/8000", "BYE", NULL);
+
+  event.type = PJ_CB_RECORD_CALL_STATE;
+  event.state = PJSIP_INV_STATE_DISCONNECTED;
+  event.media[0].status = PJSUA_CALL_MEDIA_NONE;
+  appendEvent(data, &event, remote, callId, NULL, NULL, NULL);
+
+  return 8;
+}
+
+//------------------------------------------------------------------------------
+
+- (NSUInteger)writeRecording {
+  NSMutableData *data = [NSMutableData dataWithBytes:"SBCB\x01\0\0\0" length:8];
+  NSUInteger events = 0;
+
+  for (NSUInteger i = 0; i < ReplayTestCalls; i++) {
+    @autoreleasepool {
+      events += i % 2 == 0 ? [self appendIncomingCall:i toData:data] : [self appendOutgoingCall:i toData:data];
+    }
+  }
+
+  XCTAssertTrue([data writeToFile:_path atomically:NO]);
+  return events;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallbackReplayStatistics *)replay:(NSError **)error {
+  return [self replay:error allocations:NULL];
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSCallbackReplayStatistics *)replay:(NSError **)error allocations:(NSUInteger *)allocations {
+  SBSEndpoint *endpoint = [SBSEndpoint sharedEndpoint];
+  XCTestExpectation *expectation = [self expectationWithDescription:@"replayed"];
+  __block SBSCallbackReplayStatistics *result;
+  __block NSError *replayError;
+
+  // Replays run on the endpoint's thread, and only what that thread allocates from here until the replay is done is
+  // counted
+  [endpoint performAsync:^{
+    replayThread = pthread_self();
+    replayAllocations = 0;
+    replayPreviousMallocLogger = malloc_logger;
+    malloc_logger = countReplayAllocation;
+  }];
+
+  [endpoint replayCallbacksFromPath:_path account:_account completion:^(SBSCallbackReplayStatistics *statistics, NSError *error) {
+    result = statistics;
+    replayError = error;
+    [expectation fulfill];
+  }];
+
+  [endpoint performAsync:^{
+    malloc_logger = replayPreviousMallocLogger;
+    replayPreviousMallocLogger = NULL;
+  }];
+
+  [self waitForExpectationsWithTimeout:60 handler:nil];
+  if (error != NULL) {
+    *error = replayError;
+  }
+  if (allocations != NULL) {
+    *allocations = replayAllocations;
+  }
+
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testReplayIsRepeatable {
+  NSUInteger events = [self writeRecording];
+
+  NSError *error;
+  SBSCallbackReplayStatistics *first = [self replay:&error];
+  XCTAssertNotNil(first, @"%@", error);
+  SBSCallbackReplayStatistics *second = [self replay:&error];
+  XCTAssertNotNil(second, @"%@", error);
+
+  XCTAssertEqual(first.events, events);
+  XCTAssertEqual(first.calls, ReplayTestCalls);
+  XCTAssertEqual(second.events, first.events);
+  XCTAssertEqual(second.calls, first.calls);
+
+  // Every call was hung up, so the endpoint went back to idle
+  XCTAssertEqual([SBSEndpoint sharedEndpoint].state, SBSEndpointStateIdle);
+
+  NSLog(@"Replay: %lu callbacks for %lu calls, %.0f callbacks/s",
+        (unsigned long) second.events, (unsigned long) second.calls, second.eventsPerSecond);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testPooledEventsAllocateLess {
+  [self writeRecording];
+
+  // The first replay of each run fills the pool and warms up the endpoint, so only the second is measured
+  NSError *error;
+  NSUInteger allocatedCount;
+  XCTAssertNotNil([self replay:&error], @"%@", error);
+  SBSCallbackReplayStatistics *allocated = [self replay:&error allocations:&allocatedCount];
+  XCTAssertNotNil(allocated, @"%@", error);
+
+  _account = nil;
+  [[SBSEndpoint sharedEndpoint] destroyEndpointWithError:nil];
+  [self startEndpoint:^(SBSEndpointConfiguration *configuration) {
+    configuration.callEventPoolCapacity = 16;
+  }];
+
+  NSUInteger pooledCount;
+  XCTAssertNotNil([self replay:&error], @"%@", error);
+  SBSCallbackReplayStatistics *pooled = [self replay:&error allocations:&pooledCount];
+  XCTAssertNotNil(pooled, @"%@", error);
+
+  XCTAssertEqual(pooled.events, allocated.events);
+  XCTAssertLessThanOrEqual(pooledCount, allocatedCount);
+
+  NSLog(@"Replay without event pool: %.1f allocations/callback, %.0f allocations/s, %.0f callbacks/s",
+        (double) allocatedCount / allocated.events, allocatedCount / allocated.duration, allocated.eventsPerSecond);
+  NSLog(@"Replay with event pool: %.1f allocations/callback, %.0f allocations/s, %.0f callbacks/s",
+        (double) pooledCount / pooled.events, pooledCount / pooled.duration, pooled.eventsPerSecond);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testEventsAreDeliveredInBatches {
+  [self writeRecording];
+
+  NSError *error;
+  SBSCallbackReplayStatistics *replay = [self replay:&error];
+  XCTAssertNotNil(replay, @"%@", error);
+  SBSEventDeliveryStatistics *batched = [SBSEndpoint sharedEndpoint].eventDeliveryStatistics;
+
+  // Every callback delivers at most one block, however many events it produced
+  XCTAssertEqual(batched.calls, ReplayTestCalls);
+  XCTAssertLessThanOrEqual(batched.blocks, replay.events);
+  XCTAssertLessThan(batched.blocks, batched.events);
+  XCTAssertEqual(batched.coalesced, 0);
+
+  _account = nil;
+  [[SBSEndpoint sharedEndpoint] destroyEndpointWithError:nil];
+  [self startEndpoint:^(SBSEndpointConfiguration *configuration) {
+    configuration.coalesceStateChangeEvents = YES;
+  }];
+
+  XCTAssertNotNil([self replay:&error], @"%@", error);
+  SBSEventDeliveryStatistics *coalesced = [SBSEndpoint sharedEndpoint].eventDeliveryStatistics;
+  XCTAssertEqual(coalesced.events, batched.events);
+  XCTAssertLessThanOrEqual(coalesced.blocks, batched.blocks);
+
+  NSLog(@"Event delivery: %lu events in %lu blocks, %.1f blocks/call, %.1f events/block",
+        (unsigned long) batched.events, (unsigned long) batched.blocks, batched.blocksPerCall, batched.eventsPerBlock);
+  NSLog(@"Event delivery, coalescing state changes: %lu events, %lu coalesced, %.1f blocks/call",
+        (unsigned long) coalesced.events, (unsigned long) coalesced.coalesced, coalesced.blocksPerCall);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCorruptRecordingIsRejected {
+  [self writeRecording];
+
+  // Cut off in the middle of a record
+  NSData *data = [NSData dataWithContentsOfFile:_path];
+  XCTAssertTrue([[data subdataWithRange:NSMakeRange(0, data.length - 5)] writeToFile:_path atomically:NO]);
+
+  NSError *error;
+  XCTAssertNil([self replay:&error]);
+  XCTAssertEqual(error.code, SBSEndpointErrorCannotReplayCallbacks);
+
+  // Not a recording at all
+  XCTAssertTrue([[@"not a recording" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:_path atomically:NO]);
+  XCTAssertNil([self replay:&error]);
+  XCTAssertEqual(error.code, SBSEndpointErrorCannotReplayCallbacks);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testReplayIsRefusedWhileRecording {
+  [self writeRecording];
+
+  NSString *recording = [_path stringByAppendingPathExtension:@"recording"];
+  NSError *error;
+  XCTAssertTrue([[SBSEndpoint sharedEndpoint] startRecordingCallbacksToPath:recording error:&error], @"%@", error);
+  XCTAssertFalse([[SBSEndpoint sharedEndpoint] startRecordingCallbacksToPath:recording error:&error]);
+  XCTAssertEqual(error.code, SBSEndpointErrorCannotRecordCallbacks);
+
+  XCTAssertNil([self replay:&error]);
+  XCTAssertEqual(error.code, SBSEndpointErrorCannotReplayCallbacks);
+
+  XCTAssertEqual([[SBSEndpoint sharedEndpoint] stopRecordingCallbacks], 0);
+  [[NSFileManager defaultManager] removeItemAtPath:recording error:nil];
+}
+
+@end
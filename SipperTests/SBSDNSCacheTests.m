@@ -0,0 +1,361 @@
+//
+//  SBSDNSCacheTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/16/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <arpa/inet.h>
+#import <mach/mach_time.h>
+#import <netinet/in.h>
+#import <sys/socket.h>
+
+#import <pjlib-util.h>
+#import <pjsip.h>
+
+#import "SBSPjTestCase.h"
+#import "pj_dns_cache.h"
+
+static NSTimeInterval const StubLatency = 0.02;
+static NSUInteger const CachedLookups = 1000;
+
+/**
+ * A DNS server on the loopback interface that answers for a single SIP domain after a fixed delay
+ *
+ * _sip._udp.example.test has one SRV record pointing at sip.example.test:5060, which has one A record. Addresses
+ * are deliberately left out of the additional section, so a cold lookup takes two round trips.
+ */
+@interface SBSStubDNSServer : NSObject
+
+@property(nonatomic, readonly) uint16_t port;
+@property(atomic) uint32_t ttl;
+@property(atomic, readonly) NSUInteger queries;
+
+@end
+
+@implementation SBSStubDNSServer {
+  int _socket;
+  dispatch_queue_t _queue;
+  dispatch_source_t _source;
+}
+
+- (instancetype)init {
+  if (self = [super init]) {
+    _ttl = 60;
+    _queue = dispatch_queue_create("com.switchboard.sipper.tests.dns", DISPATCH_QUEUE_SERIAL);
+
+    struct sockaddr_in address = {0};
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t length = sizeof(address);
+    _socket = socket(AF_INET, SOCK_DGRAM, 0);
+    bind(_socket, (struct sockaddr *) &address, length);
+    getsockname(_socket, (struct sockaddr *) &address, &length);
+    _port = ntohs(address.sin_port);
+
+    __weak SBSStubDNSServer *weakSelf = self;
+    _source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t) _socket, 0, _queue);
+    dispatch_source_set_event_handler(_source, ^{
+      [weakSelf receive];
+    });
+    dispatch_resume(_source);
+  }
+
+  return self;
+}
+
+- (void)stop {
+  dispatch_source_cancel(_source);
+  close(_socket);
+}
+
+- (void)receive {
+  uint8_t request[512];
+  struct sockaddr_in from;
+  socklen_t fromLength = sizeof(from);
+
+  ssize_t length = recvfrom(_socket, request, sizeof(request), 0, (struct sockaddr *) &from, &fromLength);
+  if (length < 12) {
+    return;
+  }
+
+  _queries++;
+
+  // Read the question name and type
+  NSMutableArray<NSString *> *labels = [[NSMutableArray alloc] init];
+  ssize_t offset = 12;
+  while (offset < length && request[offset] != 0) {
+    uint8_t labelLength = request[offset];
+    [labels addObject:[[NSString alloc] initWithBytes:&request[offset + 1] length:labelLength encoding:NSASCIIStringEncoding]];
+    offset += labelLength + 1;
+  }
+
+  ssize_t questionEnd = offset + 5;
+  uint16_t type = (uint16_t) (request[offset + 1] << 8 | request[offset + 2]);
+  NSString *name = [[labels componentsJoinedByString:@"."] lowercaseString];
+
+  NSMutableData *response = [NSMutableData dataWithBytes:request length:(NSUInteger) questionEnd];
+  uint8_t *header = response.mutableBytes;
+  header[2] = 0x81;
+  header[3] = 0x80;
+  header[4] = 0;
+  header[5] = 1;
+  header[6] = header[7] = header[8] = header[9] = header[10] = header[11] = 0;
+
+  if (type == 33 && [name isEqualToString:@"_sip._udp.example.test"]) {
+    uint8_t target[] = {3, 's', 'i', 'p', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 4, 't', 'e', 's', 't', 0};
+    uint8_t srv[] = {0, 10, 0, 10, 0x13, 0xC4};
+    [self appendAnswerToResponse:response type:33 length:sizeof(srv) + sizeof(target)];
+    [response appendBytes:srv length:sizeof(srv)];
+    [response appendBytes:target length:sizeof(target)];
+  } else if (type == 1 && [name isEqualToString:@"sip.example.test"]) {
+    uint8_t address[] = {192, 0, 2, 10};
+    [self appendAnswerToResponse:response type:1 length:sizeof(address)];
+    [response appendBytes:address length:sizeof(address)];
+  } else {
+    ((uint8_t *) response.mutableBytes)[3] = 0x83;
+  }
+
+  int fd = _socket;
+  dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (StubLatency * NSEC_PER_SEC)), _queue, ^{
+    sendto(fd, response.bytes, response.length, 0, (struct sockaddr *) &from, fromLength);
+  });
+}
+
+- (void)appendAnswerToResponse:(NSMutableData *)response type:(uint16_t)type length:(uint16_t)length {
+  uint32_t ttl = self.ttl;
+  uint8_t answer[] = {
+    0xC0, 0x0C,
+    (uint8_t) (type >> 8), (uint8_t) type,
+    0, 1,
+    (uint8_t) (ttl >> 24), (uint8_t) (ttl >> 16), (uint8_t) (ttl >> 8), (uint8_t) ttl,
+    (uint8_t) (length >> 8), (uint8_t) length
+  };
+
+  ((uint8_t *) response.mutableBytes)[7] = 1;
+  [response appendBytes:answer length:sizeof(answer)];
+}
+
+@end
+
+/**
+ * The outcome of a single pj_dns_cache_resolve call
+ */
+@interface SBSDNSLookup : NSObject
+
+@property(nonatomic) BOOL done;
+@property(nonatomic) pj_status_t status;
+@property(nonatomic) unsigned count;
+@property(nonatomic) pj_uint16_t port;
+@property(nonatomic) uint64_t startedAt;
+@property(nonatomic) uint64_t completedAt;
+
+@end
+
+@implementation SBSDNSLookup
+@end
+
+static void onResolved(pj_status_t status, void *token, const pjsip_server_addresses *addresses) {
+  SBSDNSLookup *lookup = (__bridge SBSDNSLookup *) token;
+  lookup.completedAt = mach_absolute_time();
+  lookup.status = status;
+  lookup.count = addresses != NULL ? addresses->count : 0;
+  lookup.port = addresses != NULL && addresses->count > 0 ? pj_sockaddr_get_port(&addresses->entry[0].addr) : 0;
+  lookup.done = YES;
+}
+
+@interface SBSDNSCacheTests : SBSPjTestCase
+
+@end
+
+@implementation SBSDNSCacheTests {
+  SBSStubDNSServer *_server;
+  pj_timer_heap_t *_timerHeap;
+  pj_ioqueue_t *_ioqueue;
+  pj_dns_resolver *_resolver;
+  mach_timebase_info_data_t _timebase;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  mach_timebase_info(&_timebase);
+  _server = [[SBSStubDNSServer alloc] init];
+
+  pj_timer_heap_create(_pool, 16, &_timerHeap);
+  pj_ioqueue_create(_pool, 16, &_ioqueue);
+  pj_dns_resolver_create(&_cp.factory, "dnstest", 0, _timerHeap, _ioqueue, &_resolver);
+
+  pj_str_t nameserver = pj_str("127.0.0.1");
+  pj_uint16_t port = _server.port;
+  pj_dns_resolver_set_ns(_resolver, 1, &nameserver, &port);
+}
+
+- (void)tearDown {
+  pj_dns_cache_shutdown();
+  pj_dns_resolver_destroy(_resolver, PJ_FALSE);
+  pj_ioqueue_destroy(_ioqueue);
+  pj_timer_heap_destroy(_timerHeap);
+
+  [_server stop];
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)startCacheWithPrefetchWindow:(unsigned)prefetchWindow maxStale:(unsigned)maxStale {
+  XCTAssertEqual(pj_dns_cache_init(&_cp.factory, _resolver, _timerHeap, prefetchWindow, maxStale), PJ_SUCCESS);
+}
+
+- (void)pollFor:(NSTimeInterval)duration until:(BOOL (^)(void))condition {
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:duration];
+  while ((condition == nil || !condition()) && [deadline timeIntervalSinceNow] > 0) {
+    pj_time_val timeout = {0, 5};
+    pj_ioqueue_poll(_ioqueue, &timeout);
+    pj_timer_heap_poll(_timerHeap, NULL);
+  }
+}
+
+- (SBSDNSLookup *)startLookup {
+  pjsip_host_info target;
+  pj_bzero(&target, sizeof(target));
+  target.type = PJSIP_TRANSPORT_UDP;
+  target.addr.host = pj_str("example.test");
+
+  SBSDNSLookup *lookup = [[SBSDNSLookup alloc] init];
+  lookup.startedAt = mach_absolute_time();
+  pj_dns_cache_resolve(&target, (__bridge void *) lookup, &onResolved);
+
+  return lookup;
+}
+
+- (SBSDNSLookup *)lookup {
+  SBSDNSLookup *lookup = [self startLookup];
+  [self pollFor:5 until:^BOOL {
+    return lookup.done;
+  }];
+
+  XCTAssertTrue(lookup.done);
+  XCTAssertEqual(lookup.status, PJ_SUCCESS);
+  XCTAssertEqual(lookup.count, 1);
+  XCTAssertEqual(lookup.port, 5060);
+
+  return lookup;
+}
+
+- (double)millisecondsFor:(SBSDNSLookup *)lookup {
+  return (double) (lookup.completedAt - lookup.startedAt) * _timebase.numer / _timebase.denom / NSEC_PER_MSEC;
+}
+
+- (pj_dns_cache_stat)stat {
+  pj_dns_cache_stat stat;
+  pj_dns_cache_get_stat(&stat);
+  return stat;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCachedLookupsSkipTheNetwork {
+  [self startCacheWithPrefetchWindow:0 maxStale:0];
+
+  double miss = [self millisecondsFor:[self lookup]];
+
+  double hits = 0;
+  for (NSUInteger i = 0; i < CachedLookups; i++) {
+    SBSDNSLookup *lookup = [self startLookup];
+    XCTAssertTrue(lookup.done);
+    hits += [self millisecondsFor:lookup];
+  }
+
+  NSLog(@"DNS lookup against a stub with %.0f ms latency: miss %.2f ms, hit %.4f ms (mean of %lu)",
+        StubLatency * 1000, miss, hits / CachedLookups, (unsigned long) CachedLookups);
+
+  // A cold lookup is an SRV query followed by an A query
+  XCTAssertGreaterThanOrEqual(miss, StubLatency * 1000 * 2);
+  XCTAssertLessThan(hits / CachedLookups, 1.0);
+  XCTAssertEqual(_server.queries, 2);
+  XCTAssertEqual(self.stat.hits, CachedLookups);
+  XCTAssertEqual(self.stat.misses, 1);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testConcurrentMissesShareOneResolution {
+  [self startCacheWithPrefetchWindow:0 maxStale:0];
+
+  SBSDNSLookup *first = [self startLookup];
+  SBSDNSLookup *second = [self startLookup];
+  [self pollFor:5 until:^BOOL {
+    return first.done && second.done;
+  }];
+
+  XCTAssertEqual(first.status, PJ_SUCCESS);
+  XCTAssertEqual(second.status, PJ_SUCCESS);
+  XCTAssertEqual(_server.queries, 2);
+  XCTAssertEqual(self.stat.misses, 2);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testServesStaleRecordsWhileRevalidating {
+  [self startCacheWithPrefetchWindow:0 maxStale:30];
+  _server.ttl = 1;
+
+  [self lookup];
+  [self pollFor:1.5 until:nil];
+
+  // The expired record is served without waiting, and refreshed behind the scenes
+  SBSDNSLookup *stale = [self startLookup];
+  XCTAssertTrue(stale.done);
+  XCTAssertEqual(stale.status, PJ_SUCCESS);
+  NSLog(@"DNS lookup of a stale record: %.4f ms", [self millisecondsFor:stale]);
+
+  SBSStubDNSServer *server = _server;
+  [self pollFor:5 until:^BOOL {
+    return server.queries == 4;
+  }];
+
+  XCTAssertEqual(server.queries, 4);
+  XCTAssertEqual(self.stat.stale_hits, 1);
+  XCTAssertEqual(self.stat.misses, 1);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testPrefetchesRecordsInUseBeforeTheyExpire {
+  [self startCacheWithPrefetchWindow:1 maxStale:0];
+  _server.ttl = 2;
+
+  [self lookup];
+  [self lookup];
+
+  // The record is refreshed a second before it expires, so a lookup after the original TTL is still a hit
+  [self pollFor:2.5 until:nil];
+  SBSDNSLookup *later = [self startLookup];
+
+  XCTAssertTrue(later.done);
+  XCTAssertEqual(_server.queries, 4);
+  XCTAssertEqual(self.stat.prefetches, 1);
+  XCTAssertEqual(self.stat.hits, 2);
+  XCTAssertEqual(self.stat.stale_hits, 0);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testShutdownCancelsResolutionsInFlight {
+  [self startCacheWithPrefetchWindow:0 maxStale:0];
+
+  SBSDNSLookup *lookup = [self startLookup];
+  pj_dns_cache_shutdown();
+
+  // The answer still arrives, but the resolver no longer has anyone to give it to
+  [self pollFor:1 until:nil];
+
+  XCTAssertEqual(_server.queries, 1);
+  XCTAssertFalse(lookup.done);
+}
+
+@end
@@ -0,0 +1,191 @@
+//
+//  SBSDtmfTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+#import <pjmedia.h>
+
+#import "SBSDtmfSender.h"
+#import "SBSPjTestCase.h"
+#import "pj_dtmf.h"
+
+// Every digit, in both cases where it has them
+static char const *const Digits = "0123456789*#ABCDabcd";
+
+// 20ms frames at 16kHz, which is what the bridge runs at
+static unsigned const ClockRate = 16000;
+static unsigned const SamplesPerFrame = 320;
+
+@interface SBSDtmfTests : SBSPjTestCase
+
+@end
+
+@implementation SBSDtmfTests
+
+//------------------------------------------------------------------------------
+
+- (void)testEveryDigitIsDetectedAtEveryRate {
+  unsigned rates[] = {8000, 16000, 48000};
+  pj_int16_t samples[960];
+
+  for (unsigned r = 0; r < PJ_ARRAY_SIZE(rates); r++) {
+    for (char const *digit = Digits; *digit; digit++) {
+      pj_dtmf_tone tone;
+      XCTAssertEqual(pj_dtmf_tone_init(&tone, *digit, rates[r]), PJ_SUCCESS);
+
+      unsigned count = rates[r] / 50;
+      pj_dtmf_tone_render(&tone, samples, count);
+      XCTAssertEqual(pj_dtmf_detect(samples, count, rates[r]), (char) toupper(*digit), @"%c at %u", *digit, rates[r]);
+    }
+  }
+}
+
+- (void)testSilenceAndOtherTonesAreNotDigits {
+  pj_int16_t samples[160] = {0};
+  XCTAssertEqual(pj_dtmf_detect(samples, 160, 8000), (char) 0);
+
+  // A single tone, as loud as a digit, is neither group
+  for (unsigned i = 0; i < 160; i++) {
+    samples[i] = (pj_int16_t) (20000 * sin(2 * M_PI * 1000 * i / 8000));
+  }
+  XCTAssertEqual(pj_dtmf_detect(samples, 160, 8000), (char) 0);
+
+  pj_dtmf_tone tone;
+  XCTAssertEqual(pj_dtmf_tone_init(&tone, 'E', 8000), PJ_EINVAL);
+  XCTAssertFalse(pj_dtmf_is_digit('x'));
+}
+
+- (void)testRelayBodyRoundTrips {
+  char buffer[64];
+  int length = pj_dtmf_relay_print('#', 250, buffer, sizeof(buffer));
+  XCTAssertEqual(length, 24);
+
+  pj_str_t body = {buffer, length};
+  char digit = 0;
+  unsigned duration = 0;
+  XCTAssertEqual(pj_dtmf_relay_parse(&body, &digit, &duration), PJ_SUCCESS);
+  XCTAssertEqual(digit, (char) '#');
+  XCTAssertEqual(duration, 250u);
+
+  // Peers aren't consistent about case, spacing, or line endings
+  body = pj_str("signal = 7\nduration= 100");
+  XCTAssertEqual(pj_dtmf_relay_parse(&body, &digit, &duration), PJ_SUCCESS);
+  XCTAssertEqual(digit, (char) '7');
+  XCTAssertEqual(duration, 100u);
+
+  body = pj_str("Duration=100\r\n");
+  XCTAssertEqual(pj_dtmf_relay_parse(&body, &digit, &duration), PJ_EINVAL);
+  XCTAssertEqual(pj_dtmf_relay_print('1', 100, buffer, 8), -1);
+}
+
+- (void)testPortPlaysPacedDigitsThatDecodeBack {
+  pjmedia_port *port;
+  XCTAssertEqual(pj_dtmf_port_create(_pool, ClockRate, 1, SamplesPerFrame, &port), PJ_SUCCESS);
+
+  pj_int16_t samples[SamplesPerFrame];
+  pjmedia_frame frame;
+  frame.buf = samples;
+
+  // Play a PIN the way the sender paces it, 100ms of each digit and 60ms of silence, and decode every frame
+  NSMutableString *heard = [NSMutableString string];
+  char last = 0;
+  unsigned silentFrames = 0;
+
+  for (char const *digit = "1234#"; *digit; digit++) {
+    XCTAssertEqual(pj_dtmf_port_play(port, *digit, 100), PJ_SUCCESS);
+
+    for (unsigned i = 0; i < 8; i++) {
+      XCTAssertEqual(pjmedia_port_get_frame(port, &frame), PJ_SUCCESS);
+
+      char detected = 0;
+      if (frame.type == PJMEDIA_FRAME_TYPE_AUDIO) {
+        XCTAssertEqual(frame.size, sizeof(samples));
+        detected = pj_dtmf_detect(samples, SamplesPerFrame, ClockRate);
+      } else {
+        silentFrames++;
+      }
+
+      if (detected != 0 && detected != last) {
+        [heard appendFormat:@"%c", detected];
+      }
+      last = detected;
+    }
+  }
+
+  XCTAssertEqualObjects(heard, @"1234#");
+  XCTAssertEqual(silentFrames, 15u);
+  XCTAssertFalse(pj_dtmf_port_is_playing(port));
+
+  pjmedia_port_destroy(port);
+}
+
+- (void)testPortFillsEveryChannel {
+  pjmedia_port *port;
+  XCTAssertEqual(pj_dtmf_port_create(_pool, ClockRate, 2, SamplesPerFrame * 2, &port), PJ_SUCCESS);
+  XCTAssertEqual(pj_dtmf_port_play(port, '5', 20), PJ_SUCCESS);
+
+  pj_int16_t samples[SamplesPerFrame * 2];
+  pjmedia_frame frame;
+  frame.buf = samples;
+  XCTAssertEqual(pjmedia_port_get_frame(port, &frame), PJ_SUCCESS);
+
+  pj_int16_t left[SamplesPerFrame];
+  for (unsigned i = 0; i < SamplesPerFrame; i++) {
+    XCTAssertEqual(samples[i * 2], samples[i * 2 + 1]);
+    left[i] = samples[i * 2];
+  }
+  XCTAssertEqual(pj_dtmf_detect(left, SamplesPerFrame, ClockRate), (char) '5');
+
+  pjmedia_port_destroy(port);
+}
+
+- (void)testSenderValidatesDigits {
+  XCTAssertTrue([SBSDtmfSender isValidDigits:@"0123456789*#ABCDabcd"]);
+  XCTAssertTrue([SBSDtmfSender isValidDigits:@""]);
+  XCTAssertFalse([SBSDtmfSender isValidDigits:@"12 34"]);
+  XCTAssertFalse([SBSDtmfSender isValidDigits:@"1２3"]);
+}
+
+- (void)testDetachedSenderFailsEveryBatch {
+  SBSDtmfSender *sender = [[SBSDtmfSender alloc] initWithMode:SBSDtmfModeAuto duration:100 gap:50];
+
+  __block pj_status_t first = PJ_SUCCESS, second = PJ_SUCCESS;
+  __block NSUInteger progressed = 0;
+  [sender sendDigits:@"1234" progress:^(NSUInteger index) { progressed++; } completion:^(pj_status_t status) { first = status; }];
+  [sender sendDigits:@"#" progress:nil completion:^(pj_status_t status) { second = status; }];
+
+  XCTAssertEqual(first, PJ_EINVALIDOP);
+  XCTAssertEqual(second, PJ_EINVALIDOP);
+  XCTAssertEqual(progressed, (NSUInteger) 0);
+  XCTAssertEqual(sender.pendingDigits, (NSUInteger) 0);
+}
+
+- (void)testRenderAndDetectThroughput {
+  unsigned const frames = 50000;
+  pj_int16_t samples[SamplesPerFrame];
+  pj_dtmf_tone tone;
+  pj_dtmf_tone_init(&tone, '9', ClockRate);
+
+  NSDate *start = [NSDate date];
+  for (unsigned i = 0; i < frames; i++) {
+    pj_dtmf_tone_render(&tone, samples, SamplesPerFrame);
+  }
+  NSTimeInterval rendering = -[start timeIntervalSinceNow];
+
+  unsigned detected = 0;
+  start = [NSDate date];
+  for (unsigned i = 0; i < frames / 10; i++) {
+    detected += pj_dtmf_detect(samples, SamplesPerFrame, ClockRate) == '9';
+  }
+  NSTimeInterval detecting = -[start timeIntervalSinceNow];
+
+  XCTAssertEqual(detected, frames / 10);
+  NSLog(@"DTMF: rendered %u frames in %.3fs (%.0fx real time), detected %u in %.3fs", frames, rendering,
+        frames * 0.02 / rendering, frames / 10, detecting);
+}
+
+@end
@@ -0,0 +1,76 @@
+//
+//  SBSEndpointStartupTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SBSEndpoint.h"
+#import "SBSEndpointConfiguration.h"
+#import "SBSEndpointStartupMetrics.h"
+#import "SBSTransportConfiguration.h"
+
+@interface SBSEndpointStartupTests : XCTestCase
+
+@end
+
+@implementation SBSEndpointStartupTests
+
+- (void)tearDown {
+  [[SBSEndpoint sharedEndpoint] destroyEndpointWithError:nil];
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * Waits for everything queued on the background thread so far, which includes the deferred startup work
+ */
+- (void)waitForBackgroundThread {
+  dispatch_semaphore_t done = dispatch_semaphore_create(0);
+  [[SBSEndpoint sharedEndpoint] performAsync:^{
+    dispatch_semaphore_signal(done);
+  }];
+  XCTAssertEqual(dispatch_semaphore_wait(done, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)), 0);
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * Time until the endpoint can be used, and until everything it started with is done, with more transports than the
+ * critical path creates
+ */
+- (void)testStartupTime {
+  SBSEndpointConfiguration *configuration = [[SBSEndpointConfiguration alloc] init];
+  configuration.transportConfigurations = @[[SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeUDP],
+                                            [SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeTCP],
+                                            [SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeUDP6],
+                                            [SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeTCP6]];
+
+  SBSEndpoint *endpoint = [SBSEndpoint sharedEndpoint];
+  XCTAssertNil(endpoint.startupMetrics);
+
+  NSError *error;
+  XCTAssertTrue([endpoint initializeEndpointWithConfiguration:configuration error:&error], @"%@", error);
+  XCTAssertGreaterThan(endpoint.startupMetrics.readyTime, 0);
+
+  [self waitForBackgroundThread];
+
+  SBSEndpointStartupMetrics *metrics = endpoint.startupMetrics;
+  XCTAssertTrue(metrics.complete);
+  XCTAssertGreaterThanOrEqual(metrics.completeTime, metrics.readyTime);
+
+  NSLog(@"Startup: ready in %.1fms, complete in %.1fms", metrics.readyTime * 1000, metrics.completeTime * 1000);
+  NSLog(@"  critical: create %.2fms, initialize %.2fms, transport %.2fms, start %.2fms, thread %.2fms",
+        metrics.createTime * 1000, metrics.initializeTime * 1000, metrics.transportTime * 1000,
+        metrics.startTime * 1000, metrics.threadTime * 1000);
+  NSLog(@"  deferred: transports %.2fms, modules %.2fms, codecs %.2fms, ringback %.2fms",
+        metrics.extraTransportTime * 1000, metrics.moduleTime * 1000, metrics.codecTime * 1000,
+        metrics.ringbackTime * 1000);
+}
+
+@end
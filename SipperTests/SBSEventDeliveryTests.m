@@ -0,0 +1,171 @@
+//
+//  SBSEventDeliveryTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SBSEventDelivery.h"
+#import "SBSEventDeliveryStatistics.h"
+
+@interface SBSEventDeliveryTests : XCTestCase
+
+@end
+
+@implementation SBSEventDeliveryTests {
+  dispatch_queue_t _queue;
+  NSMutableArray<NSString *> *_delivered;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  _queue = dispatch_queue_create("com.switchboard.sipper.tests.events", DISPATCH_QUEUE_SERIAL);
+  _delivered = [[NSMutableArray alloc] init];
+}
+
+- (dispatch_block_t)record:(NSString *)name {
+  return ^{
+    [_delivered addObject:name];
+  };
+}
+
+- (void)drain {
+  dispatch_sync(_queue, ^{});
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testTurnIsDeliveredAsOneBlock {
+  SBSEventDelivery *delivery = [[SBSEventDelivery alloc] initWithTargetQueue:_queue coalesceStateChanges:NO];
+  id owner = [[NSObject alloc] init];
+
+  // Hold the queue, so nothing is delivered until the turn has been checked
+  dispatch_semaphore_t held = dispatch_semaphore_create(0);
+  dispatch_async(_queue, ^{
+    dispatch_semaphore_wait(held, DISPATCH_TIME_FOREVER);
+  });
+
+  [delivery beginTurn];
+  [delivery deliverStateChange:[self record:@"state 1"] owner:owner name:@"state"];
+  [delivery deliver:[self record:@"message"]];
+  [delivery beginTurn];
+  [delivery deliverStateChange:[self record:@"state 2"] owner:owner name:@"state"];
+  [delivery endTurn];
+  XCTAssertEqual(delivery.statistics.blocks, 0);
+  [delivery endTurn];
+
+  dispatch_semaphore_signal(held);
+  [self drain];
+
+  NSArray *expected = @[@"state 1", @"message", @"state 2"];
+  XCTAssertEqualObjects(_delivered, expected);
+  XCTAssertEqual(delivery.statistics.events, 3);
+  XCTAssertEqual(delivery.statistics.blocks, 1);
+  XCTAssertEqual(delivery.statistics.coalesced, 0);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testDeliveryOutsideATurnJoinsThePendingBatch {
+  SBSEventDelivery *delivery = [[SBSEventDelivery alloc] initWithTargetQueue:_queue coalesceStateChanges:NO];
+
+  dispatch_semaphore_t held = dispatch_semaphore_create(0);
+  dispatch_async(_queue, ^{
+    dispatch_semaphore_wait(held, DISPATCH_TIME_FOREVER);
+  });
+
+  [delivery deliver:[self record:@"first"]];
+  [delivery deliver:[self record:@"second"]];
+
+  dispatch_semaphore_signal(held);
+  [self drain];
+
+  // The batch has been delivered, so the next delivery starts another
+  [delivery deliver:[self record:@"third"]];
+  [self drain];
+
+  NSArray *expected = @[@"first", @"second", @"third"];
+  XCTAssertEqualObjects(_delivered, expected);
+  XCTAssertEqual(delivery.statistics.blocks, 2);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCoalescedStateChangesKeepTheirOrder {
+  SBSEventDelivery *delivery = [[SBSEventDelivery alloc] initWithTargetQueue:_queue coalesceStateChanges:YES];
+  id call = [[NSObject alloc] init];
+  id other = [[NSObject alloc] init];
+
+  [delivery beginTurn];
+  [delivery deliverStateChange:[self record:@"state 1"] owner:call name:@"state"];
+  [delivery deliverStateChange:[self record:@"hold"] owner:call name:@"hold"];
+  [delivery deliverStateChange:[self record:@"other state"] owner:other name:@"state"];
+  [delivery deliver:[self record:@"message"]];
+  [delivery deliverStateChange:[self record:@"state 2"] owner:call name:@"state"];
+  [delivery endTurn];
+  [self drain];
+
+  // The latest state comes after the message, just as it was delivered
+  NSArray *expected = @[@"hold", @"other state", @"message", @"state 2"];
+  XCTAssertEqualObjects(_delivered, expected);
+  XCTAssertEqual(delivery.statistics.events, 5);
+  XCTAssertEqual(delivery.statistics.coalesced, 1);
+  XCTAssertEqual(delivery.statistics.blocks, 1);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testTurnsBelongToTheirThread {
+  SBSEventDelivery *delivery = [[SBSEventDelivery alloc] initWithTargetQueue:_queue coalesceStateChanges:NO];
+
+  [delivery beginTurn];
+  [delivery deliver:[self record:@"in turn"]];
+
+  // A thread that isn't in a turn of its own isn't held back by this one
+  dispatch_semaphore_t delivered = dispatch_semaphore_create(0);
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+    [delivery deliver:[self record:@"other thread"]];
+    dispatch_semaphore_signal(delivered);
+  });
+  dispatch_semaphore_wait(delivered, DISPATCH_TIME_FOREVER);
+  [self drain];
+  XCTAssertEqualObjects(_delivered, @[@"other thread"]);
+
+  [delivery endTurn];
+  [self drain];
+
+  NSArray *expected = @[@"other thread", @"in turn"];
+  XCTAssertEqualObjects(_delivered, expected);
+  XCTAssertEqual(delivery.statistics.blocks, 2);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testBlocksPerCall {
+  SBSEventDelivery *delivery = [[SBSEventDelivery alloc] initWithTargetQueue:_queue coalesceStateChanges:NO];
+
+  // Two calls, each delivering three events in each of two callbacks
+  for (int call = 0; call < 2; call++) {
+    [delivery countCall];
+    for (int callback = 0; callback < 2; callback++) {
+      [delivery beginTurn];
+      for (int event = 0; event < 3; event++) {
+        [delivery deliver:^{}];
+      }
+      [delivery endTurn];
+      [self drain];
+    }
+  }
+
+  SBSEventDeliveryStatistics *statistics = delivery.statistics;
+  XCTAssertEqual(statistics.calls, 2);
+  XCTAssertEqual(statistics.blocks, 4);
+  XCTAssertEqualWithAccuracy(statistics.blocksPerCall, 2.0, 0.001);
+  XCTAssertEqualWithAccuracy(statistics.eventsPerBlock, 3.0, 0.001);
+}
+
+@end
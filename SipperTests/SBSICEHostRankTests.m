@@ -0,0 +1,128 @@
+//
+//  SBSICEHostRankTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/18/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+
+#import "SBSPjTestCase.h"
+#import "pj_ice_host_rank.h"
+
+static unsigned const MaxAddresses = 8;
+
+@interface SBSICEHostRankTests : SBSPjTestCase
+
+@end
+
+@implementation SBSICEHostRankTests {
+  pj_sockaddr _addresses[MaxAddresses];
+  const char *_interfaces[MaxAddresses];
+  unsigned _count;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  XCTAssertEqual(pj_ice_host_rank_init(&_cp.factory), PJ_SUCCESS);
+
+  _count = 0;
+}
+
+- (void)tearDown {
+  pj_ice_host_rank_shutdown();
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)addAddress:(NSString *)address interface:(const char *)interface {
+  pj_str_t string = pj_str((char *) address.UTF8String);
+  int af = [address containsString:@":"] ? pj_AF_INET6() : pj_AF_INET();
+
+  pj_sockaddr_init(af, &_addresses[_count], &string, 4000);
+  _interfaces[_count] = interface;
+  _count++;
+}
+
+- (NSArray<NSString *> *)rankKeeping:(unsigned)max defaultAddress:(NSString *)defaultAddress {
+  pj_sockaddr defaultRoute;
+  if (defaultAddress != nil) {
+    pj_str_t string = pj_str((char *) defaultAddress.UTF8String);
+    pj_sockaddr_init(_addresses[0].addr.sa_family, &defaultRoute, &string, 0);
+  }
+
+  unsigned count = _count;
+  pj_ice_host_rank_apply(_addresses[0].addr.sa_family, _addresses, _interfaces, &count, max, defaultAddress != nil ? &defaultRoute : NULL);
+
+  NSMutableArray<NSString *> *ranked = [[NSMutableArray alloc] init];
+  for (unsigned i = 0; i < count; i++) {
+    char buffer[PJ_INET6_ADDRSTRLEN];
+    [ranked addObject:[NSString stringWithUTF8String:pj_sockaddr_print(&_addresses[i], buffer, sizeof(buffer), 0)]];
+  }
+
+  return ranked;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testDefaultRouteRanksFirst {
+  [self addAddress:@"192.168.1.20" interface:"en0"];
+  [self addAddress:@"10.20.30.40" interface:"pdp_ip0"];
+
+  NSArray<NSString *> *ranked = [self rankKeeping:2 defaultAddress:@"10.20.30.40"];
+  XCTAssertEqualObjects(ranked, (@[@"10.20.30.40", @"192.168.1.20"]));
+}
+
+- (void)testInterfaceTypeOrdersTheRest {
+  [self addAddress:@"10.8.0.2" interface:"utun1"];
+  [self addAddress:@"10.20.30.40" interface:"pdp_ip0"];
+  [self addAddress:@"192.168.1.20" interface:"en0"];
+
+  NSArray<NSString *> *ranked = [self rankKeeping:3 defaultAddress:nil];
+  XCTAssertEqualObjects(ranked, (@[@"192.168.1.20", @"10.20.30.40", @"10.8.0.2"]));
+}
+
+- (void)testUnusableAddressesAreDropped {
+  [self addAddress:@"169.254.12.34" interface:"en0"];
+  [self addAddress:@"fe80::1" interface:"en0"];
+  [self addAddress:@"2001:db8::20" interface:"awdl0"];
+  [self addAddress:@"2001:db8::30" interface:"llw0"];
+  [self addAddress:@"2001:db8::40" interface:"en0"];
+
+  unsigned count = _count;
+  pj_ice_host_rank_apply(pj_AF_INET6(), _addresses, _interfaces, &count, 12, NULL);
+
+  // The IPv4 link-local address is dropped too, even though it's passed in with the IPv6 addresses
+  XCTAssertEqual(count, 1);
+  XCTAssertEqual(strcmp(_interfaces[0], "en0"), 0);
+}
+
+- (void)testEveryInterfaceContributesBeforeAnyRepeats {
+  [self addAddress:@"2001:db8:1::10" interface:"en0"];
+  [self addAddress:@"2001:db8:1::11" interface:"en0"];
+  [self addAddress:@"2001:db8:1::12" interface:"en0"];
+  [self addAddress:@"2001:db8:2::10" interface:"pdp_ip0"];
+
+  NSArray<NSString *> *ranked = [self rankKeeping:2 defaultAddress:nil];
+  XCTAssertEqualObjects(ranked, (@[@"2001:db8:1::10", @"2001:db8:2::10"]));
+}
+
+- (void)testCountsAreReported {
+  [self addAddress:@"192.168.1.20" interface:"en0"];
+  [self addAddress:@"192.168.2.20" interface:"en1"];
+  [self addAddress:@"10.20.30.40" interface:"pdp_ip0"];
+  [self addAddress:@"10.8.0.2" interface:"utun1"];
+  [self rankKeeping:2 defaultAddress:@"192.168.1.20"];
+
+  pj_ice_host_rank_stat stat;
+  pj_ice_host_rank_get_stat(&stat);
+  XCTAssertEqual(stat.rankings, 1);
+  XCTAssertEqual(stat.addresses, 4);
+  XCTAssertEqual(stat.candidates, 2);
+}
+
+@end
@@ -0,0 +1,105 @@
+//
+//  SBSICETrickleTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/18/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+#import <pjnath.h>
+
+#import "SBSPjTestCase.h"
+#import "pj_ice_trickle.h"
+
+static unsigned const MaxCandidates = 8;
+
+@interface SBSICETrickleTests : SBSPjTestCase
+
+@end
+
+@implementation SBSICETrickleTests {
+  pj_ice_sess_cand _candidates[MaxCandidates];
+  unsigned _count;
+  pj_str_t _ufrag;
+  pj_bool_t _end;
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_status_t)parse:(NSString *)body {
+  pj_str_t string = pj_str((char *) body.UTF8String);
+  _count = MaxCandidates;
+  return pj_ice_trickle_parse_sdpfrag(_pool, &string, &_ufrag, _candidates, &_count, &_end);
+}
+
+- (pj_ice_sess_cand)candidate:(pj_ice_cand_type)type address:(NSString *)address port:(pj_uint16_t)port {
+  pj_ice_sess_cand cand;
+  pj_bzero(&cand, sizeof(cand));
+
+  pj_str_t string = pj_str((char *) address.UTF8String);
+  pj_sockaddr_init(pj_AF_INET(), &cand.addr, &string, port);
+
+  pj_str_t base = pj_str("192.168.1.20");
+  pj_sockaddr_init(pj_AF_INET(), &cand.rel_addr, &base, 4000);
+
+  cand.type = type;
+  cand.comp_id = 1;
+  cand.prio = 1694498815;
+  cand.foundation = pj_str("Sc0a80114");
+  return cand;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testPrintedCandidatesParseBack {
+  pj_ice_sess_cand cands[] = {
+    [self candidate:PJ_ICE_CAND_TYPE_HOST address:@"192.168.1.20" port:4000],
+    [self candidate:PJ_ICE_CAND_TYPE_SRFLX address:@"203.0.113.7" port:51234],
+  };
+
+  pj_str_t ufrag = pj_str("abcd");
+  pj_str_t pwd = pj_str("0123456789abcdef01234567");
+  char buffer[1024];
+  int length = pj_ice_trickle_print_sdpfrag(&ufrag, &pwd, cands, PJ_ARRAY_SIZE(cands), PJ_TRUE, buffer, sizeof(buffer));
+  XCTAssertGreaterThan(length, 0);
+
+  NSString *body = [[NSString alloc] initWithBytes:buffer length:length encoding:NSUTF8StringEncoding];
+  XCTAssertEqual([self parse:body], PJ_SUCCESS);
+
+  // The host candidate was already in the offer, so only the server reflexive one is trickled
+  XCTAssertEqual(_count, 1);
+  XCTAssertEqual(_candidates[0].type, PJ_ICE_CAND_TYPE_SRFLX);
+  XCTAssertEqual(_candidates[0].prio, 1694498815);
+  XCTAssertEqual(pj_sockaddr_cmp(&_candidates[0].addr, &cands[1].addr), 0);
+  XCTAssertEqual(pj_sockaddr_cmp(&_candidates[0].rel_addr, &cands[1].rel_addr), 0);
+  XCTAssertEqual(pj_strcmp2(&_candidates[0].foundation, "Sc0a80114"), 0);
+  XCTAssertEqual(pj_strcmp2(&_ufrag, "abcd"), 0);
+  XCTAssertTrue(_end);
+}
+
+- (void)testUnusableCandidatesAreSkipped {
+  NSString *body = @"a=ice-ufrag:abcd\r\n"
+                   @"m=audio 9 RTP/AVP 0\r\n"
+                   @"a=candidate:1 1 TCP 2105458943 192.168.1.20 9 typ host tcptype active\r\n"
+                   @"a=candidate:2 1 UDP 2122260223 0b1a7c4e-2c1f.local 52000 typ host\r\n"
+                   @"a=candidate:3 1 UDP 1686052607 2001:db8::7 52001 typ srflx raddr 2001:db8::20 rport 4000\n";
+
+  XCTAssertEqual([self parse:body], PJ_SUCCESS);
+  XCTAssertEqual(_count, 1);
+  XCTAssertEqual(_candidates[0].addr.addr.sa_family, pj_AF_INET6());
+  XCTAssertEqual(pj_sockaddr_get_port(&_candidates[0].addr), 52001);
+  XCTAssertFalse(_end);
+}
+
+- (void)testEndOfCandidatesAlone {
+  XCTAssertEqual([self parse:@"a=end-of-candidates\r\n"], PJ_SUCCESS);
+  XCTAssertEqual(_count, 0);
+  XCTAssertTrue(_end);
+}
+
+- (void)testRejectsBodiesThatAreNotFragments {
+  XCTAssertEqual([self parse:@"Signal=1\r\nDuration=160\r\n"], PJMEDIA_SDP_EINSDP);
+}
+
+@end
@@ -0,0 +1,159 @@
+//
+//  SBSJitterBufferControllerTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/8/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SBSJitterBufferController.h"
+
+static unsigned const FrameDuration = 20;
+static unsigned const FramesPerInterval = 100;
+static unsigned const Intervals = 300;
+static unsigned const MaxPrefetch = 20;
+static unsigned const StaticPrefetch = 8;
+static double const TargetDiscardRate = 0.01;
+
+typedef NS_ENUM(NSInteger, NetworkTrace) {
+  NetworkTraceWiFi,
+  NetworkTraceLTE
+};
+
+typedef struct {
+  double latency;
+  double discardRate;
+} SimulationResult;
+
+@interface SBSJitterBufferControllerTests : XCTestCase
+
+@end
+
+@implementation SBSJitterBufferControllerTests
+
+/**
+ * Plays a synthetic jitter trace through the controller's policy
+ *
+ * Each frame is considered late if its jitter exceeds the current buffer depth. Wi-Fi is modeled as low,
+ * steady jitter, while LTE has a much wider spread with periodic bursts of delayed packets (i.e. handovers
+ * and scheduling stalls). Passing a nil controller simulates a static buffer.
+ */
+- (SimulationResult)simulateTrace:(NetworkTrace)trace controller:(SBSJitterBufferController *)controller {
+  srand48(42);
+
+  pjmedia_jb_state state;
+  memset(&state, 0, sizeof(state));
+  state.frame_size = FrameDuration;
+
+  double totalLatency = 0;
+  unsigned totalLate = 0;
+
+  for (unsigned interval = 0; interval < Intervals; interval++) {
+    unsigned depth = controller ? controller.minPrefetch : StaticPrefetch;
+    BOOL burst = trace == NetworkTraceLTE && drand48() < 0.1;
+    double sum = 0, sumSquares = 0;
+
+    for (unsigned frame = 0; frame < FramesPerInterval; frame++) {
+      double gaussian = sqrt(-2.0 * log(1.0 - drand48())) * cos(2.0 * M_PI * drand48());
+      double jitter = fabs(gaussian) * (trace == NetworkTraceWiFi ? 6.0 : 25.0);
+      if (burst && frame >= 40 && frame < 50) {
+        jitter += 120.0;
+      }
+
+      sum += jitter;
+      sumSquares += jitter * jitter;
+
+      if (jitter > depth * FrameDuration) {
+        state.discard++;
+        totalLate++;
+      }
+    }
+
+    double mean = sum / FramesPerInterval;
+    state.avg_delay = (unsigned) mean;
+    state.dev_delay = (unsigned) sqrt(MAX(sumSquares / FramesPerInterval - mean * mean, 0));
+    state.avg_burst = (unsigned) (mean / FrameDuration);
+
+    totalLatency += depth * FrameDuration;
+    [controller adjustForState:&state elapsed:FramesPerInterval * FrameDuration / 1000.0];
+  }
+
+  SimulationResult result = {
+    .latency = totalLatency / Intervals,
+    .discardRate = (double) totalLate / (Intervals * FramesPerInterval)
+  };
+  return result;
+}
+
+//------------------------------------------------------------------------------
+
+- (SBSJitterBufferController *)controller {
+  return [[SBSJitterBufferController alloc] initWithTargetDiscardRate:TargetDiscardRate
+                                                        frameDuration:FrameDuration
+                                                          maxPrefetch:MaxPrefetch];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testFirstSampleOnlyEstablishesBaseline {
+  SBSJitterBufferController *controller = [self controller];
+  unsigned minPrefetch = controller.minPrefetch;
+
+  pjmedia_jb_state state;
+  memset(&state, 0, sizeof(state));
+  state.discard = 500;
+
+  XCTAssertFalse([controller adjustForState:&state elapsed:2.0]);
+  XCTAssertEqual(controller.minPrefetch, minPrefetch);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testGrowsOnDiscardsAndRespectsHardMaximum {
+  SBSJitterBufferController *controller = [self controller];
+
+  pjmedia_jb_state state;
+  memset(&state, 0, sizeof(state));
+  [controller adjustForState:&state elapsed:2.0];
+
+  for (unsigned i = 0; i < 50; i++) {
+    state.discard += 20;
+    [controller adjustForState:&state elapsed:2.0];
+  }
+
+  XCTAssertEqual(controller.minPrefetch, MaxPrefetch - 1);
+  XCTAssertLessThanOrEqual(controller.maxPrefetch, MaxPrefetch);
+  XCTAssertGreaterThan(controller.maxPrefetch, controller.minPrefetch);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testWiFiTraceHasLowerLatencyThanStaticBuffer {
+  SimulationResult fixed = [self simulateTrace:NetworkTraceWiFi controller:nil];
+  SimulationResult adaptive = [self simulateTrace:NetworkTraceWiFi controller:[self controller]];
+
+  XCTAssertLessThan(adaptive.latency, fixed.latency / 2);
+  XCTAssertLessThan(adaptive.discardRate, TargetDiscardRate);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testLTETraceStaysNearTargetDiscardRate {
+  SimulationResult fixed = [self simulateTrace:NetworkTraceLTE controller:nil];
+  SimulationResult adaptive = [self simulateTrace:NetworkTraceLTE controller:[self controller]];
+
+  XCTAssertLessThan(adaptive.latency, fixed.latency);
+  XCTAssertLessThan(adaptive.discardRate, TargetDiscardRate * 3);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testPerformanceAdjustment {
+  [self measureBlock:^{
+    [self simulateTrace:NetworkTraceLTE controller:[self controller]];
+  }];
+}
+
+@end
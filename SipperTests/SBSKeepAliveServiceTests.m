@@ -0,0 +1,241 @@
+//
+//  SBSKeepAliveServiceTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <arpa/inet.h>
+#import <netinet/in.h>
+#import <sys/socket.h>
+
+#import <pjsua.h>
+
+#import "SBSEndpoint.h"
+#import "SBSEndpointConfiguration.h"
+#import "SBSKeepAliveService.h"
+#import "SBSKeepAliveStatistics.h"
+#import "SBSTransportConfiguration.h"
+
+@interface SBSKeepAliveService (Testing)
+
+/**
+ * Sends one round of keep-alives, as the timer does on every interval boundary
+ */
+- (void)tick:(NSTimer *)timer;
+
+@end
+
+@interface SBSKeepAliveServiceTests : XCTestCase
+
+@end
+
+@implementation SBSKeepAliveServiceTests {
+  NSMutableArray<NSNumber *> *_sockets;
+  BOOL _started;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  _sockets = [[NSMutableArray alloc] init];
+}
+
+- (void)tearDown {
+  if (_started) {
+    [[SBSEndpoint sharedEndpoint] destroyEndpointWithError:nil];
+  }
+
+  for (NSNumber *socket in _sockets) {
+    close(socket.intValue);
+  }
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)startEndpointWithKeepAliveInterval:(NSTimeInterval)interval {
+  SBSEndpointConfiguration *configuration = [[SBSEndpointConfiguration alloc] init];
+  configuration.transportConfigurations = @[[SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeUDP],
+                                            [SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeTCP]];
+  configuration.keepAliveInterval = interval;
+
+  NSError *error;
+  _started = [[SBSEndpoint sharedEndpoint] initializeEndpointWithConfiguration:configuration error:&error];
+  XCTAssertTrue(_started, @"%@", error);
+}
+
+/**
+ * Runs a block on the endpoint's background thread, which the service is confined to, and waits for it
+ */
+- (void)onBackgroundThread:(void (^)(void))block {
+  dispatch_semaphore_t done = dispatch_semaphore_create(0);
+  [[SBSEndpoint sharedEndpoint] performAsync:^{
+    block();
+    dispatch_semaphore_signal(done);
+  }];
+  XCTAssertEqual(dispatch_semaphore_wait(done, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)), 0);
+}
+
+/**
+ * Opens a socket on the loopback interface, which gives up on reads after a second
+ */
+- (int)openSocket:(int)type address:(pj_sockaddr *)address {
+  struct sockaddr_in bound = {0};
+  bound.sin_len = sizeof(bound);
+  bound.sin_family = AF_INET;
+  bound.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t length = sizeof(bound);
+  int fd = socket(AF_INET, type, 0);
+  bind(fd, (struct sockaddr *) &bound, length);
+  getsockname(fd, (struct sockaddr *) &bound, &length);
+
+  struct timeval timeout = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  [_sockets addObject:@(fd)];
+
+  pj_str_t loopback = pj_str("127.0.0.1");
+  pj_sockaddr_init(pj_AF_INET(), address, &loopback, ntohs(bound.sin_port));
+
+  return fd;
+}
+
+- (NSString *)receive:(int)fd {
+  char buffer[64];
+  ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+  return length > 0 ? [[NSString alloc] initWithBytes:buffer length:(NSUInteger) length encoding:NSASCIIStringEncoding] : nil;
+}
+
+- (pjsip_transport *)acquireTransport:(pjsip_transport_type_e)type to:(const pj_sockaddr *)address {
+  __block pjsip_transport *transport = NULL;
+  [self onBackgroundThread:^{
+    XCTAssertEqual(pjsip_endpt_acquire_transport(pjsua_get_pjsip_endpt(), type, address, pj_sockaddr_get_len(address),
+                                                 NULL, &transport), PJ_SUCCESS);
+  }];
+
+  return transport;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testEveryFlowIsSentAPingOnEachTick {
+  [self startEndpointWithKeepAliveInterval:0];
+
+  pj_sockaddr registrar, proxy, server;
+  int registrarSocket = [self openSocket:SOCK_DGRAM address:&registrar];
+  int proxySocket = [self openSocket:SOCK_DGRAM address:&proxy];
+  int listener = [self openSocket:SOCK_STREAM address:&server];
+  listen(listener, 1);
+
+  pjsip_transport *udp = [self acquireTransport:PJSIP_TRANSPORT_UDP to:&registrar];
+  pjsip_transport *tcp = [self acquireTransport:PJSIP_TRANSPORT_TCP to:&server];
+  int connection = accept(listener, NULL, NULL);
+  [_sockets addObject:@(connection)];
+
+  // The interval is long enough that only the tick below sends anything
+  SBSKeepAliveService *service = [[SBSKeepAliveService alloc] initWithInterval:3600];
+  service.streamTransports = ^NSArray<NSValue *> *{
+    pjsip_transport_add_ref(tcp);
+    return @[[NSValue valueWithPointer:tcp]];
+  };
+
+  __block SBSKeepAliveStatistics *statistics;
+  [self onBackgroundThread:^{
+    [service addDatagramFlow:udp destination:&registrar length:pj_sockaddr_get_len(&registrar) forKey:@1];
+
+    // Registering a flow again under the same key replaces it
+    [service addDatagramFlow:udp destination:&registrar length:pj_sockaddr_get_len(&registrar) forKey:@2];
+    [service addDatagramFlow:udp destination:&proxy length:pj_sockaddr_get_len(&proxy) forKey:@2];
+
+    [service tick:nil];
+    statistics = service.statistics;
+  }];
+
+  XCTAssertEqualObjects([self receive:registrarSocket], @"\r\n\r\n");
+  XCTAssertEqualObjects([self receive:proxySocket], @"\r\n\r\n");
+  XCTAssertEqualObjects([self receive:connection], @"\r\n\r\n");
+  XCTAssertNil([self receive:registrarSocket]);
+
+  XCTAssertEqual(statistics.wakeups, 1);
+  XCTAssertEqual(statistics.flows, 3);
+  XCTAssertEqual(statistics.keepAlivesSent, 3);
+  XCTAssertEqual(statistics.sendFailures, 0);
+
+  [self onBackgroundThread:^{
+    [service stop];
+    pjsip_transport_dec_ref(udp);
+    pjsip_transport_dec_ref(tcp);
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testFlowsReferenceTheirTransports {
+  [self startEndpointWithKeepAliveInterval:0];
+
+  pj_sockaddr registrar, server;
+  [self openSocket:SOCK_DGRAM address:&registrar];
+  int listener = [self openSocket:SOCK_STREAM address:&server];
+  listen(listener, 1);
+
+  pjsip_transport *udp = [self acquireTransport:PJSIP_TRANSPORT_UDP to:&registrar];
+  pjsip_transport *tcp = [self acquireTransport:PJSIP_TRANSPORT_TCP to:&server];
+
+  SBSKeepAliveService *service = [[SBSKeepAliveService alloc] initWithInterval:3600];
+  service.streamTransports = ^NSArray<NSValue *> *{
+    pjsip_transport_add_ref(tcp);
+    return @[[NSValue valueWithPointer:tcp]];
+  };
+
+  [self onBackgroundThread:^{
+    pj_atomic_value_t udpReferences = pj_atomic_get(udp->ref_cnt);
+    pj_atomic_value_t tcpReferences = pj_atomic_get(tcp->ref_cnt);
+
+    // Each datagram flow holds one reference until it's removed
+    [service addDatagramFlow:udp destination:&registrar length:pj_sockaddr_get_len(&registrar) forKey:@1];
+    [service addDatagramFlow:udp destination:&registrar length:pj_sockaddr_get_len(&registrar) forKey:@2];
+    XCTAssertEqual(pj_atomic_get(udp->ref_cnt), udpReferences + 2);
+
+    [service removeDatagramFlowForKey:@1];
+    [service removeDatagramFlowForKey:@1];
+    XCTAssertEqual(pj_atomic_get(udp->ref_cnt), udpReferences + 1);
+
+    // The reference that comes with each stream transport is released once the tick has sent on it
+    [service tick:nil];
+    XCTAssertEqual(pj_atomic_get(tcp->ref_cnt), tcpReferences);
+
+    [service stop];
+    XCTAssertEqual(pj_atomic_get(udp->ref_cnt), udpReferences);
+
+    pjsip_transport_dec_ref(udp);
+    pjsip_transport_dec_ref(tcp);
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testEndpointRestoresPjsipKeepAlives {
+  long tcpInterval = pjsip_cfg()->tcp.keep_alive_interval;
+  long tlsInterval = pjsip_cfg()->tls.keep_alive_interval;
+
+  [self startEndpointWithKeepAliveInterval:30];
+
+  // The shared timer replaces the one PJSIP runs for each connection
+  XCTAssertEqual(pjsip_cfg()->tcp.keep_alive_interval, 0);
+  XCTAssertEqual(pjsip_cfg()->tls.keep_alive_interval, 0);
+  XCTAssertNotNil([SBSEndpoint sharedEndpoint].keepAliveStatistics);
+
+  NSError *error;
+  XCTAssertTrue([[SBSEndpoint sharedEndpoint] destroyEndpointWithError:&error], @"%@", error);
+  _started = NO;
+
+  XCTAssertEqual(pjsip_cfg()->tcp.keep_alive_interval, tcpInterval);
+  XCTAssertEqual(pjsip_cfg()->tls.keep_alive_interval, tlsInterval);
+}
+
+@end
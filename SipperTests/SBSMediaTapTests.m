@@ -0,0 +1,287 @@
+//
+//  SBSMediaTapTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+#import <pjmedia.h>
+
+#import "SBSMediaTapStatistics.h"
+#import "SBSPjTestCase.h"
+#import "pj_cb_latency.h"
+#import "pj_media_tap.h"
+
+// 20ms frames at 16kHz, which is what the bridge runs at
+static unsigned const ClockRate = 16000;
+static unsigned const SamplesPerFrame = 320;
+
+// The benchmark taps this many calls, each with an uplink and a downlink port
+static unsigned const TappedCalls = 32;
+
+@interface SBSMediaTapTests : SBSPjTestCase
+
+@end
+
+@implementation SBSMediaTapTests
+
+//------------------------------------------------------------------------------
+
+/**
+ * Puts a frame into one side of a tap, the way the bridge would, with its first sample set to a marker
+ */
+- (void)putFrameInTap:(pj_media_tap *)tap direction:(pj_media_tap_dir)dir marker:(pj_int16_t)marker {
+  pj_int16_t samples[SamplesPerFrame];
+  pj_bzero(samples, sizeof(samples));
+  samples[0] = marker;
+
+  pjmedia_frame frame;
+  pj_bzero(&frame, sizeof(frame));
+  frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+  frame.buf = samples;
+  frame.size = sizeof(samples);
+  frame.timestamp.u64 = (pj_uint64_t) marker * SamplesPerFrame;
+
+  XCTAssertEqual(pjmedia_port_put_frame(pj_media_tap_get_port(tap, dir), &frame), PJ_SUCCESS);
+}
+
+- (void)testFramesArriveInOrderOnTheirOwnSide {
+  pj_media_tap *tap;
+  XCTAssertEqual(pj_media_tap_create(ClockRate, 1, SamplesPerFrame, 8, &tap), PJ_SUCCESS);
+
+  for (pj_int16_t i = 0; i < 5; i++) {
+    [self putFrameInTap:tap direction:PJ_MEDIA_TAP_DOWNLINK marker:i];
+  }
+  [self putFrameInTap:tap direction:PJ_MEDIA_TAP_UPLINK marker:100];
+
+  pj_media_tap_frame frame;
+  for (pj_int16_t i = 0; i < 5; i++) {
+    XCTAssertTrue(pj_media_tap_peek(tap, PJ_MEDIA_TAP_DOWNLINK, &frame));
+    XCTAssertEqual(frame.samples[0], i);
+    XCTAssertEqual(frame.sample_count, SamplesPerFrame);
+    XCTAssertEqual(frame.seq, (pj_uint64_t) i);
+    XCTAssertEqual(frame.timestamp.u64, (pj_uint64_t) i * SamplesPerFrame);
+    XCTAssertFalse(frame.silent);
+
+    // Peeking again sees the same frame, until it's released
+    XCTAssertTrue(pj_media_tap_peek(tap, PJ_MEDIA_TAP_DOWNLINK, &frame));
+    XCTAssertEqual(frame.samples[0], i);
+    pj_media_tap_release(tap, PJ_MEDIA_TAP_DOWNLINK);
+  }
+  XCTAssertFalse(pj_media_tap_peek(tap, PJ_MEDIA_TAP_DOWNLINK, &frame));
+
+  XCTAssertTrue(pj_media_tap_peek(tap, PJ_MEDIA_TAP_UPLINK, &frame));
+  XCTAssertEqual(frame.samples[0], (pj_int16_t) 100);
+  XCTAssertEqual(frame.seq, (pj_uint64_t) 0);
+
+  pj_media_tap_destroy(tap);
+}
+
+- (void)testFullRingDropsAndCountsFrames {
+  pj_media_tap *tap;
+  XCTAssertEqual(pj_media_tap_create(ClockRate, 1, SamplesPerFrame, 8, &tap), PJ_SUCCESS);
+
+  for (pj_int16_t i = 0; i < 20; i++) {
+    [self putFrameInTap:tap direction:PJ_MEDIA_TAP_UPLINK marker:i];
+  }
+
+  pj_media_tap_stat stat;
+  pj_media_tap_get_stat(tap, PJ_MEDIA_TAP_UPLINK, &stat);
+  XCTAssertEqual(stat.frames, (pj_uint64_t) 8);
+  XCTAssertEqual(stat.overflows, (pj_uint64_t) 12);
+  XCTAssertEqual(stat.depth, 8u);
+  XCTAssertEqual(stat.max_depth, 8u);
+
+  // The oldest frames are the ones kept, and the consumer can tell how many went missing after them
+  pj_media_tap_frame frame;
+  for (pj_int16_t i = 0; i < 8; i++) {
+    XCTAssertTrue(pj_media_tap_peek(tap, PJ_MEDIA_TAP_UPLINK, &frame));
+    XCTAssertEqual(frame.samples[0], i);
+    pj_media_tap_release(tap, PJ_MEDIA_TAP_UPLINK);
+  }
+
+  [self putFrameInTap:tap direction:PJ_MEDIA_TAP_UPLINK marker:20];
+  XCTAssertTrue(pj_media_tap_peek(tap, PJ_MEDIA_TAP_UPLINK, &frame));
+  XCTAssertEqual(frame.seq, (pj_uint64_t) 20);
+
+  pj_media_tap_get_stat(tap, PJ_MEDIA_TAP_DOWNLINK, &stat);
+  XCTAssertEqual(stat.frames, (pj_uint64_t) 0);
+  XCTAssertEqual(stat.overflows, (pj_uint64_t) 0);
+
+  pj_media_tap_destroy(tap);
+}
+
+- (void)testMissingAudioIsSilence {
+  pj_media_tap *tap;
+  XCTAssertEqual(pj_media_tap_create(ClockRate, 1, SamplesPerFrame, 1, &tap), PJ_SUCCESS);
+
+  // The ring's one slot has audio in it first, so the silence has something to overwrite
+  [self putFrameInTap:tap direction:PJ_MEDIA_TAP_UPLINK marker:7];
+  pj_media_tap_frame frame;
+  XCTAssertTrue(pj_media_tap_peek(tap, PJ_MEDIA_TAP_UPLINK, &frame));
+  pj_media_tap_release(tap, PJ_MEDIA_TAP_UPLINK);
+
+  for (unsigned i = 0; i < 2; i++) {
+    pjmedia_frame none;
+    pj_bzero(&none, sizeof(none));
+    none.type = PJMEDIA_FRAME_TYPE_NONE;
+    XCTAssertEqual(pjmedia_port_put_frame(pj_media_tap_get_port(tap, PJ_MEDIA_TAP_UPLINK), &none), PJ_SUCCESS);
+
+    XCTAssertTrue(pj_media_tap_peek(tap, PJ_MEDIA_TAP_UPLINK, &frame));
+    XCTAssertTrue(frame.silent);
+    XCTAssertEqual(frame.sample_count, SamplesPerFrame);
+    for (unsigned s = 0; s < SamplesPerFrame; s++) {
+      XCTAssertEqual(frame.samples[s], (pj_int16_t) 0);
+    }
+    pj_media_tap_release(tap, PJ_MEDIA_TAP_UPLINK);
+  }
+
+  pj_media_tap_destroy(tap);
+}
+
+- (void)testRingSizeMustBeAPowerOfTwo {
+  pj_media_tap *tap;
+  XCTAssertEqual(pj_media_tap_create(ClockRate, 1, SamplesPerFrame, 6, &tap), PJ_EINVAL);
+  XCTAssertEqual(pj_media_tap_create(ClockRate, 1, SamplesPerFrame, 0, &tap), PJ_EINVAL);
+
+  // The port matches the bridge, so the bridge doesn't resample for it
+  XCTAssertEqual(pj_media_tap_create(ClockRate, 1, SamplesPerFrame, 1, &tap), PJ_SUCCESS);
+  pjmedia_port *port = pj_media_tap_get_port(tap, PJ_MEDIA_TAP_DOWNLINK);
+  XCTAssertEqual(PJMEDIA_PIA_SRATE(&port->info), ClockRate);
+  XCTAssertEqual(PJMEDIA_PIA_SPF(&port->info), SamplesPerFrame);
+
+  pj_media_tap_destroy(tap);
+}
+
+- (void)testStatisticsOverflowRatio {
+  SBSMediaTapStatistics *statistics = [[SBSMediaTapStatistics alloc] initWithCapacity:64
+                                                                         uplinkFrames:90
+                                                                       downlinkFrames:100
+                                                                      uplinkOverflows:10
+                                                                    downlinkOverflows:0
+                                                                             maxDepth:64];
+  XCTAssertEqualWithAccuracy(statistics.overflowRatio, 0.05, 1e-9);
+
+  statistics = [[SBSMediaTapStatistics alloc] initWithCapacity:64
+                                                  uplinkFrames:0
+                                                downlinkFrames:0
+                                               uplinkOverflows:0
+                                             downlinkOverflows:0
+                                                      maxDepth:0];
+  XCTAssertEqual(statistics.overflowRatio, 0.0);
+}
+
+/**
+ * Drives 32 tapped calls the way the bridge would, at 20 times real time, with a consumer thread draining every ring.
+ * What the bridge's thread spends putting the frames is compared against the same frames put into a null port.
+ */
+- (void)testThirtyTwoTappedCallsCost {
+  unsigned const ticks = 2000;
+  useconds_t const tickInterval = 1000;
+
+  pj_media_tap *tapArray[TappedCalls];
+  pj_media_tap **taps = tapArray;
+  for (unsigned c = 0; c < TappedCalls; c++) {
+    XCTAssertEqual(pj_media_tap_create(ClockRate, 1, SamplesPerFrame, 64, &taps[c]), PJ_SUCCESS);
+  }
+
+  pjmedia_port *null;
+  XCTAssertEqual(pjmedia_null_port_create(_pool, ClockRate, 1, SamplesPerFrame, 16, &null), PJ_SUCCESS);
+
+  pj_int16_t samples[SamplesPerFrame];
+  for (unsigned s = 0; s < SamplesPerFrame; s++) {
+    samples[s] = (pj_int16_t) (s * 97);
+  }
+
+  pjmedia_frame frame;
+  pj_bzero(&frame, sizeof(frame));
+  frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+  frame.buf = samples;
+  frame.size = sizeof(samples);
+
+  pj_uint64_t baseline = 0;
+  for (unsigned t = 0; t < ticks; t++) {
+    pj_uint64_t started = pj_cb_latency_now();
+    for (unsigned p = 0; p < TappedCalls * 2; p++) {
+      pjmedia_port_put_frame(null, &frame);
+    }
+    baseline += pj_cb_latency_now() - started;
+  }
+
+  // The consumer touches every frame, the way a handler copying it out would
+  __block BOOL stopping = NO;
+  __block pj_uint64_t consumed = 0;
+  __block pj_int64_t checksum = 0;
+  dispatch_semaphore_t exited = dispatch_semaphore_create(0);
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+      BOOL drained = NO;
+      for (unsigned c = 0; c < TappedCalls; c++) {
+        for (int dir = 0; dir < PJ_MEDIA_TAP_DIR_COUNT; dir++) {
+          pj_media_tap_frame tapped;
+          while (pj_media_tap_peek(taps[c], (pj_media_tap_dir) dir, &tapped)) {
+            checksum += tapped.samples[tapped.sample_count - 1];
+            consumed++;
+            drained = YES;
+            pj_media_tap_release(taps[c], (pj_media_tap_dir) dir);
+          }
+        }
+      }
+
+      if (!drained) {
+        usleep(tickInterval / 2);
+      }
+    }
+    dispatch_semaphore_signal(exited);
+  });
+
+  pj_uint64_t tapped = 0, slowest = 0;
+  for (unsigned t = 0; t < ticks; t++) {
+    usleep(tickInterval);
+
+    pj_uint64_t started = pj_cb_latency_now();
+    for (unsigned c = 0; c < TappedCalls; c++) {
+      pjmedia_port_put_frame(pj_media_tap_get_port(taps[c], PJ_MEDIA_TAP_UPLINK), &frame);
+      pjmedia_port_put_frame(pj_media_tap_get_port(taps[c], PJ_MEDIA_TAP_DOWNLINK), &frame);
+    }
+    pj_uint64_t elapsed = pj_cb_latency_now() - started;
+
+    tapped += elapsed;
+    slowest = MAX(slowest, elapsed);
+  }
+
+  __atomic_store_n(&stopping, YES, __ATOMIC_RELEASE);
+  dispatch_semaphore_wait(exited, DISPATCH_TIME_FOREVER);
+
+  pj_uint64_t frames = 0, overflows = 0;
+  unsigned maxDepth = 0;
+  for (unsigned c = 0; c < TappedCalls; c++) {
+    for (int dir = 0; dir < PJ_MEDIA_TAP_DIR_COUNT; dir++) {
+      pj_media_tap_stat stat;
+      pj_media_tap_get_stat(taps[c], (pj_media_tap_dir) dir, &stat);
+      frames += stat.frames;
+      overflows += stat.overflows;
+      maxDepth = MAX(maxDepth, stat.max_depth);
+    }
+  }
+
+  // Every frame was either put in a ring or counted as dropped, and all but the last ring's worth were handed over
+  XCTAssertEqual(frames + overflows, (pj_uint64_t) ticks * TappedCalls * 2);
+  XCTAssertLessThanOrEqual(consumed, frames);
+  XCTAssertGreaterThan(consumed + 64 * TappedCalls * 2, frames);
+  XCTAssertEqual(checksum, (pj_int64_t) consumed * samples[SamplesPerFrame - 1]);
+
+  NSLog(@"Media tap, %u calls: %.0f ns of bridge time per tick (%.0f ns per frame, %.0f ns untapped), %llu ns at "
+        @"most, %llu overflows, ring depth at most %u",
+        TappedCalls, (double) tapped / ticks, (double) tapped / ticks / (TappedCalls * 2), (double) baseline / ticks,
+        slowest, overflows, maxDepth);
+
+  pjmedia_port_destroy(null);
+  for (unsigned c = 0; c < TappedCalls; c++) {
+    pj_media_tap_destroy(taps[c]);
+  }
+}
+
+@end
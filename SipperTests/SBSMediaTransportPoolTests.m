@@ -0,0 +1,175 @@
+//
+//  SBSMediaTransportPoolTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <pjsua.h>
+#import <pjsua-lib/pjsua_internal.h>
+
+#import "SBSAccount+Internal.h"
+#import "SBSAccountConfiguration.h"
+#import "SBSEndpoint.h"
+#import "SBSEndpointConfiguration.h"
+#import "SBSMediaTransportPool.h"
+#import "SBSTransportConfiguration.h"
+
+@interface SBSMediaTransportPoolTests : XCTestCase
+
+@end
+
+@implementation SBSMediaTransportPoolTests {
+  SBSAccount *_account;
+  pjsua_call *_call;
+  pjsua_call_media *_callMedia;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  // Transports handed to a call report to its media, which stands in for one PJSUA would have set up. Call 0 isn't
+  // in use, so there's no SBSCall to notify.
+  _call = calloc(1, sizeof(pjsua_call));
+  _callMedia = calloc(1, sizeof(pjsua_call_media));
+  _callMedia->call = _call;
+  _callMedia->tp_ready = PJ_EPENDING;
+}
+
+- (void)tearDown {
+  _account = nil;
+  [[SBSEndpoint sharedEndpoint] destroyEndpointWithError:nil];
+
+  free(_callMedia);
+  free(_call);
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)startEndpointWithTrickle:(BOOL)trickle {
+  SBSEndpointConfiguration *configuration = [[SBSEndpointConfiguration alloc] init];
+  configuration.transportConfigurations = @[[SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeUDP]];
+
+  SBSAccountConfiguration *accountConfiguration = [[SBSAccountConfiguration alloc] init];
+  accountConfiguration.sipProxyServer = @"sip:127.0.0.1:5080";
+  accountConfiguration.sipDomain = @"test.com";
+  accountConfiguration.sipAccount = @"test";
+  accountConfiguration.sipPassword = @"asdf";
+  accountConfiguration.trickleIce = trickle;
+
+  NSError *error;
+  SBSEndpoint *endpoint = [SBSEndpoint sharedEndpoint];
+  XCTAssertTrue([endpoint initializeEndpointWithConfiguration:configuration error:&error], @"%@", error);
+  _account = [endpoint createAccountWithConfiguration:accountConfiguration error:&error];
+  XCTAssertNotNil(_account, @"%@", error);
+}
+
+/**
+ * Runs a block on the endpoint's background thread, which fills and drains the pool, and waits for it
+ */
+- (void)onBackgroundThread:(void (^)(void))block {
+  dispatch_semaphore_t done = dispatch_semaphore_create(0);
+  [[SBSEndpoint sharedEndpoint] performAsync:^{
+    block();
+    dispatch_semaphore_signal(done);
+  }];
+  XCTAssertEqual(dispatch_semaphore_wait(done, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC)), 0);
+}
+
+- (BOOL)waitFor:(NSTimeInterval)duration until:(BOOL (^)(void))condition {
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:duration];
+  while (!condition() && [deadline timeIntervalSinceNow] > 0) {
+    usleep(10000);
+  }
+
+  return condition();
+}
+
+- (pjmedia_transport *)acquire {
+  __block pjmedia_transport *transport;
+  [self onBackgroundThread:^{
+    transport = [_account acquireMediaTransportForCallMedia:_callMedia];
+  }];
+
+  return transport;
+}
+
+- (void)close:(pjmedia_transport *)transport {
+  [self onBackgroundThread:^{
+    pjmedia_transport_close(transport);
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testWarmTransportsAreHandedToCallsAndReplaced {
+  [self startEndpointWithTrickle:NO];
+  SBSMediaTransportPool *pool = _account.mediaTransportPool;
+
+  [_account warmMediaTransports:2];
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    return pool.readyCount == 2;
+  }]);
+
+  // A call takes a transport that has finished gathering, and the pool starts on its replacement
+  pjmedia_transport *transport = [self acquire];
+  XCTAssertTrue(transport != NULL);
+  XCTAssertTrue(transport->user_data == _callMedia);
+  XCTAssertEqual(pool.hits, 1);
+  XCTAssertEqual(pool.misses, 0);
+
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    return pool.readyCount == 2;
+  }]);
+
+  [self close:transport];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCooledPoolLeavesCallsToGatherTheirOwn {
+  [self startEndpointWithTrickle:NO];
+  SBSMediaTransportPool *pool = _account.mediaTransportPool;
+
+  [_account warmMediaTransports:1];
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    return pool.readyCount == 1;
+  }]);
+
+  [_account coolMediaTransports];
+  [self onBackgroundThread:^{
+  }];
+  XCTAssertEqual(pool.readyCount, 0);
+
+  // Without trickle, PJSUA creates the call's transport itself
+  XCTAssertTrue([self acquire] == NULL);
+  XCTAssertEqual(pool.hits, 0);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testTrickleCallsGetATransportBeforeGatheringCompletes {
+  [self startEndpointWithTrickle:YES];
+  SBSMediaTransportPool *pool = _account.mediaTransportPool;
+
+  pjmedia_transport *transport = [self acquire];
+  XCTAssertTrue(transport != NULL);
+  XCTAssertTrue(transport->user_data == _callMedia);
+
+  // The pool never owned it, and gathering finishing is reported to the call's media rather than to the pool
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    return _callMedia->tp_ready != PJ_EPENDING;
+  }]);
+  XCTAssertEqual(_callMedia->tp_ready, PJ_SUCCESS);
+  XCTAssertEqual(pool.readyCount, 0);
+  XCTAssertEqual(pool.hits, 0);
+
+  [self close:transport];
+}
+
+@end
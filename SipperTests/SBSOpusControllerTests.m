@@ -0,0 +1,317 @@
+//
+//  SBSOpusControllerTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <opus/opus.h>
+
+#import "SBSOpusController.h"
+
+static unsigned const SampleRate = 16000;
+static unsigned const FrameSamples = SampleRate / 50;
+static unsigned const FramesPerReport = 250;
+static unsigned const Reports = 12;
+static unsigned const MinBitrate = 16000;
+static unsigned const MaxBitrate = 32000;
+
+typedef NS_ENUM(NSInteger, NetworkTrace) {
+  NetworkTraceClean,
+  NetworkTraceLossy,
+  NetworkTraceCongested
+};
+
+typedef struct {
+  double bitrate;
+  double cpuPerSecond;
+  double lossRate;
+  double energyError;
+} LoopbackResult;
+
+@interface SBSOpusControllerTests : XCTestCase
+
+@end
+
+@implementation SBSOpusControllerTests
+
+/**
+ * Fills a frame with something speech-like: a few harmonics of a wandering pitch under a syllable envelope, with
+ * talk spurts and pauses so DTX has something to do
+ */
+- (void)synthesizeFrame:(unsigned)frame into:(opus_int16 *)pcm {
+  for (unsigned i = 0; i < FrameSamples; i++) {
+    double t = (double) (frame * FrameSamples + i) / SampleRate;
+    BOOL talking = fmod(t, 2.5) < 1.5;
+    double pitch = 140.0 + 30.0 * sin(2.0 * M_PI * 0.7 * t);
+    double envelope = talking ? 0.5 + 0.5 * sin(2.0 * M_PI * 4.0 * t) : 0.0;
+
+    double sample = 0;
+    for (unsigned harmonic = 1; harmonic <= 6; harmonic++) {
+      sample += sin(2.0 * M_PI * pitch * harmonic * t) / harmonic;
+    }
+
+    pcm[i] = (opus_int16) (6000.0 * envelope * sample + 40.0 * (drand48() - 0.5));
+  }
+}
+
+/**
+ * Whether the network drops a packet, from a two-state (Gilbert-Elliott) model so that losses come in bursts
+ */
+- (BOOL)dropsPacket:(NetworkTrace)trace state:(BOOL *)bad {
+  double enterBad = trace == NetworkTraceLossy ? 0.02 : trace == NetworkTraceCongested ? 0.04 : 0.0;
+  double leaveBad = trace == NetworkTraceLossy ? 0.3 : 0.25;
+
+  *bad = *bad ? drand48() >= leaveBad : drand48() < enterBad;
+  return *bad && drand48() < 0.6;
+}
+
+- (void)configureEncoder:(OpusEncoder *)encoder bitrate:(unsigned)bitrate complexity:(unsigned)complexity
+              packetLoss:(unsigned)packetLoss fec:(BOOL)fec dtx:(BOOL)dtx {
+  opus_encoder_ctl(encoder, OPUS_SET_BITRATE(bitrate));
+  opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(complexity));
+  opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(packetLoss));
+  opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(fec ? 1 : 0));
+  opus_encoder_ctl(encoder, OPUS_SET_DTX(dtx ? 1 : 0));
+}
+
+/**
+ * Encodes synthetic speech, drops packets as the network would, and decodes what's left with FEC where the next
+ * packet carries it and PLC otherwise. RTCP reports are fed to the controller every five seconds, and its settings
+ * applied to the encoder. Passing a nil controller keeps a static encoder at the maximum bitrate and complexity,
+ * without FEC or DTX.
+ *
+ * Quality is measured as the average difference in energy between original and decoded frames while talking, in
+ * dB. Opus doesn't preserve the waveform, so a sample-by-sample comparison would mostly measure phase.
+ */
+- (LoopbackResult)loopback:(NetworkTrace)trace controller:(SBSOpusController *)controller {
+  srand48(7);
+
+  int error;
+  OpusEncoder *encoder = opus_encoder_create(SampleRate, 1, OPUS_APPLICATION_VOIP, &error);
+  OpusDecoder *decoder = opus_decoder_create(SampleRate, 1, &error);
+
+  if (controller == nil) {
+    [self configureEncoder:encoder bitrate:MaxBitrate complexity:10 packetLoss:0 fec:NO dtx:NO];
+  } else {
+    [self configureEncoder:encoder bitrate:controller.bitrate complexity:controller.complexity
+                packetLoss:controller.packetLoss fec:controller.fec dtx:controller.dtx];
+  }
+
+  opus_int32 lookahead = 0;
+  opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+
+  unsigned frames = FramesPerReport * Reports;
+  opus_int16 *original = calloc(frames * FrameSamples, sizeof(opus_int16));
+  opus_int16 *decoded = calloc(frames * FrameSamples + lookahead, sizeof(opus_int16));
+
+  unsigned char packets[2][1275];
+  opus_int32 lengths[2] = { 0, 0 };
+  BOOL received[2] = { NO, NO };
+  BOOL bad = NO;
+
+  pjmedia_rtcp_stat stat;
+  memset(&stat, 0, sizeof(stat));
+  stat.rtt.last = trace == NetworkTraceCongested ? 500000 : trace == NetworkTraceLossy ? 120000 : 60000;
+  [controller adjustForStatistics:&stat];
+
+  unsigned long bytes = 0;
+  unsigned lost = 0;
+  clock_t cpu = 0;
+
+  // Frame n is decoded once frame n + 1 has arrived, as it would be from a jitter buffer
+  for (unsigned frame = 0; frame <= frames; frame++) {
+    unsigned current = frame % 2, previous = (frame + 1) % 2;
+
+    if (frame < frames) {
+      [self synthesizeFrame:frame into:&original[frame * FrameSamples]];
+
+      clock_t start = clock();
+      lengths[current] = opus_encode(encoder, &original[frame * FrameSamples], FrameSamples, packets[current], sizeof(packets[current]));
+      cpu += clock() - start;
+
+      bytes += lengths[current];
+      received[current] = ![self dropsPacket:trace state:&bad];
+      lost += received[current] ? 0 : 1;
+      stat.tx.pkt++;
+      stat.tx.loss += received[current] ? 0 : 1;
+    } else {
+      received[current] = NO;
+    }
+
+    if (frame > 0) {
+      opus_int16 *output = &decoded[(frame - 1) * FrameSamples];
+
+      clock_t start = clock();
+      if (received[previous]) {
+        opus_decode(decoder, packets[previous], lengths[previous], output, FrameSamples, 0);
+      } else if (received[current]) {
+        opus_decode(decoder, packets[current], lengths[current], output, FrameSamples, 1);
+      } else {
+        opus_decode(decoder, NULL, 0, output, FrameSamples, 0);
+      }
+      cpu += clock() - start;
+    }
+
+    if (controller != nil && frame > 0 && frame % FramesPerReport == 0) {
+      stat.tx.update_cnt++;
+      if ([controller adjustForStatistics:&stat]) {
+        [self configureEncoder:encoder bitrate:controller.bitrate complexity:controller.complexity
+                    packetLoss:controller.packetLoss fec:controller.fec dtx:controller.dtx];
+      }
+    }
+  }
+
+  // The decoder runs behind the encoder by its lookahead
+  double errorSum = 0;
+  unsigned talking = 0;
+  for (unsigned frame = 0; frame + 1 < frames; frame++) {
+    double originalEnergy = 1.0, decodedEnergy = 1.0;
+    for (unsigned i = 0; i < FrameSamples; i++) {
+      originalEnergy += pow(original[frame * FrameSamples + i], 2);
+      decodedEnergy += pow(decoded[frame * FrameSamples + i + lookahead], 2);
+    }
+
+    if (originalEnergy / FrameSamples > 1e5) {
+      errorSum += fabs(10.0 * log10(decodedEnergy / originalEnergy));
+      talking++;
+    }
+  }
+
+  opus_encoder_destroy(encoder);
+  opus_decoder_destroy(decoder);
+  free(original);
+  free(decoded);
+
+  double seconds = (double) frames * FrameSamples / SampleRate;
+  LoopbackResult result = {
+    .bitrate = bytes * 8 / seconds,
+    .cpuPerSecond = (double) cpu / CLOCKS_PER_SEC * 1000.0 / seconds,
+    .lossRate = (double) lost / frames,
+    .energyError = errorSum / MAX(talking, 1)
+  };
+  return result;
+}
+
+- (SBSOpusController *)controller {
+  return [[SBSOpusController alloc] initWithMinBitrate:MinBitrate maxBitrate:MaxBitrate];
+}
+
+- (pjmedia_rtcp_stat)statWithPackets:(unsigned)packets loss:(unsigned)loss rtt:(unsigned)rtt update:(unsigned)update {
+  pjmedia_rtcp_stat stat;
+  memset(&stat, 0, sizeof(stat));
+  stat.tx.pkt = packets;
+  stat.tx.loss = loss;
+  stat.tx.update_cnt = update;
+  stat.rtt.last = rtt * 1000;
+  return stat;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testFirstSampleOnlyEstablishesBaseline {
+  SBSOpusController *controller = [self controller];
+
+  pjmedia_rtcp_stat stat = [self statWithPackets:500 loss:100 rtt:50 update:1];
+  XCTAssertFalse([controller adjustForStatistics:&stat]);
+  XCTAssertTrue(controller.fec);
+  XCTAssertEqual(controller.bitrate, MaxBitrate);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testWaitsForNewReceiverReports {
+  SBSOpusController *controller = [self controller];
+
+  pjmedia_rtcp_stat stat = [self statWithPackets:0 loss:0 rtt:50 update:0];
+  [controller adjustForStatistics:&stat];
+
+  stat = [self statWithPackets:250 loss:0 rtt:50 update:0];
+  XCTAssertFalse([controller adjustForStatistics:&stat]);
+  XCTAssertTrue(controller.fec);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCleanNetworkSavesBandwidthAndCpu {
+  SBSOpusController *controller = [self controller];
+
+  pjmedia_rtcp_stat stat = [self statWithPackets:0 loss:0 rtt:50 update:0];
+  [controller adjustForStatistics:&stat];
+
+  // The initial loss estimate decays over a few reports
+  for (unsigned i = 1; i <= 10; i++) {
+    stat = [self statWithPackets:250 * i loss:0 rtt:50 update:i];
+    [controller adjustForStatistics:&stat];
+  }
+
+  XCTAssertEqual(controller.bitrate, MinBitrate);
+  XCTAssertEqual(controller.packetLoss, 0);
+  XCTAssertLessThan(controller.complexity, 9);
+  XCTAssertFalse(controller.fec);
+  XCTAssertTrue(controller.dtx);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testLossTurnsOnFecImmediately {
+  SBSOpusController *controller = [self controller];
+
+  pjmedia_rtcp_stat stat = [self statWithPackets:0 loss:0 rtt:50 update:0];
+  [controller adjustForStatistics:&stat];
+  for (unsigned i = 1; i <= 10; i++) {
+    stat = [self statWithPackets:250 * i loss:0 rtt:50 update:i];
+    [controller adjustForStatistics:&stat];
+  }
+
+  stat = [self statWithPackets:2750 loss:13 rtt:50 update:11];
+  XCTAssertTrue([controller adjustForStatistics:&stat]);
+  XCTAssertTrue(controller.fec);
+  XCTAssertFalse(controller.dtx);
+  XCTAssertEqual(controller.packetLoss, 5);
+  XCTAssertGreaterThan(controller.bitrate, MinBitrate);
+  XCTAssertLessThan(controller.bitrate, MaxBitrate);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCongestionKeepsFecAtMinimumBitrate {
+  SBSOpusController *controller = [self controller];
+
+  pjmedia_rtcp_stat stat = [self statWithPackets:0 loss:0 rtt:500 update:0];
+  [controller adjustForStatistics:&stat];
+
+  stat = [self statWithPackets:250 loss:25 rtt:500 update:1];
+  XCTAssertTrue([controller adjustForStatistics:&stat]);
+  XCTAssertTrue(controller.fec);
+  XCTAssertEqual(controller.bitrate, MinBitrate);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testLossyLoopbackTradeoff {
+  NSArray<NSString *> *names = @[@"clean", @"lossy", @"congested"];
+  LoopbackResult fixed[3], adaptive[3];
+
+  NSLog(@"Opus over a simulated loopback, %u seconds per network", Reports * FramesPerReport / 50);
+  NSLog(@"  network     encoder   loss    kbps   cpu ms/s   energy error dB");
+  for (NetworkTrace trace = NetworkTraceClean; trace <= NetworkTraceCongested; trace++) {
+    fixed[trace] = [self loopback:trace controller:nil];
+    adaptive[trace] = [self loopback:trace controller:[self controller]];
+
+    NSLog(@"  %-10s  static   %5.1f%%  %6.1f  %9.2f   %6.2f", names[trace].UTF8String, fixed[trace].lossRate * 100,
+          fixed[trace].bitrate / 1000, fixed[trace].cpuPerSecond, fixed[trace].energyError);
+    NSLog(@"  %-10s  adaptive %5.1f%%  %6.1f  %9.2f   %6.2f", names[trace].UTF8String, adaptive[trace].lossRate * 100,
+          adaptive[trace].bitrate / 1000, adaptive[trace].cpuPerSecond, adaptive[trace].energyError);
+  }
+
+  // Clean networks get the same audio for less, and lossy ones get better audio for more
+  XCTAssertLessThan(adaptive[NetworkTraceClean].bitrate, fixed[NetworkTraceClean].bitrate);
+  XCTAssertLessThan(adaptive[NetworkTraceLossy].energyError, fixed[NetworkTraceLossy].energyError);
+  XCTAssertLessThan(adaptive[NetworkTraceCongested].bitrate, fixed[NetworkTraceCongested].bitrate);
+}
+
+@end
@@ -0,0 +1,25 @@
+//
+//  SBSPjTestCase.h
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <pjlib.h>
+
+/**
+ * Base class for tests that exercise PJLIB directly, without an endpoint
+ *
+ * PJLIB is initialized before each test, with a caching pool and a pool from it. Subclasses shut down whatever they
+ * started in their own tearDown, before calling super's, which releases the pool and shuts PJLIB down.
+ */
+@interface SBSPjTestCase : XCTestCase {
+ @protected
+  pj_caching_pool _cp;
+  pj_pool_t *_pool;
+}
+
+@end
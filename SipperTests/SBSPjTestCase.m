@@ -0,0 +1,29 @@
+//
+//  SBSPjTestCase.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import "SBSPjTestCase.h"
+
+@implementation SBSPjTestCase
+
+- (void)setUp {
+  [super setUp];
+
+  pj_init();
+  pj_caching_pool_init(&_cp, NULL, 0);
+  _pool = pj_pool_create(&_cp.factory, "test", 4096, 4096, NULL);
+}
+
+- (void)tearDown {
+  pj_pool_release(_pool);
+  pj_caching_pool_destroy(&_cp);
+  pj_shutdown();
+
+  [super tearDown];
+}
+
+@end
@@ -0,0 +1,201 @@
+//
+//  SBSRatePortTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+#import <pjmedia.h>
+
+#import "SBSPjTestCase.h"
+#import "pj_rate_port.h"
+
+// The bridge runs 20ms frames at 16kHz
+static unsigned const BridgeRate = 16000;
+static unsigned const BridgeSamplesPerFrame = 320;
+
+// Both sides play a 1kHz tone, which crosses zero 40 times a frame whatever the rate
+static double const ToneFrequency = 1000;
+static unsigned const CrossingsPerFrame = 40;
+
+// How long the virtual device stays stopped while its stream restarts at a new rate
+static useconds_t const RestartDelay = 5000;
+
+/**
+ * Stands in for the conference bridge: plays a tone, and counts what it's given
+ */
+typedef struct loopback_port {
+  pjmedia_port base;
+  unsigned played;
+  unsigned received;
+  unsigned wrong_size;
+  unsigned last_crossings;
+} loopback_port;
+
+static unsigned zero_crossings(const pj_int16_t *samples, unsigned count) {
+  unsigned crossings = 0;
+  for (unsigned i = 1; i < count; i++) {
+    crossings += (samples[i - 1] < 0) != (samples[i] < 0);
+  }
+  return crossings;
+}
+
+static void render_tone(pj_int16_t *samples, unsigned count, unsigned rate, unsigned offset) {
+  for (unsigned i = 0; i < count; i++) {
+    samples[i] = (pj_int16_t) (10000 * sin(2 * M_PI * ToneFrequency * (offset + i) / rate + 0.1));
+  }
+}
+
+static pj_status_t loopback_get_frame(pjmedia_port *this_port, pjmedia_frame *frame) {
+  loopback_port *port = (loopback_port *) this_port;
+  render_tone((pj_int16_t *) frame->buf, BridgeSamplesPerFrame, BridgeRate, port->played * BridgeSamplesPerFrame);
+  port->played++;
+
+  frame->type = PJMEDIA_FRAME_TYPE_AUDIO;
+  frame->size = BridgeSamplesPerFrame * sizeof(pj_int16_t);
+  return PJ_SUCCESS;
+}
+
+static pj_status_t loopback_put_frame(pjmedia_port *this_port, pjmedia_frame *frame) {
+  loopback_port *port = (loopback_port *) this_port;
+  port->received++;
+
+  if (frame->size != BridgeSamplesPerFrame * sizeof(pj_int16_t)) {
+    port->wrong_size++;
+  } else {
+    port->last_crossings = zero_crossings((const pj_int16_t *) frame->buf, BridgeSamplesPerFrame);
+  }
+
+  return PJ_SUCCESS;
+}
+
+@interface SBSRatePortTests : SBSPjTestCase
+
+@end
+
+@implementation SBSRatePortTests {
+  loopback_port _bridge;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  pj_bzero(&_bridge, sizeof(_bridge));
+  pj_str_t name = pj_str("bridge");
+  pjmedia_port_info_init(&_bridge.base.info, &name, PJMEDIA_SIG_CLASS_PORT_AUD('L', 'B'), BridgeRate, 1, 16,
+                         BridgeSamplesPerFrame);
+  _bridge.base.get_frame = &loopback_get_frame;
+  _bridge.base.put_frame = &loopback_put_frame;
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * Runs a virtual sound device at the port's current rate for a number of frames: each frame captures a tone into the
+ * port, and plays whatever the port gives back
+ *
+ * @return the fewest zero crossings played in a frame, after the resamplers have filled up
+ */
+- (unsigned)runDevice:(pjmedia_port *)port frames:(unsigned)frames {
+  unsigned rate = PJMEDIA_PIA_SRATE(&port->info);
+  unsigned samplesPerFrame = PJMEDIA_PIA_SPF(&port->info);
+  pj_int16_t samples[samplesPerFrame];
+  unsigned fewest = UINT_MAX;
+
+  for (unsigned i = 0; i < frames; i++) {
+    pjmedia_frame frame;
+    pj_bzero(&frame, sizeof(frame));
+    frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+    frame.buf = samples;
+    frame.size = sizeof(samples);
+
+    render_tone(samples, samplesPerFrame, rate, i * samplesPerFrame);
+    XCTAssertEqual(pjmedia_port_put_frame(port, &frame), PJ_SUCCESS);
+
+    frame.size = sizeof(samples);
+    XCTAssertEqual(pjmedia_port_get_frame(port, &frame), PJ_SUCCESS);
+    XCTAssertEqual(frame.size, sizeof(samples));
+
+    if (i >= 2) {
+      fewest = MIN(fewest, zero_crossings(samples, samplesPerFrame));
+    }
+  }
+
+  return fewest;
+}
+
+- (void)testSwitchingRatesKeepsTheToneOnBothSides {
+  pjmedia_port *port;
+  XCTAssertEqual(pj_rate_port_create(_pool, &_bridge.base, 48000, PJ_TRUE, PJ_FALSE, &port), PJ_SUCCESS);
+  XCTAssertEqual(PJMEDIA_PIA_SPF(&port->info), 960u);
+
+  unsigned rates[] = {48000, 8000, 44100, 16000, 32000};
+  for (unsigned r = 0; r < PJ_ARRAY_SIZE(rates); r++) {
+    if (r > 0) {
+      usleep(RestartDelay);
+    }
+
+    XCTAssertEqual(pj_rate_port_set_clock_rate(port, rates[r]), PJ_SUCCESS);
+    XCTAssertEqual(PJMEDIA_PIA_SRATE(&port->info), rates[r]);
+    XCTAssertEqual(PJMEDIA_PIA_SPF(&port->info), rates[r] / 50);
+
+    // Both directions still carry the tone, within a crossing or two of resampler warm-up
+    unsigned played = [self runDevice:port frames:10];
+    XCTAssertGreaterThanOrEqual(played, CrossingsPerFrame - 2, @"playback at %u", rates[r]);
+    XCTAssertGreaterThanOrEqual(_bridge.last_crossings, CrossingsPerFrame - 2, @"capture at %u", rates[r]);
+  }
+
+  XCTAssertEqual(_bridge.wrong_size, 0u);
+  XCTAssertEqual(_bridge.received, 50u);
+
+  // Every switch was the device's restart delay, and not much more
+  pj_rate_port_stat stat;
+  pj_rate_port_get_stat(port, &stat);
+  XCTAssertEqual(stat.switches, 4u);
+  XCTAssertEqual(stat.frames, (pj_uint64_t) 100);
+  XCTAssertGreaterThanOrEqual(stat.max_gap_nsec, (pj_uint64_t) RestartDelay * 1000);
+  XCTAssertLessThan(stat.last_gap_nsec, (pj_uint64_t) RestartDelay * 1000 * 10);
+
+  pjmedia_port_destroy(port);
+}
+
+- (void)testUnsupportedRateIsRejected {
+  pjmedia_port *port;
+  XCTAssertEqual(pj_rate_port_create(_pool, &_bridge.base, 22050, PJ_TRUE, PJ_FALSE, &port), PJ_EINVAL);
+  XCTAssertEqual(pj_rate_port_create(_pool, &_bridge.base, 16000, PJ_TRUE, PJ_FALSE, &port), PJ_SUCCESS);
+
+  XCTAssertEqual(pj_rate_port_set_clock_rate(port, 24000), PJ_EINVAL);
+  XCTAssertEqual(PJMEDIA_PIA_SRATE(&port->info), 16000u);
+
+  // Setting the rate it already has isn't a switch
+  XCTAssertEqual(pj_rate_port_set_clock_rate(port, 16000), PJ_SUCCESS);
+  pj_rate_port_stat stat;
+  pj_rate_port_get_stat(port, &stat);
+  XCTAssertEqual(stat.switches, 0u);
+
+  pjmedia_port_destroy(port);
+}
+
+- (void)testFrameCost {
+  unsigned const frames = 5000;
+  unsigned rates[] = {16000, 48000, 44100, 8000};
+
+  for (unsigned r = 0; r < PJ_ARRAY_SIZE(rates); r++) {
+    pjmedia_port *port;
+    XCTAssertEqual(pj_rate_port_create(_pool, &_bridge.base, rates[r], PJ_TRUE, PJ_FALSE, &port), PJ_SUCCESS);
+
+    [self runDevice:port frames:frames];
+
+    pj_rate_port_stat stat;
+    pj_rate_port_get_stat(port, &stat);
+    XCTAssertEqual(stat.frames, (pj_uint64_t) frames * 2);
+    NSLog(@"Rate port at %u Hz: %.0f ns per frame on average, %llu ns at most", rates[r],
+          (double) stat.frame_nsec / stat.frames, stat.max_frame_nsec);
+
+    pjmedia_port_destroy(port);
+  }
+}
+
+@end
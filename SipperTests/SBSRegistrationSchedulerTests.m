@@ -0,0 +1,262 @@
+//
+//  SBSRegistrationSchedulerTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/12/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SBSRegistrationMetrics.h"
+#import "SBSRegistrationScheduler.h"
+
+static NSUInteger const AccountCount = 500;
+static NSTimeInterval const Resolution = 0.1;
+static NSTimeInterval const ResponseLatency = 0.15;
+static NSTimeInterval const MaxRetryDelay = 60.0;
+
+/**
+ * A fake registrar that rejects every REGISTER until it recovers, and then accepts them all
+ */
+@interface SBSFakeRegistrar : NSObject
+
+@property(nonatomic) NSTimeInterval recoversAt;
+@property(nonatomic, strong) NSMutableArray<NSArray *> *responses;
+@property(nonatomic, strong) NSMutableSet<NSNumber *> *registered;
+@property(nonatomic, strong) NSMutableArray<NSNumber *> *sentAt;
+
+@end
+
+@implementation SBSFakeRegistrar
+
+- (instancetype)init {
+  if (self = [super init]) {
+    _responses = [[NSMutableArray alloc] init];
+    _registered = [[NSMutableSet alloc] init];
+    _sentAt = [[NSMutableArray alloc] init];
+  }
+
+  return self;
+}
+
+@end
+
+@interface SBSRegistrationSchedulerTests : XCTestCase
+
+@end
+
+@implementation SBSRegistrationSchedulerTests
+
+/**
+ * Registers all accounts against a registrar that is down for a while, reporting results back to the scheduler the
+ * same way SBSAccount does
+ */
+- (SBSFakeRegistrar *)runWithMaxInFlight:(NSUInteger)maxInFlight recoversAt:(NSTimeInterval)recoversAt until:(NSTimeInterval)end {
+  srand48(7);
+
+  __block NSTimeInterval now = 0;
+  SBSFakeRegistrar *registrar = [[SBSFakeRegistrar alloc] init];
+  registrar.recoversAt = recoversAt;
+
+  SBSRegistrationScheduler *scheduler = [[SBSRegistrationScheduler alloc] initWithMaxInFlight:maxInFlight
+                                                                                    resolution:Resolution
+                                                                                retryBaseDelay:2.0
+                                                                                           now:now
+                                                                                        sender:^BOOL(NSNumber *accountId) {
+    [registrar.sentAt addObject:@(now)];
+    [registrar.responses addObject:@[@(now + ResponseLatency), accountId]];
+    return YES;
+  }];
+  scheduler.randomSource = ^double {
+    return drand48();
+  };
+
+  for (NSUInteger i = 0; i < AccountCount; i++) {
+    [scheduler scheduleRegistration:@(i) after:0 jitter:0];
+  }
+
+  for (now = 0; now <= end; now += Resolution) {
+    NSArray<NSArray *> *responses = [registrar.responses copy];
+    [registrar.responses removeAllObjects];
+
+    for (NSArray *response in responses) {
+      if ([response[0] doubleValue] > now) {
+        [registrar.responses addObject:response];
+        continue;
+      }
+
+      NSNumber *accountId = response[1];
+      BOOL success = now >= registrar.recoversAt;
+      [scheduler completeRegistration:accountId success:success];
+
+      if (success) {
+        [registrar.registered addObject:accountId];
+      } else {
+        [scheduler scheduleRetry:accountId maxDelay:MaxRetryDelay];
+      }
+    }
+
+    [scheduler advanceToTime:now];
+  }
+
+  SBSRegistrationMetrics *metrics = scheduler.metrics;
+  XCTAssertLessThanOrEqual(metrics.peakInFlight, maxInFlight);
+  XCTAssertEqual(metrics.registrationsSent, registrar.sentAt.count);
+
+  return registrar;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testRegistrarOutageRecovers {
+  SBSFakeRegistrar *registrar = [self runWithMaxInFlight:8 recoversAt:30 until:300];
+
+  XCTAssertEqual(registrar.registered.count, AccountCount);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testRetriesAreNotSynchronized {
+
+  // Without an in-flight limit, the only thing keeping retries apart is the jitter
+  SBSFakeRegistrar *registrar = [self runWithMaxInFlight:AccountCount recoversAt:600 until:120];
+
+  NSCountedSet<NSNumber *> *perTick = [[NSCountedSet alloc] init];
+  for (NSNumber *sentAt in registrar.sentAt) {
+    if (sentAt.doubleValue > 1.0) {
+      [perTick addObject:@((NSInteger) round(sentAt.doubleValue / Resolution))];
+    }
+  }
+
+  NSUInteger peak = 0;
+  for (NSNumber *tick in perTick) {
+    peak = MAX(peak, [perTick countForObject:tick]);
+  }
+
+  XCTAssertGreaterThan(registrar.sentAt.count, AccountCount * 2);
+  XCTAssertLessThan(peak, AccountCount / 10);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testCancelledRegistrationIsNotSent {
+  __block NSUInteger sent = 0;
+  SBSRegistrationScheduler *scheduler = [[SBSRegistrationScheduler alloc] initWithMaxInFlight:1
+                                                                                    resolution:Resolution
+                                                                                retryBaseDelay:2.0
+                                                                                           now:0
+                                                                                        sender:^BOOL(NSNumber *accountId) {
+    sent++;
+    return YES;
+  }];
+
+  [scheduler scheduleRegistration:@1 after:5 jitter:0];
+  [scheduler cancelRegistration:@1];
+  [scheduler advanceToTime:10];
+
+  XCTAssertEqual(sent, 0);
+  XCTAssertEqual(scheduler.metrics.pending, 0);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testLostResponsesReleaseTheirSlot {
+  __block NSUInteger sent = 0;
+  SBSRegistrationScheduler *scheduler = [[SBSRegistrationScheduler alloc] initWithMaxInFlight:1
+                                                                                    resolution:Resolution
+                                                                                retryBaseDelay:2.0
+                                                                                           now:0
+                                                                                        sender:^BOOL(NSNumber *accountId) {
+    sent++;
+    return YES;
+  }];
+
+  [scheduler scheduleRegistration:@1 after:0 jitter:0];
+  [scheduler scheduleRegistration:@2 after:0 jitter:0];
+  XCTAssertEqual(sent, 1);
+
+  [scheduler advanceToTime:scheduler.inFlightTimeout + 1];
+  XCTAssertEqual(sent, 2);
+  XCTAssertEqual(scheduler.metrics.registrationsTimedOut, 1);
+  XCTAssertEqual(scheduler.metrics.registrationsDeferred, 1);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testRefreshesTakeASlot {
+  NSMutableArray<NSNumber *> *sent = [[NSMutableArray alloc] init];
+  SBSRegistrationScheduler *scheduler = [[SBSRegistrationScheduler alloc] initWithMaxInFlight:1
+                                                                                    resolution:Resolution
+                                                                                retryBaseDelay:2.0
+                                                                                           now:0
+                                                                                        sender:^BOOL(NSNumber *accountId) {
+    [sent addObject:accountId];
+    return YES;
+  }];
+
+  // A refresh PJSIP sent on its own holds back the scheduler's registrations until it completes, including one for
+  // the same account, which is sent afterwards rather than dropped
+  [scheduler startRegistration:@1];
+  [scheduler scheduleRegistration:@1 after:0 jitter:0];
+  [scheduler scheduleRegistration:@2 after:0 jitter:0];
+  [scheduler advanceToTime:1];
+  XCTAssertEqual(sent.count, 0);
+  XCTAssertEqual(scheduler.metrics.pending, 2);
+
+  [scheduler completeRegistration:@1 success:YES];
+  XCTAssertEqualObjects(sent, @[@1]);
+
+  [scheduler completeRegistration:@1 success:YES];
+  XCTAssertEqualObjects(sent, (@[@1, @2]));
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testRetriesWithoutAMaximumDelay {
+  __block NSUInteger sent = 0;
+  SBSRegistrationScheduler *scheduler = [[SBSRegistrationScheduler alloc] initWithMaxInFlight:1
+                                                                                    resolution:Resolution
+                                                                                retryBaseDelay:2.0
+                                                                                           now:0
+                                                                                        sender:^BOOL(NSNumber *accountId) {
+    sent++;
+    return YES;
+  }];
+
+  [scheduler scheduleRegistration:@1 after:0 jitter:0];
+  [scheduler completeRegistration:@1 success:NO];
+  [scheduler scheduleRetry:@1 maxDelay:0];
+
+  // The default limit is 60 seconds
+  [scheduler advanceToTime:61];
+  XCTAssertEqual(sent, 2);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testFailedSendsWaitForTheNextTick {
+  __block NSUInteger sent = 0;
+  __block SBSRegistrationScheduler *scheduler;
+  scheduler = [[SBSRegistrationScheduler alloc] initWithMaxInFlight:1
+                                                         resolution:Resolution
+                                                     retryBaseDelay:0
+                                                                now:0
+                                                             sender:^BOOL(NSNumber *accountId) {
+    sent++;
+    
+    // A sender that reports back before it returns drains again from inside the drain
+    [scheduler completeRegistration:accountId success:NO];
+    return NO;
+  }];
+
+  // Without a base delay, each failure used to be retried right away from inside the one before it
+  [scheduler scheduleRegistration:@1 after:0 jitter:0];
+  XCTAssertEqual(sent, 1);
+
+  [scheduler advanceToTime:Resolution];
+  XCTAssertEqual(sent, 2);
+  XCTAssertEqual(scheduler.metrics.pending, 1);
+}
+
+@end
@@ -0,0 +1,200 @@
+//
+//  SBSSipCaptureTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+#import <pjsip.h>
+
+#import "SBSPjTestCase.h"
+#import "pj_sip_capture.h"
+
+static char const *const Register = "REGISTER sip:example.com SIP/2.0\r\n"
+                                    "v: SIP/2.0/UDP 10.0.0.2:5060;rport;branch=z9hG4bKPj8e3c\r\n"
+                                    "f: <sip:alice@example.com>;tag=1c2d\r\n"
+                                    "t: <sip:alice@example.com>\r\n"
+                                    "i: 5b1e0f7a-4c1d\r\n"
+                                    "CSeq: 1 REGISTER\r\n"
+                                    "m: <sip:alice@10.0.0.2:5060;ob>\r\n"
+                                    "Expires: 300\r\n"
+                                    "l: 0\r\n\r\n";
+
+@interface SBSSipCaptureTests : SBSPjTestCase
+
+@end
+
+@implementation SBSSipCaptureTests {
+  NSString *_path;
+  pj_sockaddr _local;
+  pj_sockaddr _remote;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  _path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+
+  pj_str_t local = pj_str("10.0.0.2");
+  pj_str_t remote = pj_str("10.0.0.1");
+  pj_sockaddr_init(pj_AF_INET(), &_local, &local, 5060);
+  pj_sockaddr_init(pj_AF_INET(), &_remote, &remote, 5060);
+}
+
+- (void)tearDown {
+  pj_sip_capture_shutdown();
+  [[NSFileManager defaultManager] removeItemAtPath:_path error:nil];
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)capture:(const char *)message outgoing:(BOOL)outgoing type:(pjsip_transport_type_e)type {
+  pj_time_val now;
+  pj_gettimeofday(&now);
+  pj_sip_capture_packet(outgoing, type, &_local, &_remote, &now, message, strlen(message));
+}
+
+/**
+ * Reads back the packets in a pcapng file, checking the framing of every block on the way
+ */
+- (NSArray<NSData *> *)packetsInFile {
+  NSData *file = [NSData dataWithContentsOfFile:_path];
+  NSMutableArray<NSData *> *packets = [[NSMutableArray alloc] init];
+  const uint8_t *bytes = file.bytes;
+
+  for (NSUInteger offset = 0; offset + 12 <= file.length;) {
+    uint32_t type, length, trailer;
+    memcpy(&type, bytes + offset, 4);
+    memcpy(&length, bytes + offset + 4, 4);
+    XCTAssertEqual(length % 4, 0);
+    XCTAssertLessThanOrEqual(offset + length, file.length);
+    memcpy(&trailer, bytes + offset + length - 4, 4);
+    XCTAssertEqual(trailer, length);
+
+    if (type == 6) {
+      uint32_t captured;
+      memcpy(&captured, bytes + offset + 20, 4);
+      [packets addObject:[NSData dataWithBytes:bytes + offset + 28 length:captured]];
+    }
+
+    offset += length;
+  }
+
+  return packets;
+}
+
+- (NSString *)payloadOf:(NSData *)packet {
+  const uint8_t *bytes = packet.bytes;
+  NSUInteger ip = (bytes[0] >> 4) == 4 ? 20 : 40;
+  NSUInteger transport = bytes[(bytes[0] >> 4) == 4 ? 9 : 6] == 6 ? 20 : 8;
+  return [[NSString alloc] initWithBytes:bytes + ip + transport length:packet.length - ip - transport encoding:NSUTF8StringEncoding];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testPacketsAreWrittenWithSynthesizedHeaders {
+  XCTAssertEqual(pj_sip_capture_init(NULL, 8), PJ_SUCCESS);
+  [self capture:Register outgoing:YES type:PJSIP_TRANSPORT_UDP];
+  [self capture:Register outgoing:NO type:PJSIP_TRANSPORT_TLS];
+
+  unsigned count;
+  XCTAssertEqual(pj_sip_capture_write(_path.UTF8String, &count), PJ_SUCCESS);
+  XCTAssertEqual(count, 2);
+
+  NSArray<NSData *> *packets = [self packetsInFile];
+  XCTAssertEqual(packets.count, 2);
+  XCTAssertEqual(packets[0].length, 20 + 8 + strlen(Register));
+  XCTAssertEqual(packets[1].length, 20 + 20 + strlen(Register));
+  XCTAssertEqualObjects([self payloadOf:packets[0]], @(Register));
+
+  // Sent from the local address, and received from the remote one
+  const uint8_t *sent = packets[0].bytes;
+  const uint8_t *received = packets[1].bytes;
+  XCTAssertEqual(sent[15], 2);
+  XCTAssertEqual(received[15], 1);
+  XCTAssertEqual(received[9], 6);
+}
+
+- (void)testRingKeepsTheMostRecentPackets {
+  XCTAssertEqual(pj_sip_capture_init(NULL, 3), PJ_SUCCESS);
+
+  for (int i = 0; i < 10; i++) {
+    char message[64];
+    snprintf(message, sizeof(message), "OPTIONS sip:%d@example.com SIP/2.0\r\n\r\n", i);
+    [self capture:message outgoing:YES type:PJSIP_TRANSPORT_UDP];
+  }
+
+  unsigned count;
+  XCTAssertEqual(pj_sip_capture_write(_path.UTF8String, &count), PJ_SUCCESS);
+
+  // Three rounds up to four
+  NSArray<NSData *> *packets = [self packetsInFile];
+  XCTAssertEqual(count, 4);
+  XCTAssertEqual(packets.count, 4);
+  XCTAssertTrue([[self payloadOf:packets[0]] hasPrefix:@"OPTIONS sip:6@"]);
+  XCTAssertTrue([[self payloadOf:packets[3]] hasPrefix:@"OPTIONS sip:9@"]);
+}
+
+- (void)testLongPacketsAreTruncated {
+  XCTAssertEqual(pj_sip_capture_init(NULL, 4), PJ_SUCCESS);
+
+  char *message = malloc(PJ_SIP_CAPTURE_SNAPLEN + 100);
+  memset(message, 'a', PJ_SIP_CAPTURE_SNAPLEN + 99);
+  message[PJ_SIP_CAPTURE_SNAPLEN + 99] = '\0';
+  [self capture:message outgoing:YES type:PJSIP_TRANSPORT_TCP];
+  free(message);
+
+  pj_sip_capture_stat stat;
+  pj_sip_capture_get_stat(&stat);
+  XCTAssertEqual(stat.captured, 1);
+  XCTAssertEqual(stat.truncated, 1);
+
+  XCTAssertEqual(pj_sip_capture_write(_path.UTF8String, NULL), PJ_SUCCESS);
+  XCTAssertEqual([self packetsInFile].firstObject.length, 20 + 20 + PJ_SIP_CAPTURE_SNAPLEN);
+}
+
+- (void)testWritingWithoutCaptureFails {
+  XCTAssertEqual(pj_sip_capture_write(_path.UTF8String, NULL), PJ_EINVALIDOP);
+}
+
+//------------------------------------------------------------------------------
+
+/**
+ * The cost of capturing a packet, alone and with writers on every core racing for the same ring
+ */
+- (void)testCaptureCost {
+  NSUInteger const packets = 1000000;
+  XCTAssertEqual(pj_sip_capture_init(NULL, 256), PJ_SUCCESS);
+
+  NSDate *start = [NSDate date];
+  for (NSUInteger i = 0; i < packets; i++) {
+    [self capture:Register outgoing:(i & 1) type:PJSIP_TRANSPORT_UDP];
+  }
+  NSTimeInterval single = -[start timeIntervalSinceNow];
+
+  NSUInteger threads = [NSProcessInfo processInfo].activeProcessorCount;
+  start = [NSDate date];
+  dispatch_apply(threads, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+    pj_thread_desc desc;
+    pj_thread_t *pj_thread;
+    pj_thread_register(NULL, desc, &pj_thread);
+
+    for (NSUInteger i = 0; i < packets; i++) {
+      [self capture:Register outgoing:(i & 1) type:PJSIP_TRANSPORT_UDP];
+    }
+  });
+  NSTimeInterval contended = -[start timeIntervalSinceNow];
+
+  pj_sip_capture_stat stat;
+  pj_sip_capture_get_stat(&stat);
+  XCTAssertEqual(stat.captured + stat.dropped, packets * (threads + 1));
+
+  NSLog(@"SIP capture: %.0f ns/packet on one thread, %.0f ns/packet across %lu threads (%lu dropped)",
+        single * 1e9 / packets, contended * 1e9 / (packets * threads), (unsigned long) threads, stat.dropped);
+}
+
+@end
@@ -0,0 +1,195 @@
+//
+//  SBSSipCompactTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+#import <pjmedia.h>
+
+#import "SBSPjTestCase.h"
+#import "pj_sip_compact.h"
+
+// What an INVITE carries besides its body, with compact header names and a couple of custom headers
+static int const MessageOverhead = 560;
+static int const MessageBudget = 1300;
+
+@interface SBSSipCompactTests : SBSPjTestCase
+
+@end
+
+@implementation SBSSipCompactTests
+
+//------------------------------------------------------------------------------
+
+- (NSString *)offerWithHosts:(NSUInteger)hosts ipv6:(BOOL)ipv6 relay:(BOOL)relay crypto:(NSUInteger)crypto {
+  NSMutableString *sdp = [NSMutableString stringWithString:@"v=0\r\n"
+                          @"o=- 3704285612 3704285612 IN IP4 192.168.1.20\r\n"
+                          @"s=pjmedia\r\n"
+                          @"b=AS:117\r\n"
+                          @"t=0 0\r\n"
+                          @"a=X-nat:0\r\n"
+                          @"m=audio 4000 RTP/SAVP 96 9 0 8 101\r\n"
+                          @"c=IN IP4 192.168.1.20\r\n"
+                          @"b=TIAS:96000\r\n"
+                          @"a=rtcp:4001 IN IP4 192.168.1.20\r\n"
+                          @"a=sendrecv\r\n"
+                          @"a=rtpmap:96 opus/48000/2\r\n"
+                          @"a=fmtp:96 useinbandfec=1\r\n"
+                          @"a=rtpmap:9 G722/8000\r\n"
+                          @"a=rtpmap:0 PCMU/8000\r\n"
+                          @"a=rtpmap:8 PCMA/8000\r\n"
+                          @"a=rtpmap:101 telephone-event/8000\r\n"
+                          @"a=fmtp:101 0-16\r\n"
+                          @"a=ice-ufrag:5c1a62f3\r\n"
+                          @"a=ice-pwd:3b4e2f7a0c6d1e5f\r\n"];
+
+  for (unsigned component = 1; component <= 2; component++) {
+    unsigned port = 4000 + component - 1;
+
+    for (NSUInteger i = 0; i < hosts; i++) {
+      [sdp appendFormat:@"a=candidate:H%lx %u UDP %u 192.168.%lu.20 %u typ host\r\n",
+       (unsigned long) i, component, 2130706431u - (unsigned) i * 256 - component + 1, (unsigned long) i + 1, port];
+    }
+
+    if (ipv6) {
+      for (NSUInteger i = 0; i < hosts; i++) {
+        [sdp appendFormat:@"a=candidate:V%lx %u UDP %u 2001:db8:%lu::20 %u typ host\r\n",
+         (unsigned long) i, component, 2130705919u - (unsigned) i * 256 - component + 1, (unsigned long) i + 1, port];
+      }
+    }
+
+    [sdp appendFormat:@"a=candidate:Sc0a80114 %u UDP %u 203.0.113.7 %u typ srflx raddr 192.168.1.20 rport %u\r\n",
+     component, 1694498815u - component + 1, port + 50000, port];
+
+    if (relay) {
+      [sdp appendFormat:@"a=candidate:Rcb007107 %u UDP %u 198.51.100.9 %u typ relay raddr 203.0.113.7 rport %u\r\n",
+       component, 16777215u - component + 1, port + 40000, port + 50000];
+    }
+  }
+
+  for (NSUInteger i = 0; i < crypto; i++) {
+    NSString *suite = @[@"AES_CM_128_HMAC_SHA1_80", @"AES_CM_128_HMAC_SHA1_32", @"AES_256_CM_HMAC_SHA1_80", @"AES_256_CM_HMAC_SHA1_32"][i];
+    [sdp appendFormat:@"a=crypto:%lu %@ inline:WVNfX19zZW1jdGwgKCkgewkyMjA7fQp9CnVubGVz\r\n", (unsigned long) i + 1, suite];
+  }
+
+  return sdp;
+}
+
+- (pjmedia_sdp_session *)parse:(NSString *)text {
+  pj_str_t copy;
+  pj_strdup2_with_null(_pool, &copy, text.UTF8String);
+
+  pjmedia_sdp_session *sdp = NULL;
+  XCTAssertEqual(pjmedia_sdp_parse(_pool, copy.ptr, copy.slen, &sdp), PJ_SUCCESS);
+  return sdp;
+}
+
+- (NSString *)print:(pjmedia_sdp_session *)sdp {
+  char buffer[PJSIP_MAX_PKT_LEN];
+  int length = pjmedia_sdp_print(sdp, buffer, sizeof(buffer));
+  return [[NSString alloc] initWithBytes:buffer length:length encoding:NSUTF8StringEncoding];
+}
+
+- (NSUInteger)percentile:(double)percentile of:(NSArray<NSNumber *> *)sizes {
+  NSArray<NSNumber *> *sorted = [sizes sortedArrayUsingSelector:@selector(compare:)];
+  return sorted[MIN(sorted.count - 1, (NSUInteger) (percentile * sorted.count))].unsignedIntegerValue;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testRedundantAttributesAreRemoved {
+  pj_sip_compact_stat stat = { 0 };
+  pjmedia_sdp_session *sdp = [self parse:[self offerWithHosts:1 ipv6:NO relay:NO crypto:1]];
+  pj_sip_compact_sdp(_pool, NULL, sdp, MessageBudget, &stat);
+
+  NSString *printed = [self print:sdp];
+  XCTAssertFalse([printed containsString:@"a=rtpmap:0 "]);
+  XCTAssertFalse([printed containsString:@"a=rtpmap:8 "]);
+  XCTAssertFalse([printed containsString:@"a=rtpmap:9 "]);
+  XCTAssertFalse([printed containsString:@"a=rtcp:"]);
+  XCTAssertTrue([printed containsString:@"a=rtpmap:96 opus/48000/2"]);
+  XCTAssertTrue([printed containsString:@"a=rtpmap:101 telephone-event/8000"]);
+  XCTAssertEqual(stat.attributes, 4);
+
+  // Nothing needed trimming
+  XCTAssertEqual(stat.candidates, 0);
+}
+
+- (void)testOnlyRedundantCandidatesAreTrimmed {
+  pj_sip_compact_stat stat = { 0 };
+  pjmedia_sdp_session *sdp = [self parse:[self offerWithHosts:4 ipv6:YES relay:YES crypto:2]];
+  pj_sip_compact_sdp(_pool, NULL, sdp, 0, &stat);
+
+  // With an impossible budget, everything that's redundant goes, and the rest stays
+  NSString *printed = [self print:sdp];
+  XCTAssertTrue([printed containsString:@"192.168.1.20 4000 typ host"]);
+  XCTAssertTrue([printed containsString:@"2001:db8:1::20 4000 typ host"]);
+  XCTAssertTrue([printed containsString:@"typ srflx"]);
+  XCTAssertTrue([printed containsString:@"typ relay"]);
+  XCTAssertFalse([printed containsString:@"192.168.2.20"]);
+  XCTAssertFalse([printed containsString:@"2001:db8:2::20"]);
+  XCTAssertEqual(stat.candidates, 12);
+}
+
+- (void)testCryptoIsLimitedToPreferredSuites {
+  pjmedia_srtp_setting setting;
+  pj_bzero(&setting, sizeof(setting));
+
+  char *suites[] = { "AES_256_CM_HMAC_SHA1_80", "AES_CM_128_HMAC_SHA1_80", "AES_256_CM_HMAC_SHA1_32", "AES_CM_128_HMAC_SHA1_32" };
+  for (unsigned i = 0; i < PJ_ARRAY_SIZE(suites); i++) {
+    setting.crypto[i].name = pj_str(suites[i]);
+  }
+  setting.crypto_count = PJ_ARRAY_SIZE(suites);
+
+  pj_sip_compact_crypto(&setting);
+  XCTAssertEqual(setting.crypto_count, 2);
+  XCTAssertEqual(pj_strcmp2(&setting.crypto[0].name, "AES_CM_128_HMAC_SHA1_80"), 0);
+  XCTAssertEqual(pj_strcmp2(&setting.crypto[1].name, "AES_CM_128_HMAC_SHA1_32"), 0);
+}
+
+- (void)testSizeDistributionOverGeneratedOffers {
+  NSMutableArray<NSNumber *> *before = [[NSMutableArray alloc] init];
+  NSMutableArray<NSNumber *> *after = [[NSMutableArray alloc] init];
+  NSUInteger overBefore = 0, overAfter = 0;
+
+  for (NSUInteger hosts = 1; hosts <= 4; hosts++) {
+    for (NSUInteger crypto = 1; crypto <= 4; crypto++) {
+      for (int variant = 0; variant < 4; variant++) {
+        BOOL ipv6 = (variant & 1) != 0;
+        BOOL relay = (variant & 2) != 0;
+
+        // Compaction also limits the SRTP suites, so the compacted offer is created with fewer crypto lines
+        NSString *original = [self offerWithHosts:hosts ipv6:ipv6 relay:relay crypto:crypto];
+        NSString *offered = [self offerWithHosts:hosts ipv6:ipv6 relay:relay crypto:MIN(crypto, 2u)];
+
+        pj_sip_compact_stat stat = { 0 };
+        pjmedia_sdp_session *sdp = [self parse:offered];
+        int length = pj_sip_compact_sdp(_pool, NULL, sdp, MessageBudget - MessageOverhead, &stat);
+
+        NSUInteger originalSize = [original lengthOfBytesUsingEncoding:NSUTF8StringEncoding] + MessageOverhead;
+        NSUInteger compactedSize = (NSUInteger) length + MessageOverhead;
+        XCTAssertLessThanOrEqual(compactedSize, originalSize);
+
+        [before addObject:@(originalSize)];
+        [after addObject:@(compactedSize)];
+        overBefore += originalSize > MessageBudget ? 1 : 0;
+        overAfter += compactedSize > MessageBudget ? 1 : 0;
+      }
+    }
+  }
+
+  NSLog(@"Message sizes over %lu generated offers (budget %d bytes)", (unsigned long) before.count, MessageBudget);
+  NSLog(@"            p10   p50   p90   max   over budget");
+  NSLog(@"  original %5lu %5lu %5lu %5lu   %lu", [self percentile:0.1 of:before], [self percentile:0.5 of:before],
+        [self percentile:0.9 of:before], [self percentile:1.0 of:before], (unsigned long) overBefore);
+  NSLog(@"  compact  %5lu %5lu %5lu %5lu   %lu", [self percentile:0.1 of:after], [self percentile:0.5 of:after],
+        [self percentile:0.9 of:after], [self percentile:1.0 of:after], (unsigned long) overAfter);
+
+  XCTAssertLessThan(overAfter, overBefore);
+  XCTAssertLessThan([self percentile:0.5 of:after], [self percentile:0.5 of:before]);
+}
+
+@end
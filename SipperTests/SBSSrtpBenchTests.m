@@ -0,0 +1,113 @@
+//
+//  SBSSrtpBenchTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <pjlib.h>
+#import <srtp.h>
+
+#import "SBSPjTestCase.h"
+#import "pj_srtp_bench.h"
+
+@interface SBSSrtpBenchTests : SBSPjTestCase
+
+@end
+
+@implementation SBSSrtpBenchTests
+
+- (void)setUp {
+  [super setUp];
+
+  srtp_init();
+}
+
+- (void)tearDown {
+  pj_srtp_bench_shutdown();
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (pj_srtp_bench_result)result:(const char *)name key:(unsigned)key tag:(unsigned)tag cost:(unsigned)cost {
+  pj_srtp_bench_result result = { name, key, tag, cost / 2, cost - cost / 2 };
+  return result;
+}
+
+- (NSArray<NSString *> *)sort:(pj_srtp_bench_order)order {
+  pj_srtp_bench_result results[] = {
+    [self result:"AES_CM_128_HMAC_SHA1_32" key:128 tag:32 cost:900],
+    [self result:"AES_256_CM_HMAC_SHA1_80" key:256 tag:80 cost:1400],
+    [self result:"AES_CM_128_HMAC_SHA1_80" key:128 tag:80 cost:1000],
+    [self result:"AES_256_CM_HMAC_SHA1_32" key:256 tag:32 cost:1300],
+  };
+  pj_srtp_bench_sort(results, PJ_ARRAY_SIZE(results), order);
+
+  NSMutableArray<NSString *> *names = [[NSMutableArray alloc] init];
+  for (unsigned i = 0; i < PJ_ARRAY_SIZE(results); i++) {
+    [names addObject:[NSString stringWithUTF8String:results[i].name]];
+  }
+
+  return names;
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testEverySuiteCanBeMeasured {
+  const char *names[] = { "AES_CM_128_HMAC_SHA1_80", "AES_CM_128_HMAC_SHA1_32", "AES_256_CM_HMAC_SHA1_80", "AES_256_CM_HMAC_SHA1_32" };
+
+  NSLog(@"SRTP cost per %d byte packet", PJ_SRTP_BENCH_PAYLOAD);
+  for (unsigned i = 0; i < PJ_ARRAY_SIZE(names); i++) {
+    pj_srtp_bench_result result;
+    XCTAssertEqual(pj_srtp_bench_run(_pool, names[i], 5000, &result), PJ_SUCCESS);
+    XCTAssertGreaterThan(result.protect_nsec, 0);
+    XCTAssertGreaterThan(result.unprotect_nsec, 0);
+
+    NSLog(@"  %s  protect %5u ns  unprotect %5u ns", result.name, result.protect_nsec, result.unprotect_nsec);
+  }
+}
+
+- (void)testUnknownSuitesAreNotSupported {
+  pj_srtp_bench_result result;
+  XCTAssertEqual(pj_srtp_bench_run(_pool, "F8_128_HMAC_SHA1_80", 50, &result), PJ_ENOTSUP);
+}
+
+- (void)testBalancedOrderPrefersLongTagsThenCost {
+  XCTAssertEqualObjects([self sort:PJ_SRTP_BENCH_ORDER_BALANCED],
+                        (@[@"AES_CM_128_HMAC_SHA1_80", @"AES_256_CM_HMAC_SHA1_80", @"AES_CM_128_HMAC_SHA1_32", @"AES_256_CM_HMAC_SHA1_32"]));
+}
+
+- (void)testStrongestOrderPrefersLongKeys {
+  XCTAssertEqualObjects([self sort:PJ_SRTP_BENCH_ORDER_STRONGEST],
+                        (@[@"AES_256_CM_HMAC_SHA1_80", @"AES_256_CM_HMAC_SHA1_32", @"AES_CM_128_HMAC_SHA1_80", @"AES_CM_128_HMAC_SHA1_32"]));
+}
+
+- (void)testFastestOrderOnlyConsidersCost {
+  XCTAssertEqualObjects([self sort:PJ_SRTP_BENCH_ORDER_FASTEST],
+                        (@[@"AES_CM_128_HMAC_SHA1_32", @"AES_CM_128_HMAC_SHA1_80", @"AES_256_CM_HMAC_SHA1_32", @"AES_256_CM_HMAC_SHA1_80"]));
+}
+
+- (void)testSettingFollowsCalibration {
+  XCTAssertEqual(pj_srtp_bench_calibrate(&_cp.factory, PJ_SRTP_BENCH_ORDER_STRONGEST, 500), PJ_SUCCESS);
+
+  pjmedia_srtp_setting setting;
+  pj_bzero(&setting, sizeof(setting));
+  char *suites[] = { "AES_CM_128_HMAC_SHA1_80", "NULL", "AES_256_CM_HMAC_SHA1_80" };
+  for (unsigned i = 0; i < PJ_ARRAY_SIZE(suites); i++) {
+    setting.crypto[i].name = pj_str(suites[i]);
+  }
+  setting.crypto_count = PJ_ARRAY_SIZE(suites);
+
+  pj_srtp_bench_apply(&setting);
+  XCTAssertEqual(setting.crypto_count, 3);
+  XCTAssertEqual(pj_strcmp2(&setting.crypto[0].name, "AES_256_CM_HMAC_SHA1_80"), 0);
+  XCTAssertEqual(pj_strcmp2(&setting.crypto[1].name, "AES_CM_128_HMAC_SHA1_80"), 0);
+
+  // Suites that weren't measured go last
+  XCTAssertEqual(pj_strcmp2(&setting.crypto[2].name, "NULL"), 0);
+}
+
+@end
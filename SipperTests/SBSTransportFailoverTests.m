@@ -0,0 +1,246 @@
+//
+//  SBSTransportFailoverTests.m
+//  Sipper
+//
+//  Created by Colin Morelli on 5/19/17.
+//  Copyright © 2017 Sipper. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <arpa/inet.h>
+#import <netinet/in.h>
+#import <sys/socket.h>
+
+#import <pjsua.h>
+
+#import "SBSEndpoint.h"
+#import "SBSEndpointConfiguration.h"
+#import "SBSTransportConfiguration.h"
+
+/**
+ * A SIP server on the loopback interface that accepts TCP connections and never answers, counting the connections
+ * that were opened and closed
+ */
+@interface SBSStubTCPServer : NSObject
+
+@property(nonatomic, readonly) uint16_t port;
+@property(atomic, readonly) NSUInteger accepted;
+@property(atomic, readonly) NSUInteger closed;
+
+@end
+
+@implementation SBSStubTCPServer {
+  int _socket;
+  dispatch_queue_t _queue;
+  dispatch_source_t _source;
+  NSMutableArray<dispatch_source_t> *_connections;
+}
+
+- (instancetype)init {
+  if (self = [super init]) {
+    _queue = dispatch_queue_create("com.switchboard.sipper.tests.tcp", DISPATCH_QUEUE_SERIAL);
+    _connections = [[NSMutableArray alloc] init];
+
+    struct sockaddr_in address = {0};
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t length = sizeof(address);
+    _socket = socket(AF_INET, SOCK_STREAM, 0);
+    bind(_socket, (struct sockaddr *) &address, length);
+    listen(_socket, 8);
+    getsockname(_socket, (struct sockaddr *) &address, &length);
+    _port = ntohs(address.sin_port);
+
+    __weak SBSStubTCPServer *weakSelf = self;
+    _source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t) _socket, 0, _queue);
+    dispatch_source_set_event_handler(_source, ^{
+      [weakSelf accept];
+    });
+    dispatch_resume(_source);
+  }
+
+  return self;
+}
+
+- (void)stop {
+  dispatch_sync(_queue, ^{
+    for (dispatch_source_t connection in _connections) {
+      dispatch_source_cancel(connection);
+    }
+  });
+
+  dispatch_source_cancel(_source);
+  close(_socket);
+}
+
+- (void)accept {
+  int fd = accept(_socket, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+
+  _accepted++;
+
+  // The client closing its end is the only thing that's ever read
+  __weak SBSStubTCPServer *weakSelf = self;
+  dispatch_source_t connection = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t) fd, 0, _queue);
+  dispatch_source_set_event_handler(connection, ^{
+    char buffer[512];
+    if (recv(fd, buffer, sizeof(buffer), 0) <= 0) {
+      [weakSelf connectionClosed:connection];
+    }
+  });
+  dispatch_source_set_cancel_handler(connection, ^{
+    close(fd);
+  });
+  dispatch_resume(connection);
+
+  [_connections addObject:connection];
+}
+
+- (void)connectionClosed:(dispatch_source_t)connection {
+  _closed++;
+  dispatch_source_cancel(connection);
+  [_connections removeObject:connection];
+}
+
+@end
+
+@interface SBSEndpoint (Testing)
+
+/**
+ * The connection-oriented transports the endpoint has seen connect, which is private to the endpoint
+ */
+@property(nonatomic, readonly) NSArray<NSValue *> *activeTransports;
+
+@end
+
+@interface SBSTransportFailoverTests : XCTestCase
+
+@end
+
+@implementation SBSTransportFailoverTests {
+  SBSStubTCPServer *_server;
+  pjsip_transport *_transport;
+}
+
+- (void)setUp {
+  [super setUp];
+
+  _server = [[SBSStubTCPServer alloc] init];
+}
+
+- (void)tearDown {
+  [[SBSEndpoint sharedEndpoint] destroyEndpointWithError:nil];
+  [_server stop];
+
+  [super tearDown];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)startEndpointWithMode:(SBSTransportFailoverMode)mode {
+  SBSEndpointConfiguration *configuration = [[SBSEndpointConfiguration alloc] init];
+  configuration.transportConfigurations = @[[SBSTransportConfiguration configurationWithTransportType:SBSTransportTypeTCP]];
+  configuration.transportFailoverMode = mode;
+
+  NSError *error;
+  XCTAssertTrue([[SBSEndpoint sharedEndpoint] initializeEndpointWithConfiguration:configuration error:&error], @"%@", error);
+}
+
+- (BOOL)waitFor:(NSTimeInterval)duration until:(BOOL (^)(void))condition {
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:duration];
+  while (!condition() && [deadline timeIntervalSinceNow] > 0) {
+    usleep(10000);
+  }
+
+  return condition();
+}
+
+/**
+ * Connects to the stub server the way a request would, keeping the reference that acquiring the transport returns
+ */
+- (void)connect {
+  uint16_t port = _server.port;
+  [[SBSEndpoint sharedEndpoint] performAsync:^{
+    pj_str_t host = pj_str("127.0.0.1");
+    pj_sockaddr_in address;
+    pj_sockaddr_in_init(&address, &host, port);
+
+    pj_status_t status = pjsip_endpt_acquire_transport(pjsua_get_pjsip_endpt(), PJSIP_TRANSPORT_TCP, &address,
+                                                       sizeof(address), NULL, &_transport);
+    XCTAssertEqual(status, PJ_SUCCESS);
+  }];
+
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    return [SBSEndpoint sharedEndpoint].activeTransports.count == 1 && _server.accepted == 1;
+  }]);
+}
+
+- (void)releaseTransport {
+  pjsip_transport *transport = _transport;
+  [[SBSEndpoint sharedEndpoint] performAsync:^{
+    pjsip_transport_dec_ref(transport);
+  }];
+}
+
+- (void)handleReachabilityChange {
+
+  // Reachability changes are handled on the background thread, where PJSIP may be used
+  [[SBSEndpoint sharedEndpoint] performAsync:^{
+    [[SBSEndpoint sharedEndpoint] handleReachabilityChange];
+  }];
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testMakeBeforeBreakConnectsBeforeReleasingTheOldFlow {
+  [self startEndpointWithMode:SBSTransportFailoverModeMakeBeforeBreak];
+  [self connect];
+
+  [self handleReachabilityChange];
+
+  // The replacement is connected without waiting for a request to need it
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    NSArray<NSValue *> *transports = [SBSEndpoint sharedEndpoint].activeTransports;
+    return transports.count == 1 && transports[0].pointerValue != _transport && _server.accepted == 2;
+  }]);
+
+  // The old connection is unlisted, but stays open for as long as something still references it
+  XCTAssertEqual(_server.closed, 0);
+
+  [self releaseTransport];
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    return _server.closed == 1;
+  }]);
+
+  // Nothing was re-invited, so there's no audio to wait for
+  XCTAssertEqual([SBSEndpoint sharedEndpoint].lastFailoverDuration, 0);
+}
+
+//------------------------------------------------------------------------------
+
+- (void)testBreakBeforeMakeLeavesReconnectingToTheNextRequest {
+  [self startEndpointWithMode:SBSTransportFailoverModeBreakBeforeMake];
+  [self connect];
+
+  [self handleReachabilityChange];
+
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    return [SBSEndpoint sharedEndpoint].activeTransports.count == 0;
+  }]);
+
+  // Give a replacement connection the time it would have taken to show up
+  [NSThread sleepForTimeInterval:0.5];
+  XCTAssertEqual(_server.accepted, 1);
+
+  [self releaseTransport];
+  XCTAssertTrue([self waitFor:5 until:^BOOL {
+    return _server.closed == 1;
+  }]);
+}
+
+@end
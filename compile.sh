@@ -268,7 +268,10 @@ function checkout_pjsip() {
 
 function patch_pjsip() {
   for file in $BASE_DIR/patches/pjsip/*.patch; do
-    patch -p0 -d "${SOURCE_DIR}/pjsip" < "$file"
+    if ! patch -p0 -d "${SOURCE_DIR}/pjsip" < "$file"; then
+      echo "$PRE Failed to apply $(basename "$file")"
+      exit 1
+    fi
   done
 }
 